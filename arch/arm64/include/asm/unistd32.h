@@ -883,6 +883,8 @@ __SYSCALL(__NR_clone3, sys_clone3)
 __SYSCALL(__NR_openat2, sys_openat2)
 #define __NR_pidfd_getfd 438
 __SYSCALL(__NR_pidfd_getfd, sys_pidfd_getfd)
+#define __NR_epoll_ctl_batch 439
+__SYSCALL(__NR_epoll_ctl_batch, sys_epoll_ctl_batch)
 
 /*
  * Please add new compat syscalls above this comment and update
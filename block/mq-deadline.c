@@ -33,10 +33,20 @@ static const int writes_starved = 2;    /* max times reads can starve a write */
 static const int fifo_batch = 16;       /* # of sequential requests treated as one
 				     by the above parameters. For throughput. */
 
-struct deadline_data {
-	/*
-	 * run time data
-	 */
+/*
+ * With sharding enabled, multi-queue devices get one set of sort and fifo
+ * lists per hardware queue, each under its own lock, instead of a single
+ * set shared by all of them. Batching and write starvation are then
+ * enforced per hardware queue. Deadlines are enforced per hardware queue
+ * too, but a dispatch also picks up an expired request of another shard,
+ * so one slow hardware queue cannot hold back an expired request forever.
+ */
+static bool sharded;
+module_param(sharded, bool, 0644);
+MODULE_PARM_DESC(sharded, "Keep per hardware queue lists on multi-queue devices");
+
+struct dd_shard {
+	spinlock_t lock;
 
 	/*
 	 * requests (deadline_rq s) are present on both sort_list and fifo_list
@@ -51,6 +61,16 @@ struct deadline_data {
 	unsigned int batching;		/* number of sequential requests made */
 	unsigned int starved;		/* times reads have starved writes */
 
+	/*
+	 * earliest fifo_time on the fifo lists, published for the cross shard
+	 * expiry check. Written under lock, read without it.
+	 */
+	unsigned long expire;
+
+	struct list_head dispatch;
+} ____cacheline_aligned_in_smp;
+
+struct deadline_data {
 	/*
 	 * settings that change how the i/o scheduler behaves
 	 */
@@ -59,15 +79,32 @@ struct deadline_data {
 	int writes_starved;
 	int front_merges;
 
-	spinlock_t lock;
 	spinlock_t zone_lock;
-	struct list_head dispatch;
+
+	/*
+	 * run time data
+	 */
+	atomic_long_t min_expire;	/* lower bound of shard expire times */
+	unsigned int nr_shards;
+	struct dd_shard shards[];
 };
 
+static inline struct dd_shard *
+dd_hctx_shard(struct deadline_data *dd, struct blk_mq_hw_ctx *hctx)
+{
+	return &dd->shards[dd->nr_shards > 1 ? hctx->queue_num : 0];
+}
+
+static inline struct dd_shard *
+dd_rq_shard(struct deadline_data *dd, struct request *rq)
+{
+	return dd_hctx_shard(dd, rq->mq_hctx);
+}
+
 static inline struct rb_root *
-deadline_rb_root(struct deadline_data *dd, struct request *rq)
+deadline_rb_root(struct dd_shard *ds, struct request *rq)
 {
-	return &dd->sort_list[rq_data_dir(rq)];
+	return &ds->sort_list[rq_data_dir(rq)];
 }
 
 /*
@@ -85,22 +122,22 @@ deadline_latter_request(struct request *rq)
 }
 
 static void
-deadline_add_rq_rb(struct deadline_data *dd, struct request *rq)
+deadline_add_rq_rb(struct dd_shard *ds, struct request *rq)
 {
-	struct rb_root *root = deadline_rb_root(dd, rq);
+	struct rb_root *root = deadline_rb_root(ds, rq);
 
 	elv_rb_add(root, rq);
 }
 
 static inline void
-deadline_del_rq_rb(struct deadline_data *dd, struct request *rq)
+deadline_del_rq_rb(struct dd_shard *ds, struct request *rq)
 {
 	const int data_dir = rq_data_dir(rq);
 
-	if (dd->next_rq[data_dir] == rq)
-		dd->next_rq[data_dir] = deadline_latter_request(rq);
+	if (ds->next_rq[data_dir] == rq)
+		ds->next_rq[data_dir] = deadline_latter_request(rq);
 
-	elv_rb_del(deadline_rb_root(dd, rq), rq);
+	elv_rb_del(deadline_rb_root(ds, rq), rq);
 }
 
 /*
@@ -116,7 +153,7 @@ static void deadline_remove_request(struct request_queue *q, struct request *rq)
 	 * We might not be on the rbtree, if we are doing an insert merge
 	 */
 	if (!RB_EMPTY_NODE(&rq->rb_node))
-		deadline_del_rq_rb(dd, rq);
+		deadline_del_rq_rb(dd_rq_shard(dd, rq), rq);
 
 	elv_rqhash_del(q, rq);
 	if (q->last_merge == rq)
@@ -127,13 +164,14 @@ static void dd_request_merged(struct request_queue *q, struct request *req,
 			      enum elv_merge type)
 {
 	struct deadline_data *dd = q->elevator->elevator_data;
+	struct dd_shard *ds = dd_rq_shard(dd, req);
 
 	/*
 	 * if the merge was a front merge, we need to reposition request
 	 */
 	if (type == ELEVATOR_FRONT_MERGE) {
-		elv_rb_del(deadline_rb_root(dd, req), req);
-		deadline_add_rq_rb(dd, req);
+		elv_rb_del(deadline_rb_root(ds, req), req);
+		deadline_add_rq_rb(ds, req);
 	}
 }
 
@@ -162,13 +200,13 @@ static void dd_merged_requests(struct request_queue *q, struct request *req,
  * move an entry to dispatch queue
  */
 static void
-deadline_move_request(struct deadline_data *dd, struct request *rq)
+deadline_move_request(struct dd_shard *ds, struct request *rq)
 {
 	const int data_dir = rq_data_dir(rq);
 
-	dd->next_rq[READ] = NULL;
-	dd->next_rq[WRITE] = NULL;
-	dd->next_rq[data_dir] = deadline_latter_request(rq);
+	ds->next_rq[READ] = NULL;
+	ds->next_rq[WRITE] = NULL;
+	ds->next_rq[data_dir] = deadline_latter_request(rq);
 
 	/*
 	 * take it off the sort and fifo list
@@ -178,11 +216,11 @@ deadline_move_request(struct deadline_data *dd, struct request *rq)
 
 /*
  * deadline_check_fifo returns 0 if there are no expired requests on the fifo,
- * 1 otherwise. Requires !list_empty(&dd->fifo_list[data_dir])
+ * 1 otherwise. Requires !list_empty(&ds->fifo_list[data_dir])
  */
-static inline int deadline_check_fifo(struct deadline_data *dd, int ddir)
+static inline int deadline_check_fifo(struct dd_shard *ds, int ddir)
 {
-	struct request *rq = rq_entry_fifo(dd->fifo_list[ddir].next);
+	struct request *rq = rq_entry_fifo(ds->fifo_list[ddir].next);
 
 	/*
 	 * rq is expired!
@@ -193,12 +231,63 @@ static inline int deadline_check_fifo(struct deadline_data *dd, int ddir)
 	return 0;
 }
 
+/*
+ * Publish the earliest deadline of a shard after its fifo lists changed,
+ * and lower the queue wide bound if needed. Empty shards publish a time
+ * far in the future. Requires ds->lock.
+ */
+static void deadline_update_expire(struct deadline_data *dd,
+				   struct dd_shard *ds)
+{
+	unsigned long expire = jiffies + MAX_JIFFY_OFFSET;
+	long old;
+	int data_dir;
+
+	for (data_dir = READ; data_dir <= WRITE; data_dir++) {
+		struct request *rq;
+
+		if (list_empty(&ds->fifo_list[data_dir]))
+			continue;
+		rq = rq_entry_fifo(ds->fifo_list[data_dir].next);
+		if (time_before((unsigned long)rq->fifo_time, expire))
+			expire = rq->fifo_time;
+	}
+	WRITE_ONCE(ds->expire, expire);
+
+	old = atomic_long_read(&dd->min_expire);
+	while (time_before(expire, (unsigned long)old)) {
+		long cur = atomic_long_cmpxchg(&dd->min_expire, old, expire);
+
+		if (cur == old)
+			break;
+		old = cur;
+	}
+}
+
+/*
+ * Return the expired request at the head of a fifo list of @ds, reads
+ * first, or NULL. Requires ds->lock.
+ */
+static struct request *deadline_expired_request(struct dd_shard *ds)
+{
+	int data_dir;
+
+	for (data_dir = READ; data_dir <= WRITE; data_dir++) {
+		if (!list_empty(&ds->fifo_list[data_dir]) &&
+		    deadline_check_fifo(ds, data_dir))
+			return rq_entry_fifo(ds->fifo_list[data_dir].next);
+	}
+
+	return NULL;
+}
+
 /*
  * For the specified data direction, return the next request to
  * dispatch using arrival ordered lists.
  */
 static struct request *
-deadline_fifo_request(struct deadline_data *dd, int data_dir)
+deadline_fifo_request(struct deadline_data *dd, struct dd_shard *ds,
+		      int data_dir)
 {
 	struct request *rq;
 	unsigned long flags;
@@ -206,10 +295,10 @@ deadline_fifo_request(struct deadline_data *dd, int data_dir)
 	if (WARN_ON_ONCE(data_dir != READ && data_dir != WRITE))
 		return NULL;
 
-	if (list_empty(&dd->fifo_list[data_dir]))
+	if (list_empty(&ds->fifo_list[data_dir]))
 		return NULL;
 
-	rq = rq_entry_fifo(dd->fifo_list[data_dir].next);
+	rq = rq_entry_fifo(ds->fifo_list[data_dir].next);
 	if (data_dir == READ || !blk_queue_is_zoned(rq->q))
 		return rq;
 
@@ -218,7 +307,7 @@ deadline_fifo_request(struct deadline_data *dd, int data_dir)
 	 * an unlocked target zone.
 	 */
 	spin_lock_irqsave(&dd->zone_lock, flags);
-	list_for_each_entry(rq, &dd->fifo_list[WRITE], queuelist) {
+	list_for_each_entry(rq, &ds->fifo_list[WRITE], queuelist) {
 		if (blk_req_can_dispatch_to_zone(rq))
 			goto out;
 	}
@@ -234,7 +323,8 @@ deadline_fifo_request(struct deadline_data *dd, int data_dir)
  * dispatch using sector position sorted lists.
  */
 static struct request *
-deadline_next_request(struct deadline_data *dd, int data_dir)
+deadline_next_request(struct deadline_data *dd, struct dd_shard *ds,
+		      int data_dir)
 {
 	struct request *rq;
 	unsigned long flags;
@@ -242,7 +332,7 @@ deadline_next_request(struct deadline_data *dd, int data_dir)
 	if (WARN_ON_ONCE(data_dir != READ && data_dir != WRITE))
 		return NULL;
 
-	rq = dd->next_rq[data_dir];
+	rq = ds->next_rq[data_dir];
 	if (!rq)
 		return NULL;
 
@@ -268,29 +358,30 @@ deadline_next_request(struct deadline_data *dd, int data_dir)
  * deadline_dispatch_requests selects the best request according to
  * read/write expire, fifo_batch, etc
  */
-static struct request *__dd_dispatch_request(struct deadline_data *dd)
+static struct request *__dd_dispatch_request(struct deadline_data *dd,
+					     struct dd_shard *ds)
 {
 	struct request *rq, *next_rq;
 	bool reads, writes;
 	int data_dir;
 
-	if (!list_empty(&dd->dispatch)) {
-		rq = list_first_entry(&dd->dispatch, struct request, queuelist);
+	if (!list_empty(&ds->dispatch)) {
+		rq = list_first_entry(&ds->dispatch, struct request, queuelist);
 		list_del_init(&rq->queuelist);
 		goto done;
 	}
 
-	reads = !list_empty(&dd->fifo_list[READ]);
-	writes = !list_empty(&dd->fifo_list[WRITE]);
+	reads = !list_empty(&ds->fifo_list[READ]);
+	writes = !list_empty(&ds->fifo_list[WRITE]);
 
 	/*
 	 * batches are currently reads XOR writes
 	 */
-	rq = deadline_next_request(dd, WRITE);
+	rq = deadline_next_request(dd, ds, WRITE);
 	if (!rq)
-		rq = deadline_next_request(dd, READ);
+		rq = deadline_next_request(dd, ds, READ);
 
-	if (rq && dd->batching < dd->fifo_batch)
+	if (rq && ds->batching < dd->fifo_batch)
 		/* we have a next request are still entitled to batch */
 		goto dispatch_request;
 
@@ -300,10 +391,10 @@ static struct request *__dd_dispatch_request(struct deadline_data *dd)
 	 */
 
 	if (reads) {
-		BUG_ON(RB_EMPTY_ROOT(&dd->sort_list[READ]));
+		BUG_ON(RB_EMPTY_ROOT(&ds->sort_list[READ]));
 
-		if (deadline_fifo_request(dd, WRITE) &&
-		    (dd->starved++ >= dd->writes_starved))
+		if (deadline_fifo_request(dd, ds, WRITE) &&
+		    (ds->starved++ >= dd->writes_starved))
 			goto dispatch_writes;
 
 		data_dir = READ;
@@ -317,9 +408,9 @@ static struct request *__dd_dispatch_request(struct deadline_data *dd)
 
 	if (writes) {
 dispatch_writes:
-		BUG_ON(RB_EMPTY_ROOT(&dd->sort_list[WRITE]));
+		BUG_ON(RB_EMPTY_ROOT(&ds->sort_list[WRITE]));
 
-		dd->starved = 0;
+		ds->starved = 0;
 
 		data_dir = WRITE;
 
@@ -332,14 +423,14 @@ static struct request *__dd_dispatch_request(struct deadline_data *dd)
 	/*
 	 * we are not running a batch, find best request for selected data_dir
 	 */
-	next_rq = deadline_next_request(dd, data_dir);
-	if (deadline_check_fifo(dd, data_dir) || !next_rq) {
+	next_rq = deadline_next_request(dd, ds, data_dir);
+	if (deadline_check_fifo(ds, data_dir) || !next_rq) {
 		/*
 		 * A deadline has expired, the last request was in the other
 		 * direction, or we have run out of higher-sectored requests.
 		 * Start again from the request with the earliest expiry time.
 		 */
-		rq = deadline_fifo_request(dd, data_dir);
+		rq = deadline_fifo_request(dd, ds, data_dir);
 	} else {
 		/*
 		 * The last req was the same dir and we have a next request in
@@ -355,14 +446,14 @@ static struct request *__dd_dispatch_request(struct deadline_data *dd)
 	if (!rq)
 		return NULL;
 
-	dd->batching = 0;
+	ds->batching = 0;
 
 dispatch_request:
 	/*
 	 * rq is the selected appropriate request.
 	 */
-	dd->batching++;
-	deadline_move_request(dd, rq);
+	ds->batching++;
+	deadline_move_request(ds, rq);
 done:
 	/*
 	 * If the request needs its target zone locked, do it.
@@ -372,20 +463,79 @@ static struct request *__dd_dispatch_request(struct deadline_data *dd)
 	return rq;
 }
 
+/*
+ * With sharding, take the expired request of the shard with the earliest
+ * deadline if that is not the local shard. This only walks the shards once
+ * the queue wide bound has passed, and does not wait for a busy shard: its
+ * own hardware queue is dispatching at that moment anyway.
+ *
+ * The bound is refreshed from the published shard times afterwards. Racing
+ * with an insert it can end up later than the real earliest deadline, in
+ * which case that request is only seen by its own hardware queue until the
+ * next refresh, as it would be without this check.
+ */
+static struct request *dd_dispatch_expired(struct deadline_data *dd,
+					   struct dd_shard *local)
+{
+	unsigned long now = jiffies;
+	unsigned long min_expire = now + MAX_JIFFY_OFFSET;
+	long old = atomic_long_read(&dd->min_expire);
+	struct dd_shard *earliest = NULL;
+	struct request *rq = NULL;
+	unsigned int i;
+
+	if (time_before(now, (unsigned long)old))
+		return NULL;
+
+	for (i = 0; i < dd->nr_shards; i++) {
+		unsigned long expire = READ_ONCE(dd->shards[i].expire);
+
+		if (time_before(expire, min_expire)) {
+			min_expire = expire;
+			earliest = &dd->shards[i];
+		}
+	}
+
+	if (earliest && earliest != local &&
+	    time_after_eq(now, min_expire) && spin_trylock(&earliest->lock)) {
+		rq = deadline_expired_request(earliest);
+		if (rq) {
+			deadline_move_request(earliest, rq);
+			rq->rq_flags |= RQF_STARTED;
+		}
+		deadline_update_expire(dd, earliest);
+		spin_unlock(&earliest->lock);
+	}
+
+	atomic_long_cmpxchg(&dd->min_expire, old, min_expire);
+	return rq;
+}
+
 /*
  * One confusing aspect here is that we get called for a specific
  * hardware queue, but we may return a request that is for a
  * different hardware queue. This is because mq-deadline has shared
  * state for all hardware queues, in terms of sorting, FIFOs, etc.
+ * With sharding, each hardware queue dispatches its own requests, plus
+ * expired requests of other shards.
  */
 static struct request *dd_dispatch_request(struct blk_mq_hw_ctx *hctx)
 {
 	struct deadline_data *dd = hctx->queue->elevator->elevator_data;
+	struct dd_shard *ds = dd_hctx_shard(dd, hctx);
 	struct request *rq;
 
-	spin_lock(&dd->lock);
-	rq = __dd_dispatch_request(dd);
-	spin_unlock(&dd->lock);
+	if (dd->nr_shards > 1) {
+		rq = dd_dispatch_expired(dd, ds);
+		if (rq)
+			return rq;
+	}
+
+	spin_lock(&ds->lock);
+	rq = __dd_dispatch_request(dd, ds);
+	if (dd->nr_shards > 1)
+		deadline_update_expire(dd, ds);
+	spin_unlock(&ds->lock);
 
 	return rq;
 }
@@ -393,9 +543,12 @@ static struct request *dd_dispatch_request(struct blk_mq_hw_ctx *hctx)
 static void dd_exit_queue(struct elevator_queue *e)
 {
 	struct deadline_data *dd = e->elevator_data;
+	unsigned int i;
 
-	BUG_ON(!list_empty(&dd->fifo_list[READ]));
-	BUG_ON(!list_empty(&dd->fifo_list[WRITE]));
+	for (i = 0; i < dd->nr_shards; i++) {
+		BUG_ON(!list_empty(&dd->shards[i].fifo_list[READ]));
+		BUG_ON(!list_empty(&dd->shards[i].fifo_list[WRITE]));
+	}
 
 	kfree(dd);
 }
@@ -407,30 +560,44 @@ static int dd_init_queue(struct request_queue *q, struct elevator_type *e)
 {
 	struct deadline_data *dd;
 	struct elevator_queue *eq;
+	unsigned int nr_shards = 1;
+	unsigned int i;
+
+	/* zoned writes need one queue-wide view of the target zones */
+	if (sharded && q->nr_hw_queues > 1 && !blk_queue_is_zoned(q))
+		nr_shards = q->nr_hw_queues;
 
 	eq = elevator_alloc(q, e);
 	if (!eq)
 		return -ENOMEM;
 
-	dd = kzalloc_node(sizeof(*dd), GFP_KERNEL, q->node);
+	dd = kzalloc_node(struct_size(dd, shards, nr_shards), GFP_KERNEL,
+			  q->node);
 	if (!dd) {
 		kobject_put(&eq->kobj);
 		return -ENOMEM;
 	}
 	eq->elevator_data = dd;
 
-	INIT_LIST_HEAD(&dd->fifo_list[READ]);
-	INIT_LIST_HEAD(&dd->fifo_list[WRITE]);
-	dd->sort_list[READ] = RB_ROOT;
-	dd->sort_list[WRITE] = RB_ROOT;
+	for (i = 0; i < nr_shards; i++) {
+		struct dd_shard *ds = &dd->shards[i];
+
+		INIT_LIST_HEAD(&ds->fifo_list[READ]);
+		INIT_LIST_HEAD(&ds->fifo_list[WRITE]);
+		ds->sort_list[READ] = RB_ROOT;
+		ds->sort_list[WRITE] = RB_ROOT;
+		spin_lock_init(&ds->lock);
+		INIT_LIST_HEAD(&ds->dispatch);
+		ds->expire = jiffies + MAX_JIFFY_OFFSET;
+	}
+	atomic_long_set(&dd->min_expire, jiffies + MAX_JIFFY_OFFSET);
+	dd->nr_shards = nr_shards;
 	dd->fifo_expire[READ] = read_expire;
 	dd->fifo_expire[WRITE] = write_expire;
 	dd->writes_starved = writes_starved;
 	dd->front_merges = 1;
 	dd->fifo_batch = fifo_batch;
-	spin_lock_init(&dd->lock);
 	spin_lock_init(&dd->zone_lock);
-	INIT_LIST_HEAD(&dd->dispatch);
 
 	q->elevator = eq;
 	return 0;
@@ -446,7 +613,8 @@ static int dd_request_merge(struct request_queue *q, struct request **rq,
 	if (!dd->front_merges)
 		return ELEVATOR_NO_MERGE;
 
-	__rq = elv_rb_find(&dd->sort_list[bio_data_dir(bio)], sector);
+	/* only reached without sharding, through the elevator merge hash */
+	__rq = elv_rb_find(&dd->shards[0].sort_list[bio_data_dir(bio)], sector);
 	if (__rq) {
 		BUG_ON(sector != blk_rq_pos(__rq));
 
@@ -459,17 +627,51 @@ static int dd_request_merge(struct request_queue *q, struct request **rq,
 	return ELEVATOR_NO_MERGE;
 }
 
+/*
+ * The elevator merge hash and last_merge hint are queue wide, so shards
+ * cannot use them. Merge against the most recent requests of the shard
+ * fifo instead, like kyber does with its per-context lists.
+ */
+static bool dd_shard_bio_merge(struct request_queue *q, struct dd_shard *ds,
+			       struct bio *bio, unsigned int nr_segs)
+{
+	const int data_dir = bio_data_dir(bio);
+	struct list_head *list = &ds->fifo_list[data_dir];
+	struct request *rq;
+	int checked = 8;
+
+	if (!blk_mq_bio_list_merge(q, list, bio, nr_segs))
+		return false;
+
+	/* a front merge moved the start sector of the request bio went into */
+	list_for_each_entry_reverse(rq, list, queuelist) {
+		if (!checked--)
+			break;
+		if (rq->bio == bio) {
+			elv_rb_del(&ds->sort_list[data_dir], rq);
+			deadline_add_rq_rb(ds, rq);
+			break;
+		}
+	}
+
+	return true;
+}
+
 static bool dd_bio_merge(struct blk_mq_hw_ctx *hctx, struct bio *bio,
 		unsigned int nr_segs)
 {
 	struct request_queue *q = hctx->queue;
 	struct deadline_data *dd = q->elevator->elevator_data;
+	struct dd_shard *ds = dd_hctx_shard(dd, hctx);
 	struct request *free = NULL;
 	bool ret;
 
-	spin_lock(&dd->lock);
-	ret = blk_mq_sched_try_merge(q, bio, nr_segs, &free);
-	spin_unlock(&dd->lock);
+	spin_lock(&ds->lock);
+	if (dd->nr_shards > 1)
+		ret = dd_shard_bio_merge(q, ds, bio, nr_segs);
+	else
+		ret = blk_mq_sched_try_merge(q, bio, nr_segs, &free);
+	spin_unlock(&ds->lock);
 
 	if (free)
 		blk_mq_free_request(free);
@@ -485,6 +687,7 @@ static void dd_insert_request(struct blk_mq_hw_ctx *hctx, struct request *rq,
 {
 	struct request_queue *q = hctx->queue;
 	struct deadline_data *dd = q->elevator->elevator_data;
+	struct dd_shard *ds = dd_hctx_shard(dd, hctx);
 	const int data_dir = rq_data_dir(rq);
 
 	/*
@@ -493,20 +696,20 @@ static void dd_insert_request(struct blk_mq_hw_ctx *hctx, struct request *rq,
 	 */
 	blk_req_zone_write_unlock(rq);
 
-	if (blk_mq_sched_try_insert_merge(q, rq))
+	if (dd->nr_shards == 1 && blk_mq_sched_try_insert_merge(q, rq))
 		return;
 
 	blk_mq_sched_request_inserted(rq);
 
 	if (at_head || blk_rq_is_passthrough(rq)) {
 		if (at_head)
-			list_add(&rq->queuelist, &dd->dispatch);
+			list_add(&rq->queuelist, &ds->dispatch);
 		else
-			list_add_tail(&rq->queuelist, &dd->dispatch);
+			list_add_tail(&rq->queuelist, &ds->dispatch);
 	} else {
-		deadline_add_rq_rb(dd, rq);
+		deadline_add_rq_rb(ds, rq);
 
-		if (rq_mergeable(rq)) {
+		if (rq_mergeable(rq) && dd->nr_shards == 1) {
 			elv_rqhash_add(q, rq);
 			if (!q->last_merge)
 				q->last_merge = rq;
@@ -516,7 +719,7 @@ static void dd_insert_request(struct blk_mq_hw_ctx *hctx, struct request *rq,
 		 * set expire time and add to fifo list
 		 */
 		rq->fifo_time = jiffies + dd->fifo_expire[data_dir];
-		list_add_tail(&rq->queuelist, &dd->fifo_list[data_dir]);
+		list_add_tail(&rq->queuelist, &ds->fifo_list[data_dir]);
 	}
 }
 
@@ -525,8 +728,9 @@ static void dd_insert_requests(struct blk_mq_hw_ctx *hctx,
 {
 	struct request_queue *q = hctx->queue;
 	struct deadline_data *dd = q->elevator->elevator_data;
+	struct dd_shard *ds = dd_hctx_shard(dd, hctx);
 
-	spin_lock(&dd->lock);
+	spin_lock(&ds->lock);
 	while (!list_empty(list)) {
 		struct request *rq;
 
@@ -534,7 +738,9 @@ static void dd_insert_requests(struct blk_mq_hw_ctx *hctx,
 		list_del_init(&rq->queuelist);
 		dd_insert_request(hctx, rq, at_head);
 	}
-	spin_unlock(&dd->lock);
+	if (dd->nr_shards > 1)
+		deadline_update_expire(dd, ds);
+	spin_unlock(&ds->lock);
 }
 
 /*
@@ -558,6 +764,8 @@ static void dd_prepare_request(struct request *rq, struct bio *bio)
  * write request dispatch progress in this case, mark the queue as needing a
  * restart to ensure that the queue is run again after completion of the
  * request and zones being unlocked.
+ *
+ * Zoned block devices are never sharded.
  */
 static void dd_finish_request(struct request *rq)
 {
@@ -569,7 +777,7 @@ static void dd_finish_request(struct request *rq)
 
 		spin_lock_irqsave(&dd->zone_lock, flags);
 		blk_req_zone_write_unlock(rq);
-		if (!list_empty(&dd->fifo_list[WRITE]))
+		if (!list_empty(&dd->shards[0].fifo_list[WRITE]))
 			blk_mq_sched_mark_restart_hctx(rq->mq_hctx);
 		spin_unlock_irqrestore(&dd->zone_lock, flags);
 	}
@@ -578,10 +786,11 @@ static void dd_finish_request(struct request *rq)
 static bool dd_has_work(struct blk_mq_hw_ctx *hctx)
 {
 	struct deadline_data *dd = hctx->queue->elevator->elevator_data;
+	struct dd_shard *ds = dd_hctx_shard(dd, hctx);
 
-	return !list_empty_careful(&dd->dispatch) ||
-		!list_empty_careful(&dd->fifo_list[0]) ||
-		!list_empty_careful(&dd->fifo_list[1]);
+	return !list_empty_careful(&ds->dispatch) ||
+		!list_empty_careful(&ds->fifo_list[0]) ||
+		!list_empty_careful(&ds->fifo_list[1]);
 }
 
 /*
@@ -653,122 +862,154 @@ static struct elv_fs_entry deadline_attrs[] = {
 };
 
 #ifdef CONFIG_BLK_DEBUG_FS
-#define DEADLINE_DEBUGFS_DDIR_ATTRS(ddir, name)				\
-static void *deadline_##name##_fifo_start(struct seq_file *m,		\
-					  loff_t *pos)			\
-	__acquires(&dd->lock)						\
+/*
+ * The queue level views show the only shard of an unsharded queue, or the
+ * shard of the first hardware queue otherwise. Each hardware queue shows
+ * its own shard.
+ */
+static struct dd_shard *deadline_queue_shard(void *data)
+{
+	struct request_queue *q = data;
+	struct deadline_data *dd = q->elevator->elevator_data;
+
+	return &dd->shards[0];
+}
+
+static struct dd_shard *deadline_hctx_shard(void *data)
+{
+	struct blk_mq_hw_ctx *hctx = data;
+	struct deadline_data *dd = hctx->queue->elevator->elevator_data;
+
+	return dd_hctx_shard(dd, hctx);
+}
+
+#define DEADLINE_DEBUGFS_DDIR_ATTRS(ctx, ddir, name)			\
+static void *deadline_##ctx##_##name##_fifo_start(struct seq_file *m,	\
+						  loff_t *pos)		\
+	__acquires(&ds->lock)						\
 {									\
-	struct request_queue *q = m->private;				\
-	struct deadline_data *dd = q->elevator->elevator_data;		\
+	struct dd_shard *ds = deadline_##ctx##_shard(m->private);	\
 									\
-	spin_lock(&dd->lock);						\
-	return seq_list_start(&dd->fifo_list[ddir], *pos);		\
+	spin_lock(&ds->lock);						\
+	return seq_list_start(&ds->fifo_list[ddir], *pos);		\
 }									\
 									\
-static void *deadline_##name##_fifo_next(struct seq_file *m, void *v,	\
-					 loff_t *pos)			\
+static void *deadline_##ctx##_##name##_fifo_next(struct seq_file *m,	\
+						 void *v, loff_t *pos)	\
 {									\
-	struct request_queue *q = m->private;				\
-	struct deadline_data *dd = q->elevator->elevator_data;		\
+	struct dd_shard *ds = deadline_##ctx##_shard(m->private);	\
 									\
-	return seq_list_next(v, &dd->fifo_list[ddir], pos);		\
+	return seq_list_next(v, &ds->fifo_list[ddir], pos);		\
 }									\
 									\
-static void deadline_##name##_fifo_stop(struct seq_file *m, void *v)	\
-	__releases(&dd->lock)						\
+static void deadline_##ctx##_##name##_fifo_stop(struct seq_file *m,	\
+						void *v)		\
+	__releases(&ds->lock)						\
 {									\
-	struct request_queue *q = m->private;				\
-	struct deadline_data *dd = q->elevator->elevator_data;		\
+	struct dd_shard *ds = deadline_##ctx##_shard(m->private);	\
 									\
-	spin_unlock(&dd->lock);						\
+	spin_unlock(&ds->lock);						\
 }									\
 									\
-static const struct seq_operations deadline_##name##_fifo_seq_ops = {	\
-	.start	= deadline_##name##_fifo_start,				\
-	.next	= deadline_##name##_fifo_next,				\
-	.stop	= deadline_##name##_fifo_stop,				\
+static const struct seq_operations					\
+deadline_##ctx##_##name##_fifo_seq_ops = {				\
+	.start	= deadline_##ctx##_##name##_fifo_start,			\
+	.next	= deadline_##ctx##_##name##_fifo_next,			\
+	.stop	= deadline_##ctx##_##name##_fifo_stop,			\
 	.show	= blk_mq_debugfs_rq_show,				\
 };									\
 									\
-static int deadline_##name##_next_rq_show(void *data,			\
-					  struct seq_file *m)		\
+static int deadline_##ctx##_##name##_next_rq_show(void *data,		\
+						  struct seq_file *m)	\
 {									\
-	struct request_queue *q = data;					\
-	struct deadline_data *dd = q->elevator->elevator_data;		\
-	struct request *rq = dd->next_rq[ddir];				\
+	struct dd_shard *ds = deadline_##ctx##_shard(data);		\
+	struct request *rq = ds->next_rq[ddir];				\
 									\
 	if (rq)								\
 		__blk_mq_debugfs_rq_show(m, rq);			\
 	return 0;							\
 }
-DEADLINE_DEBUGFS_DDIR_ATTRS(READ, read)
-DEADLINE_DEBUGFS_DDIR_ATTRS(WRITE, write)
-#undef DEADLINE_DEBUGFS_DDIR_ATTRS
-
-static int deadline_batching_show(void *data, struct seq_file *m)
-{
-	struct request_queue *q = data;
-	struct deadline_data *dd = q->elevator->elevator_data;
-
-	seq_printf(m, "%u\n", dd->batching);
-	return 0;
-}
-
-static int deadline_starved_show(void *data, struct seq_file *m)
-{
-	struct request_queue *q = data;
-	struct deadline_data *dd = q->elevator->elevator_data;
-
-	seq_printf(m, "%u\n", dd->starved);
-	return 0;
-}
-
-static void *deadline_dispatch_start(struct seq_file *m, loff_t *pos)
-	__acquires(&dd->lock)
-{
-	struct request_queue *q = m->private;
-	struct deadline_data *dd = q->elevator->elevator_data;
-
-	spin_lock(&dd->lock);
-	return seq_list_start(&dd->dispatch, *pos);
-}
 
-static void *deadline_dispatch_next(struct seq_file *m, void *v, loff_t *pos)
-{
-	struct request_queue *q = m->private;
-	struct deadline_data *dd = q->elevator->elevator_data;
-
-	return seq_list_next(v, &dd->dispatch, pos);
-}
-
-static void deadline_dispatch_stop(struct seq_file *m, void *v)
-	__releases(&dd->lock)
-{
-	struct request_queue *q = m->private;
-	struct deadline_data *dd = q->elevator->elevator_data;
-
-	spin_unlock(&dd->lock);
-}
-
-static const struct seq_operations deadline_dispatch_seq_ops = {
-	.start	= deadline_dispatch_start,
-	.next	= deadline_dispatch_next,
-	.stop	= deadline_dispatch_stop,
-	.show	= blk_mq_debugfs_rq_show,
+#define DEADLINE_DEBUGFS_SHARD_ATTRS(ctx)				\
+DEADLINE_DEBUGFS_DDIR_ATTRS(ctx, READ, read)				\
+DEADLINE_DEBUGFS_DDIR_ATTRS(ctx, WRITE, write)				\
+									\
+static int deadline_##ctx##_batching_show(void *data,			\
+					  struct seq_file *m)		\
+{									\
+	struct dd_shard *ds = deadline_##ctx##_shard(data);		\
+									\
+	seq_printf(m, "%u\n", ds->batching);				\
+	return 0;							\
+}									\
+									\
+static int deadline_##ctx##_starved_show(void *data,			\
+					 struct seq_file *m)		\
+{									\
+	struct dd_shard *ds = deadline_##ctx##_shard(data);		\
+									\
+	seq_printf(m, "%u\n", ds->starved);				\
+	return 0;							\
+}									\
+									\
+static void *deadline_##ctx##_dispatch_start(struct seq_file *m,	\
+					     loff_t *pos)		\
+	__acquires(&ds->lock)						\
+{									\
+	struct dd_shard *ds = deadline_##ctx##_shard(m->private);	\
+									\
+	spin_lock(&ds->lock);						\
+	return seq_list_start(&ds->dispatch, *pos);			\
+}									\
+									\
+static void *deadline_##ctx##_dispatch_next(struct seq_file *m,	\
+					    void *v, loff_t *pos)	\
+{									\
+	struct dd_shard *ds = deadline_##ctx##_shard(m->private);	\
+									\
+	return seq_list_next(v, &ds->dispatch, pos);			\
+}									\
+									\
+static void deadline_##ctx##_dispatch_stop(struct seq_file *m, void *v)	\
+	__releases(&ds->lock)						\
+{									\
+	struct dd_shard *ds = deadline_##ctx##_shard(m->private);	\
+									\
+	spin_unlock(&ds->lock);						\
+}									\
+									\
+static const struct seq_operations deadline_##ctx##_dispatch_seq_ops = {	\
+	.start	= deadline_##ctx##_dispatch_start,			\
+	.next	= deadline_##ctx##_dispatch_next,			\
+	.stop	= deadline_##ctx##_dispatch_stop,			\
+	.show	= blk_mq_debugfs_rq_show,				\
 };
+DEADLINE_DEBUGFS_SHARD_ATTRS(queue)
+DEADLINE_DEBUGFS_SHARD_ATTRS(hctx)
+#undef DEADLINE_DEBUGFS_SHARD_ATTRS
+#undef DEADLINE_DEBUGFS_DDIR_ATTRS
 
-#define DEADLINE_QUEUE_DDIR_ATTRS(name)						\
-	{#name "_fifo_list", 0400, .seq_ops = &deadline_##name##_fifo_seq_ops},	\
-	{#name "_next_rq", 0400, deadline_##name##_next_rq_show}
+#define DEADLINE_DDIR_ATTRS(ctx, name)					\
+	{#name "_fifo_list", 0400,					\
+		.seq_ops = &deadline_##ctx##_##name##_fifo_seq_ops},	\
+	{#name "_next_rq", 0400, deadline_##ctx##_##name##_next_rq_show}
+#define DEADLINE_SHARD_ATTRS(ctx)					\
+	DEADLINE_DDIR_ATTRS(ctx, read),					\
+	DEADLINE_DDIR_ATTRS(ctx, write),				\
+	{"batching", 0400, deadline_##ctx##_batching_show},		\
+	{"starved", 0400, deadline_##ctx##_starved_show},		\
+	{"dispatch", 0400, .seq_ops = &deadline_##ctx##_dispatch_seq_ops}
 static const struct blk_mq_debugfs_attr deadline_queue_debugfs_attrs[] = {
-	DEADLINE_QUEUE_DDIR_ATTRS(read),
-	DEADLINE_QUEUE_DDIR_ATTRS(write),
-	{"batching", 0400, deadline_batching_show},
-	{"starved", 0400, deadline_starved_show},
-	{"dispatch", 0400, .seq_ops = &deadline_dispatch_seq_ops},
+	DEADLINE_SHARD_ATTRS(queue),
+	{},
+};
+
+static const struct blk_mq_debugfs_attr deadline_hctx_debugfs_attrs[] = {
+	DEADLINE_SHARD_ATTRS(hctx),
 	{},
 };
-#undef DEADLINE_QUEUE_DDIR_ATTRS
+#undef DEADLINE_SHARD_ATTRS
+#undef DEADLINE_DDIR_ATTRS
 #endif
 
 static struct elevator_type mq_deadline = {
@@ -790,6 +1031,7 @@ static struct elevator_type mq_deadline = {
 
 #ifdef CONFIG_BLK_DEBUG_FS
 	.queue_debugfs_attrs = deadline_queue_debugfs_attrs,
+	.hctx_debugfs_attrs = deadline_hctx_debugfs_attrs,
 #endif
 	.elevator_attrs = deadline_attrs,
 	.elevator_name = "mq-deadline",
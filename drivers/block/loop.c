@@ -78,6 +78,7 @@
 #include <linux/uio.h>
 #include <linux/ioprio.h>
 #include <linux/blk-cgroup.h>
+#include <linux/hash.h>
 
 #include "loop.h"
 
@@ -89,6 +90,11 @@ static DEFINE_MUTEX(loop_ctl_mutex);
 static int max_part;
 static int part_shift;
 
+#define LOOP_MAX_WORKERS	64
+
+static unsigned int nr_workers = 1;
+static bool blkcg_workers;
+
 static int transfer_xor(struct loop_device *lo, int cmd,
 			struct page *raw_page, unsigned raw_off,
 			struct page *loop_page, unsigned loop_off,
@@ -458,6 +464,12 @@ static void lo_complete_rq(struct request *rq)
 	struct loop_cmd *cmd = blk_mq_rq_to_pdu(rq);
 	blk_status_t ret = BLK_STS_OK;
 
+	/* every request ends here, a requeued one takes a new reference */
+	if (cmd->css) {
+		css_put(cmd->css);
+		cmd->css = NULL;
+	}
+
 	if (!cmd->use_aio || cmd->ret < 0 || cmd->ret == blk_rq_bytes(rq) ||
 	    req_op(rq) != REQ_OP_READ) {
 		if (cmd->ret < 0)
@@ -503,8 +515,6 @@ static void lo_rw_aio_complete(struct kiocb *iocb, long ret, long ret2)
 {
 	struct loop_cmd *cmd = container_of(iocb, struct loop_cmd, iocb);
 
-	if (cmd->css)
-		css_put(cmd->css);
 	cmd->ret = ret;
 	lo_rw_aio_do_completion(cmd);
 }
@@ -824,12 +834,32 @@ static ssize_t loop_attr_dio_show(struct loop_device *lo, char *buf)
 	return sprintf(buf, "%s\n", dio ? "1" : "0");
 }
 
+static ssize_t loop_attr_workers_show(struct loop_device *lo, char *buf)
+{
+	struct loop_worker *w;
+	ssize_t len = 0;
+	unsigned int i;
+
+	for (i = 0; i < lo->nr_workers; i++) {
+		w = &lo->workers[i];
+		len += scnprintf(buf + len, PAGE_SIZE - len,
+				 "%u %d %llu %llu %llu\n", i,
+				 task_pid_nr(w->task),
+				 (u64)atomic64_read(&w->nr_reads),
+				 (u64)atomic64_read(&w->nr_writes),
+				 (u64)atomic64_read(&w->nr_ordered));
+	}
+
+	return len;
+}
+
 LOOP_ATTR_RO(backing_file);
 LOOP_ATTR_RO(offset);
 LOOP_ATTR_RO(sizelimit);
 LOOP_ATTR_RO(autoclear);
 LOOP_ATTR_RO(partscan);
 LOOP_ATTR_RO(dio);
+LOOP_ATTR_RO(workers);
 
 static struct attribute *loop_attrs[] = {
 	&loop_attr_backing_file.attr,
@@ -838,6 +868,7 @@ static struct attribute *loop_attrs[] = {
 	&loop_attr_autoclear.attr,
 	&loop_attr_partscan.attr,
 	&loop_attr_dio.attr,
+	&loop_attr_workers.attr,
 	NULL,
 };
 
@@ -891,8 +922,15 @@ static void loop_config_discard(struct loop_device *lo)
 
 static void loop_unprepare_queue(struct loop_device *lo)
 {
-	kthread_flush_worker(&lo->worker);
-	kthread_stop(lo->worker_task);
+	unsigned int i;
+
+	for (i = 0; i < lo->nr_workers; i++) {
+		kthread_flush_worker(&lo->workers[i].worker);
+		kthread_stop(lo->workers[i].task);
+	}
+	kfree(lo->workers);
+	lo->workers = NULL;
+	lo->nr_workers = 0;
 }
 
 static int loop_kthread_worker_fn(void *worker_ptr)
@@ -903,13 +941,71 @@ static int loop_kthread_worker_fn(void *worker_ptr)
 
 static int loop_prepare_queue(struct loop_device *lo)
 {
-	kthread_init_worker(&lo->worker);
-	lo->worker_task = kthread_run(loop_kthread_worker_fn,
-			&lo->worker, "loop%d", lo->lo_number);
-	if (IS_ERR(lo->worker_task))
+	unsigned int nr = clamp_t(unsigned int, nr_workers, 1, LOOP_MAX_WORKERS);
+	struct loop_worker *w;
+	unsigned int i;
+
+	lo->workers = kcalloc(nr, sizeof(*lo->workers), GFP_KERNEL);
+	if (!lo->workers)
 		return -ENOMEM;
-	set_user_nice(lo->worker_task, MIN_NICE);
+
+	for (i = 0; i < nr; i++) {
+		w = &lo->workers[i];
+		kthread_init_worker(&w->worker);
+		/* the first worker keeps the historical thread name */
+		if (!i)
+			w->task = kthread_run(loop_kthread_worker_fn,
+					&w->worker, "loop%d", lo->lo_number);
+		else
+			w->task = kthread_run(loop_kthread_worker_fn,
+					&w->worker, "loop%d:%u",
+					lo->lo_number, i);
+		if (IS_ERR(w->task))
+			goto err;
+		set_user_nice(w->task, MIN_NICE);
+		lo->nr_workers++;
+	}
 	return 0;
+
+err:
+	loop_unprepare_queue(lo);
+	return -ENOMEM;
+}
+
+static bool loop_rq_is_ordered(struct request *rq)
+{
+	switch (req_op(rq)) {
+	case REQ_OP_FLUSH:
+	case REQ_OP_DISCARD:
+	case REQ_OP_WRITE_ZEROES:
+		return true;
+	default:
+		return rq->cmd_flags & (REQ_FUA | REQ_PREFLUSH);
+	}
+}
+
+/*
+ * Pick the worker for a request. Flushes, FUA writes, discards and
+ * write zeroes all go to worker 0 so that they execute in submission
+ * order among themselves. Other requests are spread by issuing blkcg
+ * when per-cgroup workers are enabled, otherwise by submitting CPU, so
+ * that one submitter's sequential stream stays on one thread.
+ */
+static struct loop_worker *loop_select_worker(struct loop_device *lo,
+					      struct request *rq,
+					      struct loop_cmd *cmd)
+{
+	unsigned int idx;
+
+	if (lo->nr_workers == 1 || loop_rq_is_ordered(rq))
+		return &lo->workers[0];
+
+	if (blkcg_workers && cmd->css)
+		idx = hash_ptr(cmd->css, 32) % lo->nr_workers;
+	else
+		idx = raw_smp_processor_id() % lo->nr_workers;
+
+	return &lo->workers[idx];
 }
 
 static void loop_update_rotational(struct loop_device *lo)
@@ -1860,6 +1956,10 @@ module_param(max_loop, int, 0444);
 MODULE_PARM_DESC(max_loop, "Maximum number of loop devices");
 module_param(max_part, int, 0444);
 MODULE_PARM_DESC(max_part, "Maximum number of partitions per loop device");
+module_param(nr_workers, uint, 0644);
+MODULE_PARM_DESC(nr_workers, "Number of request workers per loop device, applied on LOOP_SET_FD");
+module_param(blkcg_workers, bool, 0644);
+MODULE_PARM_DESC(blkcg_workers, "Spread loop requests over workers by issuing blkcg");
 MODULE_LICENSE("GPL");
 MODULE_ALIAS_BLOCKDEV_MAJOR(LOOP_MAJOR);
 
@@ -1907,6 +2007,7 @@ static blk_status_t loop_queue_rq(struct blk_mq_hw_ctx *hctx,
 	struct request *rq = bd->rq;
 	struct loop_cmd *cmd = blk_mq_rq_to_pdu(rq);
 	struct loop_device *lo = rq->q->queuedata;
+	struct loop_worker *worker;
 
 	blk_mq_start_request(rq);
 
@@ -1924,15 +2025,26 @@ static blk_status_t loop_queue_rq(struct blk_mq_hw_ctx *hctx,
 		break;
 	}
 
-	/* always use the first bio's css */
+	/*
+	 * Always use the first bio's css. Buffered requests are charged to
+	 * it too, so that cgroup attribution survives the worker hop.
+	 */
 #ifdef CONFIG_BLK_CGROUP
-	if (cmd->use_aio && rq->bio && rq->bio->bi_blkg) {
+	if (rq->bio && rq->bio->bi_blkg) {
 		cmd->css = &bio_blkcg(rq->bio)->css;
 		css_get(cmd->css);
 	} else
 #endif
 		cmd->css = NULL;
-	kthread_queue_work(&lo->worker, &cmd->work);
+
+	worker = loop_select_worker(lo, rq, cmd);
+	if (loop_rq_is_ordered(rq))
+		atomic64_inc(&worker->nr_ordered);
+	else if (op_is_write(req_op(rq)))
+		atomic64_inc(&worker->nr_writes);
+	else
+		atomic64_inc(&worker->nr_reads);
+	kthread_queue_work(&worker->worker, &cmd->work);
 
 	return BLK_STS_OK;
 }
@@ -1949,7 +2061,16 @@ static void loop_handle_cmd(struct loop_cmd *cmd)
 		goto failed;
 	}
 
-	ret = do_req_filebacked(lo, rq);
+	if (cmd->use_aio) {
+		ret = do_req_filebacked(lo, rq);
+	} else {
+		/* the aio path associates the css on its own */
+		if (cmd->css)
+			kthread_associate_blkcg(cmd->css);
+		ret = do_req_filebacked(lo, rq);
+		if (cmd->css)
+			kthread_associate_blkcg(NULL);
+	}
  failed:
 	/* complete non-aio request */
 	if (!cmd->use_aio || ret) {
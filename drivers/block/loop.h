@@ -54,8 +54,8 @@ struct loop_device {
 
 	spinlock_t		lo_lock;
 	int			lo_state;
-	struct kthread_worker	worker;
-	struct task_struct	*worker_task;
+	struct loop_worker	*workers;
+	unsigned int		nr_workers;
 	bool			use_dio;
 	bool			sysfs_inited;
 
@@ -64,6 +64,15 @@ struct loop_device {
 	struct gendisk		*lo_disk;
 };
 
+/* One request execution thread of a loop device */
+struct loop_worker {
+	struct kthread_worker	worker;
+	struct task_struct	*task;
+	atomic64_t		nr_reads;
+	atomic64_t		nr_writes;
+	atomic64_t		nr_ordered;	/* flush, FUA, discard */
+};
+
 struct loop_cmd {
 	struct kthread_work work;
 	bool use_aio; /* use AIO interface to handle I/O */
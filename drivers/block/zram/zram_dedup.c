@@ -0,0 +1,224 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Same-content page deduplication for zram
+ *
+ * Pages are hashed before they are compressed.  Entries are kept in
+ * per-bucket rbtrees ordered by hash.  When a page's hash matches a
+ * stored entry, the entry is decompressed and compared byte for byte
+ * before it is shared, so a hash collision only costs time.
+ */
+
+#include <linux/kernel.h>
+#include <linux/log2.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
+#include <linux/xxhash.h>
+
+#include "zram_drv.h"
+
+/* One bucket per 64 pages of disksize, within these bounds */
+#define ZRAM_HASH_SHIFT		6
+#define ZRAM_HASH_SIZE_MIN	(1 << 10)
+#define ZRAM_HASH_SIZE_MAX	(1 << 20)
+
+u64 zram_dedup_checksum(const void *mem)
+{
+	return xxh3_64(mem, PAGE_SIZE, 0);
+}
+
+static struct zram_hash *zram_dedup_bucket(struct zram *zram, u64 checksum)
+{
+	return &zram->hash[checksum & (zram->hash_size - 1)];
+}
+
+static void zram_dedup_free(struct zram *zram, struct zram_entry *entry)
+{
+	zs_free(zram->mem_pool, entry->handle);
+	atomic64_sub(entry->len, &zram->stats.compr_data_size);
+	atomic64_sub(sizeof(*entry), &zram->stats.meta_data_size);
+	kfree(entry);
+}
+
+/* Drop a reference with the bucket lock held, unlinking the last one */
+static bool __zram_dedup_put(struct zram_hash *hash, struct zram_entry *entry)
+{
+	if (--entry->refcount)
+		return false;
+	rb_erase(&entry->rb_node, &hash->rb_root);
+	return true;
+}
+
+static bool zram_dedup_match(struct zram *zram, struct zram_entry *entry,
+			     const void *mem)
+{
+	bool match = false;
+	void *src;
+
+	src = zs_map_object(zram->mem_pool, entry->handle, ZS_MM_RO);
+	if (entry->len == PAGE_SIZE) {
+		match = !memcmp(mem, src, PAGE_SIZE);
+	} else {
+		struct zcomp_strm *zstrm = zcomp_stream_get(zram->comp);
+
+		if (!zcomp_decompress(zstrm, src, entry->len, zstrm->buffer))
+			match = !memcmp(mem, zstrm->buffer, PAGE_SIZE);
+		zcomp_stream_put(zram->comp);
+	}
+	zs_unmap_object(zram->mem_pool, entry->handle);
+
+	return match;
+}
+
+/*
+ * Look for a stored page identical to @mem and take a reference on it.
+ * Candidates are compared without the bucket lock held; the reference
+ * taken on each keeps it, and so its position in the tree, stable.
+ * Only a match turns that reference into one held by a slot, and only
+ * then does it count towards dup_data_size.
+ */
+struct zram_entry *zram_dedup_find(struct zram *zram, const void *mem,
+				   u64 checksum)
+{
+	struct zram_hash *hash = zram_dedup_bucket(zram, checksum);
+	struct zram_entry *entry = NULL, *next;
+	struct rb_node *node;
+	bool last, shared;
+
+	spin_lock(&hash->lock);
+	node = hash->rb_root.rb_node;
+	while (node) {
+		next = rb_entry(node, struct zram_entry, rb_node);
+		if (checksum < next->checksum) {
+			node = node->rb_left;
+		} else if (checksum > next->checksum) {
+			node = node->rb_right;
+		} else {
+			/* Keep going left to find the first match */
+			entry = next;
+			node = node->rb_left;
+		}
+	}
+	if (entry)
+		entry->refcount++;
+	spin_unlock(&hash->lock);
+
+	while (entry) {
+		if (zram_dedup_match(zram, entry, mem)) {
+			spin_lock(&hash->lock);
+			shared = entry->users++ > 0;
+			spin_unlock(&hash->lock);
+
+			/* The last slot may have let go during the compare */
+			if (shared)
+				atomic64_add(entry->len,
+					     &zram->stats.dup_data_size);
+			return entry;
+		}
+
+		spin_lock(&hash->lock);
+		node = rb_next(&entry->rb_node);
+		next = node ? rb_entry(node, struct zram_entry, rb_node) : NULL;
+		if (next && next->checksum == checksum)
+			next->refcount++;
+		else
+			next = NULL;
+		last = __zram_dedup_put(hash, entry);
+		spin_unlock(&hash->lock);
+
+		if (last)
+			zram_dedup_free(zram, entry);
+		entry = next;
+	}
+
+	return NULL;
+}
+
+/*
+ * Make a freshly stored object available for sharing.  Returns NULL if
+ * no entry could be allocated, in which case the caller keeps using the
+ * bare handle.
+ */
+struct zram_entry *zram_dedup_insert(struct zram *zram, unsigned long handle,
+				     unsigned int len, u64 checksum)
+{
+	struct zram_hash *hash = zram_dedup_bucket(zram, checksum);
+	struct rb_node **link, *parent = NULL;
+	struct zram_entry *entry;
+
+	entry = kmalloc(sizeof(*entry), GFP_NOIO | __GFP_NOWARN);
+	if (!entry)
+		return NULL;
+
+	entry->checksum = checksum;
+	entry->handle = handle;
+	entry->len = len;
+	entry->refcount = 1;
+	entry->users = 1;
+
+	spin_lock(&hash->lock);
+	link = &hash->rb_root.rb_node;
+	while (*link) {
+		struct zram_entry *cur;
+
+		parent = *link;
+		cur = rb_entry(parent, struct zram_entry, rb_node);
+		if (checksum < cur->checksum)
+			link = &parent->rb_left;
+		else
+			link = &parent->rb_right;
+	}
+	rb_link_node(&entry->rb_node, parent, link);
+	rb_insert_color(&entry->rb_node, &hash->rb_root);
+	spin_unlock(&hash->lock);
+
+	atomic64_add(sizeof(*entry), &zram->stats.meta_data_size);
+	return entry;
+}
+
+/* Drop the reference of a slot taken by zram_dedup_find() or _insert() */
+void zram_dedup_put(struct zram *zram, struct zram_entry *entry)
+{
+	struct zram_hash *hash = zram_dedup_bucket(zram, entry->checksum);
+	bool last, shared;
+
+	spin_lock(&hash->lock);
+	shared = --entry->users > 0;
+	last = __zram_dedup_put(hash, entry);
+	spin_unlock(&hash->lock);
+
+	if (last)
+		zram_dedup_free(zram, entry);
+	else if (shared)
+		atomic64_sub(entry->len, &zram->stats.dup_data_size);
+}
+
+int zram_dedup_init(struct zram *zram, size_t num_pages)
+{
+	size_t i;
+
+	if (!zram->use_dedup)
+		return 0;
+
+	zram->hash_size = clamp_t(size_t, num_pages >> ZRAM_HASH_SHIFT,
+				  ZRAM_HASH_SIZE_MIN, ZRAM_HASH_SIZE_MAX);
+	zram->hash_size = roundup_pow_of_two(zram->hash_size);
+	zram->hash = vzalloc(array_size(zram->hash_size, sizeof(*zram->hash)));
+	if (!zram->hash) {
+		zram->hash_size = 0;
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < zram->hash_size; i++) {
+		spin_lock_init(&zram->hash[i].lock);
+		zram->hash[i].rb_root = RB_ROOT;
+	}
+	return 0;
+}
+
+void zram_dedup_fini(struct zram *zram)
+{
+	vfree(zram->hash);
+	zram->hash = NULL;
+	zram->hash_size = 0;
+}
@@ -0,0 +1,70 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Same-content page deduplication for zram
+ */
+
+#ifndef _ZRAM_DEDUP_H_
+#define _ZRAM_DEDUP_H_
+
+#include <linux/rbtree.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+
+struct zram;
+
+/*
+ * A compressed object shared by every slot holding the same page.
+ * Slots marked ZRAM_DEDUP keep a pointer to one of these in place of
+ * the zsmalloc handle.
+ */
+struct zram_entry {
+	struct rb_node rb_node;
+	u64 checksum;
+	unsigned long handle;
+	unsigned int len;
+	/*
+	 * Protected by the bucket lock.  refcount also counts the transient
+	 * references of lookups in progress, users only the slots.
+	 */
+	unsigned long refcount;
+	unsigned long users;
+};
+
+struct zram_hash {
+	spinlock_t lock;
+	struct rb_root rb_root;
+};
+
+#ifdef CONFIG_ZRAM_DEDUP
+u64 zram_dedup_checksum(const void *mem);
+struct zram_entry *zram_dedup_find(struct zram *zram, const void *mem,
+				   u64 checksum);
+struct zram_entry *zram_dedup_insert(struct zram *zram, unsigned long handle,
+				     unsigned int len, u64 checksum);
+void zram_dedup_put(struct zram *zram, struct zram_entry *entry);
+
+int zram_dedup_init(struct zram *zram, size_t num_pages);
+void zram_dedup_fini(struct zram *zram);
+#else
+static inline u64 zram_dedup_checksum(const void *mem) { return 0; }
+static inline struct zram_entry *zram_dedup_find(struct zram *zram,
+						 const void *mem, u64 checksum)
+{
+	return NULL;
+}
+static inline struct zram_entry *zram_dedup_insert(struct zram *zram,
+		unsigned long handle, unsigned int len, u64 checksum)
+{
+	return NULL;
+}
+static inline void zram_dedup_put(struct zram *zram,
+				  struct zram_entry *entry) {}
+
+static inline int zram_dedup_init(struct zram *zram, size_t num_pages)
+{
+	return 0;
+}
+static inline void zram_dedup_fini(struct zram *zram) {}
+#endif
+
+#endif /* _ZRAM_DEDUP_H_ */
@@ -42,6 +42,8 @@ static DEFINE_MUTEX(zram_index_mutex);
 
 static int zram_major;
 static const char *default_compressor = "lzo-rle";
+/* Decompresses the chunks of multi-page reads on other CPUs */
+static struct workqueue_struct *zram_read_wq;
 
 /* Module params (documentation at end) */
 static unsigned int num_devices = 1;
@@ -76,6 +78,15 @@ static inline bool init_done(struct zram *zram)
 	return zram->disksize;
 }
 
+static inline bool zram_dedup_enabled(struct zram *zram)
+{
+#ifdef CONFIG_ZRAM_DEDUP
+	return zram->use_dedup;
+#else
+	return false;
+#endif
+}
+
 static inline struct zram *dev_to_zram(struct device *dev)
 {
 	return (struct zram *)dev_to_disk(dev)->private_data;
@@ -141,6 +152,16 @@ static inline bool zram_allocated(struct zram *zram, u32 index)
 			zram_test_flag(zram, index, ZRAM_WB);
 }
 
+/* The compressor that produced the object stored in this slot */
+static inline struct zcomp *zram_slot_comp(struct zram *zram, u32 index)
+{
+#ifdef CONFIG_ZRAM_RECOMPRESS
+	if (zram_test_flag(zram, index, ZRAM_RECOMP))
+		return zram->recomp;
+#endif
+	return zram->comp;
+}
+
 #if PAGE_SIZE != 4096
 static inline bool is_partial_io(struct bio_vec *bvec)
 {
@@ -391,6 +412,29 @@ static ssize_t writeback_limit_show(struct device *dev,
 	return scnprintf(buf, PAGE_SIZE, "%llu\n", val);
 }
 
+static ssize_t writeback_queue_depth_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	unsigned int val;
+
+	if (kstrtouint(buf, 10, &val) || !val || val > ZRAM_WB_MAX_QUEUE_DEPTH)
+		return -EINVAL;
+
+	WRITE_ONCE(zram->wb_queue_depth, val);
+
+	return len;
+}
+
+static ssize_t writeback_queue_depth_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%u\n",
+			 READ_ONCE(zram->wb_queue_depth));
+}
+
 static void reset_bdev(struct zram *zram)
 {
 	struct block_device *bdev;
@@ -620,18 +664,276 @@ static int read_from_bdev_async(struct zram *zram, struct bio_vec *bvec,
 #define HUGE_WRITEBACK 1
 #define IDLE_WRITEBACK 2
 
+/*
+ * Writeback batches slots that land on contiguous backing blocks into a
+ * single bio of up to ZRAM_WB_BATCH_PAGES pages and keeps up to
+ * zram->wb_queue_depth such bios in flight. Slots are only switched to
+ * ZRAM_WB once their bio completed, from the writeback context, as
+ * zram_free_page cannot run from the bio completion.
+ */
+#define ZRAM_WB_BATCH_PAGES	32
+
+struct zram_wb_req {
+	struct list_head entry;
+	struct zram_wb_ctl *ctl;
+	struct bio *bio;
+	unsigned long blk_idx;		/* first backing block */
+	unsigned int nr_pages;
+	unsigned long index[ZRAM_WB_BATCH_PAGES];
+	struct page *pages[ZRAM_WB_BATCH_PAGES];
+};
+
+struct zram_wb_ctl {
+	spinlock_t lock;
+	struct list_head idle_reqs;	/* free to fill */
+	struct list_head done_reqs;	/* completed, waiting for commit */
+	atomic_t inflight;
+	wait_queue_head_t wait;
+};
+
+static void zram_wb_req_free(struct zram_wb_req *req)
+{
+	int i;
+
+	for (i = 0; i < ZRAM_WB_BATCH_PAGES; i++)
+		if (req->pages[i])
+			__free_page(req->pages[i]);
+	kfree(req);
+}
+
+static void zram_wb_ctl_free(struct zram_wb_ctl *ctl)
+{
+	struct zram_wb_req *req, *tmp;
+
+	list_for_each_entry_safe(req, tmp, &ctl->idle_reqs, entry)
+		zram_wb_req_free(req);
+	kfree(ctl);
+}
+
+static struct zram_wb_ctl *zram_wb_ctl_alloc(unsigned int depth)
+{
+	struct zram_wb_ctl *ctl;
+	struct zram_wb_req *req;
+	unsigned int i, j;
+
+	ctl = kzalloc(sizeof(*ctl), GFP_KERNEL);
+	if (!ctl)
+		return NULL;
+
+	spin_lock_init(&ctl->lock);
+	INIT_LIST_HEAD(&ctl->idle_reqs);
+	INIT_LIST_HEAD(&ctl->done_reqs);
+	atomic_set(&ctl->inflight, 0);
+	init_waitqueue_head(&ctl->wait);
+
+	for (i = 0; i < depth; i++) {
+		req = kzalloc(sizeof(*req), GFP_KERNEL);
+		if (!req)
+			break;
+
+		for (j = 0; j < ZRAM_WB_BATCH_PAGES; j++) {
+			req->pages[j] = alloc_page(GFP_KERNEL);
+			if (!req->pages[j])
+				break;
+		}
+		if (j < ZRAM_WB_BATCH_PAGES) {
+			zram_wb_req_free(req);
+			break;
+		}
+
+		req->ctl = ctl;
+		list_add(&req->entry, &ctl->idle_reqs);
+	}
+
+	/* run with a shallower queue rather than fail under memory pressure */
+	if (list_empty(&ctl->idle_reqs)) {
+		kfree(ctl);
+		return NULL;
+	}
+
+	return ctl;
+}
+
+static void zram_wb_end_io(struct bio *bio)
+{
+	struct zram_wb_req *req = bio->bi_private;
+	struct zram_wb_ctl *ctl = req->ctl;
+	unsigned long flags;
+
+	/*
+	 * Everything happens under the lock: the writeback thread takes it
+	 * after the last completion before it frees @ctl.
+	 */
+	spin_lock_irqsave(&ctl->lock, flags);
+	list_add_tail(&req->entry, &ctl->done_reqs);
+	atomic_dec(&ctl->inflight);
+	wake_up(&ctl->wait);
+	spin_unlock_irqrestore(&ctl->lock, flags);
+}
+
+static void zram_wb_submit(struct zram *zram, struct zram_wb_ctl *ctl,
+			   struct zram_wb_req *req)
+{
+	unsigned int i;
+
+	req->bio = bio_alloc(GFP_KERNEL, req->nr_pages);
+	bio_set_dev(req->bio, zram->bdev);
+	req->bio->bi_iter.bi_sector = req->blk_idx * (PAGE_SIZE >> 9);
+	req->bio->bi_opf = REQ_OP_WRITE;
+	req->bio->bi_private = req;
+	req->bio->bi_end_io = zram_wb_end_io;
+
+	for (i = 0; i < req->nr_pages; i++)
+		bio_add_page(req->bio, req->pages[i], PAGE_SIZE, 0);
+
+	atomic64_inc(&zram->stats.bd_wb_batches);
+	atomic_inc(&ctl->inflight);
+	submit_bio(req->bio);
+}
+
+static void zram_wb_unreserve(struct zram *zram)
+{
+	spin_lock(&zram->wb_limit_lock);
+	if (zram->wb_limit_enable)
+		zram->bd_wb_limit += 1UL << (PAGE_SHIFT - 12);
+	spin_unlock(&zram->wb_limit_lock);
+}
+
+/* Switch the slots of a completed batch over to their backing blocks */
+static void zram_wb_commit(struct zram *zram, struct zram_wb_req *req)
+{
+	blk_status_t status = req->bio->bi_status;
+	unsigned long blk_idx, index;
+	unsigned int i;
+
+	bio_put(req->bio);
+	req->bio = NULL;
+
+	for (i = 0; i < req->nr_pages; i++) {
+		index = req->index[i];
+		blk_idx = req->blk_idx + i;
+
+		/*
+		 * We released zram_slot_lock so need to check if the slot was
+		 * changed. If there is freeing for the slot, we can catch it
+		 * easily by zram_allocated.
+		 * A subtle case is the slot is freed/reallocated/marked as
+		 * ZRAM_IDLE again. To close the race, idle_store doesn't
+		 * mark ZRAM_IDLE once it found the slot was ZRAM_UNDER_WB.
+		 * Thus, we could close the race by checking ZRAM_IDLE bit.
+		 */
+		zram_slot_lock(zram, index);
+		if (status || !zram_allocated(zram, index) ||
+			  !zram_test_flag(zram, index, ZRAM_IDLE)) {
+			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+			zram_clear_flag(zram, index, ZRAM_IDLE);
+			zram_slot_unlock(zram, index);
+			free_block_bdev(zram, blk_idx);
+			zram_wb_unreserve(zram);
+			continue;
+		}
+
+		zram_free_page(zram, index);
+		zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+		zram_set_flag(zram, index, ZRAM_WB);
+		zram_set_element(zram, index, blk_idx);
+		atomic64_inc(&zram->stats.pages_stored);
+		atomic64_inc(&zram->stats.bd_writes);
+		zram_slot_unlock(zram, index);
+	}
+
+	req->nr_pages = 0;
+}
+
+/* Commit completed batches and hand back a free one, waiting if needed */
+static struct zram_wb_req *zram_wb_get_req(struct zram *zram,
+					   struct zram_wb_ctl *ctl)
+{
+	struct zram_wb_req *req;
+	LIST_HEAD(done);
+
+	for (;;) {
+		spin_lock_irq(&ctl->lock);
+		list_splice_init(&ctl->done_reqs, &done);
+		spin_unlock_irq(&ctl->lock);
+
+		while (!list_empty(&done)) {
+			req = list_first_entry(&done, struct zram_wb_req,
+					       entry);
+			list_del(&req->entry);
+			zram_wb_commit(zram, req);
+			list_add(&req->entry, &ctl->idle_reqs);
+		}
+
+		req = list_first_entry_or_null(&ctl->idle_reqs,
+					       struct zram_wb_req, entry);
+		if (req) {
+			list_del(&req->entry);
+			return req;
+		}
+
+		wait_event(ctl->wait, !list_empty_careful(&ctl->done_reqs));
+	}
+}
+
+static void zram_wb_drain(struct zram *zram, struct zram_wb_ctl *ctl)
+{
+	struct zram_wb_req *req;
+
+	wait_event(ctl->wait, !atomic_read(&ctl->inflight));
+
+	/* commits whatever completed and recycles it into idle_reqs */
+	req = zram_wb_get_req(zram, ctl);
+	list_add(&req->entry, &ctl->idle_reqs);
+}
+
+/* Extend @req by the backing block right after it, if still free */
+static bool zram_wb_extend(struct zram *zram, struct zram_wb_req *req)
+{
+	unsigned long blk_idx = req->blk_idx + req->nr_pages;
+
+	if (req->nr_pages == ZRAM_WB_BATCH_PAGES || blk_idx >= zram->nr_pages)
+		return false;
+
+	if (test_and_set_bit(blk_idx, zram->bitmap))
+		return false;
+
+	atomic64_inc(&zram->stats.bd_count);
+	return true;
+}
+
+static bool zram_wb_candidate(struct zram *zram, u32 index, int mode)
+{
+	if (!zram_allocated(zram, index))
+		return false;
+
+	if (zram_test_flag(zram, index, ZRAM_WB) ||
+			zram_test_flag(zram, index, ZRAM_SAME) ||
+			zram_test_flag(zram, index, ZRAM_UNDER_WB))
+		return false;
+
+	if (mode == IDLE_WRITEBACK &&
+		  !zram_test_flag(zram, index, ZRAM_IDLE))
+		return false;
+	if (mode == HUGE_WRITEBACK &&
+		  !zram_test_flag(zram, index, ZRAM_HUGE))
+		return false;
+
+	return true;
+}
+
 static ssize_t writeback_store(struct device *dev,
 		struct device_attribute *attr, const char *buf, size_t len)
 {
 	struct zram *zram = dev_to_zram(dev);
 	unsigned long nr_pages = zram->disksize >> PAGE_SHIFT;
-	unsigned long index;
-	struct bio bio;
-	struct bio_vec bio_vec;
-	struct page *page;
+	unsigned long index, blk_idx, written;
+	struct zram_wb_ctl *ctl;
+	struct zram_wb_req *req;
+	ktime_t start;
 	ssize_t ret = len;
 	int mode;
-	unsigned long blk_idx = 0;
+	u64 ns;
 
 	if (sysfs_streq(buf, "idle"))
 		mode = IDLE_WRITEBACK;
@@ -651,50 +953,56 @@ static ssize_t writeback_store(struct device *dev,
 		goto release_init_lock;
 	}
 
-	page = alloc_page(GFP_KERNEL);
-	if (!page) {
+	ctl = zram_wb_ctl_alloc(READ_ONCE(zram->wb_queue_depth));
+	if (!ctl) {
 		ret = -ENOMEM;
 		goto release_init_lock;
 	}
 
+	start = ktime_get();
+	written = atomic64_read(&zram->stats.bd_writes);
+	req = zram_wb_get_req(zram, ctl);
+
 	for (index = 0; index < nr_pages; index++) {
 		struct bio_vec bvec;
 
-		bvec.bv_page = page;
-		bvec.bv_len = PAGE_SIZE;
-		bvec.bv_offset = 0;
+		zram_slot_lock(zram, index);
+		if (!zram_wb_candidate(zram, index, mode))
+			goto next;
+		zram_slot_unlock(zram, index);
 
+		/* reserve the writeback budget for this page up front */
 		spin_lock(&zram->wb_limit_lock);
 		if (zram->wb_limit_enable && !zram->bd_wb_limit) {
 			spin_unlock(&zram->wb_limit_lock);
 			ret = -EIO;
 			break;
 		}
+		if (zram->wb_limit_enable)
+			zram->bd_wb_limit -= 1UL << (PAGE_SHIFT - 12);
 		spin_unlock(&zram->wb_limit_lock);
 
-		if (!blk_idx) {
-			blk_idx = alloc_block_bdev(zram);
-			if (!blk_idx) {
+		/* keep the batch on contiguous blocks or start a new one */
+		if (req->nr_pages && !zram_wb_extend(zram, req)) {
+			zram_wb_submit(zram, ctl, req);
+			req = zram_wb_get_req(zram, ctl);
+		}
+		if (!req->nr_pages) {
+			req->blk_idx = alloc_block_bdev(zram);
+			if (!req->blk_idx) {
+				zram_wb_unreserve(zram);
 				ret = -ENOSPC;
 				break;
 			}
 		}
+		blk_idx = req->blk_idx + req->nr_pages;
 
+		/* the slot may have changed while the block was allocated */
 		zram_slot_lock(zram, index);
-		if (!zram_allocated(zram, index))
-			goto next;
-
-		if (zram_test_flag(zram, index, ZRAM_WB) ||
-				zram_test_flag(zram, index, ZRAM_SAME) ||
-				zram_test_flag(zram, index, ZRAM_UNDER_WB))
-			goto next;
-
-		if (mode == IDLE_WRITEBACK &&
-			  !zram_test_flag(zram, index, ZRAM_IDLE))
-			goto next;
-		if (mode == HUGE_WRITEBACK &&
-			  !zram_test_flag(zram, index, ZRAM_HUGE))
-			goto next;
+		if (!zram_wb_candidate(zram, index, mode)) {
+			zram_slot_unlock(zram, index);
+			goto release_block;
+		}
 		/*
 		 * Clearing ZRAM_UNDER_WB is duty of caller.
 		 * IOW, zram_free_page never clear it.
@@ -703,69 +1011,44 @@ static ssize_t writeback_store(struct device *dev,
 		/* Need for hugepage writeback racing */
 		zram_set_flag(zram, index, ZRAM_IDLE);
 		zram_slot_unlock(zram, index);
-		if (zram_bvec_read(zram, &bvec, index, 0, NULL)) {
-			zram_slot_lock(zram, index);
-			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
-			zram_clear_flag(zram, index, ZRAM_IDLE);
-			zram_slot_unlock(zram, index);
-			continue;
-		}
-
-		bio_init(&bio, &bio_vec, 1);
-		bio_set_dev(&bio, zram->bdev);
-		bio.bi_iter.bi_sector = blk_idx * (PAGE_SIZE >> 9);
-		bio.bi_opf = REQ_OP_WRITE | REQ_SYNC;
 
-		bio_add_page(&bio, bvec.bv_page, bvec.bv_len,
-				bvec.bv_offset);
-		/*
-		 * XXX: A single page IO would be inefficient for write
-		 * but it would be not bad as starter.
-		 */
-		ret = submit_bio_wait(&bio);
-		if (ret) {
+		bvec.bv_page = req->pages[req->nr_pages];
+		bvec.bv_len = PAGE_SIZE;
+		bvec.bv_offset = 0;
+		if (zram_bvec_read(zram, &bvec, index, 0, NULL)) {
 			zram_slot_lock(zram, index);
 			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
 			zram_clear_flag(zram, index, ZRAM_IDLE);
 			zram_slot_unlock(zram, index);
-			continue;
+			goto release_block;
 		}
 
-		atomic64_inc(&zram->stats.bd_writes);
-		/*
-		 * We released zram_slot_lock so need to check if the slot was
-		 * changed. If there is freeing for the slot, we can catch it
-		 * easily by zram_allocated.
-		 * A subtle case is the slot is freed/reallocated/marked as
-		 * ZRAM_IDLE again. To close the race, idle_store doesn't
-		 * mark ZRAM_IDLE once it found the slot was ZRAM_UNDER_WB.
-		 * Thus, we could close the race by checking ZRAM_IDLE bit.
-		 */
-		zram_slot_lock(zram, index);
-		if (!zram_allocated(zram, index) ||
-			  !zram_test_flag(zram, index, ZRAM_IDLE)) {
-			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
-			zram_clear_flag(zram, index, ZRAM_IDLE);
-			goto next;
-		}
+		req->index[req->nr_pages++] = index;
+		continue;
 
-		zram_free_page(zram, index);
-		zram_clear_flag(zram, index, ZRAM_UNDER_WB);
-		zram_set_flag(zram, index, ZRAM_WB);
-		zram_set_element(zram, index, blk_idx);
-		blk_idx = 0;
-		atomic64_inc(&zram->stats.pages_stored);
-		spin_lock(&zram->wb_limit_lock);
-		if (zram->wb_limit_enable && zram->bd_wb_limit > 0)
-			zram->bd_wb_limit -=  1UL << (PAGE_SHIFT - 12);
-		spin_unlock(&zram->wb_limit_lock);
+release_block:
+		/* blocks are only handed out from the tail of the batch */
+		free_block_bdev(zram, blk_idx);
+		zram_wb_unreserve(zram);
+		continue;
 next:
 		zram_slot_unlock(zram, index);
 	}
 
-	if (blk_idx)
-		free_block_bdev(zram, blk_idx);
-	__free_page(page);
+	if (req->nr_pages)
+		zram_wb_submit(zram, ctl, req);
+	else
+		list_add(&req->entry, &ctl->idle_reqs);
+
+	zram_wb_drain(zram, ctl);
+	zram_wb_ctl_free(ctl);
+
+	written = atomic64_read(&zram->stats.bd_writes) - written;
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	if (written && ns)
+		zram->wb_pages_per_sec = div64_u64((u64)written * NSEC_PER_SEC,
+						   ns);
+
 release_init_lock:
 	up_read(&zram->init_lock);
 
@@ -971,24 +1254,104 @@ static ssize_t max_comp_streams_store(struct device *dev,
 	return len;
 }
 
-static ssize_t comp_algorithm_show(struct device *dev,
+static ssize_t comp_algorithm_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	size_t sz;
+	struct zram *zram = dev_to_zram(dev);
+
+	down_read(&zram->init_lock);
+	sz = zcomp_available_show(zram->compressor, buf);
+	up_read(&zram->init_lock);
+
+	return sz;
+}
+
+static ssize_t comp_algorithm_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	char compressor[ARRAY_SIZE(zram->compressor)];
+	size_t sz;
+
+	strlcpy(compressor, buf, sizeof(compressor));
+	/* ignore trailing newline */
+	sz = strlen(compressor);
+	if (sz > 0 && compressor[sz - 1] == '\n')
+		compressor[sz - 1] = 0x00;
+
+	if (!zcomp_available_algorithm(compressor))
+		return -EINVAL;
+
+	down_write(&zram->init_lock);
+	if (init_done(zram)) {
+		up_write(&zram->init_lock);
+		pr_info("Can't change algorithm for initialized device\n");
+		return -EBUSY;
+	}
+
+	strcpy(zram->compressor, compressor);
+	up_write(&zram->init_lock);
+	return len;
+}
+
+#ifdef CONFIG_ZRAM_DEDUP
+static ssize_t use_dedup_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	bool val;
+
+	down_read(&zram->init_lock);
+	val = zram->use_dedup;
+	up_read(&zram->init_lock);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", (int)val);
+}
+
+static ssize_t use_dedup_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	bool val;
+
+	if (kstrtobool(buf, &val))
+		return -EINVAL;
+
+	down_write(&zram->init_lock);
+	if (init_done(zram)) {
+		up_write(&zram->init_lock);
+		pr_info("Can't change dedup usage for initialized device\n");
+		return -EBUSY;
+	}
+	zram->use_dedup = val;
+	up_write(&zram->init_lock);
+	return len;
+}
+#endif
+
+#ifdef CONFIG_ZRAM_RECOMPRESS
+#define IDLE_RECOMPRESS	1
+#define HUGE_RECOMPRESS	2
+
+static ssize_t recomp_algorithm_show(struct device *dev,
 		struct device_attribute *attr, char *buf)
 {
 	size_t sz;
 	struct zram *zram = dev_to_zram(dev);
 
 	down_read(&zram->init_lock);
-	sz = zcomp_available_show(zram->compressor, buf);
+	sz = zcomp_available_show(zram->recompressor, buf);
 	up_read(&zram->init_lock);
 
 	return sz;
 }
 
-static ssize_t comp_algorithm_store(struct device *dev,
+static ssize_t recomp_algorithm_store(struct device *dev,
 		struct device_attribute *attr, const char *buf, size_t len)
 {
 	struct zram *zram = dev_to_zram(dev);
-	char compressor[ARRAY_SIZE(zram->compressor)];
+	char compressor[ARRAY_SIZE(zram->recompressor)];
 	size_t sz;
 
 	strlcpy(compressor, buf, sizeof(compressor));
@@ -1007,11 +1370,163 @@ static ssize_t comp_algorithm_store(struct device *dev,
 		return -EBUSY;
 	}
 
-	strcpy(zram->compressor, compressor);
+	strcpy(zram->recompressor, compressor);
 	up_write(&zram->init_lock);
 	return len;
 }
 
+static bool zram_recomp_candidate(struct zram *zram, u32 index, int mode)
+{
+	if (!zram_get_handle(zram, index))
+		return false;
+
+	/* Shared objects are left alone, as are the ones already tried */
+	if (zram_test_flag(zram, index, ZRAM_SAME) ||
+	    zram_test_flag(zram, index, ZRAM_WB) ||
+	    zram_test_flag(zram, index, ZRAM_UNDER_WB) ||
+	    zram_test_flag(zram, index, ZRAM_DEDUP) ||
+	    zram_test_flag(zram, index, ZRAM_RECOMP) ||
+	    zram_test_flag(zram, index, ZRAM_INCOMPRESSIBLE))
+		return false;
+
+	if (mode == IDLE_RECOMPRESS)
+		return zram_test_flag(zram, index, ZRAM_IDLE);
+	return zram_test_flag(zram, index, ZRAM_HUGE);
+}
+
+/*
+ * Replace the object of a locked slot with one compressed by the secondary
+ * algorithm, if that is smaller.  @page is scratch space for the
+ * uncompressed data.
+ */
+static int zram_recompress(struct zram *zram, u32 index, struct page *page)
+{
+	unsigned long handle = zram_get_handle(zram, index);
+	unsigned int size = zram_get_obj_size(zram, index);
+	unsigned int comp_len;
+	unsigned long new_handle;
+	struct zcomp_strm *zstrm;
+	void *src, *dst;
+	int ret = 0;
+
+	src = zs_map_object(zram->mem_pool, handle, ZS_MM_RO);
+	dst = kmap_atomic(page);
+	if (size == PAGE_SIZE) {
+		memcpy(dst, src, PAGE_SIZE);
+	} else {
+		zstrm = zcomp_stream_get(zram->comp);
+		ret = zcomp_decompress(zstrm, src, size, dst);
+		zcomp_stream_put(zram->comp);
+	}
+	kunmap_atomic(dst);
+	zs_unmap_object(zram->mem_pool, handle);
+	if (ret)
+		return ret;
+
+	zstrm = zcomp_stream_get(zram->recomp);
+	src = kmap_atomic(page);
+	ret = zcomp_compress(zstrm, src, &comp_len);
+	kunmap_atomic(src);
+	if (ret)
+		goto out;
+
+	if (comp_len >= size || comp_len >= huge_class_size) {
+		zram_set_flag(zram, index, ZRAM_INCOMPRESSIBLE);
+		goto out;
+	}
+
+	/* The slot lock is held, so the allocation must not sleep */
+	new_handle = zs_malloc(zram->mem_pool, comp_len,
+			__GFP_KSWAPD_RECLAIM |
+			__GFP_NOWARN |
+			__GFP_HIGHMEM |
+			__GFP_MOVABLE);
+	if (!new_handle) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	dst = zs_map_object(zram->mem_pool, new_handle, ZS_MM_WO);
+	memcpy(dst, zstrm->buffer, comp_len);
+	zs_unmap_object(zram->mem_pool, new_handle);
+	zcomp_stream_put(zram->recomp);
+
+	/* Swap the object, the slot stays stored and keeps its flags */
+	zs_free(zram->mem_pool, handle);
+	atomic64_sub(size - comp_len, &zram->stats.compr_data_size);
+	if (zram_test_flag(zram, index, ZRAM_HUGE)) {
+		zram_clear_flag(zram, index, ZRAM_HUGE);
+		atomic64_dec(&zram->stats.huge_pages);
+	}
+	zram_set_flag(zram, index, ZRAM_RECOMP);
+	zram_set_handle(zram, index, new_handle);
+	zram_set_obj_size(zram, index, comp_len);
+	atomic64_inc(&zram->stats.recomp_pages);
+	atomic64_add(comp_len, &zram->stats.recomp_data_size);
+	return 0;
+
+out:
+	zcomp_stream_put(zram->recomp);
+	return ret;
+}
+
+static ssize_t recompress_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	unsigned long nr_pages = zram->disksize >> PAGE_SHIFT;
+	unsigned long index;
+	struct page *page;
+	ssize_t ret = len;
+	int mode;
+
+	if (sysfs_streq(buf, "idle"))
+		mode = IDLE_RECOMPRESS;
+	else if (sysfs_streq(buf, "huge"))
+		mode = HUGE_RECOMPRESS;
+	else
+		return -EINVAL;
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram)) {
+		ret = -EINVAL;
+		goto release_init_lock;
+	}
+
+	if (!zram->recomp) {
+		ret = -ENODEV;
+		goto release_init_lock;
+	}
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page) {
+		ret = -ENOMEM;
+		goto release_init_lock;
+	}
+
+	for (index = 0; index < nr_pages; index++) {
+		int err = 0;
+
+		zram_slot_lock(zram, index);
+		if (zram_recomp_candidate(zram, index, mode))
+			err = zram_recompress(zram, index, page);
+		zram_slot_unlock(zram, index);
+
+		if (err) {
+			ret = err;
+			break;
+		}
+		cond_resched();
+	}
+
+	__free_page(page);
+release_init_lock:
+	up_read(&zram->init_lock);
+
+	return ret;
+}
+#endif
+
 static ssize_t compact_store(struct device *dev,
 		struct device_attribute *attr, const char *buf, size_t len)
 {
@@ -1029,6 +1544,29 @@ static ssize_t compact_store(struct device *dev,
 	return len;
 }
 
+static ssize_t read_parallel_pages_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	unsigned int val;
+
+	if (kstrtouint(buf, 10, &val))
+		return -EINVAL;
+
+	WRITE_ONCE(zram->read_parallel_pages, val);
+
+	return len;
+}
+
+static ssize_t read_parallel_pages_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%u\n",
+			 READ_ONCE(zram->read_parallel_pages));
+}
+
 static ssize_t io_stat_show(struct device *dev,
 		struct device_attribute *attr, char *buf)
 {
@@ -1068,7 +1606,7 @@ static ssize_t mm_stat_show(struct device *dev,
 	max_used = atomic_long_read(&zram->stats.max_used_pages);
 
 	ret = scnprintf(buf, PAGE_SIZE,
-			"%8llu %8llu %8llu %8lu %8ld %8llu %8lu %8llu\n",
+			"%8llu %8llu %8llu %8lu %8ld %8llu %8lu %8llu %8llu %8llu %8llu %8llu\n",
 			orig_size << PAGE_SHIFT,
 			(u64)atomic64_read(&zram->stats.compr_data_size),
 			mem_used << PAGE_SHIFT,
@@ -1076,7 +1614,11 @@ static ssize_t mm_stat_show(struct device *dev,
 			max_used << PAGE_SHIFT,
 			(u64)atomic64_read(&zram->stats.same_pages),
 			pool_stats.pages_compacted,
-			(u64)atomic64_read(&zram->stats.huge_pages));
+			(u64)atomic64_read(&zram->stats.huge_pages),
+			(u64)atomic64_read(&zram->stats.dup_data_size),
+			(u64)atomic64_read(&zram->stats.meta_data_size),
+			(u64)atomic64_read(&zram->stats.recomp_pages),
+			(u64)atomic64_read(&zram->stats.recomp_data_size));
 	up_read(&zram->init_lock);
 
 	return ret;
@@ -1092,10 +1634,12 @@ static ssize_t bd_stat_show(struct device *dev,
 
 	down_read(&zram->init_lock);
 	ret = scnprintf(buf, PAGE_SIZE,
-		"%8llu %8llu %8llu\n",
+		"%8llu %8llu %8llu %8llu %8llu\n",
 			FOUR_K((u64)atomic64_read(&zram->stats.bd_count)),
 			FOUR_K((u64)atomic64_read(&zram->stats.bd_reads)),
-			FOUR_K((u64)atomic64_read(&zram->stats.bd_writes)));
+			FOUR_K((u64)atomic64_read(&zram->stats.bd_writes)),
+			(u64)atomic64_read(&zram->stats.bd_wb_batches),
+			FOUR_K(zram->wb_pages_per_sec));
 	up_read(&zram->init_lock);
 
 	return ret;
@@ -1120,12 +1664,37 @@ static ssize_t debug_stat_show(struct device *dev,
 	return ret;
 }
 
+static ssize_t read_stat_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	u64 reads, read_ns, works, queue_ns;
+	ssize_t ret;
+
+	down_read(&zram->init_lock);
+	reads = atomic64_read(&zram->stats.num_reads);
+	read_ns = atomic64_read(&zram->stats.read_ns);
+	works = atomic64_read(&zram->stats.par_read_works);
+	queue_ns = atomic64_read(&zram->stats.read_queue_ns);
+	ret = scnprintf(buf, PAGE_SIZE,
+			"%8llu %8llu %8llu %8llu %8llu\n",
+			(u64)atomic64_read(&zram->stats.par_reads),
+			(u64)atomic64_read(&zram->stats.par_read_pages),
+			reads ? div64_u64(read_ns, reads) : 0,
+			(u64)atomic64_read(&zram->stats.read_max_ns),
+			works ? div64_u64(queue_ns, works) : 0);
+	up_read(&zram->init_lock);
+
+	return ret;
+}
+
 static DEVICE_ATTR_RO(io_stat);
 static DEVICE_ATTR_RO(mm_stat);
 #ifdef CONFIG_ZRAM_WRITEBACK
 static DEVICE_ATTR_RO(bd_stat);
 #endif
 static DEVICE_ATTR_RO(debug_stat);
+static DEVICE_ATTR_RO(read_stat);
 
 static void zram_meta_free(struct zram *zram, u64 disksize)
 {
@@ -1136,6 +1705,7 @@ static void zram_meta_free(struct zram *zram, u64 disksize)
 	for (index = 0; index < num_pages; index++)
 		zram_free_page(zram, index);
 
+	zram_dedup_fini(zram);
 	zs_destroy_pool(zram->mem_pool);
 	vfree(zram->table);
 }
@@ -1155,6 +1725,12 @@ static bool zram_meta_alloc(struct zram *zram, u64 disksize)
 		return false;
 	}
 
+	if (zram_dedup_init(zram, num_pages)) {
+		zs_destroy_pool(zram->mem_pool);
+		vfree(zram->table);
+		return false;
+	}
+
 	if (!huge_class_size)
 		huge_class_size = zs_huge_class_size(zram->mem_pool);
 	return true;
@@ -1175,6 +1751,9 @@ static void zram_free_page(struct zram *zram, size_t index)
 	if (zram_test_flag(zram, index, ZRAM_IDLE))
 		zram_clear_flag(zram, index, ZRAM_IDLE);
 
+	if (zram_test_flag(zram, index, ZRAM_INCOMPRESSIBLE))
+		zram_clear_flag(zram, index, ZRAM_INCOMPRESSIBLE);
+
 	if (zram_test_flag(zram, index, ZRAM_HUGE)) {
 		zram_clear_flag(zram, index, ZRAM_HUGE);
 		atomic64_dec(&zram->stats.huge_pages);
@@ -1200,6 +1779,20 @@ static void zram_free_page(struct zram *zram, size_t index)
 	if (!handle)
 		return;
 
+	if (zram_test_flag(zram, index, ZRAM_DEDUP)) {
+		/* The last user frees the object and its accounting */
+		zram_clear_flag(zram, index, ZRAM_DEDUP);
+		zram_dedup_put(zram, (struct zram_entry *)handle);
+		goto out;
+	}
+
+	if (zram_test_flag(zram, index, ZRAM_RECOMP)) {
+		zram_clear_flag(zram, index, ZRAM_RECOMP);
+		atomic64_dec(&zram->stats.recomp_pages);
+		atomic64_sub(zram_get_obj_size(zram, index),
+				&zram->stats.recomp_data_size);
+	}
+
 	zs_free(zram->mem_pool, handle);
 
 	atomic64_sub(zram_get_obj_size(zram, index),
@@ -1248,6 +1841,8 @@ static int __zram_bvec_read(struct zram *zram, struct page *page, u32 index,
 	}
 
 	size = zram_get_obj_size(zram, index);
+	if (zram_test_flag(zram, index, ZRAM_DEDUP))
+		handle = ((struct zram_entry *)handle)->handle;
 
 	src = zs_map_object(zram->mem_pool, handle, ZS_MM_RO);
 	if (size == PAGE_SIZE) {
@@ -1256,12 +1851,13 @@ static int __zram_bvec_read(struct zram *zram, struct page *page, u32 index,
 		kunmap_atomic(dst);
 		ret = 0;
 	} else {
-		struct zcomp_strm *zstrm = zcomp_stream_get(zram->comp);
+		struct zcomp *comp = zram_slot_comp(zram, index);
+		struct zcomp_strm *zstrm = zcomp_stream_get(comp);
 
 		dst = kmap_atomic(page);
 		ret = zcomp_decompress(zstrm, src, size, dst);
 		kunmap_atomic(dst);
-		zcomp_stream_put(zram->comp);
+		zcomp_stream_put(comp);
 	}
 	zs_unmap_object(zram->mem_pool, handle);
 	zram_slot_unlock(zram, index);
@@ -1318,6 +1914,9 @@ static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 	struct page *page = bvec->bv_page;
 	unsigned long element = 0;
 	enum zram_pageflags flags = 0;
+	struct zram_entry *entry;
+	bool dedup = false;
+	u64 checksum = 0;
 
 	mem = kmap_atomic(page);
 	if (page_same_filled(mem, &element)) {
@@ -1327,6 +1926,18 @@ static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 		atomic64_inc(&zram->stats.same_pages);
 		goto out;
 	}
+	if (zram_dedup_enabled(zram)) {
+		checksum = zram_dedup_checksum(mem);
+		entry = zram_dedup_find(zram, mem, checksum);
+		if (entry) {
+			kunmap_atomic(mem);
+			/* Share the stored copy, no need to compress */
+			handle = (unsigned long)entry;
+			comp_len = entry->len;
+			dedup = true;
+			goto out;
+		}
+	}
 	kunmap_atomic(mem);
 
 compress_again:
@@ -1395,6 +2006,14 @@ static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 	zcomp_stream_put(zram->comp);
 	zs_unmap_object(zram->mem_pool, handle);
 	atomic64_add(comp_len, &zram->stats.compr_data_size);
+
+	if (zram_dedup_enabled(zram)) {
+		entry = zram_dedup_insert(zram, handle, comp_len, checksum);
+		if (entry) {
+			handle = (unsigned long)entry;
+			dedup = true;
+		}
+	}
 out:
 	/*
 	 * Free memory associated with this sector
@@ -1412,6 +2031,8 @@ static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 		zram_set_flag(zram, index, flags);
 		zram_set_element(zram, index, element);
 	}  else {
+		if (dedup)
+			zram_set_flag(zram, index, ZRAM_DEDUP);
 		zram_set_handle(zram, index, handle);
 		zram_set_obj_size(zram, index, comp_len);
 	}
@@ -1501,6 +2122,20 @@ static void zram_bio_discard(struct zram *zram, u32 index,
 	}
 }
 
+static void zram_read_account(struct zram *zram, u64 ns)
+{
+	s64 max = atomic64_read(&zram->stats.read_max_ns);
+
+	atomic64_add(ns, &zram->stats.read_ns);
+	while (ns > max) {
+		s64 old = atomic64_cmpxchg(&zram->stats.read_max_ns, max, ns);
+
+		if (old == max)
+			break;
+		max = old;
+	}
+}
+
 /*
  * Returns errno if it has some problem. Otherwise return 0 or 1.
  * Returns 0 if IO request was done synchronously
@@ -1517,9 +2152,12 @@ static int zram_bvec_rw(struct zram *zram, struct bio_vec *bvec, u32 index,
 			&zram->disk->part0);
 
 	if (!op_is_write(op)) {
+		u64 read_start = ktime_get_ns();
+
 		atomic64_inc(&zram->stats.num_reads);
 		ret = zram_bvec_read(zram, bvec, index, offset, bio);
 		flush_dcache_page(bvec->bv_page);
+		zram_read_account(zram, ktime_get_ns() - read_start);
 	} else {
 		atomic64_inc(&zram->stats.num_writes);
 		ret = zram_bvec_write(zram, bvec, index, offset, bio);
@@ -1541,6 +2179,195 @@ static int zram_bvec_rw(struct zram *zram, struct bio_vec *bvec, u32 index,
 	return ret;
 }
 
+struct zram_read_ctx;
+
+struct zram_read_work {
+	struct work_struct work;
+	struct zram_read_ctx *ctx;
+	struct bvec_iter iter;		/* first page of the chunk */
+	unsigned int nr_pages;
+};
+
+/*
+ * A read whose pages are decompressed by the read workers.  The last
+ * chunk to finish completes the bio, or the page for reads that came in
+ * through ->rw_page.
+ */
+struct zram_read_ctx {
+	struct zram *zram;
+	struct bio *bio;
+	struct page *page;
+	u32 index;
+	bool failed;
+	atomic_t pending;
+	u64 queued;
+	struct zram_read_work works[];
+};
+
+static void zram_read_put(struct zram_read_ctx *ctx)
+{
+	if (!atomic_dec_and_test(&ctx->pending))
+		return;
+
+	if (ctx->bio) {
+		if (READ_ONCE(ctx->failed))
+			bio_io_error(ctx->bio);
+		else
+			bio_endio(ctx->bio);
+	} else if (ctx->page) {
+		page_endio(ctx->page, false, ctx->failed ? -EIO : 0);
+	}
+	kfree(ctx);
+}
+
+static void zram_read_chunk(struct zram_read_work *rw)
+{
+	struct zram_read_ctx *ctx = rw->ctx;
+	struct zram *zram = ctx->zram;
+	unsigned int left = rw->nr_pages;
+	struct bvec_iter iter;
+	struct bio_vec bv;
+	u32 index;
+	int ret;
+
+	if (!ctx->bio) {
+		bv.bv_page = ctx->page;
+		bv.bv_len = PAGE_SIZE;
+		bv.bv_offset = 0;
+
+		ret = zram_bvec_rw(zram, &bv, ctx->index, 0, REQ_OP_READ, NULL);
+		/* A read from the backing device completes the page itself */
+		if (ret == 1)
+			ctx->page = NULL;
+		else if (ret < 0)
+			ctx->failed = true;
+		goto out;
+	}
+
+	index = rw->iter.bi_sector >> SECTORS_PER_PAGE_SHIFT;
+	__bio_for_each_segment(bv, ctx->bio, iter, rw->iter) {
+		if (zram_bvec_rw(zram, &bv, index++, 0, REQ_OP_READ,
+				 ctx->bio) < 0) {
+			WRITE_ONCE(ctx->failed, true);
+			break;
+		}
+		if (!--left)
+			break;
+	}
+out:
+	zram_read_put(ctx);
+}
+
+static void zram_read_work_fn(struct work_struct *work)
+{
+	struct zram_read_work *rw = container_of(work, struct zram_read_work,
+						 work);
+	struct zram *zram = rw->ctx->zram;
+
+	atomic64_add(ktime_get_ns() - rw->ctx->queued,
+		     &zram->stats.read_queue_ns);
+	atomic64_add(rw->nr_pages, &zram->stats.par_read_pages);
+	zram_read_chunk(rw);
+}
+
+/*
+ * Split a read of at least read_parallel_pages whole pages into chunks,
+ * queue all but the first to the read workers and decompress the first
+ * one here.  Returns false if the bio should be read synchronously.
+ */
+static bool zram_read_parallel(struct zram *zram, struct bio *bio)
+{
+	unsigned int threshold = READ_ONCE(zram->read_parallel_pages);
+	unsigned int nr_pages, nr_chunks, per_chunk, i = 0, n = 0;
+	struct zram_read_ctx *ctx;
+	struct bvec_iter iter;
+	struct bio_vec bv;
+
+	nr_pages = bio->bi_iter.bi_size >> PAGE_SHIFT;
+	if (!threshold || nr_pages < threshold)
+		return false;
+
+	/* Partial pages need a bounce page, leave them to the slow path */
+	if (bio->bi_iter.bi_sector & (SECTORS_PER_PAGE - 1))
+		return false;
+	bio_for_each_segment(bv, bio, iter) {
+		if (bv.bv_len != PAGE_SIZE)
+			return false;
+	}
+
+	nr_chunks = min3(DIV_ROUND_UP(nr_pages, ZRAM_READ_CHUNK_PAGES),
+			 num_online_cpus(), (unsigned int)ZRAM_READ_MAX_CHUNKS);
+	if (nr_chunks < 2)
+		return false;
+	per_chunk = DIV_ROUND_UP(nr_pages, nr_chunks);
+	nr_chunks = DIV_ROUND_UP(nr_pages, per_chunk);
+
+	ctx = kmalloc(struct_size(ctx, works, nr_chunks),
+		      GFP_NOIO | __GFP_NOWARN);
+	if (!ctx)
+		return false;
+
+	ctx->zram = zram;
+	ctx->bio = bio;
+	ctx->page = NULL;
+	ctx->failed = false;
+	atomic_set(&ctx->pending, nr_chunks);
+
+	bio_for_each_segment(bv, bio, iter) {
+		if (n++ % per_chunk)
+			continue;
+		ctx->works[i].ctx = ctx;
+		ctx->works[i].iter = iter;
+		ctx->works[i].nr_pages = min(per_chunk, nr_pages - n + 1);
+		i++;
+	}
+
+	atomic64_inc(&zram->stats.par_reads);
+	atomic64_add(nr_chunks - 1, &zram->stats.par_read_works);
+	ctx->queued = ktime_get_ns();
+	for (i = 1; i < nr_chunks; i++) {
+		INIT_WORK(&ctx->works[i].work, zram_read_work_fn);
+		queue_work(zram_read_wq, &ctx->works[i].work);
+	}
+	zram_read_chunk(&ctx->works[0]);
+
+	return true;
+}
+
+/*
+ * Reads through ->rw_page come one page at a time, but those issued under
+ * a plug are part of a batch, e.g. swap readahead.  Hand them to the read
+ * workers so the batch is decompressed in parallel.
+ */
+static bool zram_read_page_async(struct zram *zram, struct page *page,
+				 u32 index)
+{
+	struct zram_read_ctx *ctx;
+
+	if (!READ_ONCE(zram->read_parallel_pages) || !current->plug)
+		return false;
+
+	ctx = kmalloc(struct_size(ctx, works, 1), GFP_NOIO | __GFP_NOWARN);
+	if (!ctx)
+		return false;
+
+	ctx->zram = zram;
+	ctx->bio = NULL;
+	ctx->page = page;
+	ctx->index = index;
+	ctx->failed = false;
+	atomic_set(&ctx->pending, 1);
+	ctx->works[0].ctx = ctx;
+	ctx->works[0].nr_pages = 1;
+	INIT_WORK(&ctx->works[0].work, zram_read_work_fn);
+
+	atomic64_inc(&zram->stats.par_read_works);
+	ctx->queued = ktime_get_ns();
+	queue_work(zram_read_wq, &ctx->works[0].work);
+
+	return true;
+}
+
 static void __zram_make_request(struct zram *zram, struct bio *bio)
 {
 	int offset;
@@ -1558,6 +2385,10 @@ static void __zram_make_request(struct zram *zram, struct bio *bio)
 		zram_bio_discard(zram, index, offset, bio);
 		bio_endio(bio);
 		return;
+	case REQ_OP_READ:
+		if (zram_read_parallel(zram, bio))
+			return;
+		break;
 	default:
 		break;
 	}
@@ -1646,6 +2477,10 @@ static int zram_rw_page(struct block_device *bdev, sector_t sector,
 	index = sector >> SECTORS_PER_PAGE_SHIFT;
 	offset = (sector & (SECTORS_PER_PAGE - 1)) << SECTOR_SHIFT;
 
+	if (!op_is_write(op) && !offset &&
+	    zram_read_page_async(zram, page, index))
+		return 0;
+
 	bv.bv_page = page;
 	bv.bv_len = PAGE_SIZE;
 	bv.bv_offset = 0;
@@ -1702,6 +2537,12 @@ static void zram_reset_device(struct zram *zram)
 	zram_meta_free(zram, disksize);
 	memset(&zram->stats, 0, sizeof(zram->stats));
 	zcomp_destroy(comp);
+#ifdef CONFIG_ZRAM_RECOMPRESS
+	if (zram->recomp) {
+		zcomp_destroy(zram->recomp);
+		zram->recomp = NULL;
+	}
+#endif
 	reset_bdev(zram);
 }
 
@@ -1738,6 +2579,20 @@ static ssize_t disksize_store(struct device *dev,
 		goto out_free_meta;
 	}
 
+#ifdef CONFIG_ZRAM_RECOMPRESS
+	if (zram->recompressor[0]) {
+		zram->recomp = zcomp_create(zram->recompressor);
+		if (IS_ERR(zram->recomp)) {
+			pr_err("Cannot initialise %s compressing backend\n",
+					zram->recompressor);
+			err = PTR_ERR(zram->recomp);
+			zram->recomp = NULL;
+			zcomp_destroy(comp);
+			goto out_free_meta;
+		}
+	}
+#endif
+
 	zram->comp = comp;
 	zram->disksize = disksize;
 	set_capacity(zram->disk, zram->disksize >> SECTOR_SHIFT);
@@ -1830,11 +2685,20 @@ static DEVICE_ATTR_WO(mem_used_max);
 static DEVICE_ATTR_WO(idle);
 static DEVICE_ATTR_RW(max_comp_streams);
 static DEVICE_ATTR_RW(comp_algorithm);
+static DEVICE_ATTR_RW(read_parallel_pages);
+#ifdef CONFIG_ZRAM_DEDUP
+static DEVICE_ATTR_RW(use_dedup);
+#endif
+#ifdef CONFIG_ZRAM_RECOMPRESS
+static DEVICE_ATTR_RW(recomp_algorithm);
+static DEVICE_ATTR_WO(recompress);
+#endif
 #ifdef CONFIG_ZRAM_WRITEBACK
 static DEVICE_ATTR_RW(backing_dev);
 static DEVICE_ATTR_WO(writeback);
 static DEVICE_ATTR_RW(writeback_limit);
 static DEVICE_ATTR_RW(writeback_limit_enable);
+static DEVICE_ATTR_RW(writeback_queue_depth);
 #endif
 
 static struct attribute *zram_disk_attrs[] = {
@@ -1847,11 +2711,19 @@ static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_idle.attr,
 	&dev_attr_max_comp_streams.attr,
 	&dev_attr_comp_algorithm.attr,
+#ifdef CONFIG_ZRAM_DEDUP
+	&dev_attr_use_dedup.attr,
+#endif
+#ifdef CONFIG_ZRAM_RECOMPRESS
+	&dev_attr_recomp_algorithm.attr,
+	&dev_attr_recompress.attr,
+#endif
 #ifdef CONFIG_ZRAM_WRITEBACK
 	&dev_attr_backing_dev.attr,
 	&dev_attr_writeback.attr,
 	&dev_attr_writeback_limit.attr,
 	&dev_attr_writeback_limit_enable.attr,
+	&dev_attr_writeback_queue_depth.attr,
 #endif
 	&dev_attr_io_stat.attr,
 	&dev_attr_mm_stat.attr,
@@ -1859,6 +2731,8 @@ static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_bd_stat.attr,
 #endif
 	&dev_attr_debug_stat.attr,
+	&dev_attr_read_stat.attr,
+	&dev_attr_read_parallel_pages.attr,
 	NULL,
 };
 
@@ -1891,8 +2765,10 @@ static int zram_add(void)
 	device_id = ret;
 
 	init_rwsem(&zram->init_lock);
+	zram->read_parallel_pages = ZRAM_READ_PARALLEL_PAGES;
 #ifdef CONFIG_ZRAM_WRITEBACK
 	spin_lock_init(&zram->wb_limit_lock);
+	zram->wb_queue_depth = ZRAM_WB_QUEUE_DEPTH;
 #endif
 	queue = blk_alloc_queue(GFP_KERNEL);
 	if (!queue) {
@@ -2086,21 +2962,31 @@ static void destroy_devices(void)
 	idr_destroy(&zram_index_idr);
 	unregister_blkdev(zram_major, "zram");
 	cpuhp_remove_multi_state(CPUHP_ZCOMP_PREPARE);
+	destroy_workqueue(zram_read_wq);
 }
 
 static int __init zram_init(void)
 {
 	int ret;
 
+	zram_read_wq = alloc_workqueue("zram_read",
+				       WQ_UNBOUND | WQ_HIGHPRI | WQ_MEM_RECLAIM,
+				       0);
+	if (!zram_read_wq)
+		return -ENOMEM;
+
 	ret = cpuhp_setup_state_multi(CPUHP_ZCOMP_PREPARE, "block/zram:prepare",
 				      zcomp_cpu_up_prepare, zcomp_cpu_dead);
-	if (ret < 0)
+	if (ret < 0) {
+		destroy_workqueue(zram_read_wq);
 		return ret;
+	}
 
 	ret = class_register(&zram_control_class);
 	if (ret) {
 		pr_err("Unable to register zram-control class\n");
 		cpuhp_remove_multi_state(CPUHP_ZCOMP_PREPARE);
+		destroy_workqueue(zram_read_wq);
 		return ret;
 	}
 
@@ -2110,6 +2996,7 @@ static int __init zram_init(void)
 		pr_err("Unable to get major number\n");
 		class_unregister(&zram_control_class);
 		cpuhp_remove_multi_state(CPUHP_ZCOMP_PREPARE);
+		destroy_workqueue(zram_read_wq);
 		return -EBUSY;
 	}
 
@@ -20,6 +20,7 @@
 #include <linux/crypto.h>
 
 #include "zcomp.h"
+#include "zram_dedup.h"
 
 #define SECTORS_PER_PAGE_SHIFT	(PAGE_SHIFT - SECTOR_SHIFT)
 #define SECTORS_PER_PAGE	(1 << SECTORS_PER_PAGE_SHIFT)
@@ -28,6 +29,15 @@
 #define ZRAM_SECTOR_PER_LOGICAL_BLOCK	\
 	(1 << (ZRAM_LOGICAL_BLOCK_SHIFT - SECTOR_SHIFT))
 
+#define ZRAM_WB_QUEUE_DEPTH	8
+#define ZRAM_WB_MAX_QUEUE_DEPTH	64
+
+/* Read bios of at least this many pages are decompressed in parallel */
+#define ZRAM_READ_PARALLEL_PAGES	8
+/* Smallest and largest number of chunks a parallel read is split into */
+#define ZRAM_READ_CHUNK_PAGES	4
+#define ZRAM_READ_MAX_CHUNKS	16
+
 
 /*
  * The lower ZRAM_FLAG_SHIFT bits of table.flags is for
@@ -50,6 +60,9 @@ enum zram_pageflags {
 	ZRAM_UNDER_WB,	/* page is under writeback */
 	ZRAM_HUGE,	/* Incompressible page */
 	ZRAM_IDLE,	/* not accessed page since last idle marking */
+	ZRAM_DEDUP,	/* handle points to a shared zram_entry */
+	ZRAM_RECOMP,	/* compressed with the secondary algorithm */
+	ZRAM_INCOMPRESSIBLE,	/* recompression did not shrink the page */
 
 	__NR_ZRAM_PAGEFLAGS,
 };
@@ -82,10 +95,21 @@ struct zram_stats {
 	atomic_long_t max_used_pages;	/* no. of maximum pages stored */
 	atomic64_t writestall;		/* no. of write slow paths */
 	atomic64_t miss_free;		/* no. of missed free */
+	atomic64_t dup_data_size;	/* compressed bytes saved by dedup */
+	atomic64_t meta_data_size;	/* size of zram_entries */
+	atomic64_t recomp_pages;	/* no. of pages stored recompressed */
+	atomic64_t recomp_data_size;	/* compressed size of those pages */
+	atomic64_t par_reads;		/* no. of reads done in parallel */
+	atomic64_t par_read_pages;	/* no. of pages read by workers */
+	atomic64_t par_read_works;	/* no. of read works queued */
+	atomic64_t read_queue_ns;	/* time read works waited to run */
+	atomic64_t read_ns;		/* time spent reading pages */
+	atomic64_t read_max_ns;		/* longest single page read */
 #ifdef	CONFIG_ZRAM_WRITEBACK
 	atomic64_t bd_count;		/* no. of pages in backing device */
 	atomic64_t bd_reads;		/* no. of reads from backing device */
 	atomic64_t bd_writes;		/* no. of writes from backing device */
+	atomic64_t bd_wb_batches;	/* no. of writeback bios submitted */
 #endif
 };
 
@@ -93,6 +117,11 @@ struct zram {
 	struct zram_table_entry *table;
 	struct zs_pool *mem_pool;
 	struct zcomp *comp;
+#ifdef CONFIG_ZRAM_RECOMPRESS
+	/* stronger algorithm for pages that are recompressed */
+	struct zcomp *recomp;
+	char recompressor[CRYPTO_MAX_ALG_NAME];
+#endif
 	struct gendisk *disk;
 	/* Prevent concurrent execution of device init */
 	struct rw_semaphore init_lock;
@@ -112,6 +141,7 @@ struct zram {
 	 * zram is claimed so open request will be failed
 	 */
 	bool claim; /* Protected by bdev->bd_mutex */
+	unsigned int read_parallel_pages;	/* 0 disables parallel reads */
 	struct file *backing_dev;
 #ifdef CONFIG_ZRAM_WRITEBACK
 	spinlock_t wb_limit_lock;
@@ -121,9 +151,16 @@ struct zram {
 	unsigned int old_block_size;
 	unsigned long *bitmap;
 	unsigned long nr_pages;
+	unsigned int wb_queue_depth;	/* writeback bios kept in flight */
+	u64 wb_pages_per_sec;		/* rate of the last writeback */
 #endif
 #ifdef CONFIG_ZRAM_MEMORY_TRACKING
 	struct dentry *debugfs_dir;
 #endif
+#ifdef CONFIG_ZRAM_DEDUP
+	bool use_dedup;
+	struct zram_hash *hash;
+	size_t hash_size;
+#endif
 };
 #endif
@@ -1176,6 +1176,11 @@ static inline bool chain_epi_lockless(struct epitem *epi)
  * single wait queue is serialized by wq.lock, but the case when multiple wait
  * queues are used should be detected accordingly.  This is detected using
  * cmpxchg() operation.
+ *
+ * Wakeups the item isn't interested in are filtered out before the lock is
+ * taken.  ->event.events is updated by ep_modify() and ep_send_events_proc()
+ * without ep->lock anyway: ep_modify() polls the file itself after changing
+ * the mask, so an event we drop because of a stale mask isn't lost.
  */
 static int ep_poll_callback(wait_queue_entry_t *wait, unsigned mode, int sync, void *key)
 {
@@ -1183,11 +1188,10 @@ static int ep_poll_callback(wait_queue_entry_t *wait, unsigned mode, int sync, v
 	struct epitem *epi = ep_item_from_wait(wait);
 	struct eventpoll *ep = epi->ep;
 	__poll_t pollflags = key_to_poll(key);
+	__poll_t events = READ_ONCE(epi->event.events);
 	unsigned long flags;
 	int ewake = 0;
 
-	read_lock_irqsave(&ep->lock, flags);
-
 	ep_set_busy_poll_napi_id(epi);
 
 	/*
@@ -1196,8 +1200,8 @@ static int ep_poll_callback(wait_queue_entry_t *wait, unsigned mode, int sync, v
 	 * EPOLLONESHOT bit that disables the descriptor when an event is received,
 	 * until the next EPOLL_CTL_MOD will be issued.
 	 */
-	if (!(epi->event.events & ~EP_PRIVATE_BITS))
-		goto out_unlock;
+	if (!(events & ~EP_PRIVATE_BITS))
+		goto out;
 
 	/*
 	 * Check the events coming with the callback. At this stage, not
@@ -1205,8 +1209,10 @@ static int ep_poll_callback(wait_queue_entry_t *wait, unsigned mode, int sync, v
 	 * callback. We need to be able to handle both cases here, hence the
 	 * test for "key" != NULL before the event match test.
 	 */
-	if (pollflags && !(pollflags & epi->event.events))
-		goto out_unlock;
+	if (pollflags && !(pollflags & events))
+		goto out;
+
+	read_lock_irqsave(&ep->lock, flags);
 
 	/*
 	 * If we are transferring events to userspace, we can hold no locks
@@ -1260,7 +1266,8 @@ static int ep_poll_callback(wait_queue_entry_t *wait, unsigned mode, int sync, v
 	if (pwake)
 		ep_poll_safewake(&ep->poll_wait);
 
-	if (!(epi->event.events & EPOLLEXCLUSIVE))
+out:
+	if (!(events & EPOLLEXCLUSIVE))
 		ewake = 1;
 
 	if (pollflags & POLLFREE) {
@@ -1614,7 +1621,7 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi,
 	 * otherwise we might miss an event that happens between the
 	 * f_op->poll() call and the new event set registering.
 	 */
-	epi->event.events = event->events; /* need barrier below */
+	WRITE_ONCE(epi->event.events, event->events); /* need barrier below */
 	epi->event.data = event->data; /* protected by mtx */
 	if (epi->event.events & EPOLLWAKEUP) {
 		if (!ep_has_wakeup_source(epi))
@@ -1630,8 +1637,8 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi,
 	 *    we do not miss events from ep_poll_callback if an
 	 *    event occurs immediately after we call f_op->poll().
 	 *    We need this because we did not take ep->lock while
-	 *    changing epi above (but ep_poll_callback does take
-	 *    ep->lock).
+	 *    changing epi above, and ep_poll_callback checks the
+	 *    mask before taking ep->lock.
 	 *
 	 * 2) We also need to ensure we do not miss _past_ events
 	 *    when calling f_op->poll().  This barrier also
@@ -2080,30 +2087,16 @@ static inline int epoll_mutex_lock(struct mutex *mutex, int depth,
 	return -EAGAIN;
 }
 
-int do_epoll_ctl(int epfd, int op, int fd, struct epoll_event *epds,
-		 bool nonblock)
+/*
+ * Validate an epoll_ctl() request against the epoll file and the target
+ * file.  Nothing is locked yet, so only the files themselves are checked.
+ */
+static int ep_ctl_check(struct file *file, struct file *tfile, int op,
+			struct epoll_event *epds)
 {
-	int error;
-	int full_check = 0;
-	struct fd f, tf;
-	struct eventpoll *ep;
-	struct epitem *epi;
-	struct eventpoll *tep = NULL;
-
-	error = -EBADF;
-	f = fdget(epfd);
-	if (!f.file)
-		goto error_return;
-
-	/* Get the "struct file *" for the target file */
-	tf = fdget(fd);
-	if (!tf.file)
-		goto error_fput;
-
 	/* The target file descriptor must support poll */
-	error = -EPERM;
-	if (!file_can_poll(tf.file))
-		goto error_tgt_fput;
+	if (!file_can_poll(tfile))
+		return -EPERM;
 
 	/* Check if EPOLLWAKEUP is allowed */
 	if (ep_op_has_event(op))
@@ -2114,9 +2107,8 @@ int do_epoll_ctl(int epfd, int op, int fd, struct epoll_event *epds,
 	 * the user passed to us _is_ an eventpoll file. And also we do not permit
 	 * adding an epoll file descriptor inside itself.
 	 */
-	error = -EINVAL;
-	if (f.file == tf.file || !is_file_epoll(f.file))
-		goto error_tgt_fput;
+	if (file == tfile || !is_file_epoll(file))
+		return -EINVAL;
 
 	/*
 	 * epoll adds to the wakeup queue at EPOLL_CTL_ADD time only,
@@ -2125,83 +2117,46 @@ int do_epoll_ctl(int epfd, int op, int fd, struct epoll_event *epds,
 	 */
 	if (ep_op_has_event(op) && (epds->events & EPOLLEXCLUSIVE)) {
 		if (op == EPOLL_CTL_MOD)
-			goto error_tgt_fput;
-		if (op == EPOLL_CTL_ADD && (is_file_epoll(tf.file) ||
+			return -EINVAL;
+		if (op == EPOLL_CTL_ADD && (is_file_epoll(tfile) ||
 				(epds->events & ~EPOLLEXCLUSIVE_OK_BITS)))
-			goto error_tgt_fput;
+			return -EINVAL;
 	}
 
-	/*
-	 * At this point it is safe to assume that the "private_data" contains
-	 * our own data structure.
-	 */
-	ep = f.file->private_data;
+	return 0;
+}
 
-	/*
-	 * When we insert an epoll file descriptor, inside another epoll file
-	 * descriptor, there is the change of creating closed loops, which are
-	 * better be handled here, than in more critical paths. While we are
-	 * checking for loops we also determine the list of files reachable
-	 * and hang them on the tfile_check_list, so we can check that we
-	 * haven't created too many possible wakeup paths.
-	 *
-	 * We do not need to take the global 'epumutex' on EPOLL_CTL_ADD when
-	 * the epoll file descriptor is attaching directly to a wakeup source,
-	 * unless the epoll file descriptor is nested. The purpose of taking the
-	 * 'epmutex' on add is to prevent complex toplogies such as loops and
-	 * deep wakeup paths from forming in parallel through multiple
-	 * EPOLL_CTL_ADD operations.
-	 */
-	error = epoll_mutex_lock(&ep->mtx, 0, nonblock);
-	if (error)
-		goto error_tgt_fput;
-	if (op == EPOLL_CTL_ADD) {
-		if (!list_empty(&f.file->f_ep_links) ||
-						is_file_epoll(tf.file)) {
-			mutex_unlock(&ep->mtx);
-			error = epoll_mutex_lock(&epmutex, 0, nonblock);
-			if (error)
-				goto error_tgt_fput;
-			full_check = 1;
-			if (is_file_epoll(tf.file)) {
-				error = -ELOOP;
-				if (ep_loop_check(ep, tf.file) != 0) {
-					clear_tfile_check_list();
-					goto error_tgt_fput;
-				}
-			} else
-				list_add(&tf.file->f_tfile_llink,
-							&tfile_check_list);
-			error = epoll_mutex_lock(&ep->mtx, 0, nonblock);
-			if (error) {
-out_del:
-				list_del(&tf.file->f_tfile_llink);
-				goto error_tgt_fput;
-			}
-			if (is_file_epoll(tf.file)) {
-				tep = tf.file->private_data;
-				error = epoll_mutex_lock(&tep->mtx, 1, nonblock);
-				if (error) {
-					mutex_unlock(&ep->mtx);
-					goto out_del;
-				}
-			}
-		}
-	}
+/*
+ * Whether adding @tfile to the epoll @file has to go through the loop and
+ * wakeup path checks under "epmutex".  Called with "mtx" held.
+ */
+static bool ep_ctl_needs_full_check(struct file *file, struct file *tfile,
+				    int op)
+{
+	return op == EPOLL_CTL_ADD &&
+	       (!list_empty(&file->f_ep_links) || is_file_epoll(tfile));
+}
+
+/* Apply a validated epoll_ctl() request.  Called with "mtx" held. */
+static int ep_ctl_locked(struct eventpoll *ep, int op, struct file *tfile,
+			 int fd, struct epoll_event *epds, int full_check)
+{
+	struct epitem *epi;
+	int error;
 
 	/*
 	 * Try to lookup the file inside our RB tree, Since we grabbed "mtx"
 	 * above, we can be sure to be able to use the item looked up by
 	 * ep_find() till we release the mutex.
 	 */
-	epi = ep_find(ep, tf.file, fd);
+	epi = ep_find(ep, tfile, fd);
 
 	error = -EINVAL;
 	switch (op) {
 	case EPOLL_CTL_ADD:
 		if (!epi) {
 			epds->events |= EPOLLERR | EPOLLHUP;
-			error = ep_insert(ep, epds, tf.file, fd, full_check);
+			error = ep_insert(ep, epds, tfile, fd, full_check);
 		} else
 			error = -EEXIST;
 		if (full_check)
@@ -2223,14 +2178,100 @@ int do_epoll_ctl(int epfd, int op, int fd, struct epoll_event *epds,
 			error = -ENOENT;
 		break;
 	}
+
+	return error;
+}
+
+/* Take the locks a validated epoll_ctl() request needs and apply it. */
+static int ep_ctl_apply(struct file *file, struct file *tfile, int op, int fd,
+			struct epoll_event *epds, bool nonblock)
+{
+	struct eventpoll *ep = file->private_data;
+	struct eventpoll *tep = NULL;
+	int full_check = 0;
+	int error;
+
+	/*
+	 * When we insert an epoll file descriptor, inside another epoll file
+	 * descriptor, there is the change of creating closed loops, which are
+	 * better be handled here, than in more critical paths. While we are
+	 * checking for loops we also determine the list of files reachable
+	 * and hang them on the tfile_check_list, so we can check that we
+	 * haven't created too many possible wakeup paths.
+	 *
+	 * We do not need to take the global 'epumutex' on EPOLL_CTL_ADD when
+	 * the epoll file descriptor is attaching directly to a wakeup source,
+	 * unless the epoll file descriptor is nested. The purpose of taking the
+	 * 'epmutex' on add is to prevent complex toplogies such as loops and
+	 * deep wakeup paths from forming in parallel through multiple
+	 * EPOLL_CTL_ADD operations.
+	 */
+	error = epoll_mutex_lock(&ep->mtx, 0, nonblock);
+	if (error)
+		return error;
+	if (ep_ctl_needs_full_check(file, tfile, op)) {
+		mutex_unlock(&ep->mtx);
+		error = epoll_mutex_lock(&epmutex, 0, nonblock);
+		if (error)
+			return error;
+		full_check = 1;
+		if (is_file_epoll(tfile)) {
+			error = -ELOOP;
+			if (ep_loop_check(ep, tfile) != 0) {
+				clear_tfile_check_list();
+				goto out_epmutex;
+			}
+		} else
+			list_add(&tfile->f_tfile_llink, &tfile_check_list);
+		error = epoll_mutex_lock(&ep->mtx, 0, nonblock);
+		if (error) {
+out_del:
+			list_del(&tfile->f_tfile_llink);
+			goto out_epmutex;
+		}
+		if (is_file_epoll(tfile)) {
+			tep = tfile->private_data;
+			error = epoll_mutex_lock(&tep->mtx, 1, nonblock);
+			if (error) {
+				mutex_unlock(&ep->mtx);
+				goto out_del;
+			}
+		}
+	}
+
+	error = ep_ctl_locked(ep, op, tfile, fd, epds, full_check);
+
 	if (tep != NULL)
 		mutex_unlock(&tep->mtx);
 	mutex_unlock(&ep->mtx);
 
-error_tgt_fput:
+out_epmutex:
 	if (full_check)
 		mutex_unlock(&epmutex);
 
+	return error;
+}
+
+int do_epoll_ctl(int epfd, int op, int fd, struct epoll_event *epds,
+		 bool nonblock)
+{
+	int error;
+	struct fd f, tf;
+
+	error = -EBADF;
+	f = fdget(epfd);
+	if (!f.file)
+		goto error_return;
+
+	/* Get the "struct file *" for the target file */
+	tf = fdget(fd);
+	if (!tf.file)
+		goto error_fput;
+
+	error = ep_ctl_check(f.file, tf.file, op, epds);
+	if (!error)
+		error = ep_ctl_apply(f.file, tf.file, op, fd, epds, nonblock);
+
 	fdput(tf);
 error_fput:
 	fdput(f);
@@ -2256,6 +2297,110 @@ SYSCALL_DEFINE4(epoll_ctl, int, epfd, int, op, int, fd,
 	return do_epoll_ctl(epfd, op, fd, &epds, false);
 }
 
+static int ep_ctl_batch_one(struct file *file, struct epoll_ctl_batch_cmd *cmd,
+			    bool *locked)
+{
+	struct eventpoll *ep = file->private_data;
+	struct epoll_event epds;
+	struct fd tf;
+	int error;
+
+	epds.events = cmd->events;
+	epds.data = cmd->data;
+
+	tf = fdget(cmd->fd);
+	if (!tf.file)
+		return -EBADF;
+
+	error = ep_ctl_check(file, tf.file, cmd->op, &epds);
+	if (error)
+		goto out_fput;
+
+	if (!*locked) {
+		mutex_lock(&ep->mtx);
+		*locked = true;
+	}
+	if (!ep_ctl_needs_full_check(file, tf.file, cmd->op)) {
+		error = ep_ctl_locked(ep, cmd->op, tf.file, cmd->fd, &epds, 0);
+	} else {
+		/* "epmutex" nests outside of "mtx", start over for this one */
+		mutex_unlock(&ep->mtx);
+		*locked = false;
+		error = ep_ctl_apply(file, tf.file, cmd->op, cmd->fd, &epds,
+				     false);
+	}
+
+out_fput:
+	fdput(tf);
+	return error;
+}
+
+/*
+ * Apply an array of epoll_ctl() operations in order, holding "mtx" across
+ * all of them.  Processing stops at the first operation that fails.  The
+ * result of every operation that was attempted is stored in its ->result.
+ *
+ * Returns the number of operations that succeeded, including one whose
+ * ->result could not be stored, or the error of the first operation if
+ * none did.
+ */
+SYSCALL_DEFINE4(epoll_ctl_batch, int, epfd, unsigned int, flags,
+		unsigned int, ncmds, struct epoll_ctl_batch_cmd __user *, cmds)
+{
+	struct epoll_ctl_batch_cmd cmd;
+	struct eventpoll *ep;
+	bool locked = false;
+	unsigned int i = 0;
+	struct fd f;
+	int error;
+
+	if (flags || ncmds > EP_MAX_EVENTS)
+		return -EINVAL;
+	if (!ncmds)
+		return 0;
+
+	f = fdget(epfd);
+	if (!f.file)
+		return -EBADF;
+
+	error = -EINVAL;
+	if (!is_file_epoll(f.file))
+		goto error_fput;
+	ep = f.file->private_data;
+
+	for (i = 0; i < ncmds; i++) {
+		error = -EFAULT;
+		if (copy_from_user(&cmd, &cmds[i], sizeof(cmd)))
+			break;
+
+		error = ep_ctl_batch_one(f.file, &cmd, &locked);
+		if (put_user(error, &cmds[i].result)) {
+			/* Still count an applied operation we can't report */
+			if (!error)
+				i++;
+			error = -EFAULT;
+			break;
+		}
+		if (error)
+			break;
+
+		if (need_resched()) {
+			if (locked) {
+				mutex_unlock(&ep->mtx);
+				locked = false;
+			}
+			cond_resched();
+		}
+	}
+	if (locked)
+		mutex_unlock(&ep->mtx);
+
+error_fput:
+	fdput(f);
+
+	return i ? i : error;
+}
+
 /*
  * Implement the event wait interface for the eventpoll file. It is the kernel
  * part of the user space epoll_wait(2).
@@ -17,6 +17,7 @@
 #include <linux/pagemap.h>
 #include <linux/file.h>
 #include <linux/slab.h>
+#include <linux/percpu.h>
 #include <linux/pipe_fs_i.h>
 #include <linux/swap.h>
 #include <linux/splice.h>
@@ -190,8 +191,7 @@ EXPORT_SYMBOL_GPL(fuse_len_args);
 
 u64 fuse_get_unique(struct fuse_iqueue *fiq)
 {
-	fiq->reqctr += FUSE_REQ_ID_STEP;
-	return fiq->reqctr;
+	return atomic64_add_return(FUSE_REQ_ID_STEP, &fiq->reqctr);
 }
 EXPORT_SYMBOL_GPL(fuse_get_unique);
 
@@ -200,12 +200,47 @@ static unsigned int fuse_req_hash(u64 unique)
 	return hash_long(unique & ~FUSE_INT_REQ_BIT, FUSE_PQ_HASH_BITS);
 }
 
+/*
+ * A new request is available with per-CPU queues enabled.  Wake a reader
+ * sleeping on @cpu if there is one, else one on the nearest CPU that has
+ * one.  Only CPUs in fiq->reader_cpus are looked at.  Pollers, and readers
+ * that went to sleep before per-CPU queues were enabled, wait on
+ * fiq->waitq.
+ */
+static void fuse_dev_wake_cpu(struct fuse_iqueue *fiq,
+			      struct fuse_iqueue_cpu __percpu *queues, int cpu)
+{
+	int i;
+
+	/* Pairs with the barrier in prepare_to_wait() of the readers */
+	smp_mb();
+	for_each_cpu_wrap(i, fiq->reader_cpus, cpu) {
+		struct fuse_iqueue_cpu *iqc = per_cpu_ptr(queues, i);
+
+		if (waitqueue_active(&iqc->waitq)) {
+			wake_up(&iqc->waitq);
+			break;
+		}
+	}
+
+	if (waitqueue_active(&fiq->waitq))
+		wake_up(&fiq->waitq);
+	kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
+}
+
 /**
  * A new request is available, wake fiq->waitq
  */
 static void fuse_dev_wake_and_unlock(struct fuse_iqueue *fiq)
 __releases(fiq->lock)
 {
+	struct fuse_iqueue_cpu __percpu *queues = READ_ONCE(fiq->cpu_queues);
+
+	if (queues) {
+		spin_unlock(&fiq->lock);
+		fuse_dev_wake_cpu(fiq, queues, raw_smp_processor_id());
+		return;
+	}
 	wake_up(&fiq->waitq);
 	kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
 	spin_unlock(&fiq->lock);
@@ -218,13 +253,79 @@ const struct fuse_iqueue_ops fuse_dev_fiq_ops = {
 };
 EXPORT_SYMBOL_GPL(fuse_dev_fiq_ops);
 
+void fuse_iqueue_enable_percpu(struct fuse_iqueue *fiq)
+{
+	struct fuse_iqueue_cpu __percpu *queues;
+	int cpu;
+
+	if (fiq->ops != &fuse_dev_fiq_ops || fiq->cpu_queues)
+		return;
+
+	/* Without memory we just keep using the shared queue */
+	if (!zalloc_cpumask_var(&fiq->pending_cpus, GFP_KERNEL))
+		return;
+	if (!zalloc_cpumask_var(&fiq->reader_cpus, GFP_KERNEL))
+		goto out_free_pending;
+	queues = alloc_percpu(struct fuse_iqueue_cpu);
+	if (!queues)
+		goto out_free_readers;
+
+	for_each_possible_cpu(cpu) {
+		struct fuse_iqueue_cpu *iqc = per_cpu_ptr(queues, cpu);
+
+		spin_lock_init(&iqc->lock);
+		INIT_LIST_HEAD(&iqc->pending);
+		init_waitqueue_head(&iqc->waitq);
+		iqc->cpu = cpu;
+	}
+	/* Requests already on fiq->pending are still read from there */
+	smp_store_release(&fiq->cpu_queues, queues);
+	return;
+
+out_free_readers:
+	free_cpumask_var(fiq->reader_cpus);
+out_free_pending:
+	free_cpumask_var(fiq->pending_cpus);
+}
+
+/*
+ * Lock the input queue @req is going to be added to: the issuing CPU's
+ * queue if per-CPU queues are enabled, fiq->pending otherwise.  Either lock
+ * orders against fuse_abort_conn() for the fiq->connected check.
+ */
+static void fuse_pending_lock(struct fuse_iqueue *fiq, struct fuse_req *req)
+{
+	struct fuse_iqueue_cpu __percpu *queues = READ_ONCE(fiq->cpu_queues);
+
+	if (queues) {
+		req->iqc = raw_cpu_ptr(queues);
+		spin_lock(&req->iqc->lock);
+	} else {
+		req->iqc = NULL;
+		spin_lock(&fiq->lock);
+	}
+}
+
+static void fuse_pending_unlock(struct fuse_iqueue *fiq, struct fuse_req *req)
+{
+	spin_unlock(req->iqc ? &req->iqc->lock : &fiq->lock);
+}
+
 static void queue_request_and_unlock(struct fuse_iqueue *fiq,
 				     struct fuse_req *req)
-__releases(fiq->lock)
 {
 	req->in.h.len = sizeof(struct fuse_in_header) +
 		fuse_len_args(req->args->in_numargs,
 			      (struct fuse_arg *) req->args->in_args);
+	if (req->iqc) {
+		int cpu = req->iqc->cpu;
+
+		list_add_tail(&req->list, &req->iqc->pending);
+		cpumask_set_cpu(cpu, fiq->pending_cpus);
+		spin_unlock(&req->iqc->lock);
+		fuse_dev_wake_cpu(fiq, fiq->cpu_queues, cpu);
+		return;
+	}
 	list_add_tail(&req->list, &fiq->pending);
 	fiq->ops->wake_pending_and_unlock(fiq);
 }
@@ -259,7 +360,7 @@ static void flush_bg_queue(struct fuse_conn *fc)
 		req = list_first_entry(&fc->bg_queue, struct fuse_req, list);
 		list_del(&req->list);
 		fc->active_background++;
-		spin_lock(&fiq->lock);
+		fuse_pending_lock(fiq, req);
 		req->in.h.unique = fuse_get_unique(fiq);
 		queue_request_and_unlock(fiq, req);
 	}
@@ -362,6 +463,7 @@ static int queue_interrupt(struct fuse_iqueue *fiq, struct fuse_req *req)
 static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 {
 	struct fuse_iqueue *fiq = &fc->iq;
+	spinlock_t *pending_lock = req->iqc ? &req->iqc->lock : &fiq->lock;
 	int err;
 
 	if (!fc->no_interrupt) {
@@ -385,16 +487,20 @@ static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 		if (!err)
 			return;
 
-		spin_lock(&fiq->lock);
+		/* Readers clear FR_PENDING under the lock of the queue */
+		spin_lock(pending_lock);
 		/* Request is not yet in userspace, bail out */
 		if (test_bit(FR_PENDING, &req->flags)) {
 			list_del(&req->list);
-			spin_unlock(&fiq->lock);
+			if (req->iqc && list_empty(&req->iqc->pending))
+				cpumask_clear_cpu(req->iqc->cpu,
+						  fiq->pending_cpus);
+			spin_unlock(pending_lock);
 			__fuse_put_request(req);
 			req->out.h.error = -EINTR;
 			return;
 		}
-		spin_unlock(&fiq->lock);
+		spin_unlock(pending_lock);
 	}
 
 	/*
@@ -409,9 +515,9 @@ static void __fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
 	struct fuse_iqueue *fiq = &fc->iq;
 
 	BUG_ON(test_bit(FR_BACKGROUND, &req->flags));
-	spin_lock(&fiq->lock);
-	if (!fiq->connected) {
-		spin_unlock(&fiq->lock);
+	fuse_pending_lock(fiq, req);
+	if (!READ_ONCE(fiq->connected)) {
+		fuse_pending_unlock(fiq, req);
 		req->out.h.error = -ENOTCONN;
 	} else {
 		req->in.h.unique = fuse_get_unique(fiq);
@@ -585,12 +691,12 @@ static int fuse_simple_notify_reply(struct fuse_conn *fc,
 
 	fuse_args_to_req(req, args);
 
-	spin_lock(&fiq->lock);
-	if (fiq->connected) {
+	fuse_pending_lock(fiq, req);
+	if (READ_ONCE(fiq->connected)) {
 		queue_request_and_unlock(fiq, req);
 	} else {
 		err = -ENODEV;
-		spin_unlock(&fiq->lock);
+		fuse_pending_unlock(fiq, req);
 		fuse_put_request(fc, req);
 	}
 
@@ -1164,6 +1270,108 @@ __releases(fiq->lock)
 		return fuse_read_batch_forget(fiq, cs, nbytes);
 }
 
+/*
+ * Readers take this many requests off their own CPU's queue before they
+ * look at the other CPUs first, so that requests issued on CPUs without a
+ * reader of their own are not starved by a busy local queue.
+ */
+#define FUSE_IQC_LOCAL_QUOTA	16
+
+static bool fuse_cpu_requests_pending(struct fuse_iqueue *fiq)
+{
+	if (!READ_ONCE(fiq->cpu_queues))
+		return false;
+
+	return !cpumask_empty(fiq->pending_cpus);
+}
+
+static struct fuse_req *fuse_dequeue_iqc(struct fuse_iqueue *fiq,
+					 struct fuse_iqueue_cpu *iqc,
+					 size_t limit)
+{
+	struct fuse_req *req;
+
+	spin_lock(&iqc->lock);
+	req = list_first_entry_or_null(&iqc->pending, struct fuse_req, list);
+	if (req && req->in.h.len <= limit) {
+		clear_bit(FR_PENDING, &req->flags);
+		list_del_init(&req->list);
+		if (list_empty(&iqc->pending))
+			cpumask_clear_cpu(iqc->cpu, fiq->pending_cpus);
+	} else {
+		req = NULL;
+	}
+	spin_unlock(&iqc->lock);
+
+	return req;
+}
+
+/*
+ * Take the oldest request no larger than @limit off the per-CPU queues,
+ * trying the reader's own CPU first unless it used up its quota.  Only
+ * CPUs in fiq->pending_cpus are looked at.
+ */
+static struct fuse_req *fuse_dequeue_cpu_request(struct fuse_iqueue *fiq,
+						 size_t limit)
+{
+	struct fuse_iqueue_cpu __percpu *queues = READ_ONCE(fiq->cpu_queues);
+	struct fuse_iqueue_cpu *local;
+	struct fuse_req *req;
+	int this_cpu, cpu;
+
+	if (!queues)
+		return NULL;
+
+	this_cpu = raw_smp_processor_id();
+	local = per_cpu_ptr(queues, this_cpu);
+	if (cpumask_test_cpu(this_cpu, fiq->pending_cpus) &&
+	    this_cpu_inc_return(queues->local_reads) % FUSE_IQC_LOCAL_QUOTA) {
+		req = fuse_dequeue_iqc(fiq, local, limit);
+		if (req)
+			return req;
+	}
+
+	for_each_cpu_wrap(cpu, fiq->pending_cpus, this_cpu + 1) {
+		req = fuse_dequeue_iqc(fiq, per_cpu_ptr(queues, cpu), limit);
+		if (req)
+			return req;
+	}
+
+	return NULL;
+}
+
+/*
+ * Sleep on the reader's CPU queue, where requests issued on that CPU look
+ * first, or on fiq->waitq without per-CPU queues.
+ */
+static int fuse_wait_for_request(struct fuse_iqueue *fiq)
+{
+	struct fuse_iqueue_cpu __percpu *queues = READ_ONCE(fiq->cpu_queues);
+	struct fuse_iqueue_cpu *iqc;
+	int err;
+
+	if (!queues)
+		return wait_event_interruptible_exclusive(fiq->waitq,
+				!fiq->connected || request_pending(fiq));
+
+	iqc = raw_cpu_ptr(queues);
+	spin_lock(&iqc->lock);
+	if (!iqc->readers++)
+		cpumask_set_cpu(iqc->cpu, fiq->reader_cpus);
+	spin_unlock(&iqc->lock);
+
+	err = wait_event_interruptible_exclusive(iqc->waitq,
+			!fiq->connected || request_pending(fiq) ||
+			fuse_cpu_requests_pending(fiq));
+
+	spin_lock(&iqc->lock);
+	if (!--iqc->readers)
+		cpumask_clear_cpu(iqc->cpu, fiq->reader_cpus);
+	spin_unlock(&iqc->lock);
+
+	return err;
+}
+
 /*
  * Read a single request into the userspace filesystem's buffer.  This
  * function waits until a request is available, then removes it from
@@ -1172,54 +1380,57 @@ __releases(fiq->lock)
  * was an error during the copying then it's finished by calling
  * fuse_request_end().  Otherwise add it to the processing list, and set
  * the 'sent' flag.
+ *
+ * If @more, the buffer already holds earlier requests of a batched read:
+ * don't wait, and leave anything that doesn't fit in @nbytes queued.
+ * Interrupts and forgets end the batch, so the next read gets them first.
  */
-static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
-				struct fuse_copy_state *cs, size_t nbytes)
+static ssize_t fuse_dev_read_one(struct fuse_dev *fud, struct file *file,
+				 struct fuse_copy_state *cs, size_t nbytes,
+				 bool more)
 {
 	ssize_t err;
 	struct fuse_conn *fc = fud->fc;
 	struct fuse_iqueue *fiq = &fc->iq;
 	struct fuse_pqueue *fpq = &fud->pq;
+	size_t limit = more ? nbytes : SIZE_MAX;
 	struct fuse_req *req;
 	struct fuse_args *args;
 	unsigned reqsize;
 	unsigned int hash;
 
-	/*
-	 * Require sane minimum read buffer - that has capacity for fixed part
-	 * of any request header + negotiated max_write room for data.
-	 *
-	 * Historically libfuse reserves 4K for fixed header room, but e.g.
-	 * GlusterFS reserves only 80 bytes
-	 *
-	 *	= `sizeof(fuse_in_header) + sizeof(fuse_write_in)`
-	 *
-	 * which is the absolute minimum any sane filesystem should be using
-	 * for header room.
-	 */
-	if (nbytes < max_t(size_t, FUSE_MIN_READ_BUFFER,
-			   sizeof(struct fuse_in_header) +
-			   sizeof(struct fuse_write_in) +
-			   fc->max_write))
-		return -EINVAL;
-
  restart:
 	for (;;) {
-		spin_lock(&fiq->lock);
-		if (!fiq->connected || request_pending(fiq))
-			break;
-		spin_unlock(&fiq->lock);
+		if (!READ_ONCE(fiq->connected) || request_pending(fiq)) {
+			spin_lock(&fiq->lock);
+			if (!fiq->connected || request_pending(fiq))
+				break;
+			spin_unlock(&fiq->lock);
+		}
+
+		/* With per-CPU queues, regular requests don't need fiq->lock */
+		req = fuse_dequeue_cpu_request(fiq, limit);
+		if (req)
+			goto dequeued;
 
+		if (more)
+			return 0;
 		if (file->f_flags & O_NONBLOCK)
 			return -EAGAIN;
-		err = wait_event_interruptible_exclusive(fiq->waitq,
-				!fiq->connected || request_pending(fiq));
+		err = fuse_wait_for_request(fiq);
 		if (err)
 			return err;
 	}
 
 	if (!fiq->connected) {
 		err = fc->aborted ? -ECONNABORTED : -ENODEV;
+		if (more)
+			err = 0;
+		goto err_unlock;
+	}
+
+	if (more && (!list_empty(&fiq->interrupts) || forget_pending(fiq))) {
+		err = 0;
 		goto err_unlock;
 	}
 
@@ -1230,18 +1441,34 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 	}
 
 	if (forget_pending(fiq)) {
-		if (list_empty(&fiq->pending) || fiq->forget_batch-- > 0)
+		if ((list_empty(&fiq->pending) &&
+		     !fuse_cpu_requests_pending(fiq)) ||
+		    fiq->forget_batch-- > 0)
 			return fuse_read_forget(fc, fiq, cs, nbytes);
 
 		if (fiq->forget_batch <= -8)
 			fiq->forget_batch = 16;
 	}
 
+	if (list_empty(&fiq->pending)) {
+		/* Only forgets here, the requests are on the per-CPU queues */
+		spin_unlock(&fiq->lock);
+		req = fuse_dequeue_cpu_request(fiq, limit);
+		if (!req)
+			goto restart;
+		goto dequeued;
+	}
+
 	req = list_entry(fiq->pending.next, struct fuse_req, list);
+	if (req->in.h.len > limit) {
+		err = 0;
+		goto err_unlock;
+	}
 	clear_bit(FR_PENDING, &req->flags);
 	list_del_init(&req->list);
 	spin_unlock(&fiq->lock);
 
+ dequeued:
 	args = req->args;
 	reqsize = req->in.h.len;
 
@@ -1302,6 +1529,53 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 	return err;
 }
 
+static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
+				struct fuse_copy_state *cs, size_t nbytes)
+{
+	struct fuse_conn *fc = fud->fc;
+	ssize_t ret, total;
+
+	/*
+	 * Require sane minimum read buffer - that has capacity for fixed part
+	 * of any request header + negotiated max_write room for data.
+	 *
+	 * Historically libfuse reserves 4K for fixed header room, but e.g.
+	 * GlusterFS reserves only 80 bytes
+	 *
+	 *	= `sizeof(fuse_in_header) + sizeof(fuse_write_in)`
+	 *
+	 * which is the absolute minimum any sane filesystem should be using
+	 * for header room.
+	 */
+	if (nbytes < max_t(size_t, FUSE_MIN_READ_BUFFER,
+			   sizeof(struct fuse_in_header) +
+			   sizeof(struct fuse_write_in) +
+			   fc->max_write))
+		return -EINVAL;
+
+	total = fuse_dev_read_one(fud, file, cs, nbytes, false);
+	/* Splice read moves whole pages, only batch plain reads */
+	if (total <= 0 || !fc->batch_read || !cs->iter)
+		return total;
+
+	while (total < nbytes) {
+		/*
+		 * The copy grabbed a whole page of the buffer, give back what
+		 * it didn't use so the next request follows this one.  The
+		 * previous request may be gone already, don't unlock it again.
+		 */
+		iov_iter_revert(cs->iter, cs->len);
+		cs->len = 0;
+		cs->req = NULL;
+
+		ret = fuse_dev_read_one(fud, file, cs, nbytes - total, true);
+		if (ret <= 0)
+			break;
+		total += ret;
+	}
+	return total;
+}
+
 static int fuse_dev_open(struct inode *inode, struct file *file)
 {
 	/*
@@ -2037,7 +2311,7 @@ static __poll_t fuse_dev_poll(struct file *file, poll_table *wait)
 	spin_lock(&fiq->lock);
 	if (!fiq->connected)
 		mask = EPOLLERR;
-	else if (request_pending(fiq))
+	else if (request_pending(fiq) || fuse_cpu_requests_pending(fiq))
 		mask |= EPOLLIN | EPOLLRDNORM;
 	spin_unlock(&fiq->lock);
 
@@ -2057,6 +2331,33 @@ static void end_requests(struct fuse_conn *fc, struct list_head *head)
 	}
 }
 
+/*
+ * Move everything off the per-CPU queues and wake all readers.  Called after
+ * clearing fiq->connected, so nothing can be queued there anymore.
+ */
+static void fuse_abort_cpu_queues(struct fuse_iqueue *fiq,
+				  struct list_head *to_end)
+{
+	struct fuse_iqueue_cpu __percpu *queues = READ_ONCE(fiq->cpu_queues);
+	struct fuse_req *req;
+	int cpu;
+
+	if (!queues)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct fuse_iqueue_cpu *iqc = per_cpu_ptr(queues, cpu);
+
+		spin_lock(&iqc->lock);
+		list_for_each_entry(req, &iqc->pending, list)
+			clear_bit(FR_PENDING, &req->flags);
+		list_splice_tail_init(&iqc->pending, to_end);
+		cpumask_clear_cpu(cpu, fiq->pending_cpus);
+		spin_unlock(&iqc->lock);
+		wake_up_all(&iqc->waitq);
+	}
+}
+
 static void end_polls(struct fuse_conn *fc)
 {
 	struct rb_node *p;
@@ -2143,6 +2444,7 @@ void fuse_abort_conn(struct fuse_conn *fc)
 			kfree(fuse_dequeue_forget(fiq, 1, NULL));
 		wake_up_all(&fiq->waitq);
 		spin_unlock(&fiq->lock);
+		fuse_abort_cpu_queues(fiq, &to_end);
 		kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
 		end_polls(fc);
 		wake_up_all(&fc->blocked_waitq);
@@ -2219,42 +2521,68 @@ static int fuse_device_clone(struct fuse_conn *fc, struct file *new)
 	return 0;
 }
 
-static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
-			   unsigned long arg)
+static long fuse_dev_ioctl_clone(struct file *file, __u32 __user *argp)
 {
-	int err = -ENOTTY;
+	int err = -EFAULT;
+	int oldfd;
 
-	if (cmd == FUSE_DEV_IOC_CLONE) {
-		int oldfd;
+	if (!get_user(oldfd, argp)) {
+		struct file *old = fget(oldfd);
 
-		err = -EFAULT;
-		if (!get_user(oldfd, (__u32 __user *) arg)) {
-			struct file *old = fget(oldfd);
+		err = -EINVAL;
+		if (old) {
+			struct fuse_dev *fud = NULL;
 
-			err = -EINVAL;
-			if (old) {
-				struct fuse_dev *fud = NULL;
-
-				/*
-				 * Check against file->f_op because CUSE
-				 * uses the same ioctl handler.
-				 */
-				if (old->f_op == file->f_op &&
-				    old->f_cred->user_ns == file->f_cred->user_ns)
-					fud = fuse_get_dev(old);
-
-				if (fud) {
-					mutex_lock(&fuse_mutex);
-					err = fuse_device_clone(fud->fc, file);
-					mutex_unlock(&fuse_mutex);
-				}
-				fput(old);
+			/*
+			 * Check against file->f_op because CUSE
+			 * uses the same ioctl handler.
+			 */
+			if (old->f_op == file->f_op &&
+			    old->f_cred->user_ns == file->f_cred->user_ns)
+				fud = fuse_get_dev(old);
+
+			if (fud) {
+				mutex_lock(&fuse_mutex);
+				err = fuse_device_clone(fud->fc, file);
+				mutex_unlock(&fuse_mutex);
 			}
+			fput(old);
 		}
 	}
 	return err;
 }
 
+static long fuse_dev_ioctl_passthrough_open(struct file *file,
+					    void __user *argp)
+{
+	struct fuse_passthrough_map map;
+	struct fuse_dev *fud;
+
+	if (copy_from_user(&map, argp, sizeof(map)))
+		return -EFAULT;
+
+	fud = fuse_get_dev(file);
+	if (!fud)
+		return -EINVAL;
+
+	return fuse_passthrough_open(fud->fc, &map);
+}
+
+static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
+			   unsigned long arg)
+{
+	void __user *argp = (void __user *)arg;
+
+	switch (cmd) {
+	case FUSE_DEV_IOC_CLONE:
+		return fuse_dev_ioctl_clone(file, argp);
+	case FUSE_DEV_IOC_PASSTHROUGH_OPEN:
+		return fuse_dev_ioctl_passthrough_open(file, argp);
+	default:
+		return -ENOTTY;
+	}
+}
+
 const struct file_operations fuse_dev_operations = {
 	.owner		= THIS_MODULE,
 	.open		= fuse_dev_open,
@@ -31,6 +31,7 @@
 #include <linux/pid_namespace.h>
 #include <linux/refcount.h>
 #include <linux/user_namespace.h>
+#include <linux/idr.h>
 
 /** Default max number of pages that can be used in a single read request */
 #define FUSE_DEFAULT_MAX_PAGES_PER_REQ 32
@@ -163,6 +164,14 @@ enum {
 struct fuse_conn;
 struct fuse_release_args;
 
+/** Backing file that reads and writes are redirected to */
+struct fuse_passthrough {
+	struct file *filp;
+
+	/** Credentials of the daemon that registered @filp */
+	const struct cred *cred;
+};
+
 /** FUSE specific file data */
 struct fuse_file {
 	/** Fuse connection for this file */
@@ -186,6 +195,9 @@ struct fuse_file {
 	/** FOPEN_* flags returned by open */
 	u32 open_flags;
 
+	/** Backing file if opened with FOPEN_PASSTHROUGH */
+	struct fuse_passthrough passthrough;
+
 	/** Entry on inode's write_files list */
 	struct list_head write_entry;
 
@@ -353,6 +365,9 @@ struct fuse_req {
 	/** Used to wake up the task waiting for completion of request*/
 	wait_queue_head_t waitq;
 
+	/** Per-CPU input queue the request was queued on, if any */
+	struct fuse_iqueue_cpu *iqc;
+
 #if IS_ENABLED(CONFIG_VIRTIO_FS)
 	/** virtio-fs's physically contiguous buffer for in and out args */
 	void *argbuf;
@@ -397,6 +412,29 @@ struct fuse_iqueue_ops {
 /** /dev/fuse input queue operations */
 extern const struct fuse_iqueue_ops fuse_dev_fiq_ops;
 
+/**
+ * Per-CPU part of the /dev/fuse input queue (FUSE_PERCPU_QUEUES)
+ */
+struct fuse_iqueue_cpu {
+	/** Lock protecting @pending and @readers */
+	spinlock_t lock;
+
+	/** Requests issued on this CPU */
+	struct list_head pending;
+
+	/** Readers that went to sleep on this CPU */
+	wait_queue_head_t waitq;
+
+	/** Number of readers on @waitq */
+	unsigned int readers;
+
+	/** Reads on this CPU that tried this CPU's queue first */
+	unsigned int local_reads;
+
+	/** The CPU this queue belongs to */
+	int cpu;
+};
+
 struct fuse_iqueue {
 	/** Connection established */
 	unsigned connected;
@@ -408,11 +446,20 @@ struct fuse_iqueue {
 	wait_queue_head_t waitq;
 
 	/** The next unique request id */
-	u64 reqctr;
+	atomic64_t reqctr;
 
 	/** The list of pending requests */
 	struct list_head pending;
 
+	/** Per-CPU pending requests, if negotiated */
+	struct fuse_iqueue_cpu __percpu *cpu_queues;
+
+	/** CPUs with requests on their queue */
+	cpumask_var_t pending_cpus;
+
+	/** CPUs with readers sleeping on their queue */
+	cpumask_var_t reader_cpus;
+
 	/** Pending interrupts */
 	struct list_head interrupts;
 
@@ -607,6 +654,12 @@ struct fuse_conn {
 	/** cache READLINK responses in page cache */
 	unsigned cache_symlinks:1;
 
+	/** Fill reads of the device with as many requests as fit */
+	unsigned batch_read:1;
+
+	/** Can files be opened in passthrough mode? */
+	unsigned passthrough:1;
+
 	/*
 	 * The following bitfields are only for optimization purposes
 	 * and hence races in setting them will not cause malfunction
@@ -752,6 +805,9 @@ struct fuse_conn {
 
 	/** List of device instances belonging to this connection */
 	struct list_head devices;
+
+	/** Backing files registered for passthrough, protected by lock */
+	struct idr passthrough_req;
 };
 
 static inline struct fuse_conn *get_fuse_conn_super(struct super_block *sb)
@@ -1079,6 +1135,18 @@ int fuse_set_acl(struct inode *inode, struct posix_acl *acl, int type);
 /* readdir.c */
 int fuse_readdir(struct file *file, struct dir_context *ctx);
 
+/* passthrough.c */
+int fuse_passthrough_open(struct fuse_conn *fc,
+			  const struct fuse_passthrough_map *map);
+void fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_file *ff,
+			    const struct fuse_open_out *openarg,
+			    struct file *file);
+void fuse_passthrough_release(struct fuse_passthrough *passthrough);
+void fuse_passthrough_destroy(struct fuse_conn *fc);
+ssize_t fuse_passthrough_read_iter(struct kiocb *iocb, struct iov_iter *iter);
+ssize_t fuse_passthrough_write_iter(struct kiocb *iocb, struct iov_iter *iter);
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma);
+
 /**
  * Return the number of bytes in an arguments list
  */
@@ -1088,6 +1156,11 @@ unsigned int fuse_len_args(unsigned int numargs, struct fuse_arg *args);
  * Get the next unique ID for a request
  */
 u64 fuse_get_unique(struct fuse_iqueue *fiq);
+
+/**
+ * Queue requests on the issuing CPU from now on
+ */
+void fuse_iqueue_enable_percpu(struct fuse_iqueue *fiq);
 void fuse_free_conn(struct fuse_conn *fc);
 
 #endif /* _FS_FUSE_I_H */
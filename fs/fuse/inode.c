@@ -609,6 +609,7 @@ void fuse_conn_init(struct fuse_conn *fc, struct user_namespace *user_ns,
 	INIT_LIST_HEAD(&fc->bg_queue);
 	INIT_LIST_HEAD(&fc->entry);
 	INIT_LIST_HEAD(&fc->devices);
+	idr_init(&fc->passthrough_req);
 	atomic_set(&fc->num_waiting, 0);
 	fc->max_background = FUSE_DEFAULT_MAX_BACKGROUND;
 	fc->congestion_threshold = FUSE_DEFAULT_CONGESTION_THRESHOLD;
@@ -632,6 +633,10 @@ void fuse_conn_put(struct fuse_conn *fc)
 
 		if (fiq->ops->release)
 			fiq->ops->release(fiq);
+		free_percpu(fiq->cpu_queues);
+		free_cpumask_var(fiq->pending_cpus);
+		free_cpumask_var(fiq->reader_cpus);
+		fuse_passthrough_destroy(fc);
 		put_pid_ns(fc->pid_ns);
 		put_user_ns(fc->user_ns);
 		fc->release(fc);
@@ -941,6 +946,17 @@ static void process_init_reply(struct fuse_conn *fc, struct fuse_args *args,
 				fc->cache_symlinks = 1;
 			if (arg->flags & FUSE_ABORT_ERROR)
 				fc->abort_err = 1;
+			if (arg->flags & FUSE_PERCPU_QUEUES)
+				fuse_iqueue_enable_percpu(&fc->iq);
+			if (arg->flags & FUSE_BATCH_READ)
+				fc->batch_read = 1;
+			if ((arg->flags & FUSE_PASSTHROUGH) &&
+			    (ia->in.flags & FUSE_PASSTHROUGH)) {
+				fc->passthrough = 1;
+				/* Nothing may stack on top of us */
+				fc->sb->s_stack_depth =
+					FILESYSTEM_MAX_STACK_DEPTH;
+			}
 			if (arg->flags & FUSE_MAX_PAGES) {
 				fc->max_pages =
 					min_t(unsigned int, FUSE_MAX_MAX_PAGES,
@@ -984,6 +1000,12 @@ void fuse_send_init(struct fuse_conn *fc)
 		FUSE_PARALLEL_DIROPS | FUSE_HANDLE_KILLPRIV | FUSE_POSIX_ACL |
 		FUSE_ABORT_ERROR | FUSE_MAX_PAGES | FUSE_CACHE_SYMLINKS |
 		FUSE_NO_OPENDIR_SUPPORT | FUSE_EXPLICIT_INVAL_DATA;
+	/* Only the /dev/fuse device reads requests off the input queue */
+	if (fc->iq.ops == &fuse_dev_fiq_ops)
+		ia->in.flags |= FUSE_PERCPU_QUEUES | FUSE_BATCH_READ;
+	/* Backing files are reached with the daemon's credentials */
+	if (fc->iq.ops == &fuse_dev_fiq_ops && capable(CAP_SYS_ADMIN))
+		ia->in.flags |= FUSE_PASSTHROUGH;
 	ia->args.opcode = FUSE_INIT;
 	ia->args.in_numargs = 1;
 	ia->args.in_args[0].size = sizeof(ia->in);
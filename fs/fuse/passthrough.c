@@ -0,0 +1,333 @@
+/*
+  FUSE: Filesystem in Userspace
+
+  Passthrough of read, write and mmap to a backing file registered by the
+  daemon.  Everything else, including all metadata operations, still goes
+  through the daemon.
+
+  This program can be distributed under the terms of the GNU GPL.
+  See the file COPYING.
+*/
+
+#include "fuse_i.h"
+
+#include <linux/cred.h>
+#include <linux/file.h>
+#include <linux/slab.h>
+#include <linux/uio.h>
+
+struct fuse_aio_req {
+	struct kiocb iocb;
+	struct kiocb *iocb_fuse;
+};
+
+static rwf_t fuse_iocb_to_rwf(struct kiocb *iocb)
+{
+	int ifl = iocb->ki_flags;
+	rwf_t flags = 0;
+
+	if (ifl & IOCB_NOWAIT)
+		flags |= RWF_NOWAIT;
+	if (ifl & IOCB_HIPRI)
+		flags |= RWF_HIPRI;
+	if (ifl & IOCB_DSYNC)
+		flags |= RWF_DSYNC;
+	if (ifl & IOCB_SYNC)
+		flags |= RWF_SYNC;
+	if (ifl & IOCB_APPEND)
+		flags |= RWF_APPEND;
+
+	return flags;
+}
+
+/*
+ * The backing file changed underneath us: pick up the new size and let the
+ * next getattr ask the daemon for the rest.
+ */
+static void fuse_passthrough_written(struct inode *inode, loff_t pos)
+{
+	fuse_write_update_size(inode, pos);
+	fuse_invalidate_attr(inode);
+}
+
+static void fuse_aio_cleanup_handler(struct fuse_aio_req *aio_req)
+{
+	struct kiocb *iocb = &aio_req->iocb;
+	struct kiocb *iocb_fuse = aio_req->iocb_fuse;
+
+	if (iocb->ki_flags & IOCB_WRITE) {
+		/* Freeze protection was handed over by the submitter */
+		__sb_writers_acquired(file_inode(iocb->ki_filp)->i_sb,
+				      SB_FREEZE_WRITE);
+		file_end_write(iocb->ki_filp);
+		fuse_passthrough_written(file_inode(iocb_fuse->ki_filp),
+					 iocb->ki_pos);
+	}
+
+	iocb_fuse->ki_pos = iocb->ki_pos;
+	kfree(aio_req);
+}
+
+static void fuse_aio_rw_complete(struct kiocb *iocb, long res, long res2)
+{
+	struct fuse_aio_req *aio_req =
+		container_of(iocb, struct fuse_aio_req, iocb);
+	struct kiocb *iocb_fuse = aio_req->iocb_fuse;
+
+	fuse_aio_cleanup_handler(aio_req);
+	iocb_fuse->ki_complete(iocb_fuse, res, res2);
+}
+
+ssize_t fuse_passthrough_read_iter(struct kiocb *iocb_fuse,
+				   struct iov_iter *iter)
+{
+	struct file *fuse_filp = iocb_fuse->ki_filp;
+	struct fuse_file *ff = fuse_filp->private_data;
+	struct file *backing = ff->passthrough.filp;
+	const struct cred *old_cred;
+	ssize_t ret;
+
+	if (!iov_iter_count(iter))
+		return 0;
+
+	old_cred = override_creds(ff->passthrough.cred);
+	if (is_sync_kiocb(iocb_fuse)) {
+		ret = vfs_iter_read(backing, iter, &iocb_fuse->ki_pos,
+				    fuse_iocb_to_rwf(iocb_fuse));
+	} else {
+		struct fuse_aio_req *aio_req;
+
+		ret = -ENOMEM;
+		aio_req = kmalloc(sizeof(*aio_req), GFP_KERNEL);
+		if (!aio_req)
+			goto out;
+
+		aio_req->iocb_fuse = iocb_fuse;
+		kiocb_clone(&aio_req->iocb, iocb_fuse, backing);
+		aio_req->iocb.ki_complete = fuse_aio_rw_complete;
+		ret = vfs_iocb_iter_read(backing, &aio_req->iocb, iter);
+		if (ret != -EIOCBQUEUED)
+			fuse_aio_cleanup_handler(aio_req);
+	}
+out:
+	revert_creds(old_cred);
+	fuse_invalidate_atime(file_inode(fuse_filp));
+
+	return ret;
+}
+
+ssize_t fuse_passthrough_write_iter(struct kiocb *iocb_fuse,
+				    struct iov_iter *iter)
+{
+	struct file *fuse_filp = iocb_fuse->ki_filp;
+	struct fuse_file *ff = fuse_filp->private_data;
+	struct inode *fuse_inode = file_inode(fuse_filp);
+	struct file *backing = ff->passthrough.filp;
+	const struct cred *old_cred;
+	ssize_t ret;
+
+	if (!iov_iter_count(iter))
+		return 0;
+
+	inode_lock(fuse_inode);
+	/* Limits of the FUSE file; the backing file checks its own */
+	ret = generic_write_checks(iocb_fuse, iter);
+	if (ret <= 0) {
+		inode_unlock(fuse_inode);
+		return ret;
+	}
+
+	old_cred = override_creds(ff->passthrough.cred);
+	if (is_sync_kiocb(iocb_fuse)) {
+		file_start_write(backing);
+		ret = vfs_iter_write(backing, iter, &iocb_fuse->ki_pos,
+				     fuse_iocb_to_rwf(iocb_fuse));
+		file_end_write(backing);
+		if (ret > 0)
+			fuse_passthrough_written(fuse_inode,
+						 iocb_fuse->ki_pos);
+	} else {
+		struct fuse_aio_req *aio_req;
+
+		ret = -ENOMEM;
+		aio_req = kmalloc(sizeof(*aio_req), GFP_KERNEL);
+		if (!aio_req)
+			goto out;
+
+		file_start_write(backing);
+		/*
+		 * The write may complete in another context, don't leave
+		 * lockdep thinking we still hold freeze protection.
+		 */
+		__sb_writers_release(file_inode(backing)->i_sb,
+				     SB_FREEZE_WRITE);
+		aio_req->iocb_fuse = iocb_fuse;
+		kiocb_clone(&aio_req->iocb, iocb_fuse, backing);
+		aio_req->iocb.ki_complete = fuse_aio_rw_complete;
+		ret = vfs_iocb_iter_write(backing, &aio_req->iocb, iter);
+		if (ret != -EIOCBQUEUED)
+			fuse_aio_cleanup_handler(aio_req);
+	}
+out:
+	revert_creds(old_cred);
+	inode_unlock(fuse_inode);
+
+	return ret;
+}
+
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct fuse_file *ff = file->private_data;
+	struct file *backing = ff->passthrough.filp;
+	const struct cred *old_cred;
+	int ret;
+
+	if (!backing->f_op->mmap)
+		return -ENODEV;
+
+	if (WARN_ON(file != vma->vm_file))
+		return -EIO;
+
+	/* As do_mmap() would check against the backing file itself */
+	if ((vma->vm_flags & VM_SHARED) && !(backing->f_mode & FMODE_WRITE)) {
+		if (vma->vm_flags & VM_WRITE)
+			return -EACCES;
+		vma->vm_flags &= ~VM_MAYWRITE;
+	}
+
+	vma->vm_file = get_file(backing);
+
+	old_cred = override_creds(ff->passthrough.cred);
+	ret = call_mmap(vma->vm_file, vma);
+	revert_creds(old_cred);
+
+	if (ret) {
+		/* Drop reference count from new vm_file value */
+		fput(backing);
+	} else {
+		/* Drop reference count from previous vm_file value */
+		fput(file);
+	}
+
+	return ret;
+}
+
+/*
+ * Register a backing file on behalf of the daemon.  Its credentials are
+ * captured here and used for all I/O on the backing file, so callers of the
+ * FUSE file can't reach anything the daemon couldn't.  Only a daemon with
+ * CAP_SYS_ADMIN in the initial user namespace may do so.
+ */
+int fuse_passthrough_open(struct fuse_conn *fc,
+			  const struct fuse_passthrough_map *map)
+{
+	struct fuse_passthrough *passthrough;
+	struct super_block *backing_sb;
+	struct file *backing;
+	int ret;
+
+	if (!fc->passthrough || !capable(CAP_SYS_ADMIN))
+		return -EPERM;
+
+	if (map->flags || map->padding)
+		return -EINVAL;
+
+	backing = fget(map->fd);
+	if (!backing)
+		return -EBADF;
+
+	ret = -EINVAL;
+	if (!S_ISREG(file_inode(backing)->i_mode) ||
+	    !backing->f_op->read_iter || !backing->f_op->write_iter)
+		goto out_fput;
+
+	/* Don't let passthrough filesystems stack on top of each other */
+	backing_sb = file_inode(backing)->i_sb;
+	if (backing_sb->s_stack_depth >= FILESYSTEM_MAX_STACK_DEPTH)
+		goto out_fput;
+
+	ret = -ENOMEM;
+	passthrough = kmalloc(sizeof(*passthrough), GFP_KERNEL);
+	if (!passthrough)
+		goto out_fput;
+
+	passthrough->filp = backing;
+	passthrough->cred = prepare_creds();
+	if (!passthrough->cred)
+		goto out_free;
+
+	idr_preload(GFP_KERNEL);
+	spin_lock(&fc->lock);
+	ret = idr_alloc(&fc->passthrough_req, passthrough, 1, 0, GFP_ATOMIC);
+	spin_unlock(&fc->lock);
+	idr_preload_end();
+	if (ret > 0)
+		return ret;
+
+	put_cred(passthrough->cred);
+out_free:
+	kfree(passthrough);
+out_fput:
+	fput(backing);
+	return ret;
+}
+
+/*
+ * Attach the backing file named in the open reply to the FUSE @file.  If
+ * the daemon handed us a bad identifier, or a backing file not open for
+ * everything @file is open for, the file is opened without passthrough.
+ */
+void fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_file *ff,
+			    const struct fuse_open_out *openarg,
+			    struct file *file)
+{
+	struct fuse_passthrough *passthrough = NULL;
+	fmode_t mode = file->f_mode & (FMODE_READ | FMODE_WRITE);
+
+	if (fc->passthrough && openarg->passthrough_fh) {
+		spin_lock(&fc->lock);
+		passthrough = idr_remove(&fc->passthrough_req,
+					 openarg->passthrough_fh);
+		spin_unlock(&fc->lock);
+	}
+
+	if (passthrough && (passthrough->filp->f_mode & mode) != mode) {
+		fuse_passthrough_release(passthrough);
+		kfree(passthrough);
+		passthrough = NULL;
+	}
+
+	if (!passthrough) {
+		ff->open_flags &= ~FOPEN_PASSTHROUGH;
+		return;
+	}
+
+	ff->passthrough = *passthrough;
+	kfree(passthrough);
+}
+
+void fuse_passthrough_release(struct fuse_passthrough *passthrough)
+{
+	if (passthrough->filp) {
+		fput(passthrough->filp);
+		passthrough->filp = NULL;
+	}
+	if (passthrough->cred) {
+		put_cred(passthrough->cred);
+		passthrough->cred = NULL;
+	}
+}
+
+static int fuse_passthrough_free_one(int id, void *p, void *data)
+{
+	fuse_passthrough_release(p);
+	kfree(p);
+	return 0;
+}
+
+/* Drop backing files that were registered but never used by an open */
+void fuse_passthrough_destroy(struct fuse_conn *fc)
+{
+	idr_for_each(&fc->passthrough_req, fuse_passthrough_free_one, NULL);
+	idr_destroy(&fc->passthrough_req);
+}
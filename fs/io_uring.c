@@ -76,6 +76,8 @@
 #include <linux/fadvise.h>
 #include <linux/eventpoll.h>
 #include <linux/fs_struct.h>
+#include <linux/task_work.h>
+#include <linux/splice.h>
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/io_uring.h>
@@ -96,6 +98,12 @@
 #define IORING_FILE_TABLE_MASK	(IORING_MAX_FILES_TABLE - 1)
 #define IORING_MAX_FIXED_FILES	(64 * IORING_MAX_FILES_TABLE)
 
+/*
+ * When several rings share an SQPOLL thread, each ring submits at most this
+ * many entries per pass so that one busy ring can't starve the others.
+ */
+#define IORING_SQPOLL_CAP_ENTRIES	8
+
 struct io_uring {
 	u32 head ____cacheline_aligned_in_smp;
 	u32 tail ____cacheline_aligned_in_smp;
@@ -198,6 +206,25 @@ struct fixed_file_data {
 	struct completion		done;
 };
 
+/*
+ * SQPOLL thread state, shared by every ring that attached to it with
+ * IORING_SETUP_ATTACH_WQ. The thread round-robins over ->ctx_list.
+ */
+struct io_sq_data {
+	refcount_t		refs;
+
+	/* protects ->ctx_list and ->sq_thread_idle */
+	struct mutex		lock;
+	struct list_head	ctx_list;
+
+	struct task_struct	*thread;
+	wait_queue_head_t	wait;
+	struct completion	started;
+
+	/* longest idle period of the attached rings */
+	unsigned		sq_thread_idle;
+};
+
 struct io_ring_ctx {
 	struct {
 		struct percpu_ref	refs;
@@ -243,9 +270,10 @@ struct io_ring_ctx {
 
 	/* IO offload */
 	struct io_wq		*io_wq;
-	struct task_struct	*sqo_thread;	/* if using sq thread polling */
+	struct io_sq_data	*sq_data;	/* if using sq polling */
+	struct list_head	sqd_list;
 	struct mm_struct	*sqo_mm;
-	wait_queue_head_t	sqo_wait;
+	wait_queue_head_t	*sqo_wait;
 
 	/*
 	 * If used, fixed file set. Writers must ensure that ->refs is dead,
@@ -265,7 +293,7 @@ struct io_ring_ctx {
 
 	const struct cred	*creds;
 
-	/* 0 is for ctx quiesce/reinit/free, 1 is for sqo_thread started */
+	/* for ctx quiesce/reinit/free */
 	struct completion	*completions;
 
 	/* if all else fails... */
@@ -277,6 +305,9 @@ struct io_ring_ctx {
 
 	struct idr		personality_idr;
 
+	/* provided buffer groups, protected by ->uring_lock */
+	struct idr		io_buffer_idr;
+
 	struct {
 		unsigned		cached_cq_tail;
 		unsigned		cq_entries;
@@ -326,6 +357,7 @@ struct io_poll_iocb {
 	__poll_t			events;
 	bool				done;
 	bool				canceled;
+	bool				multishot;
 	struct wait_queue_entry		wait;
 };
 
@@ -348,6 +380,7 @@ struct io_accept {
 	struct sockaddr __user		*addr;
 	int __user			*addr_len;
 	int				flags;
+	bool				multishot;
 };
 
 struct io_sync {
@@ -390,6 +423,7 @@ struct io_sr_msg {
 		void __user		*buf;
 	};
 	int				msg_flags;
+	u16				bgid;
 	size_t				len;
 };
 
@@ -433,6 +467,37 @@ struct io_epoll {
 	struct epoll_event		event;
 };
 
+struct io_splice {
+	struct file			*file_out;
+	struct file			*file_in;
+	loff_t				off_out;
+	loff_t				off_in;
+	u64				len;
+	unsigned int			flags;
+};
+
+struct io_provide_buf {
+	struct file			*file;
+	__u64				addr;
+	__s32				len;
+	__u32				bgid;
+	__u16				nbufs;
+	__u16				bid;
+};
+
+/*
+ * A buffer handed to the kernel with IORING_OP_PROVIDE_BUFFERS. The first
+ * buffer of a group is stored in ->io_buffer_idr and the rest are on its
+ * ->list.
+ */
+struct io_buffer {
+	struct list_head		list;
+	__u64				addr;
+	__s32				len;
+	__u16				bid;
+	__u16				bgid;
+};
+
 struct io_async_connect {
 	struct sockaddr_storage		address;
 };
@@ -467,6 +532,7 @@ enum {
 	REQ_F_LINK_BIT		= IOSQE_IO_LINK_BIT,
 	REQ_F_HARDLINK_BIT	= IOSQE_IO_HARDLINK_BIT,
 	REQ_F_FORCE_ASYNC_BIT	= IOSQE_ASYNC_BIT,
+	REQ_F_BUFFER_SELECT_BIT	= IOSQE_BUFFER_SELECT_BIT,
 
 	REQ_F_LINK_NEXT_BIT,
 	REQ_F_FAIL_LINK_BIT,
@@ -482,6 +548,8 @@ enum {
 	REQ_F_COMP_LOCKED_BIT,
 	REQ_F_NEED_CLEANUP_BIT,
 	REQ_F_OVERFLOW_BIT,
+	REQ_F_POLLED_BIT,
+	REQ_F_BUFFER_SELECTED_BIT,
 };
 
 enum {
@@ -495,6 +563,8 @@ enum {
 	REQ_F_HARDLINK		= BIT(REQ_F_HARDLINK_BIT),
 	/* IOSQE_ASYNC */
 	REQ_F_FORCE_ASYNC	= BIT(REQ_F_FORCE_ASYNC_BIT),
+	/* IOSQE_BUFFER_SELECT */
+	REQ_F_BUFFER_SELECT	= BIT(REQ_F_BUFFER_SELECT_BIT),
 
 	/* already grabbed next link */
 	REQ_F_LINK_NEXT		= BIT(REQ_F_LINK_NEXT_BIT),
@@ -524,6 +594,10 @@ enum {
 	REQ_F_NEED_CLEANUP	= BIT(REQ_F_NEED_CLEANUP_BIT),
 	/* in overflow list */
 	REQ_F_OVERFLOW		= BIT(REQ_F_OVERFLOW_BIT),
+	/* already went through poll handler */
+	REQ_F_POLLED		= BIT(REQ_F_POLLED_BIT),
+	/* buffer already selected */
+	REQ_F_BUFFER_SELECTED	= BIT(REQ_F_BUFFER_SELECTED_BIT),
 };
 
 /*
@@ -549,6 +623,8 @@ struct io_kiocb {
 		struct io_fadvise	fadvise;
 		struct io_madvise	madvise;
 		struct io_epoll		epoll;
+		struct io_provide_buf	pbuf;
+		struct io_splice	splice;
 	};
 
 	struct io_async_ctx		*io;
@@ -575,6 +651,14 @@ struct io_kiocb {
 	struct list_head	inflight_entry;
 
 	struct io_wq_work	work;
+
+	/* buffer picked from a provided group, if REQ_F_BUFFER_SELECTED */
+	struct io_buffer	*kbuf;
+
+	/* for retrying on readiness instead of punting to io-wq */
+	struct task_struct	*task;
+	struct io_poll_iocb	*apoll;
+	struct callback_head	task_work;
 };
 
 #define IO_PLUG_THRESHOLD		2
@@ -618,6 +702,11 @@ struct io_op_def {
 	unsigned		file_table : 1;
 	/* needs ->fs */
 	unsigned		needs_fs : 1;
+	/* set if opcode supports polled "wait" */
+	unsigned		pollin : 1;
+	unsigned		pollout : 1;
+	/* op supports buffer selection */
+	unsigned		buffer_select : 1;
 };
 
 static const struct io_op_def io_op_defs[] = {
@@ -627,6 +716,7 @@ static const struct io_op_def io_op_defs[] = {
 		.needs_mm		= 1,
 		.needs_file		= 1,
 		.unbound_nonreg_file	= 1,
+		.pollin		= 1,
 	},
 	[IORING_OP_WRITEV] = {
 		.async_ctx		= 1,
@@ -634,6 +724,7 @@ static const struct io_op_def io_op_defs[] = {
 		.needs_file		= 1,
 		.hash_reg_file		= 1,
 		.unbound_nonreg_file	= 1,
+		.pollout	= 1,
 	},
 	[IORING_OP_FSYNC] = {
 		.needs_file		= 1,
@@ -641,11 +732,14 @@ static const struct io_op_def io_op_defs[] = {
 	[IORING_OP_READ_FIXED] = {
 		.needs_file		= 1,
 		.unbound_nonreg_file	= 1,
+		.pollin		= 1,
+		.buffer_select		= 1,
 	},
 	[IORING_OP_WRITE_FIXED] = {
 		.needs_file		= 1,
 		.hash_reg_file		= 1,
 		.unbound_nonreg_file	= 1,
+		.pollout	= 1,
 	},
 	[IORING_OP_POLL_ADD] = {
 		.needs_file		= 1,
@@ -661,6 +755,7 @@ static const struct io_op_def io_op_defs[] = {
 		.needs_file		= 1,
 		.unbound_nonreg_file	= 1,
 		.needs_fs		= 1,
+		.pollout	= 1,
 	},
 	[IORING_OP_RECVMSG] = {
 		.async_ctx		= 1,
@@ -668,6 +763,7 @@ static const struct io_op_def io_op_defs[] = {
 		.needs_file		= 1,
 		.unbound_nonreg_file	= 1,
 		.needs_fs		= 1,
+		.pollin		= 1,
 	},
 	[IORING_OP_TIMEOUT] = {
 		.async_ctx		= 1,
@@ -679,6 +775,7 @@ static const struct io_op_def io_op_defs[] = {
 		.needs_file		= 1,
 		.unbound_nonreg_file	= 1,
 		.file_table		= 1,
+		.pollin		= 1,
 	},
 	[IORING_OP_ASYNC_CANCEL] = {},
 	[IORING_OP_LINK_TIMEOUT] = {
@@ -690,6 +787,7 @@ static const struct io_op_def io_op_defs[] = {
 		.needs_mm		= 1,
 		.needs_file		= 1,
 		.unbound_nonreg_file	= 1,
+		.pollout	= 1,
 	},
 	[IORING_OP_FALLOCATE] = {
 		.needs_file		= 1,
@@ -718,11 +816,14 @@ static const struct io_op_def io_op_defs[] = {
 		.needs_mm		= 1,
 		.needs_file		= 1,
 		.unbound_nonreg_file	= 1,
+		.pollin		= 1,
+		.buffer_select		= 1,
 	},
 	[IORING_OP_WRITE] = {
 		.needs_mm		= 1,
 		.needs_file		= 1,
 		.unbound_nonreg_file	= 1,
+		.pollout	= 1,
 	},
 	[IORING_OP_FADVISE] = {
 		.needs_file		= 1,
@@ -734,11 +835,14 @@ static const struct io_op_def io_op_defs[] = {
 		.needs_mm		= 1,
 		.needs_file		= 1,
 		.unbound_nonreg_file	= 1,
+		.pollout	= 1,
 	},
 	[IORING_OP_RECV] = {
 		.needs_mm		= 1,
 		.needs_file		= 1,
 		.unbound_nonreg_file	= 1,
+		.pollin		= 1,
+		.buffer_select		= 1,
 	},
 	[IORING_OP_OPENAT2] = {
 		.needs_file		= 1,
@@ -750,9 +854,23 @@ static const struct io_op_def io_op_defs[] = {
 		.unbound_nonreg_file	= 1,
 		.file_table		= 1,
 	},
+	[IORING_OP_PROVIDE_BUFFERS] = {},
+	[IORING_OP_REMOVE_BUFFERS] = {},
+	[IORING_OP_SPLICE] = {
+		.needs_file		= 1,
+		.hash_reg_file		= 1,
+		.unbound_nonreg_file	= 1,
+	},
+	[IORING_OP_TEE] = {
+		.needs_file		= 1,
+		.hash_reg_file		= 1,
+		.unbound_nonreg_file	= 1,
+	},
 };
 
 static void io_wq_submit_work(struct io_wq_work **workptr);
+static void __io_queue_sqe(struct io_kiocb *req,
+			   const struct io_uring_sqe *sqe);
 static void io_cqring_fill_event(struct io_kiocb *req, long res);
 static void io_put_req(struct io_kiocb *req);
 static void __io_double_put_req(struct io_kiocb *req);
@@ -802,7 +920,7 @@ static struct io_ring_ctx *io_ring_ctx_alloc(struct io_uring_params *p)
 	if (!ctx->fallback_req)
 		goto err;
 
-	ctx->completions = kmalloc(2 * sizeof(struct completion), GFP_KERNEL);
+	ctx->completions = kmalloc(sizeof(struct completion), GFP_KERNEL);
 	if (!ctx->completions)
 		goto err;
 
@@ -829,8 +947,8 @@ static struct io_ring_ctx *io_ring_ctx_alloc(struct io_uring_params *p)
 	init_waitqueue_head(&ctx->cq_wait);
 	INIT_LIST_HEAD(&ctx->cq_overflow_list);
 	init_completion(&ctx->completions[0]);
-	init_completion(&ctx->completions[1]);
 	idr_init(&ctx->personality_idr);
+	idr_init(&ctx->io_buffer_idr);
 	mutex_init(&ctx->uring_lock);
 	init_waitqueue_head(&ctx->wait);
 	spin_lock_init(&ctx->completion_lock);
@@ -841,6 +959,7 @@ static struct io_ring_ctx *io_ring_ctx_alloc(struct io_uring_params *p)
 	init_waitqueue_head(&ctx->inflight_wait);
 	spin_lock_init(&ctx->inflight_lock);
 	INIT_LIST_HEAD(&ctx->inflight_list);
+	INIT_LIST_HEAD(&ctx->sqd_list);
 	return ctx;
 err:
 	if (ctx->fallback_req)
@@ -1063,8 +1182,8 @@ static void __io_cqring_ev_posted(struct io_ring_ctx *ctx, bool trigger_ev)
 {
 	if (waitqueue_active(&ctx->wait))
 		wake_up(&ctx->wait);
-	if (waitqueue_active(&ctx->sqo_wait))
-		wake_up(&ctx->sqo_wait);
+	if (ctx->sqo_wait && waitqueue_active(ctx->sqo_wait))
+		wake_up(ctx->sqo_wait);
 	if (trigger_ev)
 		eventfd_signal(ctx->cq_ev_fd, 1);
 }
@@ -1074,6 +1193,19 @@ static void io_cqring_ev_posted(struct io_ring_ctx *ctx)
 	__io_cqring_ev_posted(ctx, io_should_trigger_evfd(ctx));
 }
 
+/*
+ * The CQE of a request that consumed a provided buffer tells the
+ * application which one it was. The buffer then belongs to the
+ * application again; only our descriptor is freed with the request.
+ */
+static inline u32 io_cqe_flags(struct io_kiocb *req)
+{
+	if (!(req->flags & REQ_F_BUFFER_SELECTED))
+		return 0;
+	return ((u32) req->kbuf->bid << IORING_CQE_BUFFER_SHIFT) |
+		IORING_CQE_F_BUFFER;
+}
+
 /* Returns true if there are no backlogged entries after the flush */
 static bool io_cqring_overflow_flush(struct io_ring_ctx *ctx, bool force)
 {
@@ -1110,7 +1242,7 @@ static bool io_cqring_overflow_flush(struct io_ring_ctx *ctx, bool force)
 		if (cqe) {
 			WRITE_ONCE(cqe->user_data, req->user_data);
 			WRITE_ONCE(cqe->res, req->result);
-			WRITE_ONCE(cqe->flags, 0);
+			WRITE_ONCE(cqe->flags, io_cqe_flags(req));
 		} else {
 			WRITE_ONCE(ctx->rings->cq_overflow,
 				atomic_inc_return(&ctx->cached_cq_overflow));
@@ -1134,7 +1266,7 @@ static bool io_cqring_overflow_flush(struct io_ring_ctx *ctx, bool force)
 	return cqe != NULL;
 }
 
-static void io_cqring_fill_event(struct io_kiocb *req, long res)
+static void __io_cqring_fill_event(struct io_kiocb *req, long res, u32 cflags)
 {
 	struct io_ring_ctx *ctx = req->ctx;
 	struct io_uring_cqe *cqe;
@@ -1150,7 +1282,7 @@ static void io_cqring_fill_event(struct io_kiocb *req, long res)
 	if (likely(cqe)) {
 		WRITE_ONCE(cqe->user_data, req->user_data);
 		WRITE_ONCE(cqe->res, res);
-		WRITE_ONCE(cqe->flags, 0);
+		WRITE_ONCE(cqe->flags, cflags);
 	} else if (ctx->cq_overflow_flushed) {
 		WRITE_ONCE(ctx->rings->cq_overflow,
 				atomic_inc_return(&ctx->cached_cq_overflow));
@@ -1166,6 +1298,33 @@ static void io_cqring_fill_event(struct io_kiocb *req, long res)
 	}
 }
 
+static void io_cqring_fill_event(struct io_kiocb *req, long res)
+{
+	__io_cqring_fill_event(req, res, io_cqe_flags(req));
+}
+
+/*
+ * Post a CQE for a multishot request that stays armed. Those never go to
+ * the overflow list, a request can only be on it once; if the ring is full,
+ * or other CQEs are already backlogged, nothing is posted and the caller
+ * completes the request for good instead. Called with ->completion_lock.
+ */
+static bool io_cqring_fill_event_more(struct io_kiocb *req, long res)
+{
+	struct io_ring_ctx *ctx = req->ctx;
+	struct io_rings *rings = ctx->rings;
+
+	if (!list_empty(&ctx->cq_overflow_list))
+		return false;
+	if (ctx->cached_cq_tail - READ_ONCE(rings->cq.head) ==
+	    rings->cq_ring_entries)
+		return false;
+
+	__io_cqring_fill_event(req, res, IORING_CQE_F_MORE);
+	io_commit_cqring(ctx);
+	return true;
+}
+
 static void io_cqring_add_event(struct io_kiocb *req, long res)
 {
 	struct io_ring_ctx *ctx = req->ctx;
@@ -1179,6 +1338,21 @@ static void io_cqring_add_event(struct io_kiocb *req, long res)
 	io_cqring_ev_posted(ctx);
 }
 
+static bool io_cqring_add_event_more(struct io_kiocb *req, long res)
+{
+	struct io_ring_ctx *ctx = req->ctx;
+	unsigned long flags;
+	bool posted;
+
+	spin_lock_irqsave(&ctx->completion_lock, flags);
+	posted = io_cqring_fill_event_more(req, res);
+	spin_unlock_irqrestore(&ctx->completion_lock, flags);
+
+	if (posted)
+		io_cqring_ev_posted(ctx);
+	return posted;
+}
+
 static inline bool io_is_fallback_req(struct io_kiocb *req)
 {
 	return req == (struct io_kiocb *)
@@ -1238,6 +1412,7 @@ static struct io_kiocb *io_get_req(struct io_ring_ctx *ctx,
 	/* one is dropped after submission, the other at completion */
 	refcount_set(&req->refs, 2);
 	req->result = 0;
+	req->task = NULL;
 	INIT_IO_WORK(&req->work, io_wq_submit_work);
 	return req;
 fallback:
@@ -1267,6 +1442,10 @@ static void __io_req_aux_free(struct io_kiocb *req)
 		else
 			fput(req->file);
 	}
+	if (req->flags & REQ_F_BUFFER_SELECTED)
+		kfree(req->kbuf);
+	if (req->task)
+		put_task_struct(req->task);
 
 	io_req_work_drop_env(req);
 }
@@ -1547,7 +1726,8 @@ static inline bool io_req_multi_free(struct req_batch *rb, struct io_kiocb *req)
 	if ((req->flags & REQ_F_LINK) || io_is_fallback_req(req))
 		return false;
 
-	if (!(req->flags & REQ_F_FIXED_FILE) || req->io)
+	if (!(req->flags & REQ_F_FIXED_FILE) || req->io || req->task ||
+	    (req->flags & REQ_F_BUFFER_SELECTED))
 		rb->need_iter++;
 
 	rb->reqs[rb->to_free++] = req;
@@ -1872,6 +2052,48 @@ static struct file *io_file_get(struct io_submit_state *state, int fd)
 	return state->file;
 }
 
+static inline struct file *io_file_from_index(struct io_ring_ctx *ctx,
+					      int index)
+{
+	struct fixed_file_table *table;
+
+	table = &ctx->file_data->table[index >> IORING_FILE_TABLE_SHIFT];
+	return table->files[index & IORING_FILE_TABLE_MASK];;
+}
+
+/*
+ * Look up @fd, either in the fixed file table or in the file table of the
+ * task. A fixed file pins the table through ->file_data->refs instead of
+ * holding a file reference.
+ */
+static int io_req_get_file(struct io_submit_state *state, struct io_kiocb *req,
+			   int fd, bool fixed, struct file **out_file)
+{
+	struct io_ring_ctx *ctx = req->ctx;
+	struct file *file;
+
+	if (fixed) {
+		if (unlikely(!ctx->file_data ||
+		    (unsigned) fd >= ctx->nr_user_files))
+			return -EBADF;
+		fd = array_index_nospec(fd, ctx->nr_user_files);
+		file = io_file_from_index(ctx, fd);
+		if (!file)
+			return -EBADF;
+		percpu_ref_get(&ctx->file_data->refs);
+	} else {
+		if (req->needs_fixed_file)
+			return -EBADF;
+		trace_io_uring_file_get(ctx, fd);
+		file = io_file_get(state, fd);
+		if (unlikely(!file))
+			return -EBADF;
+	}
+
+	*out_file = file;
+	return 0;
+}
+
 /*
  * If we tracked the file through the SCM inflight mechanism, we could support
  * any file. For now, just ensure that anything potentially problematic is done
@@ -1886,7 +2108,7 @@ static bool io_file_supports_async(struct file *file)
 	if (S_ISREG(mode) && file->f_op != &io_uring_fops)
 		return true;
 
-	return false;
+	return file->f_mode & FMODE_NOWAIT;
 }
 
 static int io_prep_rw(struct io_kiocb *req, const struct io_uring_sqe *sqe,
@@ -1985,6 +2207,105 @@ static void kiocb_done(struct kiocb *kiocb, ssize_t ret, struct io_kiocb **nxt,
 		io_rw_done(kiocb, ret);
 }
 
+/*
+ * Submission holds ->uring_lock, io-wq workers have to grab it to touch the
+ * provided buffer groups.
+ */
+static void io_ring_submit_lock(struct io_ring_ctx *ctx)
+{
+	if (io_wq_current_is_worker())
+		mutex_lock(&ctx->uring_lock);
+}
+
+static void io_ring_submit_unlock(struct io_ring_ctx *ctx)
+{
+	if (io_wq_current_is_worker())
+		mutex_unlock(&ctx->uring_lock);
+}
+
+/*
+ * Take a buffer from group @bgid for this request and clamp @len to its
+ * size. A request keeps its buffer until it completes or gives it back
+ * with io_buffer_recycle().
+ */
+static struct io_buffer *io_buffer_select(struct io_kiocb *req, u16 bgid,
+					  size_t *len)
+{
+	struct io_ring_ctx *ctx = req->ctx;
+	struct io_buffer *kbuf, *head;
+
+	if (!(req->flags & REQ_F_BUFFER_SELECTED)) {
+		io_ring_submit_lock(ctx);
+		head = idr_find(&ctx->io_buffer_idr, bgid);
+		if (!head) {
+			io_ring_submit_unlock(ctx);
+			return ERR_PTR(-ENOBUFS);
+		}
+		if (!list_empty(&head->list)) {
+			kbuf = list_last_entry(&head->list, struct io_buffer,
+						list);
+			list_del(&kbuf->list);
+		} else {
+			kbuf = head;
+			idr_remove(&ctx->io_buffer_idr, bgid);
+		}
+		io_ring_submit_unlock(ctx);
+
+		req->kbuf = kbuf;
+		req->flags |= REQ_F_BUFFER_SELECTED;
+	}
+
+	kbuf = req->kbuf;
+	if (*len > kbuf->len)
+		*len = kbuf->len;
+	return kbuf;
+}
+
+/*
+ * Called when a non-blocking attempt got -EAGAIN. Give the buffer back to
+ * its group so requests waiting for data don't hold on to buffers; it is
+ * the next one handed out, while it's still cache hot.
+ */
+static void io_buffer_recycle(struct io_kiocb *req)
+{
+	struct io_ring_ctx *ctx = req->ctx;
+	struct io_buffer *kbuf = req->kbuf;
+	struct io_buffer *head;
+
+	if (!(req->flags & REQ_F_BUFFER_SELECTED))
+		return;
+	req->flags &= ~REQ_F_BUFFER_SELECTED;
+	req->kbuf = NULL;
+
+	io_ring_submit_lock(ctx);
+	head = idr_find(&ctx->io_buffer_idr, kbuf->bgid);
+	if (head) {
+		list_add_tail(&kbuf->list, &head->list);
+	} else {
+		INIT_LIST_HEAD(&kbuf->list);
+		if (idr_alloc(&ctx->io_buffer_idr, kbuf, kbuf->bgid,
+			      kbuf->bgid + 1, GFP_KERNEL) < 0)
+			kfree(kbuf);
+	}
+	io_ring_submit_unlock(ctx);
+}
+
+/* find the registered buffer a provided buffer lives in, if any */
+static struct io_mapped_ubuf *io_find_fixed_ubuf(struct io_ring_ctx *ctx,
+						 u64 buf_addr, size_t len)
+{
+	struct io_mapped_ubuf *imu;
+	unsigned i;
+
+	for (i = 0; i < ctx->nr_user_bufs; i++) {
+		imu = &ctx->user_bufs[i];
+		if (buf_addr >= imu->ubuf &&
+		    buf_addr + len <= imu->ubuf + imu->len)
+			return imu;
+	}
+	return NULL;
+}
+
 static ssize_t io_import_fixed(struct io_kiocb *req, int rw,
 			       struct iov_iter *iter)
 {
@@ -2000,12 +2321,25 @@ static ssize_t io_import_fixed(struct io_kiocb *req, int rw,
 		return -EFAULT;
 
 	buf_index = (unsigned long) req->rw.kiocb.private;
-	if (unlikely(buf_index >= ctx->nr_user_bufs))
-		return -EFAULT;
+	if (req->flags & REQ_F_BUFFER_SELECT) {
+		struct io_buffer *kbuf;
+
+		/* buf_index is the group, the buffer must be registered */
+		kbuf = io_buffer_select(req, buf_index, &len);
+		if (IS_ERR(kbuf))
+			return PTR_ERR(kbuf);
+		buf_addr = kbuf->addr;
+		imu = io_find_fixed_ubuf(ctx, buf_addr, len);
+		if (unlikely(!imu))
+			return -EFAULT;
+	} else {
+		if (unlikely(buf_index >= ctx->nr_user_bufs))
+			return -EFAULT;
 
-	index = array_index_nospec(buf_index, ctx->nr_user_bufs);
-	imu = &ctx->user_bufs[index];
-	buf_addr = req->rw.addr;
+		index = array_index_nospec(buf_index, ctx->nr_user_bufs);
+		imu = &ctx->user_bufs[index];
+		buf_addr = req->rw.addr;
+	}
 
 	/* overflow */
 	if (buf_addr + len < buf_addr)
@@ -2072,12 +2406,25 @@ static ssize_t io_import_iovec(int rw, struct io_kiocb *req,
 		return io_import_fixed(req, rw, iter);
 	}
 
-	/* buffer index only valid with fixed read/write */
-	if (req->rw.kiocb.private)
+	/* buffer index only valid with fixed read/write or buffer select */
+	if (req->rw.kiocb.private && !(req->flags & REQ_F_BUFFER_SELECT))
 		return -EINVAL;
 
 	if (opcode == IORING_OP_READ || opcode == IORING_OP_WRITE) {
 		ssize_t ret;
+
+		if (req->flags & REQ_F_BUFFER_SELECT) {
+			struct io_buffer *kbuf;
+			u16 bgid;
+
+			bgid = (unsigned long) req->rw.kiocb.private;
+			kbuf = io_buffer_select(req, bgid, &sqe_len);
+			if (IS_ERR(kbuf)) {
+				*iovec = NULL;
+				return PTR_ERR(kbuf);
+			}
+			buf = u64_to_user_ptr(kbuf->addr);
+		}
 		ret = import_single_range(rw, buf, sqe_len, *iovec, iter);
 		*iovec = NULL;
 		return ret;
@@ -2275,6 +2622,8 @@ static int io_read(struct io_kiocb *req, struct io_kiocb **nxt,
 			kiocb_done(kiocb, ret2, nxt, req->in_async);
 		} else {
 copy_iov:
+			/* a selected buffer is picked again on retry */
+			io_buffer_recycle(req);
 			ret = io_setup_async_rw(req, io_size, iovec,
 						inline_vecs, &iter);
 			if (ret)
@@ -2401,6 +2750,119 @@ static int io_write(struct io_kiocb *req, struct io_kiocb **nxt,
 	return ret;
 }
 
+static int __io_splice_prep(struct io_kiocb *req,
+			    const struct io_uring_sqe *sqe)
+{
+	struct io_splice *sp = &req->splice;
+	unsigned int valid_flags = SPLICE_F_FD_IN_FIXED | SPLICE_F_ALL;
+	int ret;
+
+	if (req->flags & REQ_F_NEED_CLEANUP)
+		return 0;
+	if (unlikely(req->ctx->flags & IORING_SETUP_IOPOLL))
+		return -EINVAL;
+
+	sp->file_in = NULL;
+	sp->len = READ_ONCE(sqe->len);
+	sp->flags = READ_ONCE(sqe->splice_flags);
+
+	if (unlikely(sp->flags & ~valid_flags))
+		return -EINVAL;
+
+	ret = io_req_get_file(NULL, req, READ_ONCE(sqe->splice_fd_in),
+			      sp->flags & SPLICE_F_FD_IN_FIXED, &sp->file_in);
+	if (ret)
+		return ret;
+	req->flags |= REQ_F_NEED_CLEANUP;
+
+	if (unlikely(!(sp->file_in->f_mode & FMODE_READ)))
+		return -EBADF;
+	if (unlikely(!(req->file->f_mode & FMODE_WRITE)))
+		return -EBADF;
+	return 0;
+}
+
+static void io_splice_put_file_in(struct io_kiocb *req)
+{
+	struct io_splice *sp = &req->splice;
+
+	if (sp->flags & SPLICE_F_FD_IN_FIXED)
+		percpu_ref_put(&req->ctx->file_data->refs);
+	else
+		fput(sp->file_in);
+	req->flags &= ~REQ_F_NEED_CLEANUP;
+}
+
+/*
+ * Pipes honour SPLICE_F_NONBLOCK and non-blocking sockets and character
+ * devices return -EAGAIN by themselves, so those can be tried inline.
+ * Reading or writing the page cache of a file may block on IO, that has
+ * to go through io-wq.
+ */
+static bool io_splice_nowait(struct file *file)
+{
+	umode_t mode = file_inode(file)->i_mode;
+
+	if (get_pipe_info(file))
+		return true;
+	if (S_ISREG(mode) || S_ISBLK(mode))
+		return false;
+	return file->f_flags & O_NONBLOCK;
+}
+
+static int io_splice_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
+{
+	struct io_splice *sp = &req->splice;
+
+	sp->off_in = READ_ONCE(sqe->splice_off_in);
+	sp->off_out = READ_ONCE(sqe->off);
+	return __io_splice_prep(req, sqe);
+}
+
+static int io_tee_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
+{
+	if (READ_ONCE(sqe->splice_off_in) || READ_ONCE(sqe->off))
+		return -EINVAL;
+	return __io_splice_prep(req, sqe);
+}
+
+static int io_splice(struct io_kiocb *req, struct io_kiocb **nxt,
+		     bool force_nonblock)
+{
+	struct io_splice *sp = &req->splice;
+	struct file *in = sp->file_in;
+	struct file *out = sp->file_out;
+	unsigned int flags = sp->flags & ~SPLICE_F_FD_IN_FIXED;
+	loff_t *poff_in, *poff_out;
+	long ret = 0;
+
+	if (force_nonblock) {
+		if (!io_splice_nowait(in) || !io_splice_nowait(out))
+			return -EAGAIN;
+		flags |= SPLICE_F_NONBLOCK;
+	}
+
+	if (sp->len) {
+		if (req->opcode == IORING_OP_TEE) {
+			ret = do_tee(in, out, sp->len, flags);
+		} else {
+			poff_in = (sp->off_in == -1) ? NULL : &sp->off_in;
+			poff_out = (sp->off_out == -1) ? NULL : &sp->off_out;
+			ret = do_splice(in, poff_in, out, poff_out, sp->len,
+					flags);
+		}
+		if (force_nonblock && ret == -EAGAIN)
+			return -EAGAIN;
+	}
+
+	io_splice_put_file_in(req);
+	if (ret != sp->len)
+		req_set_fail_links(req);
+	io_cqring_add_event(req, ret);
+	io_put_req_find_next(req, nxt);
+	return 0;
+}
+
 /*
  * IORING_OP_NOP just posts a completion event, nothing else.
  */
@@ -2717,51 +3179,225 @@ static int io_epoll_ctl(struct io_kiocb *req, struct io_kiocb **nxt,
 #endif
 }
 
-static int io_madvise_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
+static int __io_remove_buffers(struct io_ring_ctx *ctx, struct io_buffer *head,
+			       int bgid, unsigned nbufs)
 {
-#if defined(CONFIG_ADVISE_SYSCALLS) && defined(CONFIG_MMU)
-	if (sqe->ioprio || sqe->buf_index || sqe->off)
+	unsigned i = 0;
+
+	/* shouldn't happen */
+	if (!nbufs)
+		return 0;
+
+	/* the head kbuf is the list itself */
+	while (!list_empty(&head->list)) {
+		struct io_buffer *nxt;
+
+		nxt = list_first_entry(&head->list, struct io_buffer, list);
+		list_del(&nxt->list);
+		kfree(nxt);
+		if (++i == nbufs)
+			return i;
+	}
+	i++;
+	kfree(head);
+	idr_remove(&ctx->io_buffer_idr, bgid);
+
+	return i;
+}
+
+static int io_remove_buffers_prep(struct io_kiocb *req,
+				  const struct io_uring_sqe *sqe)
+{
+	struct io_provide_buf *p = &req->pbuf;
+	u64 tmp;
+
+	if (sqe->ioprio || sqe->rw_flags || sqe->addr || sqe->len || sqe->off)
 		return -EINVAL;
 
-	req->madvise.addr = READ_ONCE(sqe->addr);
-	req->madvise.len = READ_ONCE(sqe->len);
-	req->madvise.advice = READ_ONCE(sqe->fadvise_advice);
+	tmp = READ_ONCE(sqe->fd);
+	if (!tmp || tmp > USHRT_MAX)
+		return -EINVAL;
+
+	memset(p, 0, sizeof(*p));
+	p->nbufs = tmp;
+	p->bgid = READ_ONCE(sqe->buf_group);
 	return 0;
-#else
-	return -EOPNOTSUPP;
-#endif
 }
 
-static int io_madvise(struct io_kiocb *req, struct io_kiocb **nxt,
-		      bool force_nonblock)
+static int io_remove_buffers(struct io_kiocb *req, struct io_kiocb **nxt)
 {
-#if defined(CONFIG_ADVISE_SYSCALLS) && defined(CONFIG_MMU)
-	struct io_madvise *ma = &req->madvise;
+	struct io_provide_buf *p = &req->pbuf;
+	struct io_ring_ctx *ctx = req->ctx;
+	struct io_buffer *head;
 	int ret;
 
-	if (force_nonblock)
-		return -EAGAIN;
+	io_ring_submit_lock(ctx);
+	head = idr_find(&ctx->io_buffer_idr, p->bgid);
+	if (head)
+		ret = __io_remove_buffers(ctx, head, p->bgid, p->nbufs);
+	else
+		ret = -ENOENT;
+	io_ring_submit_unlock(ctx);
 
-	ret = do_madvise(ma->addr, ma->len, ma->advice);
 	if (ret < 0)
 		req_set_fail_links(req);
 	io_cqring_add_event(req, ret);
 	io_put_req_find_next(req, nxt);
 	return 0;
-#else
-	return -EOPNOTSUPP;
-#endif
 }
 
-static int io_fadvise_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
+static int io_provide_buffers_prep(struct io_kiocb *req,
+				   const struct io_uring_sqe *sqe)
 {
-	if (sqe->ioprio || sqe->buf_index || sqe->addr)
+	struct io_provide_buf *p = &req->pbuf;
+	u64 tmp;
+
+	if (sqe->ioprio || sqe->rw_flags)
 		return -EINVAL;
 
-	req->fadvise.offset = READ_ONCE(sqe->off);
-	req->fadvise.len = READ_ONCE(sqe->len);
-	req->fadvise.advice = READ_ONCE(sqe->fadvise_advice);
-	return 0;
+	tmp = READ_ONCE(sqe->fd);
+	if (!tmp || tmp > USHRT_MAX)
+		return -E2BIG;
+	p->nbufs = tmp;
+	p->addr = READ_ONCE(sqe->addr);
+	p->len = READ_ONCE(sqe->len);
+	if (p->len <= 0)
+		return -EINVAL;
+
+	if (!access_ok(u64_to_user_ptr(p->addr), (u64) p->len * p->nbufs))
+		return -EFAULT;
+
+	p->bgid = READ_ONCE(sqe->buf_group);
+	tmp = READ_ONCE(sqe->off);
+	if (tmp + p->nbufs - 1 > USHRT_MAX)
+		return -E2BIG;
+	p->bid = tmp;
+	return 0;
+}
+
+static int io_add_buffers(struct io_provide_buf *pbuf, struct io_buffer **head)
+{
+	struct io_buffer *buf;
+	u64 addr = pbuf->addr;
+	int i, bid = pbuf->bid;
+
+	for (i = 0; i < pbuf->nbufs; i++) {
+		buf = kmalloc(sizeof(*buf), GFP_KERNEL);
+		if (!buf)
+			break;
+
+		buf->addr = addr;
+		buf->len = pbuf->len;
+		buf->bid = bid;
+		buf->bgid = pbuf->bgid;
+		addr += pbuf->len;
+		bid++;
+		if (!*head) {
+			INIT_LIST_HEAD(&buf->list);
+			*head = buf;
+		} else {
+			list_add_tail(&buf->list, &(*head)->list);
+		}
+	}
+
+	return i ? i : -ENOMEM;
+}
+
+static int io_provide_buffers(struct io_kiocb *req, struct io_kiocb **nxt)
+{
+	struct io_provide_buf *p = &req->pbuf;
+	struct io_ring_ctx *ctx = req->ctx;
+	struct io_buffer *head, *list;
+	int ret = 0;
+
+	io_ring_submit_lock(ctx);
+
+	list = head = idr_find(&ctx->io_buffer_idr, p->bgid);
+
+	ret = io_add_buffers(p, &head);
+	if (ret < 0)
+		goto out;
+
+	if (!list) {
+		int id;
+
+		id = idr_alloc(&ctx->io_buffer_idr, head, p->bgid, p->bgid + 1,
+				GFP_KERNEL);
+		if (id < 0) {
+			__io_remove_buffers(ctx, head, p->bgid, -1U);
+			ret = id;
+			goto out;
+		}
+	}
+out:
+	io_ring_submit_unlock(ctx);
+	if (ret < 0)
+		req_set_fail_links(req);
+	io_cqring_add_event(req, ret);
+	io_put_req_find_next(req, nxt);
+	return 0;
+}
+
+static int __io_destroy_buffers(int id, void *p, void *data)
+{
+	struct io_ring_ctx *ctx = data;
+	struct io_buffer *buf = p;
+
+	__io_remove_buffers(ctx, buf, id, -1U);
+	return 0;
+}
+
+static void io_destroy_buffers(struct io_ring_ctx *ctx)
+{
+	idr_for_each(&ctx->io_buffer_idr, __io_destroy_buffers, ctx);
+	idr_destroy(&ctx->io_buffer_idr);
+}
+
+static int io_madvise_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
+{
+#if defined(CONFIG_ADVISE_SYSCALLS) && defined(CONFIG_MMU)
+	if (sqe->ioprio || sqe->buf_index || sqe->off)
+		return -EINVAL;
+
+	req->madvise.addr = READ_ONCE(sqe->addr);
+	req->madvise.len = READ_ONCE(sqe->len);
+	req->madvise.advice = READ_ONCE(sqe->fadvise_advice);
+	return 0;
+#else
+	return -EOPNOTSUPP;
+#endif
+}
+
+static int io_madvise(struct io_kiocb *req, struct io_kiocb **nxt,
+		      bool force_nonblock)
+{
+#if defined(CONFIG_ADVISE_SYSCALLS) && defined(CONFIG_MMU)
+	struct io_madvise *ma = &req->madvise;
+	int ret;
+
+	if (force_nonblock)
+		return -EAGAIN;
+
+	ret = do_madvise(ma->addr, ma->len, ma->advice);
+	if (ret < 0)
+		req_set_fail_links(req);
+	io_cqring_add_event(req, ret);
+	io_put_req_find_next(req, nxt);
+	return 0;
+#else
+	return -EOPNOTSUPP;
+#endif
+}
+
+static int io_fadvise_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
+{
+	if (sqe->ioprio || sqe->buf_index || sqe->addr)
+		return -EINVAL;
+
+	req->fadvise.offset = READ_ONCE(sqe->off);
+	req->fadvise.len = READ_ONCE(sqe->len);
+	req->fadvise.advice = READ_ONCE(sqe->fadvise_advice);
+	return 0;
 }
 
 static int io_fadvise(struct io_kiocb *req, struct io_kiocb **nxt,
@@ -3158,6 +3794,7 @@ static int io_recvmsg_prep(struct io_kiocb *req,
 	sr->msg_flags = READ_ONCE(sqe->msg_flags);
 	sr->msg = u64_to_user_ptr(READ_ONCE(sqe->addr));
 	sr->len = READ_ONCE(sqe->len);
+	sr->bgid = READ_ONCE(sqe->buf_group);
 
 	if (!io || req->opcode == IORING_OP_RECV)
 		return 0;
@@ -3263,11 +3900,22 @@ static int io_recv(struct io_kiocb *req, struct io_kiocb **nxt,
 	sock = sock_from_file(req->file, &ret);
 	if (sock) {
 		struct io_sr_msg *sr = &req->sr_msg;
+		void __user *buf = sr->buf;
+		size_t len = sr->len;
 		struct msghdr msg;
 		struct iovec iov;
 		unsigned flags;
 
-		ret = import_single_range(READ, sr->buf, sr->len, &iov,
+		if (req->flags & REQ_F_BUFFER_SELECT) {
+			struct io_buffer *kbuf;
+
+			kbuf = io_buffer_select(req, sr->bgid, &len);
+			if (IS_ERR(kbuf))
+				return PTR_ERR(kbuf);
+			buf = u64_to_user_ptr(kbuf->addr);
+		}
+
+		ret = import_single_range(READ, buf, len, &iov,
 						&msg.msg_iter);
 		if (ret)
 			return ret;
@@ -3286,8 +3934,10 @@ static int io_recv(struct io_kiocb *req, struct io_kiocb **nxt,
 			flags |= MSG_DONTWAIT;
 
 		ret = sock_recvmsg(sock, &msg, flags);
-		if (force_nonblock && ret == -EAGAIN)
+		if (force_nonblock && ret == -EAGAIN) {
+			io_buffer_recycle(req);
 			return -EAGAIN;
+		}
 		if (ret == -ERESTARTSYS)
 			ret = -EINTR;
 	}
@@ -3308,14 +3958,20 @@ static int io_accept_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
 #if defined(CONFIG_NET)
 	struct io_accept *accept = &req->accept;
 
+	unsigned ioprio;
+
 	if (unlikely(req->ctx->flags & (IORING_SETUP_IOPOLL|IORING_SETUP_SQPOLL)))
 		return -EINVAL;
-	if (sqe->ioprio || sqe->len || sqe->buf_index)
+	if (sqe->len || sqe->buf_index)
+		return -EINVAL;
+	ioprio = READ_ONCE(sqe->ioprio);
+	if (ioprio & ~IORING_ACCEPT_MULTISHOT)
 		return -EINVAL;
 
 	accept->addr = u64_to_user_ptr(READ_ONCE(sqe->addr));
 	accept->addr_len = u64_to_user_ptr(READ_ONCE(sqe->addr2));
 	accept->flags = READ_ONCE(sqe->accept_flags);
+	accept->multishot = ioprio & IORING_ACCEPT_MULTISHOT;
 	return 0;
 #else
 	return -EOPNOTSUPP;
@@ -3331,45 +3987,33 @@ static int __io_accept(struct io_kiocb *req, struct io_kiocb **nxt,
 	int ret;
 
 	file_flags = force_nonblock ? O_NONBLOCK : 0;
+retry:
 	ret = __sys_accept4_file(req->file, file_flags, accept->addr,
 					accept->addr_len, accept->flags);
 	if (ret == -EAGAIN && force_nonblock)
 		return -EAGAIN;
 	if (ret == -ERESTARTSYS)
 		ret = -EINTR;
+	/* multishot keeps accepting until the backlog is drained */
+	if (ret >= 0 && accept->multishot && io_cqring_add_event_more(req, ret))
+		goto retry;
 	if (ret < 0)
 		req_set_fail_links(req);
 	io_cqring_add_event(req, ret);
 	io_put_req_find_next(req, nxt);
 	return 0;
 }
-
-static void io_accept_finish(struct io_wq_work **workptr)
-{
-	struct io_kiocb *req = container_of(*workptr, struct io_kiocb, work);
-	struct io_kiocb *nxt = NULL;
-
-	if (io_req_cancelled(req))
-		return;
-	__io_accept(req, &nxt, false);
-	if (nxt)
-		io_wq_assign_next(workptr, nxt);
-}
 #endif
 
 static int io_accept(struct io_kiocb *req, struct io_kiocb **nxt,
 		     bool force_nonblock)
 {
 #if defined(CONFIG_NET)
-	int ret;
-
-	ret = __io_accept(req, nxt, force_nonblock);
-	if (ret == -EAGAIN && force_nonblock) {
-		req->work.func = io_accept_finish;
-		io_put_req(req);
-		return -EAGAIN;
-	}
-	return 0;
+	/*
+	 * On -EAGAIN the request is either retried once the socket is
+	 * readable, or punted to io_wq_submit_work() for a blocking accept.
+	 */
+	return __io_accept(req, nxt, force_nonblock);
 #else
 	return -EOPNOTSUPP;
 #endif
@@ -3445,10 +4089,46 @@ static int io_connect(struct io_kiocb *req, struct io_kiocb **nxt,
 #endif
 }
 
+/*
+ * Cancel a request waiting for its file to become ready, see
+ * io_arm_poll_handler().  Called with ->completion_lock held.
+ */
+static void io_async_poll_remove(struct io_kiocb *req)
+{
+	struct io_poll_iocb *apoll = req->apoll;
+	bool do_complete = false;
+
+	spin_lock(&apoll->head->lock);
+	WRITE_ONCE(apoll->canceled, true);
+	if (!list_empty(&apoll->wait.entry)) {
+		list_del_init(&apoll->wait.entry);
+		do_complete = true;
+	}
+	spin_unlock(&apoll->head->lock);
+	hash_del(&req->hash_node);
+
+	/* if the wakeup beat us, the queued retry sees ->canceled */
+	if (!do_complete)
+		return;
+
+	req->apoll = NULL;
+	kfree(apoll);
+	io_cqring_fill_event(req, -ECANCELED);
+	io_commit_cqring(req->ctx);
+	req_set_fail_links(req);
+	req->flags |= REQ_F_COMP_LOCKED;
+	io_double_put_req(req);
+}
+
 static void io_poll_remove_one(struct io_kiocb *req)
 {
 	struct io_poll_iocb *poll = &req->poll;
 
+	if (req->opcode != IORING_OP_POLL_ADD) {
+		io_async_poll_remove(req);
+		return;
+	}
+
 	spin_lock(&poll->head->lock);
 	WRITE_ONCE(poll->canceled, true);
 	if (!list_empty(&poll->wait.entry)) {
@@ -3474,6 +4154,8 @@ static void io_poll_remove_all(struct io_ring_ctx *ctx)
 			io_poll_remove_one(req);
 	}
 	spin_unlock_irq(&ctx->completion_lock);
+
+	io_cqring_ev_posted(ctx);
 }
 
 static int io_poll_cancel(struct io_ring_ctx *ctx, __u64 sqe_addr)
@@ -3568,11 +4250,23 @@ static void io_poll_complete_work(struct io_wq_work **workptr)
 	 * avoid further branches in the fast path.
 	 */
 	spin_lock_irq(&ctx->completion_lock);
+	/* don't re-arm if io_poll_remove_one() ran since we checked */
+	if (READ_ONCE(poll->canceled)) {
+		mask = 0;
+		ret = -ECANCELED;
+	}
 	if (!mask && ret != -ECANCELED) {
 		add_wait_queue(poll->head, &poll->wait);
 		spin_unlock_irq(&ctx->completion_lock);
 		return;
 	}
+	if (poll->multishot &&
+	    io_cqring_fill_event_more(req, mangle_poll(mask))) {
+		add_wait_queue(poll->head, &poll->wait);
+		spin_unlock_irq(&ctx->completion_lock);
+		io_cqring_ev_posted(ctx);
+		return;
+	}
 	hash_del(&req->hash_node);
 	io_poll_complete(req, mask, ret);
 	spin_unlock_irq(&ctx->completion_lock);
@@ -3627,6 +4321,33 @@ static void io_poll_trigger_evfd(struct io_wq_work **workptr)
 	io_put_req(req);
 }
 
+/*
+ * A multishot poll stays on the waitqueue and posts the event inline if it
+ * can. It can't if the eventfd is what's waking us, the completion_lock is
+ * contended or the CQ ring is full. io_poll_complete_work() then looks at
+ * the file again and either re-arms or completes the request.
+ */
+static int io_poll_multi_wake(struct io_kiocb *req, __poll_t mask)
+{
+	struct io_ring_ctx *ctx = req->ctx;
+	unsigned long flags;
+	bool posted = false;
+
+	if (mask && !(io_should_trigger_evfd(ctx) && eventfd_signal_count()) &&
+	    spin_trylock_irqsave(&ctx->completion_lock, flags)) {
+		posted = io_cqring_fill_event_more(req, mangle_poll(mask));
+		spin_unlock_irqrestore(&ctx->completion_lock, flags);
+	}
+
+	if (posted) {
+		io_cqring_ev_posted(ctx);
+	} else {
+		list_del_init(&req->poll.wait.entry);
+		io_queue_async_work(req);
+	}
+	return 1;
+}
+
 static int io_poll_wake(struct wait_queue_entry *wait, unsigned mode, int sync,
 			void *key)
 {
@@ -3639,6 +4360,9 @@ static int io_poll_wake(struct wait_queue_entry *wait, unsigned mode, int sync,
 	if (mask && !(mask & poll->events))
 		return 0;
 
+	if (poll->multishot)
+		return io_poll_multi_wake(req, mask);
+
 	list_del_init(&poll->wait.entry);
 
 	/*
@@ -3690,19 +4414,25 @@ struct io_poll_table {
 	int error;
 };
 
-static void io_poll_queue_proc(struct file *file, struct wait_queue_head *head,
-			       struct poll_table_struct *p)
+static void __io_queue_proc(struct io_poll_iocb *poll, struct io_poll_table *pt,
+			    struct wait_queue_head *head)
 {
-	struct io_poll_table *pt = container_of(p, struct io_poll_table, pt);
-
-	if (unlikely(pt->req->poll.head)) {
+	if (unlikely(poll->head)) {
 		pt->error = -EINVAL;
 		return;
 	}
 
 	pt->error = 0;
-	pt->req->poll.head = head;
-	add_wait_queue(head, &pt->req->poll.wait);
+	poll->head = head;
+	add_wait_queue(head, &poll->wait);
+}
+
+static void io_poll_queue_proc(struct file *file, struct wait_queue_head *head,
+			       struct poll_table_struct *p)
+{
+	struct io_poll_table *pt = container_of(p, struct io_poll_table, pt);
+
+	__io_queue_proc(&pt->req->poll, pt, head);
 }
 
 static void io_poll_req_insert(struct io_kiocb *req)
@@ -3717,17 +4447,22 @@ static void io_poll_req_insert(struct io_kiocb *req)
 static int io_poll_add_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
 {
 	struct io_poll_iocb *poll = &req->poll;
+	u32 flags;
 	u16 events;
 
 	if (unlikely(req->ctx->flags & IORING_SETUP_IOPOLL))
 		return -EINVAL;
-	if (sqe->addr || sqe->ioprio || sqe->off || sqe->len || sqe->buf_index)
+	if (sqe->addr || sqe->ioprio || sqe->off || sqe->buf_index)
+		return -EINVAL;
+	flags = READ_ONCE(sqe->len);
+	if (flags & ~IORING_POLL_ADD_MULTI)
 		return -EINVAL;
 	if (!poll->file)
 		return -EBADF;
 
 	events = READ_ONCE(sqe->poll_events);
 	poll->events = demangle_poll(events) | EPOLLERR | EPOLLHUP;
+	poll->multishot = flags & IORING_POLL_ADD_MULTI;
 	return 0;
 }
 
@@ -3736,7 +4471,7 @@ static int io_poll_add(struct io_kiocb *req, struct io_kiocb **nxt)
 	struct io_poll_iocb *poll = &req->poll;
 	struct io_ring_ctx *ctx = req->ctx;
 	struct io_poll_table ipt;
-	bool cancel = false;
+	bool cancel = false, posted = false;
 	__poll_t mask;
 
 	INIT_IO_WORK(&req->work, io_poll_complete_work);
@@ -3769,6 +4504,12 @@ static int io_poll_add(struct io_kiocb *req, struct io_kiocb **nxt)
 			ipt.error = 0;
 			mask = 0;
 		}
+		/* already ready, post the first event and stay armed */
+		if (mask && poll->multishot && !ipt.error &&
+		    io_cqring_fill_event_more(req, mangle_poll(mask))) {
+			posted = true;
+			mask = 0;
+		}
 		if (mask || ipt.error)
 			list_del_init(&poll->wait.entry);
 		else if (cancel)
@@ -3783,13 +4524,198 @@ static int io_poll_add(struct io_kiocb *req, struct io_kiocb **nxt)
 	}
 	spin_unlock_irq(&ctx->completion_lock);
 
-	if (mask) {
+	if (mask || posted)
 		io_cqring_ev_posted(ctx);
+	if (mask)
 		io_put_req_find_next(req, nxt);
-	}
 	return ipt.error;
 }
 
+static bool io_run_task_work(void)
+{
+	if (!current->task_works)
+		return false;
+
+	__set_current_state(TASK_RUNNING);
+	task_work_run();
+	return true;
+}
+
+/*
+ * Take a request armed by io_arm_poll_handler() off the cancel hash and
+ * free its poll entry.  Returns true if it was canceled in the meantime.
+ */
+static bool io_async_poll_disarm(struct io_kiocb *req)
+{
+	struct io_ring_ctx *ctx = req->ctx;
+	struct io_poll_iocb *apoll = req->apoll;
+	bool canceled;
+
+	spin_lock_irq(&ctx->completion_lock);
+	hash_del(&req->hash_node);
+	canceled = READ_ONCE(apoll->canceled);
+	spin_unlock_irq(&ctx->completion_lock);
+
+	req->apoll = NULL;
+	kfree(apoll);
+	return canceled;
+}
+
+static void io_async_poll_fail(struct io_kiocb *req)
+{
+	io_cqring_add_event(req, -ECANCELED);
+	req_set_fail_links(req);
+	io_double_put_req(req);
+}
+
+static void io_async_task_func(struct callback_head *cb)
+{
+	struct io_kiocb *req = container_of(cb, struct io_kiocb, task_work);
+	struct io_ring_ctx *ctx = req->ctx;
+	const struct cred *old_creds;
+
+	/* run from exit_task_work(), the mm is already gone */
+	if (io_async_poll_disarm(req) || (current->flags & PF_EXITING)) {
+		io_async_poll_fail(req);
+		return;
+	}
+
+	/* we may be running from io_cqring_wait() with the state set */
+	__set_current_state(TASK_RUNNING);
+	old_creds = override_creds(req->work.creds);
+	mutex_lock(&ctx->uring_lock);
+	__io_queue_sqe(req, NULL);
+	mutex_unlock(&ctx->uring_lock);
+	revert_creds(old_creds);
+}
+
+/*
+ * Only used when the submitting task can no longer run task_work, i.e. it
+ * is exiting.  There's nobody left to retry for, so cancel the request.
+ */
+static void io_async_poll_work(struct io_wq_work **workptr)
+{
+	struct io_kiocb *req = container_of(*workptr, struct io_kiocb, work);
+
+	io_async_poll_disarm(req);
+	io_async_poll_fail(req);
+}
+
+static int io_async_wake(struct wait_queue_entry *wait, unsigned mode, int sync,
+			 void *key)
+{
+	struct io_kiocb *req = wait->private;
+	struct io_poll_iocb *apoll = req->apoll;
+	struct task_struct *tsk = req->task;
+	__poll_t mask = key_to_poll(key);
+
+	/* for instances that support it check for an event match first: */
+	if (mask && !(mask & apoll->events))
+		return 0;
+
+	list_del_init(&apoll->wait.entry);
+
+	init_task_work(&req->task_work, io_async_task_func);
+	if (likely(!task_work_add(tsk, &req->task_work, true))) {
+		wake_up_process(tsk);
+	} else {
+		req->work.func = io_async_poll_work;
+		req->work.flags |= IO_WQ_WORK_UNBOUND;
+		io_wq_enqueue(req->ctx->io_wq, &req->work);
+	}
+	return 1;
+}
+
+static void io_async_queue_proc(struct file *file, struct wait_queue_head *head,
+				struct poll_table_struct *p)
+{
+	struct io_poll_table *pt = container_of(p, struct io_poll_table, pt);
+
+	__io_queue_proc(pt->req->apoll, pt, head);
+}
+
+/*
+ * Instead of punting a request that got -EAGAIN on a pollable file to an
+ * io-wq worker, which would then block on it, wait for the file to become
+ * ready and retry the request from the submitting task via task_work.
+ * Returns false if the request should be punted after all.
+ */
+static bool io_arm_poll_handler(struct io_kiocb *req)
+{
+	const struct io_op_def *def = &io_op_defs[req->opcode];
+	struct io_ring_ctx *ctx = req->ctx;
+	struct io_poll_iocb *apoll;
+	struct io_poll_table ipt;
+	bool woken = false;
+	__poll_t mask;
+
+	if (!req->file || !file_can_poll(req->file))
+		return false;
+	if (!def->pollin && !def->pollout)
+		return false;
+	if (req->flags & REQ_F_MUST_PUNT)
+		return false;
+	/* task_work only runs on the way back to userspace */
+	if (current->flags & PF_KTHREAD)
+		return false;
+
+	apoll = kmalloc(sizeof(*apoll), GFP_KERNEL);
+	if (unlikely(!apoll))
+		return false;
+
+	if (!req->task)
+		req->task = get_task_struct(current);
+	/* the retry must run with the same (personality) creds */
+	if (!req->work.creds)
+		req->work.creds = get_current_cred();
+	req->apoll = apoll;
+	INIT_HLIST_NODE(&req->hash_node);
+
+	mask = EPOLLERR | EPOLLHUP;
+	if (def->pollin)
+		mask |= EPOLLIN | EPOLLRDNORM;
+	if (def->pollout)
+		mask |= EPOLLOUT | EPOLLWRNORM;
+
+	apoll->file = req->file;
+	apoll->head = NULL;
+	apoll->events = mask;
+	apoll->done = false;
+	apoll->canceled = false;
+	INIT_LIST_HEAD(&apoll->wait.entry);
+	init_waitqueue_func_entry(&apoll->wait, io_async_wake);
+	apoll->wait.private = req;
+
+	ipt.pt._qproc = io_async_queue_proc;
+	ipt.pt._key = mask;
+	ipt.req = req;
+	ipt.error = -EINVAL;
+
+	mask = vfs_poll(req->file, &ipt.pt) & mask;
+
+	spin_lock_irq(&ctx->completion_lock);
+	if (likely(apoll->head)) {
+		spin_lock(&apoll->head->lock);
+		woken = list_empty(&apoll->wait.entry);
+		if (mask || ipt.error)
+			list_del_init(&apoll->wait.entry);
+		spin_unlock(&apoll->head->lock);
+	}
+	/* a wakeup that already fired owns the retry */
+	if (!woken && (mask || ipt.error)) {
+		spin_unlock_irq(&ctx->completion_lock);
+		req->apoll = NULL;
+		kfree(apoll);
+		return false;
+	}
+	if (!woken)
+		io_poll_req_insert(req);
+	spin_unlock_irq(&ctx->completion_lock);
+
+	req->flags |= REQ_F_POLLED;
+	return true;
+}
+
 static enum hrtimer_restart io_timeout_fn(struct hrtimer *timer)
 {
 	struct io_timeout_data *data = container_of(timer,
@@ -4212,6 +5138,18 @@ static int io_req_defer_prep(struct io_kiocb *req,
 	case IORING_OP_EPOLL_CTL:
 		ret = io_epoll_ctl_prep(req, sqe);
 		break;
+	case IORING_OP_PROVIDE_BUFFERS:
+		ret = io_provide_buffers_prep(req, sqe);
+		break;
+	case IORING_OP_REMOVE_BUFFERS:
+		ret = io_remove_buffers_prep(req, sqe);
+		break;
+	case IORING_OP_SPLICE:
+		ret = io_splice_prep(req, sqe);
+		break;
+	case IORING_OP_TEE:
+		ret = io_tee_prep(req, sqe);
+		break;
 	default:
 		printk_once(KERN_WARNING "io_uring: unhandled opcode %d\n",
 				req->opcode);
@@ -4274,6 +5212,10 @@ static void io_cleanup_req(struct io_kiocb *req)
 	case IORING_OP_STATX:
 		putname(req->open.filename);
 		break;
+	case IORING_OP_SPLICE:
+	case IORING_OP_TEE:
+		io_splice_put_file_in(req);
+		break;
 	}
 
 	req->flags &= ~REQ_F_NEED_CLEANUP;
@@ -4477,6 +5419,38 @@ static int io_issue_sqe(struct io_kiocb *req, const struct io_uring_sqe *sqe,
 		}
 		ret = io_epoll_ctl(req, nxt, force_nonblock);
 		break;
+	case IORING_OP_PROVIDE_BUFFERS:
+		if (sqe) {
+			ret = io_provide_buffers_prep(req, sqe);
+			if (ret)
+				break;
+		}
+		ret = io_provide_buffers(req, nxt);
+		break;
+	case IORING_OP_REMOVE_BUFFERS:
+		if (sqe) {
+			ret = io_remove_buffers_prep(req, sqe);
+			if (ret)
+				break;
+		}
+		ret = io_remove_buffers(req, nxt);
+		break;
+	case IORING_OP_SPLICE:
+		if (sqe) {
+			ret = io_splice_prep(req, sqe);
+			if (ret < 0)
+				break;
+		}
+		ret = io_splice(req, nxt, force_nonblock);
+		break;
+	case IORING_OP_TEE:
+		if (sqe) {
+			ret = io_tee_prep(req, sqe);
+			if (ret < 0)
+				break;
+		}
+		ret = io_splice(req, nxt, force_nonblock);
+		break;
 	default:
 		ret = -EINVAL;
 		break;
@@ -4555,21 +5529,11 @@ static int io_req_needs_file(struct io_kiocb *req, int fd)
 	return 1;
 }
 
-static inline struct file *io_file_from_index(struct io_ring_ctx *ctx,
-					      int index)
-{
-	struct fixed_file_table *table;
-
-	table = &ctx->file_data->table[index >> IORING_FILE_TABLE_SHIFT];
-	return table->files[index & IORING_FILE_TABLE_MASK];;
-}
-
 static int io_req_set_file(struct io_submit_state *state, struct io_kiocb *req,
 			   const struct io_uring_sqe *sqe)
 {
-	struct io_ring_ctx *ctx = req->ctx;
 	unsigned flags;
-	int fd;
+	int fd, ret;
 
 	flags = READ_ONCE(sqe->flags);
 	fd = READ_ONCE(sqe->fd);
@@ -4577,26 +5541,11 @@ static int io_req_set_file(struct io_submit_state *state, struct io_kiocb *req,
 	if (!io_req_needs_file(req, fd))
 		return 0;
 
-	if (flags & IOSQE_FIXED_FILE) {
-		if (unlikely(!ctx->file_data ||
-		    (unsigned) fd >= ctx->nr_user_files))
-			return -EBADF;
-		fd = array_index_nospec(fd, ctx->nr_user_files);
-		req->file = io_file_from_index(ctx, fd);
-		if (!req->file)
-			return -EBADF;
+	ret = io_req_get_file(state, req, fd, flags & IOSQE_FIXED_FILE,
+			      &req->file);
+	if (!ret && (flags & IOSQE_FIXED_FILE))
 		req->flags |= REQ_F_FIXED_FILE;
-		percpu_ref_get(&ctx->file_data->refs);
-	} else {
-		if (req->needs_fixed_file)
-			return -EBADF;
-		trace_io_uring_file_get(ctx, fd);
-		req->file = io_file_get(state, fd);
-		if (unlikely(!req->file))
-			return -EBADF;
-	}
-
-	return 0;
+	return ret;
 }
 
 static int io_grab_files(struct io_kiocb *req)
@@ -4696,6 +5645,9 @@ static struct io_kiocb *io_prep_linked_timeout(struct io_kiocb *req)
 
 	if (!(req->flags & REQ_F_LINK))
 		return NULL;
+	/* for polled retry, if flag is set, we already went through here */
+	if (req->flags & REQ_F_POLLED)
+		return NULL;
 
 	nxt = list_first_entry_or_null(&req->link_list, struct io_kiocb,
 					link_list);
@@ -4723,6 +5675,11 @@ static void __io_queue_sqe(struct io_kiocb *req, const struct io_uring_sqe *sqe)
 	 */
 	if (ret == -EAGAIN && (!(req->flags & REQ_F_NOWAIT) ||
 	    (req->flags & REQ_F_MUST_PUNT))) {
+		if (io_arm_poll_handler(req)) {
+			if (linked_timeout)
+				io_queue_linked_timeout(linked_timeout);
+			goto done_req;
+		}
 punt:
 		if (io_op_defs[req->opcode].file_table) {
 			ret = io_grab_files(req);
@@ -4803,7 +5760,8 @@ static inline void io_queue_link_head(struct io_kiocb *req)
 }
 
 #define SQE_VALID_FLAGS	(IOSQE_FIXED_FILE|IOSQE_IO_DRAIN|IOSQE_IO_LINK|	\
-				IOSQE_IO_HARDLINK | IOSQE_ASYNC)
+				IOSQE_IO_HARDLINK | IOSQE_ASYNC | \
+				IOSQE_BUFFER_SELECT)
 
 static bool io_submit_sqe(struct io_kiocb *req, const struct io_uring_sqe *sqe,
 			  struct io_submit_state *state, struct io_kiocb **link)
@@ -4820,6 +5778,11 @@ static bool io_submit_sqe(struct io_kiocb *req, const struct io_uring_sqe *sqe,
 		ret = -EINVAL;
 		goto err_req;
 	}
+	if ((sqe_flags & IOSQE_BUFFER_SELECT) &&
+	    !io_op_defs[req->opcode].buffer_select) {
+		ret = -EOPNOTSUPP;
+		goto err_req;
+	}
 
 	id = READ_ONCE(sqe->personality);
 	if (id) {
@@ -4835,7 +5798,7 @@ static bool io_submit_sqe(struct io_kiocb *req, const struct io_uring_sqe *sqe,
 
 	/* same numerical values with corresponding REQ_F_*, safe to copy */
 	req->flags |= sqe_flags & (IOSQE_IO_DRAIN|IOSQE_IO_HARDLINK|
-					IOSQE_ASYNC);
+					IOSQE_ASYNC|IOSQE_BUFFER_SELECT);
 
 	ret = io_req_set_file(state, req, sqe);
 	if (unlikely(ret)) {
@@ -5079,123 +6042,153 @@ static int io_submit_sqes(struct io_ring_ctx *ctx, unsigned int nr,
 	return submitted;
 }
 
+enum {
+	SQT_IDLE	= 1,
+	SQT_SPIN	= 2,
+	SQT_DID_WORK	= 4,
+};
+
+/*
+ * One pass of the SQPOLL thread over @ctx: reap polled completions and
+ * submit at most @cap new entries. Called with the sq_data lock held.
+ */
+static int __io_sq_thread(struct io_ring_ctx *ctx, unsigned int cap,
+			  struct mm_struct **cur_mm)
+{
+	const struct cred *old_cred;
+	unsigned int to_submit;
+	int sret = SQT_IDLE;
+	int ret;
+
+	if (ctx->flags & IORING_SETUP_IOPOLL) {
+		unsigned nr_events = 0;
+
+		/*
+		 * Keep spinning while we have poll entries outstanding, the
+		 * application is waiting for us to reap them.
+		 */
+		mutex_lock(&ctx->uring_lock);
+		if (!list_empty(&ctx->poll_list)) {
+			__io_iopoll_check(ctx, &nr_events, 0);
+			sret = SQT_SPIN;
+		}
+		mutex_unlock(&ctx->uring_lock);
+	}
+
+	to_submit = min(io_sqring_entries(ctx), cap);
+	if (!to_submit)
+		return sret;
+
+	/* Rings may belong to different tasks, don't carry one's mm over */
+	if (*cur_mm && *cur_mm != ctx->sqo_mm) {
+		unuse_mm(*cur_mm);
+		mmput(*cur_mm);
+		*cur_mm = NULL;
+	}
+
+	old_cred = override_creds(ctx->creds);
+	mutex_lock(&ctx->uring_lock);
+	ret = io_submit_sqes(ctx, to_submit, NULL, -1, cur_mm, true);
+	mutex_unlock(&ctx->uring_lock);
+	revert_creds(old_cred);
+
+	/*
+	 * If submit got -EBUSY, the application needs to reap and flush
+	 * events before we can make progress. Don't count it as work, and
+	 * io_sq_ring_has_work() lets us sleep until the application wakes us.
+	 */
+	if (ret > 0)
+		sret = SQT_DID_WORK;
+	return sret;
+}
+
+static bool io_sq_ring_has_work(struct io_ring_ctx *ctx)
+{
+	return io_sqring_entries(ctx) &&
+		list_empty_careful(&ctx->cq_overflow_list);
+}
+
 static int io_sq_thread(void *data)
 {
-	struct io_ring_ctx *ctx = data;
+	struct io_sq_data *sqd = data;
+	struct io_ring_ctx *ctx;
 	struct mm_struct *cur_mm = NULL;
-	const struct cred *old_cred;
 	mm_segment_t old_fs;
 	DEFINE_WAIT(wait);
-	unsigned inflight;
-	unsigned long timeout;
-	int ret;
+	unsigned long timeout = 0;
 
-	complete(&ctx->completions[1]);
+	complete(&sqd->started);
 
 	old_fs = get_fs();
 	set_fs(USER_DS);
-	old_cred = override_creds(ctx->creds);
 
-	ret = timeout = inflight = 0;
 	while (!kthread_should_park()) {
-		unsigned int to_submit;
-
-		if (inflight) {
-			unsigned nr_events = 0;
-
-			if (ctx->flags & IORING_SETUP_IOPOLL) {
-				/*
-				 * inflight is the count of the maximum possible
-				 * entries we submitted, but it can be smaller
-				 * if we dropped some of them. If we don't have
-				 * poll entries available, then we know that we
-				 * have nothing left to poll for. Reset the
-				 * inflight count to zero in that case.
-				 */
-				mutex_lock(&ctx->uring_lock);
-				if (!list_empty(&ctx->poll_list))
-					__io_iopoll_check(ctx, &nr_events, 0);
-				else
-					inflight = 0;
-				mutex_unlock(&ctx->uring_lock);
-			} else {
-				/*
-				 * Normal IO, just pretend everything completed.
-				 * We don't have to poll completions for that.
-				 */
-				nr_events = inflight;
-			}
+		unsigned int cap = UINT_MAX;
+		bool needs_sched = true;
+		int sret = 0;
+
+		mutex_lock(&sqd->lock);
+		if (!list_is_singular(&sqd->ctx_list))
+			cap = IORING_SQPOLL_CAP_ENTRIES;
+		list_for_each_entry(ctx, &sqd->ctx_list, sqd_list)
+			sret |= __io_sq_thread(ctx, cap, &cur_mm);
+		/* Start the next pass with the following ring */
+		if (!list_empty(&sqd->ctx_list))
+			list_rotate_left(&sqd->ctx_list);
+		if (sret & (SQT_SPIN | SQT_DID_WORK))
+			timeout = jiffies + sqd->sq_thread_idle;
+		mutex_unlock(&sqd->lock);
 
-			inflight -= nr_events;
-			if (!inflight)
-				timeout = jiffies + ctx->sq_thread_idle;
+		/*
+		 * We're polling. If we did work or are within the idle period
+		 * shared by all rings, spin without work before going to sleep.
+		 */
+		if ((sret & (SQT_SPIN | SQT_DID_WORK)) ||
+		    !time_after(jiffies, timeout)) {
+			cond_resched();
+			continue;
 		}
 
-		to_submit = io_sqring_entries(ctx);
-
 		/*
-		 * If submit got -EBUSY, flag us as needing the application
-		 * to enter the kernel to reap and flush events.
+		 * Drop cur_mm before scheduling, we can't hold it for
+		 * long periods (or over schedule()). Do this before
+		 * adding ourselves to the waitqueue, as the unuse/drop
+		 * may sleep.
 		 */
-		if (!to_submit || ret == -EBUSY) {
-			/*
-			 * We're polling. If we're within the defined idle
-			 * period, then let us spin without work before going
-			 * to sleep. The exception is if we got EBUSY doing
-			 * more IO, we should wait for the application to
-			 * reap events and wake us up.
-			 */
-			if (inflight ||
-			    (!time_after(jiffies, timeout) && ret != -EBUSY &&
-			    !percpu_ref_is_dying(&ctx->refs))) {
-				cond_resched();
-				continue;
-			}
-
-			/*
-			 * Drop cur_mm before scheduling, we can't hold it for
-			 * long periods (or over schedule()). Do this before
-			 * adding ourselves to the waitqueue, as the unuse/drop
-			 * may sleep.
-			 */
-			if (cur_mm) {
-				unuse_mm(cur_mm);
-				mmput(cur_mm);
-				cur_mm = NULL;
-			}
+		if (cur_mm) {
+			unuse_mm(cur_mm);
+			mmput(cur_mm);
+			cur_mm = NULL;
+		}
 
-			prepare_to_wait(&ctx->sqo_wait, &wait,
-						TASK_INTERRUPTIBLE);
+		mutex_lock(&sqd->lock);
+		prepare_to_wait(&sqd->wait, &wait, TASK_INTERRUPTIBLE);
 
-			/* Tell userspace we may need a wakeup call */
+		/* Tell userspace we may need a wakeup call */
+		list_for_each_entry(ctx, &sqd->ctx_list, sqd_list)
 			ctx->rings->sq_flags |= IORING_SQ_NEED_WAKEUP;
-			/* make sure to read SQ tail after writing flags */
-			smp_mb();
-
-			to_submit = io_sqring_entries(ctx);
-			if (!to_submit || ret == -EBUSY) {
-				if (kthread_should_park()) {
-					finish_wait(&ctx->sqo_wait, &wait);
-					break;
-				}
-				if (signal_pending(current))
-					flush_signals(current);
-				schedule();
-				finish_wait(&ctx->sqo_wait, &wait);
+		/* make sure to read SQ tail after writing flags */
+		smp_mb();
 
-				ctx->rings->sq_flags &= ~IORING_SQ_NEED_WAKEUP;
-				continue;
+		list_for_each_entry(ctx, &sqd->ctx_list, sqd_list) {
+			if (io_sq_ring_has_work(ctx)) {
+				needs_sched = false;
+				break;
 			}
-			finish_wait(&ctx->sqo_wait, &wait);
+		}
+		mutex_unlock(&sqd->lock);
 
-			ctx->rings->sq_flags &= ~IORING_SQ_NEED_WAKEUP;
+		if (needs_sched && !kthread_should_park()) {
+			if (signal_pending(current))
+				flush_signals(current);
+			schedule();
 		}
+		finish_wait(&sqd->wait, &wait);
 
-		mutex_lock(&ctx->uring_lock);
-		ret = io_submit_sqes(ctx, to_submit, NULL, -1, &cur_mm, true);
-		mutex_unlock(&ctx->uring_lock);
-		if (ret > 0)
-			inflight += ret;
+		mutex_lock(&sqd->lock);
+		list_for_each_entry(ctx, &sqd->ctx_list, sqd_list)
+			ctx->rings->sq_flags &= ~IORING_SQ_NEED_WAKEUP;
+		mutex_unlock(&sqd->lock);
 	}
 
 	set_fs(old_fs);
@@ -5203,7 +6196,6 @@ static int io_sq_thread(void *data)
 		unuse_mm(cur_mm);
 		mmput(cur_mm);
 	}
-	revert_creds(old_cred);
 
 	kthread_parkme();
 
@@ -5283,6 +6275,9 @@ static int io_cqring_wait(struct io_ring_ctx *ctx, int min_events,
 	do {
 		prepare_to_wait_exclusive(&ctx->wait, &iowq.wq,
 						TASK_INTERRUPTIBLE);
+		/* retries of polled requests may post the events we wait for */
+		if (io_run_task_work())
+			continue;
 		if (io_should_wake(&iowq, false))
 			break;
 		schedule();
@@ -5354,18 +6349,57 @@ static int io_sqe_files_unregister(struct io_ring_ctx *ctx)
 	return 0;
 }
 
-static void io_sq_thread_stop(struct io_ring_ctx *ctx)
+static void io_sq_update_thread_idle(struct io_sq_data *sqd)
+{
+	struct io_ring_ctx *ctx;
+	unsigned sq_thread_idle = 0;
+
+	list_for_each_entry(ctx, &sqd->ctx_list, sqd_list)
+		sq_thread_idle = max(sq_thread_idle, ctx->sq_thread_idle);
+	sqd->sq_thread_idle = sq_thread_idle;
+}
+
+/*
+ * Take @ctx off the sq thread's list. The thread holds sqd->lock for a whole
+ * pass, so once this returns it is done submitting for @ctx.
+ */
+static void io_sq_thread_detach(struct io_ring_ctx *ctx)
+{
+	struct io_sq_data *sqd = ctx->sq_data;
+
+	mutex_lock(&sqd->lock);
+	if (!list_empty(&ctx->sqd_list)) {
+		list_del_init(&ctx->sqd_list);
+		io_sq_update_thread_idle(sqd);
+	}
+	mutex_unlock(&sqd->lock);
+}
+
+static void io_put_sq_data(struct io_sq_data *sqd)
 {
-	if (ctx->sqo_thread) {
-		wait_for_completion(&ctx->completions[1]);
+	if (!refcount_dec_and_test(&sqd->refs))
+		return;
+
+	if (sqd->thread) {
+		wait_for_completion(&sqd->started);
 		/*
 		 * The park is a bit of a work-around, without it we get
 		 * warning spews on shutdown with SQPOLL set and affinity
 		 * set to a single CPU.
 		 */
-		kthread_park(ctx->sqo_thread);
-		kthread_stop(ctx->sqo_thread);
-		ctx->sqo_thread = NULL;
+		kthread_park(sqd->thread);
+		kthread_stop(sqd->thread);
+	}
+	kfree(sqd);
+}
+
+static void io_sq_thread_stop(struct io_ring_ctx *ctx)
+{
+	if (ctx->sq_data) {
+		io_sq_thread_detach(ctx);
+		io_put_sq_data(ctx->sq_data);
+		ctx->sq_data = NULL;
+		ctx->sqo_wait = NULL;
 	}
 }
 
@@ -5963,12 +6997,61 @@ static int io_init_wq_offload(struct io_ring_ctx *ctx,
 	return ret;
 }
 
+/*
+ * With IORING_SETUP_ATTACH_WQ, an SQPOLL ring shares the sq thread of the
+ * ring at p->wq_fd, if that ring has one.
+ */
+static struct io_sq_data *io_attach_sq_data(struct io_uring_params *p)
+{
+	struct io_ring_ctx *ctx_attach;
+	struct io_sq_data *sqd;
+	struct fd f;
+
+	f = fdget(p->wq_fd);
+	if (!f.file)
+		return ERR_PTR(-EBADF);
+	if (f.file->f_op != &io_uring_fops) {
+		fdput(f);
+		return ERR_PTR(-EINVAL);
+	}
+
+	ctx_attach = f.file->private_data;
+	/* @sq_data is protected by holding the fd */
+	sqd = ctx_attach->sq_data;
+	if (sqd)
+		refcount_inc(&sqd->refs);
+	fdput(f);
+	return sqd;
+}
+
+static struct io_sq_data *io_get_sq_data(struct io_uring_params *p)
+{
+	struct io_sq_data *sqd;
+
+	if (p->flags & IORING_SETUP_ATTACH_WQ) {
+		sqd = io_attach_sq_data(p);
+		if (sqd)
+			return sqd;
+	}
+
+	sqd = kzalloc(sizeof(*sqd), GFP_KERNEL);
+	if (!sqd)
+		return ERR_PTR(-ENOMEM);
+
+	refcount_set(&sqd->refs, 1);
+	mutex_init(&sqd->lock);
+	INIT_LIST_HEAD(&sqd->ctx_list);
+	init_waitqueue_head(&sqd->wait);
+	init_completion(&sqd->started);
+	return sqd;
+}
+
 static int io_sq_offload_start(struct io_ring_ctx *ctx,
 			       struct io_uring_params *p)
 {
+	struct io_sq_data *sqd = NULL;
 	int ret;
 
-	init_waitqueue_head(&ctx->sqo_wait);
 	mmgrab(current->mm);
 	ctx->sqo_mm = current->mm;
 
@@ -5977,10 +7060,22 @@ static int io_sq_offload_start(struct io_ring_ctx *ctx,
 		if (!capable(CAP_SYS_ADMIN))
 			goto err;
 
+		sqd = io_get_sq_data(p);
+		if (IS_ERR(sqd)) {
+			ret = PTR_ERR(sqd);
+			goto err;
+		}
+		ctx->sq_data = sqd;
+		ctx->sqo_wait = &sqd->wait;
+
 		ctx->sq_thread_idle = msecs_to_jiffies(p->sq_thread_idle);
 		if (!ctx->sq_thread_idle)
 			ctx->sq_thread_idle = HZ;
 
+		/* An attached ring runs on the existing thread and its CPU */
+		if (sqd->thread)
+			goto done;
+
 		if (p->flags & IORING_SETUP_SQ_AFF) {
 			int cpu = p->sq_thread_cpu;
 
@@ -5990,29 +7085,38 @@ static int io_sq_offload_start(struct io_ring_ctx *ctx,
 			if (!cpu_online(cpu))
 				goto err;
 
-			ctx->sqo_thread = kthread_create_on_cpu(io_sq_thread,
-							ctx, cpu,
+			sqd->thread = kthread_create_on_cpu(io_sq_thread,
+							sqd, cpu,
 							"io_uring-sq");
 		} else {
-			ctx->sqo_thread = kthread_create(io_sq_thread, ctx,
+			sqd->thread = kthread_create(io_sq_thread, sqd,
 							"io_uring-sq");
 		}
-		if (IS_ERR(ctx->sqo_thread)) {
-			ret = PTR_ERR(ctx->sqo_thread);
-			ctx->sqo_thread = NULL;
+		if (IS_ERR(sqd->thread)) {
+			ret = PTR_ERR(sqd->thread);
+			sqd->thread = NULL;
 			goto err;
 		}
-		wake_up_process(ctx->sqo_thread);
+		wake_up_process(sqd->thread);
 	} else if (p->flags & IORING_SETUP_SQ_AFF) {
 		/* Can't have SQ_AFF without SQPOLL */
 		ret = -EINVAL;
 		goto err;
 	}
-
+done:
 	ret = io_init_wq_offload(ctx, p);
 	if (ret)
 		goto err;
 
+	if (sqd) {
+		mutex_lock(&sqd->lock);
+		list_add_tail(&ctx->sqd_list, &sqd->ctx_list);
+		io_sq_update_thread_idle(sqd);
+		mutex_unlock(&sqd->lock);
+		/* make an idle thread set IORING_SQ_NEED_WAKEUP for us too */
+		wake_up(&sqd->wait);
+	}
+
 	return 0;
 err:
 	io_finish_async(ctx);
@@ -6339,6 +7443,7 @@ static void io_ring_ctx_free(struct io_ring_ctx *ctx)
 	io_sqe_buffer_unregister(ctx);
 	io_sqe_files_unregister(ctx);
 	io_eventfd_unregister(ctx);
+	io_destroy_buffers(ctx);
 
 #if defined(CONFIG_UNIX)
 	if (ctx->ring_sock) {
@@ -6407,14 +7512,15 @@ static void io_ring_ctx_wait_and_kill(struct io_ring_ctx *ctx)
 	mutex_unlock(&ctx->uring_lock);
 
 	/*
-	 * Wait for sq thread to idle, if we have one. It won't spin on new
-	 * work after we've killed the ctx ref above. This is important to do
-	 * before we cancel existing commands, as the thread could otherwise
-	 * be queueing new work post that. If that's work we need to cancel,
-	 * it could cause shutdown to hang.
+	 * Take the ring off the sq thread, if we have one. The thread may be
+	 * shared with other rings and never idle, but once detached it won't
+	 * queue new work for us. This is important to do before we cancel
+	 * existing commands, as the thread could otherwise be queueing new
+	 * work post that. If that's work we need to cancel, it could cause
+	 * shutdown to hang.
 	 */
-	while (ctx->sqo_thread && !wq_has_sleeper(&ctx->sqo_wait))
-		cpu_relax();
+	if (ctx->sq_data)
+		io_sq_thread_detach(ctx);
 
 	io_kill_timeouts(ctx);
 	io_poll_remove_all(ctx);
@@ -6618,7 +7724,7 @@ SYSCALL_DEFINE6(io_uring_enter, unsigned int, fd, u32, to_submit,
 		if (!list_empty_careful(&ctx->cq_overflow_list))
 			io_cqring_overflow_flush(ctx, false);
 		if (flags & IORING_ENTER_SQ_WAKEUP)
-			wake_up(&ctx->sqo_wait);
+			wake_up(ctx->sqo_wait);
 		submitted = to_submit;
 	} else if (to_submit) {
 		struct mm_struct *cur_mm;
@@ -6926,7 +8032,7 @@ static int io_uring_create(unsigned entries, struct io_uring_params *p)
 
 	p->features = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP |
 			IORING_FEAT_SUBMIT_STABLE | IORING_FEAT_RW_CUR_POS |
-			IORING_FEAT_CUR_PERSONALITY;
+			IORING_FEAT_CUR_PERSONALITY | IORING_FEAT_FAST_POLL;
 	trace_io_uring_create(ret, ctx, p->sq_entries, p->cq_entries, p->flags);
 	return ret;
 err:
@@ -7204,6 +8310,7 @@ static int __init io_uring_init(void)
 	BUILD_BUG_SQE_ELEM(8,  __u64,  off);
 	BUILD_BUG_SQE_ELEM(8,  __u64,  addr2);
 	BUILD_BUG_SQE_ELEM(16, __u64,  addr);
+	BUILD_BUG_SQE_ELEM(16, __u64,  splice_off_in);
 	BUILD_BUG_SQE_ELEM(24, __u32,  len);
 	BUILD_BUG_SQE_ELEM(28,     __kernel_rwf_t, rw_flags);
 	BUILD_BUG_SQE_ELEM(28, /* compat */   int, rw_flags);
@@ -7218,9 +8325,12 @@ static int __init io_uring_init(void)
 	BUILD_BUG_SQE_ELEM(28, __u32,  open_flags);
 	BUILD_BUG_SQE_ELEM(28, __u32,  statx_flags);
 	BUILD_BUG_SQE_ELEM(28, __u32,  fadvise_advice);
+	BUILD_BUG_SQE_ELEM(28, __u32,  splice_flags);
 	BUILD_BUG_SQE_ELEM(32, __u64,  user_data);
 	BUILD_BUG_SQE_ELEM(40, __u16,  buf_index);
+	BUILD_BUG_SQE_ELEM(40, __u16,  buf_group);
 	BUILD_BUG_SQE_ELEM(42, __u16,  personality);
+	BUILD_BUG_SQE_ELEM(44, __s32,  splice_fd_in);
 
 	BUILD_BUG_ON(ARRAY_SIZE(io_op_defs) != IORING_OP_LAST);
 	req_cachep = KMEM_CACHE(io_kiocb, SLAB_HWCACHE_ALIGN | SLAB_PANIC);
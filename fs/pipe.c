@@ -36,6 +36,13 @@
  */
 unsigned int pipe_max_size = 1048576;
 
+/*
+ * The largest page order a pipe grown with F_SETPIPE_SZ may use for the
+ * buffers filled by write().  0 keeps every buffer a single page.  Can be
+ * set by root in /proc/sys/fs/pipe-max-buf-order
+ */
+unsigned int pipe_max_buf_order;
+
 /* Maximum allocatable pages per user. Hard limit is unset by default, soft
  * matches default values.
  */
@@ -134,7 +141,8 @@ static void anon_pipe_buf_release(struct pipe_inode_info *pipe,
 	 * temporary page, let's keep track of it as a one-deep
 	 * allocation cache. (Otherwise just release our reference to it)
 	 */
-	if (page_count(page) == 1 && !pipe->tmp_page)
+	if (page_count(page) == 1 && !pipe->tmp_page &&
+	    compound_order(page) <= pipe->buf_order)
 		pipe->tmp_page = page;
 	else
 		put_page(page);
@@ -145,6 +153,10 @@ static int anon_pipe_buf_steal(struct pipe_inode_info *pipe,
 {
 	struct page *page = buf->page;
 
+	/* Nobody stealing pages expects more than one */
+	if (PageCompound(page))
+		return 1;
+
 	if (page_count(page) == 1) {
 		memcg_kmem_uncharge(page, 0);
 		__SetPageLocked(page);
@@ -273,6 +285,30 @@ static bool pipe_buf_can_merge(struct pipe_buffer *buf)
 	return buf->ops == &anon_pipe_buf_ops;
 }
 
+/*
+ * Get a page for a new anonymous buffer: the cached one, or a fresh one of
+ * the pipe's buffer order if a @large buffer may be used.  Large pages are
+ * opportunistic; if they can't be had cheaply we fall back to a single page.
+ */
+static struct page *anon_pipe_get_page(struct pipe_inode_info *pipe,
+				       bool large)
+{
+	struct page *page = pipe->tmp_page;
+
+	if (page)
+		return page;
+
+	if (large) {
+		page = alloc_pages(GFP_KERNEL | __GFP_ACCOUNT | __GFP_COMP |
+				   __GFP_NORETRY | __GFP_NOWARN,
+				   pipe->buf_order);
+		if (page)
+			return page;
+	}
+
+	return alloc_page(GFP_HIGHUSER | __GFP_ACCOUNT);
+}
+
 /* Done while waiting without holding the pipe lock - thus the READ_ONCE() */
 static inline bool pipe_readable(const struct pipe_inode_info *pipe)
 {
@@ -363,7 +399,8 @@ pipe_read(struct kiocb *iocb, struct iov_iter *to)
 			break;
 		if (ret)
 			break;
-		if (filp->f_flags & O_NONBLOCK) {
+		if ((filp->f_flags & O_NONBLOCK) ||
+		    (iocb->ki_flags & IOCB_NOWAIT)) {
 			ret = -EAGAIN;
 			break;
 		}
@@ -472,13 +509,14 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 	 */
 	head = pipe->head;
 	was_empty = pipe_empty(head, pipe->tail);
-	chars = total_len & (PAGE_SIZE-1);
+	chars = total_len & ((PAGE_SIZE << pipe->buf_order) - 1);
 	if (chars && !was_empty) {
 		unsigned int mask = pipe->ring_size - 1;
 		struct pipe_buffer *buf = &pipe->bufs[(head - 1) & mask];
 		int offset = buf->offset + buf->len;
 
-		if (pipe_buf_can_merge(buf) && offset + chars <= PAGE_SIZE) {
+		if (pipe_buf_can_merge(buf) &&
+		    offset + chars <= page_size(buf->page)) {
 			ret = pipe_buf_confirm(pipe, buf);
 			if (ret)
 				goto out;
@@ -507,17 +545,26 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 		if (!pipe_full(head, pipe->tail, pipe->max_usage)) {
 			unsigned int mask = pipe->ring_size - 1;
 			struct pipe_buffer *buf = &pipe->bufs[head & mask];
-			struct page *page = pipe->tmp_page;
+			struct page *page;
+			size_t size;
+			bool large;
 			int copied;
 
-			if (!page) {
-				page = alloc_page(GFP_HIGHUSER | __GFP_ACCOUNT);
-				if (unlikely(!page)) {
-					ret = ret ? : -ENOMEM;
-					break;
-				}
-				pipe->tmp_page = page;
+			/*
+			 * Every slot may hold a page, whoever fills it.  Only
+			 * the first max_usage >> buf_order occupied slots get
+			 * a large page, so write() never pins much more than
+			 * twice the size of the pipe.
+			 */
+			large = pipe->buf_order &&
+				pipe_occupancy(head, pipe->tail) <
+				(pipe->max_usage >> pipe->buf_order);
+			page = anon_pipe_get_page(pipe, large);
+			if (unlikely(!page)) {
+				ret = ret ? : -ENOMEM;
+				break;
 			}
+			pipe->tmp_page = page;
 
 			/* Allocate a slot in the ring in advance and attach an
 			 * empty buffer.  If we fault or otherwise fail to use
@@ -548,8 +595,9 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 			}
 			pipe->tmp_page = NULL;
 
-			copied = copy_page_from_iter(page, 0, PAGE_SIZE, from);
-			if (unlikely(copied < PAGE_SIZE && iov_iter_count(from))) {
+			size = page_size(page);
+			copied = copy_page_from_iter(page, 0, size, from);
+			if (unlikely(copied < size && iov_iter_count(from))) {
 				if (!ret)
 					ret = -EFAULT;
 				break;
@@ -566,7 +614,8 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 			continue;
 
 		/* Wait for buffer space to become available. */
-		if (filp->f_flags & O_NONBLOCK) {
+		if ((filp->f_flags & O_NONBLOCK) ||
+		    (iocb->ki_flags & IOCB_NOWAIT)) {
 			if (!ret)
 				ret = -EAGAIN;
 			break;
@@ -837,7 +886,7 @@ void free_pipe_info(struct pipe_inode_info *pipe)
 			pipe_buf_release(pipe, buf);
 	}
 	if (pipe->tmp_page)
-		__free_page(pipe->tmp_page);
+		put_page(pipe->tmp_page);
 	kfree(pipe->bufs);
 	kfree(pipe);
 }
@@ -927,6 +976,8 @@ int create_pipe_files(struct file **res, int flags)
 	res[1] = f;
 	stream_open(inode, res[0]);
 	stream_open(inode, res[1]);
+	res[0]->f_mode |= FMODE_NOWAIT;
+	res[1]->f_mode |= FMODE_NOWAIT;
 	return 0;
 }
 
@@ -1067,6 +1118,7 @@ static int fifo_open(struct inode *inode, struct file *filp)
 
 	/* We can only do regular read/write on fifos */
 	stream_open(inode, filp);
+	filp->f_mode |= FMODE_NOWAIT;
 
 	switch (filp->f_mode & (FMODE_READ | FMODE_WRITE)) {
 	case FMODE_READ:
@@ -1182,6 +1234,26 @@ unsigned int round_pipe_size(unsigned long size)
 	return roundup_pow_of_two(size);
 }
 
+/*
+ * Pick the page order of the buffers write() fills in a pipe of @nr_slots.
+ * Large pipes get larger buffers so that bulk writes need fewer allocations
+ * and copies, as long as at least the default number of slots can hold one.
+ * The ring keeps one slot per page, as splice and vmsplice still fill a
+ * single page per slot.
+ */
+static unsigned int pipe_size_to_order(unsigned int nr_slots)
+{
+	unsigned int max_order = READ_ONCE(pipe_max_buf_order);
+	unsigned int order = 0;
+
+	max_order = min_t(unsigned int, max_order, PIPE_MAX_BUF_ORDER);
+	while (order < max_order &&
+	       (nr_slots >> (order + 1)) >= PIPE_DEF_BUFFERS)
+		order++;
+
+	return order;
+}
+
 /*
  * Allocate a new array of pipe buffers and copy the info over. Returns the
  * pipe size if successful, or return -ERROR on error.
@@ -1189,7 +1261,7 @@ unsigned int round_pipe_size(unsigned long size)
 static long pipe_set_size(struct pipe_inode_info *pipe, unsigned long arg)
 {
 	struct pipe_buffer *bufs;
-	unsigned int size, nr_slots, head, tail, mask, n;
+	unsigned int size, nr_slots, order, head, tail, mask, n;
 	unsigned long user_bufs;
 	long ret = 0;
 
@@ -1199,6 +1271,8 @@ static long pipe_set_size(struct pipe_inode_info *pipe, unsigned long arg)
 	if (!nr_slots)
 		return -EINVAL;
 
+	order = pipe_size_to_order(nr_slots);
+
 	/*
 	 * If trying to increase the pipe capacity, check that an
 	 * unprivileged user is not trying to exceed various limits
@@ -1271,6 +1345,11 @@ static long pipe_set_size(struct pipe_inode_info *pipe, unsigned long arg)
 	pipe->max_usage = nr_slots;
 	pipe->tail = tail;
 	pipe->head = head;
+	if (pipe->tmp_page && compound_order(pipe->tmp_page) > order) {
+		put_page(pipe->tmp_page);
+		pipe->tmp_page = NULL;
+	}
+	pipe->buf_order = order;
 	wake_up_interruptible_all(&pipe->rd_wait);
 	wake_up_interruptible_all(&pipe->wr_wait);
 	return pipe->max_usage * PAGE_SIZE;
@@ -66,6 +66,43 @@ static struct buffer_head *get_block_length(struct super_block *sb,
 }
 
 
+/*
+ * Start reading the device blocks of a datablock without waiting for them.
+ * Readahead does this for a run of datablocks before decompressing any of
+ * them, so that squashfs_read_data() later finds the buffers uptodate or
+ * already under I/O.
+ */
+void squashfs_prefetch_data(struct super_block *sb, u64 index, int length)
+{
+	struct squashfs_sb_info *msblk = sb->s_fs_info;
+	struct buffer_head *bh[16];
+	u64 cur_index = index >> msblk->devblksize_log2;
+	u64 end_index;
+	int b;
+
+	length = SQUASHFS_COMPRESSED_SIZE_BLOCK(length);
+	if (length <= 0 || (index + length) > msblk->bytes_used)
+		return;
+
+	end_index = (index + length + msblk->devblksize - 1) >>
+		msblk->devblksize_log2;
+
+	while (cur_index < end_index) {
+		for (b = 0; b < ARRAY_SIZE(bh) && cur_index < end_index;
+				b++, cur_index++) {
+			bh[b] = sb_getblk(sb, cur_index);
+			if (bh[b] == NULL) {
+				end_index = cur_index;
+				break;
+			}
+		}
+		ll_rw_block(REQ_OP_READ, REQ_RAHEAD, b, bh);
+		while (b--)
+			put_bh(bh[b]);
+	}
+}
+
+
 /*
  * Read and decompress a metadata block or datablock.  Length is non-zero
  * if a datablock is being read (the size is stored elsewhere in the
@@ -100,6 +100,7 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 			 * disk.
 			 */
 			cache->unused--;
+			cache->misses++;
 			entry->block = block;
 			entry->refcount = 1;
 			entry->pending = 1;
@@ -138,6 +139,7 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 		 * for reuse.
 		 */
 		entry = &cache->entry[i];
+		cache->hits++;
 		if (entry->refcount == 0)
 			cache->unused--;
 		entry->refcount++;
@@ -34,6 +34,8 @@
 #include <linux/string.h>
 #include <linux/pagemap.h>
 #include <linux/mutex.h>
+#include <linux/blkdev.h>
+#include <linux/workqueue.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
@@ -495,6 +497,238 @@ static int squashfs_readpage(struct file *file, struct page *page)
 }
 
 
+/* A datablock being read ahead, and the page cache pages it fills */
+struct squashfs_ra_block {
+	struct work_struct	work;
+	struct list_head	list;
+	struct super_block	*sb;
+	u64			block;
+	int			bsize;
+	int			expected;
+	int			pages;
+	struct page		*page[];
+};
+
+/*
+ * Readahead blocks of all mounts are decompressed on one workqueue.  Each
+ * mount keeps at most "parallel" work items running on it; further blocks
+ * wait on the mount's ra_pending list and are picked up by the running
+ * work items as they finish their block.
+ */
+static struct workqueue_struct *squashfs_read_wq;
+
+int __init squashfs_readahead_init(void)
+{
+	squashfs_read_wq = alloc_workqueue("squashfs_read",
+		WQ_UNBOUND | WQ_MEM_RECLAIM, 0);
+
+	return squashfs_read_wq ? 0 : -ENOMEM;
+}
+
+void squashfs_readahead_exit(void)
+{
+	destroy_workqueue(squashfs_read_wq);
+}
+
+static bool squashfs_readahead_idle(struct squashfs_sb_info *msblk)
+{
+	bool idle;
+
+	spin_lock(&msblk->ra_lock);
+	idle = msblk->ra_active == 0;
+	spin_unlock(&msblk->ra_lock);
+
+	return idle;
+}
+
+/* Wait for the readahead of a mount that is going away to finish */
+void squashfs_readahead_wait(struct squashfs_sb_info *msblk)
+{
+	wait_event(msblk->ra_wait, squashfs_readahead_idle(msblk));
+}
+
+static void squashfs_readahead_one(struct squashfs_ra_block *rab)
+{
+	struct squashfs_sb_info *msblk = rab->sb->s_fs_info;
+	int i;
+
+	if (!squashfs_readahead_block(rab->sb, rab->page, rab->pages,
+			rab->block, rab->bsize, rab->expected))
+		atomic_long_inc(&msblk->ra_blocks);
+
+	for (i = 0; i < rab->pages; i++) {
+		if (rab->page[i] == NULL)
+			continue;
+		unlock_page(rab->page[i]);
+		put_page(rab->page[i]);
+	}
+	kfree(rab);
+}
+
+static void squashfs_readahead_work(struct work_struct *work)
+{
+	struct squashfs_ra_block *rab = container_of(work,
+		struct squashfs_ra_block, work);
+	struct squashfs_sb_info *msblk = rab->sb->s_fs_info;
+
+	do {
+		squashfs_readahead_one(rab);
+		cond_resched();
+
+		spin_lock(&msblk->ra_lock);
+		rab = NULL;
+		/* "parallel" may have been lowered by a remount */
+		if (msblk->ra_active <= msblk->parallel)
+			rab = list_first_entry_or_null(&msblk->ra_pending,
+				struct squashfs_ra_block, list);
+		if (rab) {
+			list_del(&rab->list);
+		} else if (--msblk->ra_active == 0) {
+			/* Under ra_lock: msblk may go once it is dropped */
+			wake_up(&msblk->ra_wait);
+		}
+		spin_unlock(&msblk->ra_lock);
+	} while (rab);
+}
+
+/* Start work items for pending blocks up to the mount's limit */
+static void squashfs_readahead_start(struct squashfs_sb_info *msblk)
+{
+	struct squashfs_ra_block *rab;
+
+	while (msblk->ra_active < msblk->parallel) {
+		rab = list_first_entry_or_null(&msblk->ra_pending,
+			struct squashfs_ra_block, list);
+		if (rab == NULL)
+			break;
+		list_del(&rab->list);
+		msblk->ra_active++;
+		queue_work(squashfs_read_wq, &rab->work);
+	}
+}
+
+static void squashfs_readahead_queue(struct squashfs_sb_info *msblk,
+	struct list_head *blocks)
+{
+	spin_lock(&msblk->ra_lock);
+	list_splice_tail_init(blocks, &msblk->ra_pending);
+	squashfs_readahead_start(msblk);
+	spin_unlock(&msblk->ra_lock);
+}
+
+void squashfs_readahead_set_parallel(struct squashfs_sb_info *msblk,
+	unsigned int parallel)
+{
+	spin_lock(&msblk->ra_lock);
+	msblk->parallel = parallel;
+	squashfs_readahead_start(msblk);
+	spin_unlock(&msblk->ra_lock);
+}
+
+/*
+ * Set up readahead of datablock @index.  Returns NULL if the block lies
+ * beyond the end of the file, is a fragment or sparse block, or can't be
+ * looked up, in which case its pages are read by squashfs_readpage().
+ */
+static struct squashfs_ra_block *squashfs_ra_block_alloc(struct inode *inode,
+	int index)
+{
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	int shift = msblk->block_log - PAGE_SHIFT;
+	loff_t i_size = i_size_read(inode);
+	int file_end = i_size >> msblk->block_log;
+	pgoff_t start_index = (pgoff_t) index << shift;
+	pgoff_t end_index = (i_size + PAGE_SIZE - 1) >> PAGE_SHIFT;
+	struct squashfs_ra_block *rab;
+	u64 block = 0;
+	int bsize;
+
+	if (start_index >= end_index)
+		return NULL;
+
+	if (index == file_end && squashfs_i(inode)->fragment_block !=
+					SQUASHFS_INVALID_BLK)
+		return NULL;
+
+	bsize = read_blocklist(inode, index, &block);
+	if (bsize <= 0)
+		return NULL;
+
+	rab = kzalloc(struct_size(rab, page, 1 << shift), GFP_KERNEL);
+	if (rab == NULL)
+		return NULL;
+
+	INIT_WORK(&rab->work, squashfs_readahead_work);
+	rab->sb = inode->i_sb;
+	rab->block = block;
+	rab->bsize = bsize;
+	rab->pages = min_t(pgoff_t, 1 << shift, end_index - start_index);
+	rab->expected = index == file_end ?
+			(i_size & (msblk->block_size - 1)) :
+			 msblk->block_size;
+
+	return rab;
+}
+
+/*
+ * Readahead works on whole datablocks.  The device I/O for every datablock
+ * in the window is started before any of them is decompressed, then the
+ * blocks are decompressed in parallel on the read workqueue, up to the
+ * "parallel" mount option at a time.  The work items unlock the pages as
+ * each block completes.
+ */
+static int squashfs_readpages(struct file *file, struct address_space *mapping,
+	struct list_head *pages, unsigned int nr_pages)
+{
+	struct inode *inode = mapping->host;
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	int shift = msblk->block_log - PAGE_SHIFT;
+	int mask = (1 << shift) - 1;
+	gfp_t gfp = readahead_gfp_mask(mapping);
+	struct squashfs_ra_block *rab = NULL;
+	struct blk_plug plug;
+	LIST_HEAD(blocks);
+	int index = -1;
+
+	while (!list_empty(pages)) {
+		struct page *page = lru_to_page(pages);
+		int block_index = page->index >> shift;
+
+		list_del(&page->lru);
+		if (add_to_page_cache_lru(page, mapping, page->index, gfp)) {
+			put_page(page);
+			continue;
+		}
+
+		if (block_index != index) {
+			index = block_index;
+			rab = squashfs_ra_block_alloc(inode, index);
+			if (rab)
+				list_add_tail(&rab->list, &blocks);
+		}
+
+		/* The workqueue drops our reference once the page is read */
+		if (rab && (page->index & mask) < rab->pages) {
+			rab->page[page->index & mask] = page;
+			continue;
+		}
+
+		squashfs_readpage(file, page);
+		put_page(page);
+	}
+
+	blk_start_plug(&plug);
+	list_for_each_entry(rab, &blocks, list)
+		squashfs_prefetch_data(inode->i_sb, rab->block, rab->bsize);
+	blk_finish_plug(&plug);
+
+	squashfs_readahead_queue(msblk, &blocks);
+
+	return 0;
+}
+
+
 const struct address_space_operations squashfs_aops = {
-	.readpage = squashfs_readpage
+	.readpage = squashfs_readpage,
+	.readpages = squashfs_readpages
 };
@@ -34,3 +34,30 @@ int squashfs_readpage_block(struct page *page, u64 block, int bsize, int expecte
 	squashfs_cache_put(buffer);
 	return res;
 }
+
+/*
+ * Read a datablock for readahead.  @page holds the locked pages covered by
+ * the block, with NULL for those already in the page cache.
+ */
+int squashfs_readahead_block(struct super_block *sb, struct page **page,
+	int pages, u64 block, int bsize, int expected)
+{
+	struct squashfs_cache_entry *buffer = squashfs_get_datablock(sb,
+		block, bsize);
+	int res = buffer->error, n, offset = 0;
+
+	for (n = 0; n < pages; n++, expected -= PAGE_SIZE,
+			offset += PAGE_SIZE) {
+		if (page[n] == NULL)
+			continue;
+
+		if (res)
+			SetPageError(page[n]);
+		else
+			squashfs_fill_page(page[n], buffer, offset,
+				min_t(int, expected, PAGE_SIZE));
+	}
+
+	squashfs_cache_put(buffer);
+	return res;
+}
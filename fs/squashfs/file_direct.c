@@ -172,3 +172,68 @@ static int squashfs_read_cache(struct page *target_page, u64 block, int bsize,
 	squashfs_cache_put(buffer);
 	return res;
 }
+
+
+/*
+ * Decompress a datablock for readahead directly into the page cache.
+ * @page holds the locked pages covered by the block, with NULL for those
+ * already in the page cache; the decompressor writes those parts of the
+ * block into scratch pages which are then dropped.
+ */
+int squashfs_readahead_block(struct super_block *sb, struct page **page,
+	int pages, u64 block, int bsize, int expected)
+{
+	struct squashfs_page_actor *actor;
+	struct page **dest;
+	int i, bytes, res = -ENOMEM;
+	void *pageaddr;
+
+	dest = kcalloc(pages, sizeof(*dest), GFP_KERNEL);
+	if (dest == NULL)
+		goto out;
+
+	for (i = 0; i < pages; i++) {
+		dest[i] = page[i] ? : alloc_page(GFP_KERNEL);
+		if (dest[i] == NULL)
+			goto out;
+	}
+
+	actor = squashfs_page_actor_init_special(dest, pages, 0);
+	if (actor == NULL)
+		goto out;
+
+	res = squashfs_read_data(sb, block, bsize, NULL, actor);
+	kfree(actor);
+	if (res < 0)
+		goto out;
+
+	if (res != expected) {
+		res = -EIO;
+		goto out;
+	}
+
+	/* Last page may have trailing bytes not filled */
+	bytes = res % PAGE_SIZE;
+	if (bytes && page[pages - 1]) {
+		pageaddr = kmap_atomic(page[pages - 1]);
+		memset(pageaddr + bytes, 0, PAGE_SIZE - bytes);
+		kunmap_atomic(pageaddr);
+	}
+	res = 0;
+
+out:
+	for (i = 0; i < pages; i++) {
+		if (page[i] == NULL) {
+			if (dest && dest[i])
+				__free_page(dest[i]);
+			continue;
+		}
+		flush_dcache_page(page[i]);
+		if (res)
+			SetPageError(page[i]);
+		else
+			SetPageUptodate(page[i]);
+	}
+	kfree(dest);
+	return res;
+}
@@ -17,6 +17,7 @@
 /* block.c */
 extern int squashfs_read_data(struct super_block *, u64, int, u64 *,
 				struct squashfs_page_actor *);
+extern void squashfs_prefetch_data(struct super_block *, u64, int);
 
 /* cache.c */
 extern struct squashfs_cache *squashfs_cache_init(char *, int, int);
@@ -57,9 +58,16 @@ extern __le64 *squashfs_read_fragment_index_table(struct super_block *,
 void squashfs_fill_page(struct page *, struct squashfs_cache_entry *, int, int);
 void squashfs_copy_cache(struct page *, struct squashfs_cache_entry *, int,
 				int);
+extern int squashfs_readahead_init(void);
+extern void squashfs_readahead_exit(void);
+extern void squashfs_readahead_wait(struct squashfs_sb_info *);
+extern void squashfs_readahead_set_parallel(struct squashfs_sb_info *,
+				unsigned int);
 
 /* file_xxx.c */
 extern int squashfs_readpage_block(struct page *, u64, int, int);
+extern int squashfs_readahead_block(struct super_block *, struct page **, int,
+				u64, int, int);
 
 /* id.c */
 extern int squashfs_get_id(struct super_block *, unsigned int, unsigned int *);
@@ -21,6 +21,8 @@ struct squashfs_cache {
 	int			unused;
 	int			block_size;
 	int			pages;
+	unsigned long		hits;
+	unsigned long		misses;
 	spinlock_t		lock;
 	wait_queue_head_t	wait_queue;
 	struct squashfs_cache_entry *entry;
@@ -64,5 +66,12 @@ struct squashfs_sb_info {
 	unsigned int				inodes;
 	unsigned int				fragments;
 	int					xattr_ids;
+	spinlock_t				ra_lock;
+	struct list_head			ra_pending;
+	unsigned int				ra_active;
+	wait_queue_head_t			ra_wait;
+	unsigned int				parallel;
+	bool					parallel_set;
+	atomic_long_t				ra_blocks;
 };
 #endif
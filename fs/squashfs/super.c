@@ -18,6 +18,7 @@
 
 #include <linux/fs.h>
 #include <linux/fs_context.h>
+#include <linux/fs_parser.h>
 #include <linux/vfs.h>
 #include <linux/slab.h>
 #include <linux/mutex.h>
@@ -26,6 +27,7 @@
 #include <linux/module.h>
 #include <linux/magic.h>
 #include <linux/xattr.h>
+#include <linux/seq_file.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
@@ -37,6 +39,53 @@
 static struct file_system_type squashfs_fs_type;
 static const struct super_operations squashfs_super_ops;
 
+struct squashfs_mount_opts {
+	unsigned int parallel;
+};
+
+enum squashfs_param {
+	Opt_parallel,
+};
+
+static const struct fs_parameter_spec squashfs_fs_parameters[] = {
+	fsparam_u32("parallel", Opt_parallel),
+	{}
+};
+
+static int squashfs_parse_param(struct fs_context *fc,
+	struct fs_parameter *param)
+{
+	struct squashfs_mount_opts *opts = fc->fs_private;
+	struct fs_parse_result result;
+	int opt;
+
+	opt = fs_parse(fc, squashfs_fs_parameters, param, &result);
+	if (opt < 0)
+		return opt;
+
+	switch (opt) {
+	case Opt_parallel:
+		if (result.uint_32 < 1 ||
+		    result.uint_32 > WQ_UNBOUND_MAX_ACTIVE)
+			return invalf(fc, "squashfs: parallel must be 1-%d",
+				      WQ_UNBOUND_MAX_ACTIVE);
+		opts->parallel = result.uint_32;
+		break;
+	}
+
+	return 0;
+}
+
+/*
+ * By default decompress as many readahead blocks at once as there are CPUs,
+ * but no more than there are decompressors to run them.
+ */
+static unsigned int squashfs_default_parallel(void)
+{
+	return min_t(unsigned int, num_online_cpus(),
+		     squashfs_max_decompressors());
+}
+
 static const struct squashfs_decompressor *supported_squashfs_filesystem(
 	struct fs_context *fc,
 	short major, short minor, short id)
@@ -67,6 +116,7 @@ static const struct squashfs_decompressor *supported_squashfs_filesystem(
 
 static int squashfs_fill_super(struct super_block *sb, struct fs_context *fc)
 {
+	struct squashfs_mount_opts *opts = fc->fs_private;
 	struct squashfs_sb_info *msblk;
 	struct squashfs_super_block *sblk = NULL;
 	struct inode *root;
@@ -213,6 +263,13 @@ static int squashfs_fill_super(struct super_block *sb, struct fs_context *fc)
 		goto insanity;
 	}
 
+	/* Readahead blocks decompressed at once */
+	msblk->parallel = opts->parallel ? : squashfs_default_parallel();
+	msblk->parallel_set = opts->parallel != 0;
+	spin_lock_init(&msblk->ra_lock);
+	INIT_LIST_HEAD(&msblk->ra_pending);
+	init_waitqueue_head(&msblk->ra_wait);
+
 	/* Handle xattrs */
 	sb->s_xattr = squashfs_xattr_handlers;
 	xattr_id_table_start = le64_to_cpu(sblk->xattr_id_table_start);
@@ -350,18 +407,40 @@ static int squashfs_get_tree(struct fs_context *fc)
 
 static int squashfs_reconfigure(struct fs_context *fc)
 {
+	struct squashfs_mount_opts *opts = fc->fs_private;
+	struct squashfs_sb_info *msblk = fc->root->d_sb->s_fs_info;
+
 	sync_filesystem(fc->root->d_sb);
 	fc->sb_flags |= SB_RDONLY;
+
+	if (opts->parallel) {
+		squashfs_readahead_set_parallel(msblk, opts->parallel);
+		msblk->parallel_set = true;
+	}
 	return 0;
 }
 
+static void squashfs_free_fs_context(struct fs_context *fc)
+{
+	kfree(fc->fs_private);
+}
+
 static const struct fs_context_operations squashfs_context_ops = {
+	.free		= squashfs_free_fs_context,
+	.parse_param	= squashfs_parse_param,
 	.get_tree	= squashfs_get_tree,
 	.reconfigure	= squashfs_reconfigure,
 };
 
 static int squashfs_init_fs_context(struct fs_context *fc)
 {
+	struct squashfs_mount_opts *opts;
+
+	opts = kzalloc(sizeof(*opts), GFP_KERNEL);
+	if (!opts)
+		return -ENOMEM;
+
+	fc->fs_private = opts;
 	fc->ops = &squashfs_context_ops;
 	return 0;
 }
@@ -386,11 +465,43 @@ static int squashfs_statfs(struct dentry *dentry, struct kstatfs *buf)
 	return 0;
 }
 
+static int squashfs_show_options(struct seq_file *m, struct dentry *root)
+{
+	struct squashfs_sb_info *msblk = root->d_sb->s_fs_info;
+
+	if (msblk->parallel_set)
+		seq_printf(m, ",parallel=%u", msblk->parallel);
+	return 0;
+}
+
+static void squashfs_show_cache_stats(struct seq_file *m,
+	struct squashfs_cache *cache)
+{
+	if (cache)
+		seq_printf(m, "\n\t%s cache: hits %lu misses %lu", cache->name,
+			   READ_ONCE(cache->hits), READ_ONCE(cache->misses));
+}
+
+/* Cache and readahead counters, shown in /proc/<pid>/mountstats */
+static int squashfs_show_stats(struct seq_file *m, struct dentry *root)
+{
+	struct squashfs_sb_info *msblk = root->d_sb->s_fs_info;
+
+	seq_printf(m, "parallel %u", msblk->parallel);
+	squashfs_show_cache_stats(m, msblk->block_cache);
+	squashfs_show_cache_stats(m, msblk->fragment_cache);
+	squashfs_show_cache_stats(m, msblk->read_page);
+	seq_printf(m, "\n\treadahead blocks: %ld",
+		   atomic_long_read(&msblk->ra_blocks));
+	return 0;
+}
+
 
 static void squashfs_put_super(struct super_block *sb)
 {
 	if (sb->s_fs_info) {
 		struct squashfs_sb_info *sbi = sb->s_fs_info;
+		squashfs_readahead_wait(sbi);
 		squashfs_cache_delete(sbi->block_cache);
 		squashfs_cache_delete(sbi->fragment_cache);
 		squashfs_cache_delete(sbi->read_page);
@@ -445,8 +556,15 @@ static int __init init_squashfs_fs(void)
 	if (err)
 		return err;
 
+	err = squashfs_readahead_init();
+	if (err) {
+		destroy_inodecache();
+		return err;
+	}
+
 	err = register_filesystem(&squashfs_fs_type);
 	if (err) {
+		squashfs_readahead_exit();
 		destroy_inodecache();
 		return err;
 	}
@@ -460,6 +578,7 @@ static int __init init_squashfs_fs(void)
 static void __exit exit_squashfs_fs(void)
 {
 	unregister_filesystem(&squashfs_fs_type);
+	squashfs_readahead_exit();
 	destroy_inodecache();
 }
 
@@ -482,6 +601,7 @@ static struct file_system_type squashfs_fs_type = {
 	.owner = THIS_MODULE,
 	.name = "squashfs",
 	.init_fs_context = squashfs_init_fs_context,
+	.parameters = squashfs_fs_parameters,
 	.kill_sb = kill_block_super,
 	.fs_flags = FS_REQUIRES_DEV
 };
@@ -492,6 +612,8 @@ static const struct super_operations squashfs_super_ops = {
 	.free_inode = squashfs_free_inode,
 	.statfs = squashfs_statfs,
 	.put_super = squashfs_put_super,
+	.show_options = squashfs_show_options,
+	.show_stats = squashfs_show_stats,
 };
 
 module_init(init_squashfs_fs);
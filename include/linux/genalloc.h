@@ -35,6 +35,7 @@
 struct device;
 struct device_node;
 struct gen_pool;
+struct gen_pool_extents;
 
 /**
  * typedef genpool_algo_t: Allocation callback function type definition
@@ -64,6 +65,7 @@ struct gen_pool {
 	void *data;
 
 	const char *name;
+	bool use_extents;		/* index free space of new chunks */
 };
 
 /*
@@ -76,6 +78,7 @@ struct gen_pool_chunk {
 	void *owner;			/* private data to retrieve at alloc time */
 	unsigned long start_addr;	/* start address of memory chunk */
 	unsigned long end_addr;		/* end address of memory chunk (inclusive) */
+	struct gen_pool_extents *extents; /* free range index, or NULL */
 	unsigned long bits[0];		/* bitmap for allocating memory chunk */
 };
 
@@ -94,6 +97,7 @@ struct genpool_data_fixed {
 };
 
 extern struct gen_pool *gen_pool_create(int, int);
+extern int gen_pool_use_extents(struct gen_pool *pool);
 extern phys_addr_t gen_pool_virt_to_phys(struct gen_pool *pool, unsigned long);
 extern int gen_pool_add_owner(struct gen_pool *, unsigned long, phys_addr_t,
 			     size_t, int, void *);
@@ -0,0 +1,100 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Bounded multi-producer/multi-consumer ring of pointers.
+ *
+ * Unlike kfifo, which needs external locking as soon as there is more
+ * than one reader or writer, any number of CPUs may enqueue and dequeue
+ * concurrently.  Each slot carries a sequence number telling producers
+ * and consumers whose turn it is, so claiming a slot is a single
+ * cmpxchg on the head or tail index and the data itself is never
+ * written under a lock.
+ *
+ * As with ptr_ring, NULL cannot be queued: it is what an empty ring
+ * returns.
+ */
+
+#ifndef _LINUX_MPMC_RING_H
+#define _LINUX_MPMC_RING_H
+
+#include <linux/cache.h>
+#include <linux/compiler.h>
+#include <linux/gfp.h>
+#include <linux/kernel.h>
+#include <linux/types.h>
+
+/* Entries buffered per CPU by mpmc_ring_enqueue_local() */
+#define MPMC_RING_LOCAL_BATCH	16
+
+struct mpmc_ring_slot {
+	unsigned long seq;
+	void *ptr;
+};
+
+struct mpmc_ring_local {
+	unsigned int nr;
+	void *ptrs[MPMC_RING_LOCAL_BATCH];
+};
+
+struct mpmc_ring {
+	/* Next position to fill */
+	unsigned long head ____cacheline_aligned_in_smp;
+	/* Next position to drain */
+	unsigned long tail ____cacheline_aligned_in_smp;
+	/* Read-only after mpmc_ring_init() */
+	struct mpmc_ring_slot *slots ____cacheline_aligned_in_smp;
+	unsigned int mask;
+	struct mpmc_ring_local __percpu *local;
+};
+
+int mpmc_ring_init(struct mpmc_ring *ring, unsigned int size, gfp_t gfp);
+int mpmc_ring_init_local(struct mpmc_ring *ring, unsigned int size,
+			 gfp_t gfp);
+void mpmc_ring_free(struct mpmc_ring *ring, void (*destroy)(void *));
+
+int mpmc_ring_enqueue(struct mpmc_ring *ring, void *ptr);
+void *mpmc_ring_dequeue(struct mpmc_ring *ring);
+unsigned int mpmc_ring_enqueue_batch(struct mpmc_ring *ring, void **ptrs,
+				     unsigned int n);
+unsigned int mpmc_ring_dequeue_batch(struct mpmc_ring *ring, void **ptrs,
+				     unsigned int n);
+
+int mpmc_ring_enqueue_local(struct mpmc_ring *ring, void *ptr);
+unsigned int mpmc_ring_flush_local(struct mpmc_ring *ring);
+unsigned int mpmc_ring_flush_all(struct mpmc_ring *ring);
+
+/**
+ * mpmc_ring_size - the number of entries the ring can hold
+ * @ring: the ring
+ */
+static inline unsigned int mpmc_ring_size(const struct mpmc_ring *ring)
+{
+	return ring->mask + 1;
+}
+
+/**
+ * mpmc_ring_count - approximate number of entries in the ring
+ * @ring: the ring
+ *
+ * With concurrent producers or consumers this is only a snapshot, and
+ * it does not include entries held back by mpmc_ring_enqueue_local().
+ */
+static inline unsigned int mpmc_ring_count(const struct mpmc_ring *ring)
+{
+	unsigned long tail = READ_ONCE(ring->tail);
+	long count = (long)(READ_ONCE(ring->head) - tail);
+
+	return clamp_t(long, count, 0, ring->mask + 1);
+}
+
+/**
+ * mpmc_ring_empty - test whether the ring looks empty
+ * @ring: the ring
+ *
+ * Like mpmc_ring_count(), the answer may be stale by the time it is used.
+ */
+static inline bool mpmc_ring_empty(const struct mpmc_ring *ring)
+{
+	return mpmc_ring_count(ring) == 0;
+}
+
+#endif /* _LINUX_MPMC_RING_H */
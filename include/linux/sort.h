@@ -13,4 +13,18 @@ void sort(void *base, size_t num, size_t size,
 	  cmp_func_t cmp_func,
 	  swap_func_t swap_func);
 
+void heapsort_r(void *base, size_t num, size_t size,
+		cmp_r_func_t cmp_func,
+		swap_func_t swap_func,
+		const void *priv);
+
+void introsort_r(void *base, size_t num, size_t size,
+		 cmp_r_func_t cmp_func,
+		 swap_func_t swap_func,
+		 const void *priv);
+
+void introsort(void *base, size_t num, size_t size,
+	       cmp_func_t cmp_func,
+	       swap_func_t swap_func);
+
 #endif
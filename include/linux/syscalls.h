@@ -11,6 +11,7 @@
 
 struct __aio_sigset;
 struct epoll_event;
+struct epoll_ctl_batch_cmd;
 struct iattr;
 struct inode;
 struct iocb;
@@ -1003,6 +1004,9 @@ asmlinkage long sys_pidfd_send_signal(int pidfd, int sig,
 				       siginfo_t __user *info,
 				       unsigned int flags);
 asmlinkage long sys_pidfd_getfd(int pidfd, int fd, unsigned int flags);
+asmlinkage long sys_epoll_ctl_batch(int epfd, unsigned int flags,
+				    unsigned int ncmds,
+				    struct epoll_ctl_batch_cmd __user *cmds);
 
 /*
  * Architecture-specific system calls
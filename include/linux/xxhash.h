@@ -130,6 +130,42 @@ static inline unsigned long xxhash(const void *input, size_t length,
 #endif
 }
 
+/**
+ * struct xxh128_hash - a 128-bit hash value, as returned by xxh3_128()
+ * @low64:  The low 64 bits of the hash.
+ * @high64: The high 64 bits of the hash.
+ */
+struct xxh128_hash {
+	uint64_t low64;
+	uint64_t high64;
+};
+
+/**
+ * xxh3_64() - calculate the 64-bit XXH3 hash of the input with a given seed.
+ *
+ * @input:  The data to hash.
+ * @length: The length of the data to hash.
+ * @seed:   The seed can be used to alter the result predictably.
+ *
+ * XXH3 is much faster than xxh64() on short inputs, and on x86-64 uses
+ * SSE2 or AVX2 for inputs of 1KB and more when the FPU may be used.
+ * The result differs from xxh64() for the same input and seed.
+ *
+ * Return:  The 64-bit XXH3 hash of the data.
+ */
+uint64_t xxh3_64(const void *input, size_t length, uint64_t seed);
+
+/**
+ * xxh3_128() - calculate the 128-bit XXH3 hash of the input with a given seed.
+ *
+ * @input:  The data to hash.
+ * @length: The length of the data to hash.
+ * @seed:   The seed can be used to alter the result predictably.
+ *
+ * Return:  The 128-bit XXH3 hash of the data.
+ */
+struct xxh128_hash xxh3_128(const void *input, size_t length, uint64_t seed);
+
 /*-****************************
  * Streaming Hash Functions
  *****************************/
@@ -236,6 +272,66 @@ int xxh64_update(struct xxh64_state *state, const void *input, size_t length);
  */
 uint64_t xxh64_digest(const struct xxh64_state *state);
 
+#define XXH3_SECRET_SIZE	192
+#define XXH3_BUFFER_SIZE	256
+
+/**
+ * struct xxh3_state - private XXH3 state, do not use members directly
+ */
+struct xxh3_state {
+	uint64_t acc[8];
+	uint8_t custom_secret[XXH3_SECRET_SIZE];
+	uint8_t buffer[XXH3_BUFFER_SIZE];
+	uint32_t buffered_size;
+	uint32_t nb_stripes_so_far;
+	uint64_t total_len;
+	uint64_t seed;
+};
+
+/**
+ * xxh3_reset() - reset the XXH3 state to start a new hashing operation
+ *
+ * @state: The XXH3 state to reset.
+ * @seed:  Initialize the hash state with this seed.
+ *
+ * The same state can produce both the 64-bit and the 128-bit hash.
+ */
+void xxh3_reset(struct xxh3_state *state, uint64_t seed);
+
+/**
+ * xxh3_update() - hash the data given and update the XXH3 state
+ * @state:  The XXH3 state to update.
+ * @input:  The data to hash.
+ * @length: The length of the data to hash.
+ *
+ * After calling xxh3_reset() call xxh3_update() as many times as necessary.
+ *
+ * Return:  Zero on success, otherwise an error code.
+ */
+int xxh3_update(struct xxh3_state *state, const void *input, size_t length);
+
+/**
+ * xxh3_64_digest() - produce the current 64-bit XXH3 hash
+ *
+ * @state: Produce the current hash of this state.
+ *
+ * The result is the same as xxh3_64() over all the data passed to
+ * xxh3_update() since the last xxh3_reset().  More input may be added
+ * after a call to xxh3_64_digest().
+ *
+ * Return: The 64-bit XXH3 hash stored in the state.
+ */
+uint64_t xxh3_64_digest(const struct xxh3_state *state);
+
+/**
+ * xxh3_128_digest() - produce the current 128-bit XXH3 hash
+ *
+ * @state: Produce the current hash of this state.
+ *
+ * Return: The 128-bit XXH3 hash stored in the state.
+ */
+struct xxh128_hash xxh3_128_digest(const struct xxh3_state *state);
+
 /*-**************************
  * Utils
  ***************************/
@@ -256,4 +352,12 @@ void xxh32_copy_state(struct xxh32_state *dst, const struct xxh32_state *src);
  */
 void xxh64_copy_state(struct xxh64_state *dst, const struct xxh64_state *src);
 
+/**
+ * xxh3_copy_state() - copy the source state into the destination state
+ *
+ * @src: The source XXH3 state.
+ * @dst: The destination XXH3 state.
+ */
+void xxh3_copy_state(struct xxh3_state *dst, const struct xxh3_state *src);
+
 #endif /* XXHASH_H */
@@ -61,6 +61,11 @@ struct snd_rawmidi_runtime {
 	size_t avail_min;	/* min avail for wakeup */
 	size_t avail;		/* max used buffer for wakeup */
 	size_t xruns;		/* over/underruns counter */
+	/* mmap'able input ring (SNDRV_RAWMIDI_MODE_MMAP) */
+	void *mmap_area;	/* control page followed by the ring */
+	struct snd_rawmidi_mmap_control *mmap_control;
+	u32 mmap_appl_count;	/* last synced mmap_control->appl_count */
+	atomic_t mmap_count;	/* number of user mappings */
 	/* misc */
 	spinlock_t lock;
 	wait_queue_head_t sleep;
@@ -81,6 +86,8 @@ struct snd_rawmidi_substream {
 	bool append;			/* append flag (merge more streams) */
 	bool active_sensing;		/* send active sensing when close */
 	int use_count;			/* use counter (for output) */
+	unsigned int framing;		/* whether to frame input data */
+	unsigned int clock_type;	/* clock source to use for input framing */
 	size_t bytes;
 	struct snd_rawmidi *rmidi;
 	struct snd_rawmidi_str *pstr;
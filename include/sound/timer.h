@@ -10,6 +10,8 @@
 
 #include <sound/asound.h>
 #include <linux/interrupt.h>
+#include <linux/ktime.h>
+#include <linux/llist.h>
 
 #define snd_timer_chip(timer) ((timer)->private_data)
 
@@ -74,9 +76,16 @@ struct snd_timer {
 	struct list_head active_list_head;
 	struct list_head ack_list_head;
 	struct list_head sack_list_head; /* slow ack list head */
-	struct tasklet_struct task_queue;
+	struct llist_node dispatch_node; /* per-CPU slow callback queue link */
+	unsigned long dispatch_pending;	/* queued for slow callback dispatch */
+	atomic_t dispatch_active;	/* queued or in-flight dispatches */
 	int max_instances;	/* upper limit of timer instances */
 	int num_instances;	/* current number of timer instances */
+	/* interrupt interval jitter statistics */
+	ktime_t last_irq;
+	u64 jitter_count;
+	u64 jitter_sum;			/* nsec */
+	u64 jitter_max;			/* nsec */
 };
 
 struct snd_timer_instance {
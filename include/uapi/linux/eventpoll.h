@@ -79,6 +79,18 @@ struct epoll_event {
 	__u64 data;
 } EPOLL_PACKED;
 
+/*
+ * One operation for epoll_ctl_batch().  The layout is the same for 32 and
+ * 64 bit userspace.
+ */
+struct epoll_ctl_batch_cmd {
+	__s32 op;		/* EPOLL_CTL_ADD, _DEL or _MOD */
+	__s32 fd;		/* target file descriptor */
+	__poll_t events;	/* as in struct epoll_event */
+	__s32 result;		/* out: 0 or -errno, set by the kernel */
+	__u64 data;		/* as in struct epoll_event */
+};
+
 #ifdef CONFIG_PM_SLEEP
 static inline void ep_take_care_of_epollwakeup(struct epoll_event *epev)
 {
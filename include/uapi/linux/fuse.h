@@ -172,6 +172,14 @@
  *  - add FUSE_WRITE_KILL_PRIV flag
  *  - add FUSE_SETUPMAPPING and FUSE_REMOVEMAPPING
  *  - add map_alignment to fuse_init_out, add FUSE_MAP_ALIGNMENT flag
+ *
+ *  7.32
+ *  - add FUSE_PERCPU_QUEUES and FUSE_BATCH_READ
+ *
+ *  7.33
+ *  - add FUSE_PASSTHROUGH, FOPEN_PASSTHROUGH and passthrough_fh to
+ *    fuse_open_out
+ *  - add FUSE_DEV_IOC_PASSTHROUGH_OPEN
  */
 
 #ifndef _LINUX_FUSE_H
@@ -207,7 +215,7 @@
 #define FUSE_KERNEL_VERSION 7
 
 /** Minor version number of this interface */
-#define FUSE_KERNEL_MINOR_VERSION 31
+#define FUSE_KERNEL_MINOR_VERSION 33
 
 /** The node ID of the root inode */
 #define FUSE_ROOT_ID 1
@@ -277,12 +285,14 @@ struct fuse_file_lock {
  * FOPEN_NONSEEKABLE: the file is not seekable
  * FOPEN_CACHE_DIR: allow caching this directory
  * FOPEN_STREAM: the file is stream-like (no file position at all)
+ * FOPEN_PASSTHROUGH: read/write/mmap go to the file in passthrough_fh
  */
 #define FOPEN_DIRECT_IO		(1 << 0)
 #define FOPEN_KEEP_CACHE	(1 << 1)
 #define FOPEN_NONSEEKABLE	(1 << 2)
 #define FOPEN_CACHE_DIR		(1 << 3)
 #define FOPEN_STREAM		(1 << 4)
+#define FOPEN_PASSTHROUGH	(1 << 5)
 
 /**
  * INIT request/reply flags
@@ -314,6 +324,9 @@ struct fuse_file_lock {
  * FUSE_NO_OPENDIR_SUPPORT: kernel supports zero-message opendir
  * FUSE_EXPLICIT_INVAL_DATA: only invalidate cached pages on explicit request
  * FUSE_MAP_ALIGNMENT: map_alignment field is valid
+ * FUSE_PERCPU_QUEUES: queue requests per CPU, prefer a reader on that CPU
+ * FUSE_BATCH_READ: a read of the device may return several requests
+ * FUSE_PASSTHROUGH: backing files can be registered for FOPEN_PASSTHROUGH
  */
 #define FUSE_ASYNC_READ		(1 << 0)
 #define FUSE_POSIX_LOCKS	(1 << 1)
@@ -342,6 +355,9 @@ struct fuse_file_lock {
 #define FUSE_NO_OPENDIR_SUPPORT (1 << 24)
 #define FUSE_EXPLICIT_INVAL_DATA (1 << 25)
 #define FUSE_MAP_ALIGNMENT	(1 << 26)
+#define FUSE_PERCPU_QUEUES	(1 << 27)
+#define FUSE_BATCH_READ		(1 << 28)
+#define FUSE_PASSTHROUGH	(1 << 29)
 
 /**
  * CUSE INIT request/reply flags
@@ -591,7 +607,7 @@ struct fuse_create_in {
 struct fuse_open_out {
 	uint64_t	fh;
 	uint32_t	open_flags;
-	uint32_t	padding;
+	uint32_t	passthrough_fh;
 };
 
 struct fuse_release_in {
@@ -868,8 +884,23 @@ struct fuse_notify_retrieve_in {
 	uint64_t	dummy4;
 };
 
+/*
+ * Backing file for FUSE_DEV_IOC_PASSTHROUGH_OPEN.  The ioctl returns an
+ * identifier to pass back in fuse_open_out.passthrough_fh together with
+ * FOPEN_PASSTHROUGH.  Each identifier is consumed by the open using it.
+ * The ioctl, like FUSE_PASSTHROUGH itself, needs CAP_SYS_ADMIN, and the
+ * backing file must be open for reading and writing as far as the FUSE
+ * file is.
+ */
+struct fuse_passthrough_map {
+	int32_t		fd;
+	uint32_t	flags;
+	uint64_t	padding;
+};
+
 /* Device ioctls: */
 #define FUSE_DEV_IOC_CLONE	_IOR(229, 0, uint32_t)
+#define FUSE_DEV_IOC_PASSTHROUGH_OPEN	_IOW(229, 1, struct fuse_passthrough_map)
 
 struct fuse_lseek_in {
 	uint64_t	fh;
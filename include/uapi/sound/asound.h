@@ -710,7 +710,7 @@ enum {
  *  Raw MIDI section - /dev/snd/midi??
  */
 
-#define SNDRV_RAWMIDI_VERSION		SNDRV_PROTOCOL_VERSION(2, 0, 1)
+#define SNDRV_RAWMIDI_VERSION		SNDRV_PROTOCOL_VERSION(2, 0, 2)
 
 enum {
 	SNDRV_RAWMIDI_STREAM_OUTPUT = 0,
@@ -736,12 +736,55 @@ struct snd_rawmidi_info {
 	unsigned char reserved[64];	/* reserved for future use */
 };
 
+#define SNDRV_RAWMIDI_MODE_FRAMING_MASK		(7<<0)
+#define SNDRV_RAWMIDI_MODE_FRAMING_SHIFT	0
+#define SNDRV_RAWMIDI_MODE_FRAMING_NONE		(0<<0)
+#define SNDRV_RAWMIDI_MODE_FRAMING_TSTAMP	(1<<0)
+#define SNDRV_RAWMIDI_MODE_CLOCK_MASK		(7<<3)
+#define SNDRV_RAWMIDI_MODE_CLOCK_SHIFT		3
+#define SNDRV_RAWMIDI_MODE_CLOCK_NONE		(0<<3)
+#define SNDRV_RAWMIDI_MODE_CLOCK_REALTIME	(1<<3)
+#define SNDRV_RAWMIDI_MODE_CLOCK_MONOTONIC	(2<<3)
+#define SNDRV_RAWMIDI_MODE_CLOCK_MONOTONIC_RAW	(3<<3)
+#define SNDRV_RAWMIDI_MODE_MMAP			(1<<6)	/* mmap'able input ring */
+
+#define SNDRV_RAWMIDI_FRAMING_DATA_LENGTH 16
+
+/* input frame with SNDRV_RAWMIDI_MODE_FRAMING_TSTAMP, one per received packet */
+struct snd_rawmidi_framing_tstamp {
+	/* For now, frame_type is always 0. Applications are expected to
+	 * skip unknown frame types.
+	 */
+	__u8 frame_type;
+	__u8 length;		/* number of valid bytes in data field */
+	__u8 reserved[2];
+	__u32 tv_nsec;		/* nanoseconds */
+	__u64 tv_sec;		/* seconds */
+	__u8 data[SNDRV_RAWMIDI_FRAMING_DATA_LENGTH];
+} __attribute__((packed));
+
 struct snd_rawmidi_params {
 	int stream;
 	size_t buffer_size;		/* queue size in bytes */
 	size_t avail_min;		/* minimum avail bytes for wakeup */
 	unsigned int no_active_sensing: 1; /* do not send active sensing byte in close() */
-	unsigned char reserved[16];	/* reserved for future use */
+	unsigned int mode;		/* For input data only, SNDRV_RAWMIDI_MODE_* */
+	unsigned char reserved[12];	/* reserved for future use */
+};
+
+/*
+ * Control area of an input stream opened with SNDRV_RAWMIDI_MODE_MMAP,
+ * mapped at offset 0 of the rawmidi device. The data ring (buffer_size
+ * bytes, a power of two) follows at the next page boundary. The counters
+ * are free running; the ring offset of a counter is count & (buffer_size - 1)
+ * and the readable amount is hw_count - appl_count.
+ */
+struct snd_rawmidi_mmap_control {
+	__u32 hw_count;		/* RO: bytes produced by the driver */
+	__u32 appl_count;	/* RW: bytes consumed by the application */
+	__u32 avail_min;	/* RW: minimum avail bytes for wakeup */
+	__u32 buffer_size;	/* RO: size of the data ring in bytes */
+	__u32 reserved[12];	/* reserved for future use */
 };
 
 #ifndef __KERNEL__
@@ -127,6 +127,7 @@ static int sixty = 60;
 static int __maybe_unused neg_one = -1;
 static int __maybe_unused two = 2;
 static int __maybe_unused four = 4;
+static unsigned int pipe_max_buf_order_limit = PIPE_MAX_BUF_ORDER;
 static unsigned long zero_ul;
 static unsigned long one_ul = 1;
 static unsigned long long_max = LONG_MAX;
@@ -1927,6 +1928,15 @@ static struct ctl_table fs_table[] = {
 		.mode		= 0644,
 		.proc_handler	= proc_dopipe_max_size,
 	},
+	{
+		.procname	= "pipe-max-buf-order",
+		.data		= &pipe_max_buf_order,
+		.maxlen		= sizeof(pipe_max_buf_order),
+		.mode		= 0644,
+		.proc_handler	= proc_douintvec_minmax,
+		.extra1		= SYSCTL_ZERO,
+		.extra2		= &pipe_max_buf_order_limit,
+	},
 	{
 		.procname	= "pipe-user-pages-hard",
 		.data		= &pipe_user_pages_hard,
@@ -23,12 +23,20 @@
  * allocator in NMI handler should depend on
  * CONFIG_ARCH_HAVE_NMI_SAFE_CMPXCHG.
  *
+ * Pools with many allocations can opt into an extent index (see
+ * gen_pool_use_extents()), which keeps the free ranges of each chunk in
+ * rbtrees so that best-fit allocation and freeing are O(log n) instead of
+ * a bitmap scan.  The bitmap is still maintained and remains the source
+ * of truth, but such pools take a per-chunk spinlock and so can not be
+ * used from NMI context.
+ *
  * Copyright 2005 (C) Jes Sorensen <jes@trained-monkey.org>
  */
 
 #include <linux/slab.h>
 #include <linux/export.h>
 #include <linux/bitmap.h>
+#include <linux/rbtree.h>
 #include <linux/rculist.h>
 #include <linux/interrupt.h>
 #include <linux/genalloc.h>
@@ -140,6 +148,246 @@ static int bitmap_clear_ll(unsigned long *map, int start, int nr)
 	return 0;
 }
 
+/*
+ * Free range index of a chunk.  Every maximal run of clear bits in the
+ * chunk bitmap is one extent, linked into an address ordered tree (for
+ * coalescing on free) and a (length, address) ordered tree (for best-fit).
+ * All updates happen under @lock together with the matching bitmap
+ * update.  If an extent can not be allocated the index is given up and
+ * the chunk falls back to scanning its bitmap.
+ */
+struct gen_pool_extents {
+	spinlock_t lock;
+	bool broken;
+	struct rb_root by_addr;
+	struct rb_root by_size;
+};
+
+struct gen_pool_extent {
+	struct rb_node addr_node;
+	struct rb_node size_node;
+	unsigned long start;		/* first free bit */
+	unsigned long nr;		/* number of free bits */
+};
+
+static void extent_insert_addr(struct gen_pool_extents *ext,
+			       struct gen_pool_extent *e)
+{
+	struct rb_node **link = &ext->by_addr.rb_node, *parent = NULL;
+
+	while (*link) {
+		struct gen_pool_extent *cur;
+
+		parent = *link;
+		cur = rb_entry(parent, struct gen_pool_extent, addr_node);
+		if (e->start < cur->start)
+			link = &parent->rb_left;
+		else
+			link = &parent->rb_right;
+	}
+	rb_link_node(&e->addr_node, parent, link);
+	rb_insert_color(&e->addr_node, &ext->by_addr);
+}
+
+static void extent_insert_size(struct gen_pool_extents *ext,
+			       struct gen_pool_extent *e)
+{
+	struct rb_node **link = &ext->by_size.rb_node, *parent = NULL;
+
+	while (*link) {
+		struct gen_pool_extent *cur;
+
+		parent = *link;
+		cur = rb_entry(parent, struct gen_pool_extent, size_node);
+		if (e->nr < cur->nr ||
+		    (e->nr == cur->nr && e->start < cur->start))
+			link = &parent->rb_left;
+		else
+			link = &parent->rb_right;
+	}
+	rb_link_node(&e->size_node, parent, link);
+	rb_insert_color(&e->size_node, &ext->by_size);
+}
+
+static void extent_erase(struct gen_pool_extents *ext,
+			 struct gen_pool_extent *e)
+{
+	rb_erase(&e->addr_node, &ext->by_addr);
+	rb_erase(&e->size_node, &ext->by_size);
+	kfree(e);
+}
+
+/* Change the range of @e, which is linked into both trees. */
+static void extent_update(struct gen_pool_extents *ext,
+			  struct gen_pool_extent *e,
+			  unsigned long start, unsigned long nr)
+{
+	rb_erase(&e->size_node, &ext->by_size);
+	/* Extents never overlap, so moving the start keeps the address order */
+	e->start = start;
+	e->nr = nr;
+	extent_insert_size(ext, e);
+}
+
+static int extent_add(struct gen_pool_extents *ext, unsigned long start,
+		      unsigned long nr, gfp_t gfp)
+{
+	struct gen_pool_extent *e;
+
+	e = kmalloc(sizeof(*e), gfp);
+	if (!e)
+		return -ENOMEM;
+	e->start = start;
+	e->nr = nr;
+	extent_insert_addr(ext, e);
+	extent_insert_size(ext, e);
+	return 0;
+}
+
+/* Find the extent starting at or closest before @bit. */
+static struct gen_pool_extent *extent_lookup(struct gen_pool_extents *ext,
+					     unsigned long bit)
+{
+	struct rb_node *node = ext->by_addr.rb_node;
+	struct gen_pool_extent *found = NULL;
+
+	while (node) {
+		struct gen_pool_extent *e;
+
+		e = rb_entry(node, struct gen_pool_extent, addr_node);
+		if (bit < e->start) {
+			node = node->rb_left;
+		} else {
+			found = e;
+			node = node->rb_right;
+		}
+	}
+	return found;
+}
+
+/* Smallest extent of at least @nr bits, lowest address first. */
+static unsigned long extent_best_fit(struct gen_pool_extents *ext,
+				     unsigned long size, unsigned int nr)
+{
+	struct rb_node *node = ext->by_size.rb_node;
+	unsigned long start_bit = size;
+
+	while (node) {
+		struct gen_pool_extent *e;
+
+		e = rb_entry(node, struct gen_pool_extent, size_node);
+		if (e->nr >= nr) {
+			start_bit = e->start;
+			node = node->rb_left;
+		} else {
+			node = node->rb_right;
+		}
+	}
+	return start_bit;
+}
+
+static void extents_destroy(struct gen_pool_extents *ext)
+{
+	struct gen_pool_extent *e, *tmp;
+
+	rbtree_postorder_for_each_entry_safe(e, tmp, &ext->by_addr, addr_node)
+		kfree(e);
+	ext->by_addr = RB_ROOT;
+	ext->by_size = RB_ROOT;
+}
+
+static void extents_break(struct gen_pool_extents *ext)
+{
+	pr_warn_once("genalloc: out of memory for the extent index, falling back to bitmap scans\n");
+	extents_destroy(ext);
+	ext->broken = true;
+}
+
+/* Remove [start, start + nr), which must be free, from the index. */
+static void extents_reserve(struct gen_pool_extents *ext,
+			    unsigned long start, unsigned long nr)
+{
+	struct gen_pool_extent *e = extent_lookup(ext, start);
+	unsigned long end = start + nr, e_end;
+
+	if (WARN_ON(!e || e->start + e->nr < end)) {
+		extents_break(ext);
+		return;
+	}
+
+	e_end = e->start + e->nr;
+	if (e->start == start && e_end == end)
+		extent_erase(ext, e);
+	else if (e->start == start)
+		extent_update(ext, e, end, e_end - end);
+	else if (e_end == end)
+		extent_update(ext, e, e->start, start - e->start);
+	else if (extent_add(ext, end, e_end - end, GFP_ATOMIC))
+		extents_break(ext);
+	else
+		extent_update(ext, e, e->start, start - e->start);
+}
+
+/* Return [start, start + nr) to the index, merging with its neighbours. */
+static void extents_release(struct gen_pool_extents *ext,
+			    unsigned long start, unsigned long nr)
+{
+	struct gen_pool_extent *prev, *next = NULL;
+	struct rb_node *node;
+	unsigned long end = start + nr;
+
+	prev = extent_lookup(ext, start);
+	if (prev)
+		node = rb_next(&prev->addr_node);
+	else
+		node = rb_first(&ext->by_addr);
+	if (node)
+		next = rb_entry(node, struct gen_pool_extent, addr_node);
+
+	if (prev && prev->start + prev->nr != start)
+		prev = NULL;
+	if (next && next->start != end)
+		next = NULL;
+
+	if (prev && next) {
+		end = next->start + next->nr;
+		extent_erase(ext, next);
+		extent_update(ext, prev, prev->start, end - prev->start);
+	} else if (prev) {
+		extent_update(ext, prev, prev->start, end - prev->start);
+	} else if (next) {
+		extent_update(ext, next, start, next->start + next->nr - start);
+	} else if (extent_add(ext, start, nr, GFP_ATOMIC)) {
+		extents_break(ext);
+	}
+}
+
+static struct gen_pool_extents *extents_create(unsigned long nbits, int nid)
+{
+	struct gen_pool_extents *ext;
+
+	ext = kzalloc_node(sizeof(*ext), GFP_KERNEL, nid);
+	if (!ext)
+		return NULL;
+
+	spin_lock_init(&ext->lock);
+	ext->by_addr = RB_ROOT;
+	ext->by_size = RB_ROOT;
+	if (nbits && extent_add(ext, 0, nbits, GFP_KERNEL)) {
+		kfree(ext);
+		return NULL;
+	}
+	return ext;
+}
+
+static void extents_free(struct gen_pool_extents *ext)
+{
+	if (!ext)
+		return;
+	extents_destroy(ext);
+	kfree(ext);
+}
+
 /**
  * gen_pool_create - create a new special memory pool
  * @min_alloc_order: log base 2 of number of bytes each bitmap bit represents
@@ -160,11 +408,36 @@ struct gen_pool *gen_pool_create(int min_alloc_order, int nid)
 		pool->algo = gen_pool_first_fit;
 		pool->data = NULL;
 		pool->name = NULL;
+		pool->use_extents = false;
 	}
 	return pool;
 }
 EXPORT_SYMBOL(gen_pool_create);
 
+/**
+ * gen_pool_use_extents - index the free space of a pool
+ * @pool: pool to switch over, which must not have any chunks yet
+ *
+ * Keep the free ranges of every chunk subsequently added to @pool in an
+ * extent tree, and switch the pool to best-fit allocation, which is then
+ * served from the tree in O(log n) rather than by scanning the bitmap.
+ * Other allocation algorithms still work and keep the index up to date.
+ * Allocating from or freeing to such a pool takes a spinlock, so it must
+ * not be done from NMI context.
+ *
+ * Returns 0 on success or -EBUSY if chunks were already added.
+ */
+int gen_pool_use_extents(struct gen_pool *pool)
+{
+	if (!list_empty(&pool->chunks))
+		return -EBUSY;
+
+	pool->use_extents = true;
+	gen_pool_set_algo(pool, gen_pool_best_fit, NULL);
+	return 0;
+}
+EXPORT_SYMBOL(gen_pool_use_extents);
+
 /**
  * gen_pool_add_owner- add a new chunk of special memory to the pool
  * @pool: pool to add new memory chunk to
@@ -191,6 +464,14 @@ int gen_pool_add_owner(struct gen_pool *pool, unsigned long virt, phys_addr_t ph
 	if (unlikely(chunk == NULL))
 		return -ENOMEM;
 
+	if (pool->use_extents) {
+		chunk->extents = extents_create(nbits, nid);
+		if (!chunk->extents) {
+			vfree(chunk);
+			return -ENOMEM;
+		}
+	}
+
 	chunk->phys_addr = phys;
 	chunk->start_addr = virt;
 	chunk->end_addr = virt + size - 1;
@@ -252,6 +533,7 @@ void gen_pool_destroy(struct gen_pool *pool)
 		bit = find_next_bit(chunk->bits, end_bit, 0);
 		BUG_ON(bit < end_bit);
 
+		extents_free(chunk->extents);
 		vfree(chunk);
 	}
 	kfree_const(pool->name);
@@ -259,6 +541,37 @@ void gen_pool_destroy(struct gen_pool *pool)
 }
 EXPORT_SYMBOL(gen_pool_destroy);
 
+/*
+ * Allocate @nbits from a chunk with an extent index: best-fit comes
+ * straight from the tree, any other algorithm scans the bitmap as usual.
+ * Either way the bitmap and the index are updated together under the
+ * chunk lock, so the lockless bitmap update can not race.
+ */
+static int gen_pool_alloc_extents(struct gen_pool_chunk *chunk, int end_bit,
+				  int nbits, genpool_algo_t algo, void *data,
+				  struct gen_pool *pool)
+{
+	struct gen_pool_extents *ext = chunk->extents;
+	unsigned long flags;
+	int start_bit, remain;
+
+	spin_lock_irqsave(&ext->lock, flags);
+	if (algo == gen_pool_best_fit && !ext->broken)
+		start_bit = extent_best_fit(ext, end_bit, nbits);
+	else
+		start_bit = algo(chunk->bits, end_bit, 0, nbits, data, pool,
+				 chunk->start_addr);
+	if (start_bit < end_bit) {
+		remain = bitmap_set_ll(chunk->bits, start_bit, nbits);
+		BUG_ON(remain);
+		if (!ext->broken)
+			extents_reserve(ext, start_bit, nbits);
+	}
+	spin_unlock_irqrestore(&ext->lock, flags);
+
+	return start_bit;
+}
+
 /**
  * gen_pool_alloc_algo_owner - allocate special memory from the pool
  * @pool: pool to allocate from
@@ -296,8 +609,17 @@ unsigned long gen_pool_alloc_algo_owner(struct gen_pool *pool, size_t size,
 		if (size > atomic_long_read(&chunk->avail))
 			continue;
 
-		start_bit = 0;
 		end_bit = chunk_size(chunk) >> order;
+		if (chunk->extents) {
+			start_bit = gen_pool_alloc_extents(chunk, end_bit,
+							   nbits, algo, data,
+							   pool);
+			if (start_bit >= end_bit)
+				continue;
+			goto found;
+		}
+
+		start_bit = 0;
 retry:
 		start_bit = algo(chunk->bits, end_bit, start_bit,
 				 nbits, data, pool, chunk->start_addr);
@@ -310,7 +632,7 @@ unsigned long gen_pool_alloc_algo_owner(struct gen_pool *pool, size_t size,
 			BUG_ON(remain);
 			goto retry;
 		}
-
+found:
 		addr = chunk->start_addr + ((unsigned long)start_bit << order);
 		size = nbits << order;
 		atomic_long_sub(size, &chunk->avail);
@@ -471,6 +793,21 @@ void *gen_pool_dma_zalloc_align(struct gen_pool *pool, size_t size,
 }
 EXPORT_SYMBOL(gen_pool_dma_zalloc_align);
 
+static void gen_pool_free_extents(struct gen_pool_chunk *chunk,
+				  int start_bit, int nbits)
+{
+	struct gen_pool_extents *ext = chunk->extents;
+	unsigned long flags;
+	int remain;
+
+	spin_lock_irqsave(&ext->lock, flags);
+	remain = bitmap_clear_ll(chunk->bits, start_bit, nbits);
+	BUG_ON(remain);
+	if (!ext->broken)
+		extents_release(ext, start_bit, nbits);
+	spin_unlock_irqrestore(&ext->lock, flags);
+}
+
 /**
  * gen_pool_free_owner - free allocated special memory back to the pool
  * @pool: pool to free to
@@ -502,8 +839,13 @@ void gen_pool_free_owner(struct gen_pool *pool, unsigned long addr, size_t size,
 		if (addr >= chunk->start_addr && addr <= chunk->end_addr) {
 			BUG_ON(addr + size - 1 > chunk->end_addr);
 			start_bit = (addr - chunk->start_addr) >> order;
-			remain = bitmap_clear_ll(chunk->bits, start_bit, nbits);
-			BUG_ON(remain);
+			if (chunk->extents) {
+				gen_pool_free_extents(chunk, start_bit, nbits);
+			} else {
+				remain = bitmap_clear_ll(chunk->bits, start_bit,
+							 nbits);
+				BUG_ON(remain);
+			}
 			size = nbits << order;
 			atomic_long_add(size, &chunk->avail);
 			if (owner)
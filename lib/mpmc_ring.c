@@ -0,0 +1,385 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Bounded multi-producer/multi-consumer ring of pointers
+ *
+ * Slot i of lap L is free for the producer claiming position
+ * p = L * size + i when its sequence number equals p, and holds data
+ * for the consumer claiming position p when it equals p + 1.  Releasing
+ * a slot to the next lap sets it to p + size.  Producers and consumers
+ * therefore only contend on the head and tail indices respectively, and
+ * only for as long as a cmpxchg takes.
+ *
+ * A slot's sequence number can only move away from "free for p" once
+ * the head index has been advanced past p, which is what lets the batch
+ * functions check a run of slots first and then claim them all with a
+ * single cmpxchg.
+ */
+
+#include <linux/cpu.h>
+#include <linux/export.h>
+#include <linux/irqflags.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/mpmc_ring.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+#include <linux/smp.h>
+
+static int __mpmc_ring_init(struct mpmc_ring *ring, unsigned int size,
+			    bool local, gfp_t gfp)
+{
+	unsigned int i;
+
+	/*
+	 * Round up to the next power of 2, as kfifo does, so that the
+	 * positions can wrap freely.
+	 */
+	if (size < 2 || size > (1U << 31))
+		return -EINVAL;
+	size = roundup_pow_of_two(size);
+
+	ring->slots = kvmalloc_array(size, sizeof(*ring->slots), gfp);
+	if (!ring->slots)
+		return -ENOMEM;
+
+	ring->local = NULL;
+	if (local) {
+		ring->local = alloc_percpu_gfp(struct mpmc_ring_local, gfp);
+		if (!ring->local) {
+			kvfree(ring->slots);
+			return -ENOMEM;
+		}
+	}
+
+	for (i = 0; i < size; i++) {
+		ring->slots[i].seq = i;
+		ring->slots[i].ptr = NULL;
+	}
+	ring->mask = size - 1;
+	ring->head = 0;
+	ring->tail = 0;
+
+	return 0;
+}
+
+/**
+ * mpmc_ring_init - allocate a ring
+ * @ring: the ring to initialise
+ * @size: the number of entries, rounded up to a power of 2
+ * @gfp: allocation flags
+ *
+ * Return: 0 on success, -EINVAL for a bad @size or -ENOMEM.
+ */
+int mpmc_ring_init(struct mpmc_ring *ring, unsigned int size, gfp_t gfp)
+{
+	return __mpmc_ring_init(ring, size, false, gfp);
+}
+EXPORT_SYMBOL(mpmc_ring_init);
+
+/**
+ * mpmc_ring_init_local - allocate a ring with per-CPU producer caches
+ * @ring: the ring to initialise
+ * @size: the number of entries, rounded up to a power of 2
+ * @gfp: allocation flags
+ *
+ * As mpmc_ring_init(), and additionally allows mpmc_ring_enqueue_local()
+ * to be used on the ring.
+ *
+ * Return: 0 on success, -EINVAL for a bad @size or -ENOMEM.
+ */
+int mpmc_ring_init_local(struct mpmc_ring *ring, unsigned int size,
+			 gfp_t gfp)
+{
+	return __mpmc_ring_init(ring, size, true, gfp);
+}
+EXPORT_SYMBOL(mpmc_ring_init_local);
+
+/**
+ * mpmc_ring_free - free a ring and everything still queued on it
+ * @ring: the ring
+ * @destroy: called for each entry still queued or cached, may be NULL
+ *
+ * There must be no concurrent users of the ring.
+ */
+void mpmc_ring_free(struct mpmc_ring *ring, void (*destroy)(void *))
+{
+	void *ptr;
+	int cpu;
+
+	if (ring->local) {
+		for_each_possible_cpu(cpu) {
+			struct mpmc_ring_local *c;
+
+			c = per_cpu_ptr(ring->local, cpu);
+			while (destroy && c->nr)
+				destroy(c->ptrs[--c->nr]);
+		}
+		free_percpu(ring->local);
+		ring->local = NULL;
+	}
+
+	while (destroy && (ptr = mpmc_ring_dequeue(ring)))
+		destroy(ptr);
+
+	kvfree(ring->slots);
+	ring->slots = NULL;
+	ring->mask = 0;
+}
+EXPORT_SYMBOL(mpmc_ring_free);
+
+/**
+ * mpmc_ring_enqueue_batch - add entries to the tail of a ring
+ * @ring: the ring
+ * @ptrs: the entries to add, none of which may be NULL
+ * @n: the number of entries in @ptrs
+ *
+ * Adds as many of @ptrs as there is room for, in order.  The entries
+ * occupy consecutive positions in the ring, so consumers see them in
+ * the same order and without entries from other producers in between.
+ *
+ * Return: the number of entries added.
+ */
+unsigned int mpmc_ring_enqueue_batch(struct mpmc_ring *ring, void **ptrs,
+				     unsigned int n)
+{
+	struct mpmc_ring_slot *slot;
+	unsigned long pos, prev;
+	unsigned int i, k;
+	long dif = 0;
+
+	if (!n)
+		return 0;
+
+	pos = READ_ONCE(ring->head);
+	for (;;) {
+		for (k = 0; k < n; k++) {
+			slot = &ring->slots[(pos + k) & ring->mask];
+			dif = (long)(smp_load_acquire(&slot->seq) - (pos + k));
+			if (dif)
+				break;
+		}
+		if (k) {
+			prev = cmpxchg(&ring->head, pos, pos + k);
+			if (prev == pos)
+				break;
+			pos = prev;
+		} else if (dif < 0) {
+			/* The first slot still holds last lap's entry */
+			return 0;
+		} else {
+			pos = READ_ONCE(ring->head);
+		}
+	}
+
+	for (i = 0; i < k; i++) {
+		slot = &ring->slots[(pos + i) & ring->mask];
+		WRITE_ONCE(slot->ptr, ptrs[i]);
+		smp_store_release(&slot->seq, pos + i + 1);
+	}
+	return k;
+}
+EXPORT_SYMBOL(mpmc_ring_enqueue_batch);
+
+/**
+ * mpmc_ring_dequeue_batch - remove entries from the head of a ring
+ * @ring: the ring
+ * @ptrs: where to store the entries
+ * @n: the maximum number of entries to remove
+ *
+ * Return: the number of entries removed.
+ */
+unsigned int mpmc_ring_dequeue_batch(struct mpmc_ring *ring, void **ptrs,
+				     unsigned int n)
+{
+	struct mpmc_ring_slot *slot;
+	unsigned long pos, prev;
+	unsigned int i, k;
+	long dif = 0;
+
+	if (!n)
+		return 0;
+
+	pos = READ_ONCE(ring->tail);
+	for (;;) {
+		for (k = 0; k < n; k++) {
+			slot = &ring->slots[(pos + k) & ring->mask];
+			dif = (long)(smp_load_acquire(&slot->seq) -
+				     (pos + k + 1));
+			if (dif)
+				break;
+		}
+		if (k) {
+			prev = cmpxchg(&ring->tail, pos, pos + k);
+			if (prev == pos)
+				break;
+			pos = prev;
+		} else if (dif < 0) {
+			/* Nothing has been published at the tail yet */
+			return 0;
+		} else {
+			pos = READ_ONCE(ring->tail);
+		}
+	}
+
+	for (i = 0; i < k; i++) {
+		slot = &ring->slots[(pos + i) & ring->mask];
+		ptrs[i] = READ_ONCE(slot->ptr);
+		smp_store_release(&slot->seq, pos + i + ring->mask + 1);
+	}
+	return k;
+}
+EXPORT_SYMBOL(mpmc_ring_dequeue_batch);
+
+/**
+ * mpmc_ring_enqueue - add an entry to the tail of a ring
+ * @ring: the ring
+ * @ptr: the entry, which must not be NULL
+ *
+ * Return: 0 on success or -ENOSPC if the ring is full.
+ */
+int mpmc_ring_enqueue(struct mpmc_ring *ring, void *ptr)
+{
+	return mpmc_ring_enqueue_batch(ring, &ptr, 1) ? 0 : -ENOSPC;
+}
+EXPORT_SYMBOL(mpmc_ring_enqueue);
+
+/**
+ * mpmc_ring_dequeue - remove the entry at the head of a ring
+ * @ring: the ring
+ *
+ * Return: the entry, or NULL if the ring is empty.
+ */
+void *mpmc_ring_dequeue(struct mpmc_ring *ring)
+{
+	void *ptr;
+
+	return mpmc_ring_dequeue_batch(ring, &ptr, 1) ? ptr : NULL;
+}
+EXPORT_SYMBOL(mpmc_ring_dequeue);
+
+static void mpmc_ring_flush_cache(struct mpmc_ring *ring,
+				  struct mpmc_ring_local *c)
+{
+	unsigned int done;
+
+	done = mpmc_ring_enqueue_batch(ring, c->ptrs, c->nr);
+	if (done && done < c->nr)
+		memmove(c->ptrs, c->ptrs + done,
+			(c->nr - done) * sizeof(*c->ptrs));
+	c->nr -= done;
+}
+
+/**
+ * mpmc_ring_enqueue_local - add an entry through this CPU's cache
+ * @ring: the ring, set up with mpmc_ring_init_local()
+ * @ptr: the entry, which must not be NULL
+ *
+ * The entry is kept in a per-CPU cache and published together with the
+ * next MPMC_RING_LOCAL_BATCH - 1 entries added on this CPU, so the
+ * shared head index is touched once per batch rather than once per
+ * entry.  Consumers do not see cached entries until the batch fills or
+ * mpmc_ring_flush_local() is called on the same CPU; users must do so
+ * before waiting for the entries to be consumed.
+ *
+ * The caller must not migrate between adding entries and flushing them,
+ * so must run with preemption disabled or be bound to one CPU; this is
+ * checked with CONFIG_DEBUG_PREEMPT.  Entries left in the cache of
+ * another CPU, for instance one that has gone offline since, are only
+ * published by mpmc_ring_flush_all().
+ *
+ * Entries added on one CPU stay in order, but entries from different
+ * CPUs may be reordered relative to each other by up to a batch.
+ *
+ * Return: 0 on success or -ENOSPC if both the ring and the cache are full.
+ */
+int mpmc_ring_enqueue_local(struct mpmc_ring *ring, void *ptr)
+{
+	int cpu = smp_processor_id();
+	struct mpmc_ring_local *c;
+	unsigned long flags;
+	int ret = 0;
+
+	local_irq_save(flags);
+	c = per_cpu_ptr(ring->local, cpu);
+	if (c->nr == MPMC_RING_LOCAL_BATCH)
+		mpmc_ring_flush_cache(ring, c);
+	if (c->nr < MPMC_RING_LOCAL_BATCH) {
+		c->ptrs[c->nr++] = ptr;
+		if (c->nr == MPMC_RING_LOCAL_BATCH)
+			mpmc_ring_flush_cache(ring, c);
+	} else {
+		ret = -ENOSPC;
+	}
+	local_irq_restore(flags);
+
+	return ret;
+}
+EXPORT_SYMBOL(mpmc_ring_enqueue_local);
+
+/**
+ * mpmc_ring_flush_local - publish the entries cached on this CPU
+ * @ring: the ring, set up with mpmc_ring_init_local()
+ *
+ * As for mpmc_ring_enqueue_local(), the caller must not migrate.
+ *
+ * Return: the number of entries left in the cache because the ring is full.
+ */
+unsigned int mpmc_ring_flush_local(struct mpmc_ring *ring)
+{
+	int cpu = smp_processor_id();
+	struct mpmc_ring_local *c;
+	unsigned long flags;
+	unsigned int left;
+
+	local_irq_save(flags);
+	c = per_cpu_ptr(ring->local, cpu);
+	mpmc_ring_flush_cache(ring, c);
+	left = c->nr;
+	local_irq_restore(flags);
+
+	return left;
+}
+EXPORT_SYMBOL(mpmc_ring_flush_local);
+
+static void mpmc_ring_flush_this_cpu(void *info)
+{
+	struct mpmc_ring *ring = info;
+
+	mpmc_ring_flush_cache(ring, this_cpu_ptr(ring->local));
+}
+
+/**
+ * mpmc_ring_flush_all - publish the entries cached on every CPU
+ * @ring: the ring, set up with mpmc_ring_init_local()
+ *
+ * For users that cannot flush on the CPU that cached the entries, for
+ * instance because it has gone offline.  The caches of online CPUs are
+ * flushed on those CPUs by IPI, those of offline CPUs directly.  Must be
+ * called from process context.
+ *
+ * Return: the number of entries left in the caches because the ring is
+ * full.  Entries cached concurrently by online CPUs may or may not be
+ * counted.
+ */
+unsigned int mpmc_ring_flush_all(struct mpmc_ring *ring)
+{
+	unsigned int left = 0;
+	int cpu;
+
+	cpus_read_lock();
+	on_each_cpu(mpmc_ring_flush_this_cpu, ring, 1);
+	for_each_possible_cpu(cpu) {
+		struct mpmc_ring_local *c = per_cpu_ptr(ring->local, cpu);
+
+		if (!cpu_online(cpu))
+			mpmc_ring_flush_cache(ring, c);
+		left += READ_ONCE(c->nr);
+	}
+	cpus_read_unlock();
+
+	return left;
+}
+EXPORT_SYMBOL(mpmc_ring_flush_all);
+
+MODULE_LICENSE("GPL");
@@ -8,12 +8,19 @@
  * Glibc qsort() manages n*log2(n) - 1.26*n for random inputs (1.63*n
  * better) at the expense of stack usage and much larger code to avoid
  * quicksort's O(n^2) worst case.
+ *
+ * For callers where sorting is hot, introsort_r() offers a pattern-defeating
+ * quicksort that falls back to the heapsort when it keeps picking bad
+ * pivots, so it keeps the O(n log n) worst case while running in linear
+ * time on presorted input.  CONFIG_SORT_INTROSORT makes it the default.
  */
 
 #define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
 
 #include <linux/types.h>
 #include <linux/export.h>
+#include <linux/kernel.h>
+#include <linux/log2.h>
 #include <linux/sort.h>
 
 /**
@@ -177,29 +184,26 @@ static size_t parent(size_t i, unsigned int lsbit, size_t size)
 	return i / 2;
 }
 
-/**
- * sort_r - sort an array of elements
- * @base: pointer to data to sort
- * @num: number of elements
- * @size: size of each element
- * @cmp_func: pointer to comparison function
- * @swap_func: pointer to swap function or NULL
- * @priv: third argument passed to comparison function
- *
- * This function does a heapsort on the given array.  You may provide
- * a swap_func function if you need to do something more than a memory
- * copy (e.g. fix up pointers or auxiliary data), but the built-in swap
- * avoids a slow retpoline and so is significantly faster.
- *
- * Sorting time is O(n log n) both on average and worst-case. While
- * quicksort is slightly faster on average, it suffers from exploitable
- * O(n*n) worst-case behavior and extra memory requirements that make
- * it less suitable for kernel use.
+static swap_func_t choose_swap_func(const void *base, size_t size,
+				    swap_func_t swap_func)
+{
+	if (swap_func)
+		return swap_func;
+	if (is_aligned(base, size, 8))
+		return SWAP_WORDS_64;
+	if (is_aligned(base, size, 4))
+		return SWAP_WORDS_32;
+	return SWAP_BYTES;
+}
+
+/*
+ * The heapsort proper, with @swap_func already resolved.  Used directly
+ * by heapsort_r() and as the worst-case fallback of introsort_r().
  */
-void sort_r(void *base, size_t num, size_t size,
-	    cmp_r_func_t cmp_func,
-	    swap_func_t swap_func,
-	    const void *priv)
+static void __heapsort(void *base, size_t num, size_t size,
+		       cmp_r_func_t cmp_func,
+		       swap_func_t swap_func,
+		       const void *priv)
 {
 	/* pre-scale counters for performance */
 	size_t n = num * size, a = (num/2) * size;
@@ -208,15 +212,6 @@ void sort_r(void *base, size_t num, size_t size,
 	if (!a)		/* num < 2 || size == 0 */
 		return;
 
-	if (!swap_func) {
-		if (is_aligned(base, size, 8))
-			swap_func = SWAP_WORDS_64;
-		else if (is_aligned(base, size, 4))
-			swap_func = SWAP_WORDS_32;
-		else
-			swap_func = SWAP_BYTES;
-	}
-
 	/*
 	 * Loop invariants:
 	 * 1. elements [a,n) satisfy the heap property (compare greater than
@@ -261,6 +256,304 @@ void sort_r(void *base, size_t num, size_t size,
 		}
 	}
 }
+
+/**
+ * heapsort_r - sort an array of elements with heapsort
+ * @base: pointer to data to sort
+ * @num: number of elements
+ * @size: size of each element
+ * @cmp_func: pointer to comparison function
+ * @swap_func: pointer to swap function or NULL
+ * @priv: third argument passed to comparison function
+ *
+ * This function does a heapsort on the given array.  You may provide
+ * a swap_func function if you need to do something more than a memory
+ * copy (e.g. fix up pointers or auxiliary data), but the built-in swap
+ * avoids a slow retpoline and so is significantly faster.
+ *
+ * Sorting time is O(n log n) both on average and worst-case, using
+ * constant stack space.
+ */
+void heapsort_r(void *base, size_t num, size_t size,
+		cmp_r_func_t cmp_func,
+		swap_func_t swap_func,
+		const void *priv)
+{
+	swap_func = choose_swap_func(base, size, swap_func);
+	__heapsort(base, num, size, cmp_func, swap_func, priv);
+}
+EXPORT_SYMBOL(heapsort_r);
+
+/*
+ * Partitions of at most this many elements are finished off with an
+ * insertion sort.
+ */
+#define INSERTION_SORT_THRESHOLD	16
+/* Above this many elements, the pivot is a median of three medians. */
+#define NINTHER_THRESHOLD		128
+/*
+ * How many elements the optimistic insertion sort of an apparently
+ * sorted partition may move before giving up on it.
+ */
+#define PARTIAL_INSERTION_LIMIT		8
+/*
+ * Pending partitions.  The larger half is always the one pushed, so this
+ * covers 2^32 times INSERTION_SORT_THRESHOLD elements; anything beyond
+ * that is handed to the heapsort instead.
+ */
+#define INTROSORT_STACK_DEPTH		32
+
+static void insertion_sort(void *base, size_t lo, size_t hi, size_t size,
+			   cmp_r_func_t cmp_func, swap_func_t swap_func,
+			   const void *priv)
+{
+	size_t i, j;
+
+	for (i = lo + size; i < hi; i += size)
+		for (j = i; j > lo &&
+		     do_cmp(base + j - size, base + j, cmp_func, priv) > 0;
+		     j -= size)
+			do_swap(base + j - size, base + j, size, swap_func);
+}
+
+/*
+ * Insertion sort [lo, hi), but give up once more than
+ * PARTIAL_INSERTION_LIMIT elements had to be moved.  Returns true if
+ * the range ended up sorted.
+ */
+static bool partial_insertion_sort(void *base, size_t lo, size_t hi,
+				   size_t size, cmp_r_func_t cmp_func,
+				   swap_func_t swap_func, const void *priv)
+{
+	const size_t limit = PARTIAL_INSERTION_LIMIT * size;
+	size_t i, j, moved = 0;
+
+	for (i = lo + size; i < hi; i += size) {
+		for (j = i; j > lo &&
+		     do_cmp(base + j - size, base + j, cmp_func, priv) > 0;
+		     j -= size)
+			do_swap(base + j - size, base + j, size, swap_func);
+
+		moved += i - j;
+		if (moved > limit && i + size < hi)
+			return false;
+	}
+	return true;
+}
+
+/* Order the elements at @a, @b and @c so that *a <= *b <= *c. */
+static void sort3(void *a, void *b, void *c, size_t size,
+		  cmp_r_func_t cmp_func, swap_func_t swap_func,
+		  const void *priv)
+{
+	if (do_cmp(b, a, cmp_func, priv) < 0)
+		do_swap(a, b, size, swap_func);
+	if (do_cmp(c, b, cmp_func, priv) < 0) {
+		do_swap(b, c, size, swap_func);
+		if (do_cmp(b, a, cmp_func, priv) < 0)
+			do_swap(a, b, size, swap_func);
+	}
+}
+
+/*
+ * Partition [lo, hi) around the element at lo, which must already hold
+ * the pivot.  Returns the final offset of the pivot; everything before it
+ * compares <= and everything after it >= the pivot.  Elements equal to
+ * the pivot stop both scans, so runs of duplicates still split evenly.
+ * *@swapped is cleared if the range was already partitioned.
+ */
+static size_t partition(void *base, size_t lo, size_t hi, size_t size,
+			cmp_r_func_t cmp_func, swap_func_t swap_func,
+			const void *priv, bool *swapped)
+{
+	size_t i = lo + size, j = hi - size;
+
+	*swapped = false;
+	for (;;) {
+		while (i <= j && do_cmp(base + i, base + lo, cmp_func, priv) < 0)
+			i += size;
+		while (i <= j && do_cmp(base + j, base + lo, cmp_func, priv) > 0)
+			j -= size;
+		if (i >= j)
+			break;
+		do_swap(base + i, base + j, size, swap_func);
+		*swapped = true;
+		i += size;
+		j -= size;
+	}
+	if (j != lo)
+		do_swap(base + lo, base + j, size, swap_func);
+	return j;
+}
+
+/**
+ * introsort_r - sort an array of elements with introsort
+ * @base: pointer to data to sort
+ * @num: number of elements
+ * @size: size of each element
+ * @cmp_func: pointer to comparison function
+ * @swap_func: pointer to swap function or NULL
+ * @priv: third argument passed to comparison function
+ *
+ * Same interface as heapsort_r(), but does a pattern-defeating quicksort:
+ * median-of-3 (or ninther) pivots, insertion sort for short partitions,
+ * and an early exit for partitions that turn out to be already sorted,
+ * which makes presorted input O(n).  Each badly unbalanced partition
+ * costs one of log2(n) credits; when they run out the partition is
+ * handed to heapsort, so the worst case stays O(n log n).
+ *
+ * The sort is not stable and uses a small, bounded amount of stack.
+ */
+void introsort_r(void *base, size_t num, size_t size,
+		 cmp_r_func_t cmp_func,
+		 swap_func_t swap_func,
+		 const void *priv)
+{
+	struct {
+		size_t lo, hi;
+		unsigned int bad;
+	} stack[INTROSORT_STACK_DEPTH];
+	unsigned int sp = 0, bad;
+	size_t lo = 0, hi = num * size;
+
+	if (num < 2 || !size)
+		return;
+
+	swap_func = choose_swap_func(base, size, swap_func);
+	bad = ilog2(num);
+
+	for (;;) {
+		size_t n = (hi - lo) / size, mid, p, l, r;
+		bool swapped;
+
+		if (n <= INSERTION_SORT_THRESHOLD) {
+			insertion_sort(base, lo, hi, size,
+				       cmp_func, swap_func, priv);
+			goto next;
+		}
+
+		/* Move the pivot to lo */
+		mid = lo + (n / 2) * size;
+		if (n > NINTHER_THRESHOLD) {
+			size_t s = (n / 8) * size;
+
+			sort3(base + lo, base + mid, base + hi - size,
+			      size, cmp_func, swap_func, priv);
+			sort3(base + lo + s, base + mid - s, base + hi - size - s,
+			      size, cmp_func, swap_func, priv);
+			sort3(base + lo + 2 * s, base + mid + s,
+			      base + hi - size - 2 * s,
+			      size, cmp_func, swap_func, priv);
+			sort3(base + mid - s, base + mid, base + mid + s,
+			      size, cmp_func, swap_func, priv);
+			do_swap(base + lo, base + mid, size, swap_func);
+		} else {
+			sort3(base + mid, base + lo, base + hi - size,
+			      size, cmp_func, swap_func, priv);
+		}
+
+		p = partition(base, lo, hi, size, cmp_func, swap_func, priv,
+			      &swapped);
+		l = (p - lo) / size;
+		r = n - l - 1;
+
+		if (l < n / 8 || r < n / 8) {
+			/* Out of credit: stop trusting the pivots */
+			if (!--bad) {
+				__heapsort(base + lo, n, size,
+					   cmp_func, swap_func, priv);
+				goto next;
+			}
+
+			/* Shuffle a few elements to break up the pattern */
+			if (l >= INSERTION_SORT_THRESHOLD) {
+				do_swap(base + lo, base + lo + (l / 4) * size,
+					size, swap_func);
+				do_swap(base + p - size,
+					base + p - (l / 4) * size,
+					size, swap_func);
+			}
+			if (r >= INSERTION_SORT_THRESHOLD) {
+				do_swap(base + p + size,
+					base + p + (1 + r / 4) * size,
+					size, swap_func);
+				do_swap(base + hi - size,
+					base + hi - (r / 4) * size,
+					size, swap_func);
+			}
+		} else if (!swapped &&
+			   partial_insertion_sort(base, lo, p, size,
+						  cmp_func, swap_func, priv) &&
+			   partial_insertion_sort(base, p + size, hi, size,
+						  cmp_func, swap_func, priv)) {
+			goto next;
+		}
+
+		/* Carry on with the smaller half, stack the larger one */
+		if (sp == INTROSORT_STACK_DEPTH) {
+			if (l < r)
+				__heapsort(base + p + size, r, size,
+					   cmp_func, swap_func, priv);
+			else
+				__heapsort(base + lo, l, size,
+					   cmp_func, swap_func, priv);
+		} else if (l < r) {
+			stack[sp].lo = p + size;
+			stack[sp].hi = hi;
+			stack[sp++].bad = bad;
+		} else {
+			stack[sp].lo = lo;
+			stack[sp].hi = p;
+			stack[sp++].bad = bad;
+		}
+		if (l < r)
+			hi = p;
+		else
+			lo = p + size;
+		continue;
+next:
+		if (!sp)
+			break;
+		sp--;
+		lo = stack[sp].lo;
+		hi = stack[sp].hi;
+		bad = stack[sp].bad;
+	}
+}
+EXPORT_SYMBOL(introsort_r);
+
+/**
+ * sort_r - sort an array of elements
+ * @base: pointer to data to sort
+ * @num: number of elements
+ * @size: size of each element
+ * @cmp_func: pointer to comparison function
+ * @swap_func: pointer to swap function or NULL
+ * @priv: third argument passed to comparison function
+ *
+ * This function does a heapsort on the given array, or an introsort if
+ * CONFIG_SORT_INTROSORT is set.  You may provide a swap_func function if
+ * you need to do something more than a memory copy (e.g. fix up pointers
+ * or auxiliary data), but the built-in swap avoids a slow retpoline and
+ * so is significantly faster.
+ *
+ * Sorting time is O(n log n) both on average and worst-case. While
+ * quicksort is slightly faster on average, it suffers from exploitable
+ * O(n*n) worst-case behavior and extra memory requirements that make
+ * it less suitable for kernel use; introsort bounds both.  Callers that
+ * want a particular algorithm regardless of the default can use
+ * heapsort_r() or introsort_r() directly.
+ */
+void sort_r(void *base, size_t num, size_t size,
+	    cmp_r_func_t cmp_func,
+	    swap_func_t swap_func,
+	    const void *priv)
+{
+	if (IS_ENABLED(CONFIG_SORT_INTROSORT))
+		introsort_r(base, num, size, cmp_func, swap_func, priv);
+	else
+		heapsort_r(base, num, size, cmp_func, swap_func, priv);
+}
 EXPORT_SYMBOL(sort_r);
 
 void sort(void *base, size_t num, size_t size,
@@ -270,3 +563,11 @@ void sort(void *base, size_t num, size_t size,
 	return sort_r(base, num, size, _CMP_WRAPPER, swap_func, cmp_func);
 }
 EXPORT_SYMBOL(sort);
+
+void introsort(void *base, size_t num, size_t size,
+	       cmp_func_t cmp_func,
+	       swap_func_t swap_func)
+{
+	return introsort_r(base, num, size, _CMP_WRAPPER, swap_func, cmp_func);
+}
+EXPORT_SYMBOL(introsort);
@@ -0,0 +1,211 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Test and benchmark for the genalloc extent index.
+ *
+ * Two best-fit pools, one scanning its bitmap and one using the extent
+ * index, are fragmented and then put through the same random sequence of
+ * allocations and frees.  Both must hand out identical addresses; the time
+ * spent in gen_pool_alloc()/gen_pool_free() is reported for each.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/genalloc.h>
+#include <linux/ktime.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/random.h>
+#include <linux/sizes.h>
+#include <linux/slab.h>
+
+/* Nothing is ever dereferenced, so any non-zero base will do */
+#define TEST_BASE	0x10000000UL
+#define TEST_ORDER	5
+
+static unsigned int pool_size = SZ_4M;
+module_param(pool_size, uint, 0444);
+MODULE_PARM_DESC(pool_size, "Size of the test pools in bytes");
+
+static unsigned int nr_ops = 100000;
+module_param(nr_ops, uint, 0444);
+MODULE_PARM_DESC(nr_ops, "Number of random allocations/frees to time");
+
+struct test_block {
+	unsigned long addr;
+	size_t size;
+};
+
+struct test_result {
+	unsigned long *trace;	/* every address handed out, in order */
+	unsigned int nr_trace;
+	u64 alloc_ns, free_ns;
+	unsigned int allocs, frees, failed;
+};
+
+static size_t __init random_size(struct rnd_state *rnd)
+{
+	u32 r = prandom_u32_state(rnd);
+
+	/* Mostly small blocks with the odd large one */
+	if (r % 16)
+		return ((r >> 4) % 16 + 1) << TEST_ORDER;
+	return ((r >> 4) % 256 + 1) << TEST_ORDER;
+}
+
+static int __init run_pool(struct gen_pool *pool, struct test_result *res,
+			   unsigned int max_blocks)
+{
+	struct test_block *blocks;
+	struct rnd_state rnd;
+	unsigned int nr = 0, i;
+	ktime_t t;
+
+	blocks = kvmalloc_array(max_blocks, sizeof(*blocks), GFP_KERNEL);
+	if (!blocks)
+		return -ENOMEM;
+
+	prandom_seed_state(&rnd, 42);
+
+	/* Fill the pool, then free every other block to fragment it */
+	while (nr < max_blocks) {
+		size_t size = random_size(&rnd);
+		unsigned long addr = gen_pool_alloc(pool, size);
+
+		if (!addr)
+			break;
+		blocks[nr].addr = addr;
+		blocks[nr++].size = size;
+	}
+	for (i = 0; i < nr; i += 2)
+		gen_pool_free(pool, blocks[i].addr, blocks[i].size);
+	for (i = 1; i < nr; i += 2)
+		blocks[i / 2] = blocks[i];
+	nr /= 2;
+
+	for (i = 0; i < nr_ops; i++) {
+		u32 r = prandom_u32_state(&rnd);
+
+		if (nr && (r & 1 || nr == max_blocks)) {
+			struct test_block *b = &blocks[(r >> 1) % nr];
+
+			t = ktime_get();
+			gen_pool_free(pool, b->addr, b->size);
+			res->free_ns += ktime_to_ns(ktime_sub(ktime_get(), t));
+			res->frees++;
+			*b = blocks[--nr];
+		} else {
+			size_t size = random_size(&rnd);
+			unsigned long addr;
+
+			t = ktime_get();
+			addr = gen_pool_alloc(pool, size);
+			res->alloc_ns += ktime_to_ns(ktime_sub(ktime_get(), t));
+			res->allocs++;
+			res->trace[res->nr_trace++] = addr;
+			if (!addr) {
+				res->failed++;
+				continue;
+			}
+			blocks[nr].addr = addr;
+			blocks[nr++].size = size;
+		}
+		if (!(i % 1024))
+			cond_resched();
+	}
+
+	while (nr--)
+		gen_pool_free(pool, blocks[nr].addr, blocks[nr].size);
+	kvfree(blocks);
+
+	return gen_pool_avail(pool) == gen_pool_size(pool) ? 0 : -EINVAL;
+}
+
+static int __init test_pool(bool extents, struct test_result *res)
+{
+	unsigned int max_blocks = pool_size >> TEST_ORDER;
+	struct gen_pool *pool;
+	int err;
+
+	pool = gen_pool_create(TEST_ORDER, NUMA_NO_NODE);
+	if (!pool)
+		return -ENOMEM;
+
+	/* gen_pool_use_extents() also switches the pool to best-fit */
+	if (extents) {
+		err = gen_pool_use_extents(pool);
+	} else {
+		gen_pool_set_algo(pool, gen_pool_best_fit, NULL);
+		err = 0;
+	}
+	if (!err)
+		err = gen_pool_add(pool, TEST_BASE, pool_size, NUMA_NO_NODE);
+	if (!err)
+		err = run_pool(pool, res, max_blocks);
+	if (err == -EINVAL)
+		pr_err("%s pool leaked space\n", extents ? "extent" : "bitmap");
+
+	gen_pool_destroy(pool);
+	return err;
+}
+
+static void __init report(const char *name, struct test_result *res)
+{
+	pr_info("%s: %u allocs (%u failed) avg %llu ns, %u frees avg %llu ns\n",
+		name, res->allocs, res->failed,
+		res->allocs ? div_u64(res->alloc_ns, res->allocs) : 0,
+		res->frees,
+		res->frees ? div_u64(res->free_ns, res->frees) : 0);
+}
+
+static int __init test_genalloc_init(void)
+{
+	struct test_result bitmap = { }, extent = { };
+	unsigned int i;
+	int err = -ENOMEM;
+
+	if (pool_size < PAGE_SIZE || !nr_ops)
+		return -EINVAL;
+
+	bitmap.trace = kvmalloc_array(nr_ops, sizeof(unsigned long), GFP_KERNEL);
+	extent.trace = kvmalloc_array(nr_ops, sizeof(unsigned long), GFP_KERNEL);
+	if (!bitmap.trace || !extent.trace)
+		goto out;
+
+	err = test_pool(false, &bitmap);
+	if (!err)
+		err = test_pool(true, &extent);
+	if (err)
+		goto out;
+
+	err = -EINVAL;
+	if (bitmap.nr_trace != extent.nr_trace) {
+		pr_err("allocation count mismatch: %u vs %u\n",
+		       bitmap.nr_trace, extent.nr_trace);
+		goto out;
+	}
+	for (i = 0; i < bitmap.nr_trace; i++) {
+		if (bitmap.trace[i] != extent.trace[i]) {
+			pr_err("allocation %u mismatch: bitmap %lx extent %lx\n",
+			       i, bitmap.trace[i], extent.trace[i]);
+			goto out;
+		}
+	}
+
+	report("bitmap", &bitmap);
+	report("extent", &extent);
+	pr_info("test passed\n");
+	err = 0;
+out:
+	kvfree(bitmap.trace);
+	kvfree(extent.trace);
+	return err;
+}
+
+static void __exit test_genalloc_exit(void)
+{
+}
+
+module_init(test_genalloc_init);
+module_exit(test_genalloc_exit);
+
+MODULE_LICENSE("GPL");
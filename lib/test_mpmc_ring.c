@@ -0,0 +1,353 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Test and benchmark for the MPMC ring.
+ *
+ * After a few single-threaded checks, pairs of producer and consumer
+ * threads are bound to the online CPUs and pass nr_items pointers each
+ * through the ring.  The consumers check that every item arrives exactly
+ * once.  The same is then done through a kfifo protected by a spinlock,
+ * which is what users of kfifo with several readers or writers have to
+ * do today, and the time taken by each is reported.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/completion.h>
+#include <linux/cpumask.h>
+#include <linux/delay.h>
+#include <linux/kfifo.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/mpmc_ring.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+
+#define TEST_RING_SIZE	1024
+#define TEST_BATCH	8
+
+static unsigned int nr_items = 1000000;
+module_param(nr_items, uint, 0444);
+MODULE_PARM_DESC(nr_items, "Number of items passed by each producer");
+
+static unsigned int max_threads;
+module_param(max_threads, uint, 0444);
+MODULE_PARM_DESC(max_threads, "Maximum number of threads (default: online CPUs)");
+
+static struct mpmc_ring test_ring;
+static DECLARE_KFIFO_PTR(test_fifo, void *);
+static DEFINE_SPINLOCK(test_fifo_lock);
+
+struct test_ops {
+	const char *name;
+	unsigned int batch;
+	unsigned int (*put)(void **ptrs, unsigned int n);
+	unsigned int (*get)(void **ptrs, unsigned int n);
+	void (*flush)(void);
+};
+
+static unsigned int ring_put(void **ptrs, unsigned int n)
+{
+	return mpmc_ring_enqueue_batch(&test_ring, ptrs, n);
+}
+
+static unsigned int ring_get(void **ptrs, unsigned int n)
+{
+	return mpmc_ring_dequeue_batch(&test_ring, ptrs, n);
+}
+
+static unsigned int ring_put_local(void **ptrs, unsigned int n)
+{
+	return mpmc_ring_enqueue_local(&test_ring, ptrs[0]) ? 0 : 1;
+}
+
+static void ring_flush_local(void)
+{
+	while (mpmc_ring_flush_local(&test_ring))
+		cond_resched();
+}
+
+static unsigned int fifo_put(void **ptrs, unsigned int n)
+{
+	return kfifo_in_spinlocked(&test_fifo, ptrs, n, &test_fifo_lock);
+}
+
+static unsigned int fifo_get(void **ptrs, unsigned int n)
+{
+	return kfifo_out_spinlocked(&test_fifo, ptrs, n, &test_fifo_lock);
+}
+
+static const struct test_ops test_ops[] = {
+	{ "kfifo+spinlock", 1, fifo_put, fifo_get, NULL },
+	{ "kfifo+spinlock batch", TEST_BATCH, fifo_put, fifo_get, NULL },
+	{ "mpmc", 1, ring_put, ring_get, NULL },
+	{ "mpmc batch", TEST_BATCH, ring_put, ring_get, NULL },
+	{ "mpmc local", 1, ring_put_local, ring_get, ring_flush_local },
+};
+
+struct test_thread {
+	struct task_struct *task;
+	bool producer;
+	unsigned long count;
+	unsigned long sum;
+};
+
+static struct {
+	const struct test_ops *ops;
+	unsigned long total;
+	atomic_long_t consumed;
+	atomic_t running;
+	struct completion start;
+	struct completion done;
+} test_ctx;
+
+static void test_produce(struct test_thread *t)
+{
+	const struct test_ops *ops = test_ctx.ops;
+	void *ptrs[TEST_BATCH];
+	unsigned long i = 0;
+	unsigned int n, k;
+
+	while (i < nr_items) {
+		n = min_t(unsigned long, ops->batch, nr_items - i);
+		for (k = 0; k < n; k++)
+			ptrs[k] = (void *)(i + k + 1);
+		k = ops->put(ptrs, n);
+		if (!k)
+			cond_resched();
+		i += k;
+	}
+	if (ops->flush)
+		ops->flush();
+}
+
+static void test_consume(struct test_thread *t)
+{
+	const struct test_ops *ops = test_ctx.ops;
+	void *ptrs[TEST_BATCH];
+	unsigned int n, k;
+
+	while (atomic_long_read(&test_ctx.consumed) < test_ctx.total) {
+		n = ops->get(ptrs, ops->batch);
+		if (!n) {
+			cond_resched();
+			continue;
+		}
+		for (k = 0; k < n; k++)
+			t->sum += (unsigned long)ptrs[k];
+		t->count += n;
+		atomic_long_add(n, &test_ctx.consumed);
+	}
+}
+
+static int test_thread_fn(void *arg)
+{
+	struct test_thread *t = arg;
+
+	wait_for_completion(&test_ctx.start);
+	if (t->producer)
+		test_produce(t);
+	else
+		test_consume(t);
+
+	if (atomic_dec_and_test(&test_ctx.running))
+		complete(&test_ctx.done);
+
+	/* Wait for the kthread_stop() call */
+	while (!kthread_should_stop())
+		msleep(1);
+	return 0;
+}
+
+static int __init run_threads(const struct test_ops *ops,
+			      struct test_thread *threads,
+			      unsigned int nr_threads, u64 *ns)
+{
+	unsigned long count = 0, sum = 0, expected;
+	unsigned int i;
+	ktime_t t0;
+	int cpu = -1;
+
+	test_ctx.ops = ops;
+	test_ctx.total = (unsigned long)nr_items * (nr_threads / 2);
+	atomic_long_set(&test_ctx.consumed, 0);
+	atomic_set(&test_ctx.running, nr_threads);
+	init_completion(&test_ctx.start);
+	init_completion(&test_ctx.done);
+
+	for (i = 0; i < nr_threads; i++) {
+		struct test_thread *t = &threads[i];
+
+		memset(t, 0, sizeof(*t));
+		t->producer = i & 1;
+		t->task = kthread_create(test_thread_fn, t, "mpmc_test/%u", i);
+		if (IS_ERR(t->task)) {
+			int err = PTR_ERR(t->task);
+
+			/* Threads that were never woken exit without running */
+			while (i--)
+				kthread_stop(threads[i].task);
+			return err;
+		}
+
+		cpu = cpumask_next(cpu, cpu_online_mask);
+		if (cpu >= nr_cpu_ids)
+			cpu = cpumask_first(cpu_online_mask);
+		kthread_bind(t->task, cpu);
+	}
+	for (i = 0; i < nr_threads; i++)
+		wake_up_process(threads[i].task);
+
+	t0 = ktime_get();
+	complete_all(&test_ctx.start);
+	wait_for_completion(&test_ctx.done);
+	*ns = ktime_to_ns(ktime_sub(ktime_get(), t0));
+
+	for (i = 0; i < nr_threads; i++) {
+		kthread_stop(threads[i].task);
+		count += threads[i].count;
+		sum += threads[i].sum;
+	}
+
+	expected = (unsigned long)nr_items * (nr_items + 1) / 2 *
+		   (nr_threads / 2);
+	if (count != test_ctx.total || sum != expected) {
+		pr_err("%s: %u threads passed %lu items (sum %lu), expected %lu (sum %lu)\n",
+		       ops->name, nr_threads, count, sum, test_ctx.total,
+		       expected);
+		return -EINVAL;
+	}
+	return 0;
+}
+
+static int __init test_single(void)
+{
+	unsigned int i, n;
+	void **in, **out;
+	int err = -EINVAL;
+
+	in = kmalloc_array(TEST_RING_SIZE, sizeof(*in), GFP_KERNEL);
+	out = kmalloc_array(2 * TEST_RING_SIZE, sizeof(*out), GFP_KERNEL);
+	if (!in || !out) {
+		err = -ENOMEM;
+		goto out;
+	}
+	for (i = 0; i < TEST_RING_SIZE; i++)
+		in[i] = (void *)(unsigned long)(i + 1);
+
+	if (mpmc_ring_dequeue(&test_ring) || !mpmc_ring_empty(&test_ring))
+		goto fail;
+
+	/* Fill in uneven batches, then overflow */
+	for (i = 0; i < TEST_RING_SIZE; i += n) {
+		n = mpmc_ring_enqueue_batch(&test_ring, in + i,
+					    min(7U, TEST_RING_SIZE - i));
+		if (!n)
+			goto fail;
+	}
+	if (mpmc_ring_count(&test_ring) != TEST_RING_SIZE ||
+	    mpmc_ring_enqueue(&test_ring, in[0]) != -ENOSPC ||
+	    mpmc_ring_enqueue_batch(&test_ring, in, 2))
+		goto fail;
+
+	/* Drain half, refill across the wrap, then drain everything */
+	n = mpmc_ring_dequeue_batch(&test_ring, out, TEST_RING_SIZE / 2);
+	if (n != TEST_RING_SIZE / 2 ||
+	    mpmc_ring_enqueue_batch(&test_ring, in, TEST_RING_SIZE) != n)
+		goto fail;
+	n += mpmc_ring_dequeue_batch(&test_ring, out + n, TEST_RING_SIZE);
+	if (n != TEST_RING_SIZE + TEST_RING_SIZE / 2)
+		goto fail;
+	for (i = 0; i < n; i++)
+		if (out[i] != in[i % TEST_RING_SIZE])
+			goto fail;
+
+	/* Locally cached entries only appear once flushed */
+	preempt_disable();
+	for (i = 0; i < MPMC_RING_LOCAL_BATCH - 1; i++)
+		mpmc_ring_enqueue_local(&test_ring, in[i]);
+	n = mpmc_ring_count(&test_ring);
+	mpmc_ring_flush_local(&test_ring);
+	preempt_enable();
+	if (n || mpmc_ring_dequeue_batch(&test_ring, out, TEST_RING_SIZE) !=
+		 MPMC_RING_LOCAL_BATCH - 1 || out[0] != in[0])
+		goto fail;
+
+	/* Entries cached on any CPU are published by a global flush */
+	preempt_disable();
+	for (i = 0; i < 3; i++)
+		mpmc_ring_enqueue_local(&test_ring, in[i]);
+	preempt_enable();
+	if (mpmc_ring_flush_all(&test_ring) ||
+	    mpmc_ring_dequeue_batch(&test_ring, out, TEST_RING_SIZE) != 3 ||
+	    out[2] != in[2])
+		goto fail;
+
+	err = 0;
+	goto out;
+fail:
+	pr_err("single-threaded test failed\n");
+out:
+	kfree(in);
+	kfree(out);
+	return err;
+}
+
+static int __init test_mpmc_ring_init(void)
+{
+	unsigned int nr_threads, i, limit;
+	struct test_thread *threads;
+	u64 ns;
+	int err;
+
+	err = mpmc_ring_init_local(&test_ring, TEST_RING_SIZE, GFP_KERNEL);
+	if (err)
+		return err;
+	err = kfifo_alloc(&test_fifo, TEST_RING_SIZE, GFP_KERNEL);
+	if (err)
+		goto out_ring;
+
+	err = test_single();
+	if (err)
+		goto out_fifo;
+
+	limit = max_threads ?: num_online_cpus();
+	limit = max(limit, 2U);
+	threads = kcalloc(limit, sizeof(*threads), GFP_KERNEL);
+	err = -ENOMEM;
+	if (!threads)
+		goto out_fifo;
+
+	for (nr_threads = 2; nr_threads <= limit; nr_threads *= 2) {
+		for (i = 0; i < ARRAY_SIZE(test_ops); i++) {
+			const struct test_ops *ops = &test_ops[i];
+			u64 items = (u64)nr_items * (nr_threads / 2);
+
+			err = run_threads(ops, threads, nr_threads, &ns);
+			if (err)
+				goto out_threads;
+			pr_info("%u threads, %s: %llu ns/item\n", nr_threads,
+				ops->name, div64_u64(ns, items ?: 1));
+		}
+	}
+	pr_info("test passed\n");
+	err = 0;
+
+out_threads:
+	kfree(threads);
+out_fifo:
+	kfifo_free(&test_fifo);
+out_ring:
+	mpmc_ring_free(&test_ring, NULL);
+	return err;
+}
+
+static void __exit test_mpmc_ring_exit(void)
+{
+}
+
+module_init(test_mpmc_ring_init);
+module_exit(test_mpmc_ring_exit);
+
+MODULE_LICENSE("GPL");
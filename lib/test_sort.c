@@ -1,17 +1,159 @@
 // SPDX-License-Identifier: GPL-2.0-only
 #include <linux/sort.h>
 #include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/ktime.h>
+#include <linux/random.h>
 #include <linux/module.h>
 
-/* a simple boot-time regression test */
+/*
+ * A simple boot-time regression test, followed by a comparison of the
+ * heapsort and introsort engines on a few input patterns.
+ */
 
 #define TEST_LEN 1000
 
+/* fixed, so that every run sorts the same inputs */
+#define TEST_SEED 0x5eed
+
+static unsigned int bench_len = 100000;
+module_param(bench_len, uint, 0444);
+MODULE_PARM_DESC(bench_len, "Number of elements sorted by the benchmark (0 to skip)");
+
 static int __init cmpint(const void *a, const void *b)
 {
 	return *(int *)a - *(int *)b;
 }
 
+static int __init cmpint_r(const void *a, const void *b, const void *priv)
+{
+	int x = *(int *)a, y = *(int *)b;
+
+	return (x > y) - (x < y);
+}
+
+enum test_pattern {
+	PATTERN_RANDOM,
+	PATTERN_SORTED,
+	PATTERN_REVERSED,
+	PATTERN_ORGAN_PIPE,
+	PATTERN_FEW_UNIQUE,
+	NR_PATTERNS,
+};
+
+static const char * const pattern_names[NR_PATTERNS] __initconst = {
+	[PATTERN_RANDOM]	= "random",
+	[PATTERN_SORTED]	= "sorted",
+	[PATTERN_REVERSED]	= "reversed",
+	[PATTERN_ORGAN_PIPE]	= "organ-pipe",
+	[PATTERN_FEW_UNIQUE]	= "few-unique",
+};
+
+static void __init fill(int *a, int len, enum test_pattern pattern,
+			struct rnd_state *rnd)
+{
+	int i;
+
+	for (i = 0; i < len; i++) {
+		switch (pattern) {
+		case PATTERN_RANDOM:
+			a[i] = prandom_u32_state(rnd) & INT_MAX;
+			break;
+		case PATTERN_SORTED:
+			a[i] = i;
+			break;
+		case PATTERN_REVERSED:
+			a[i] = len - i;
+			break;
+		case PATTERN_ORGAN_PIPE:
+			a[i] = i < len / 2 ? i : len - i;
+			break;
+		default:
+			a[i] = prandom_u32_state(rnd) % 8;
+			break;
+		}
+	}
+}
+
+static bool __init is_sorted(const int *a, int len)
+{
+	int i;
+
+	for (i = 0; i < len - 1; i++)
+		if (a[i] > a[i + 1])
+			return false;
+	return true;
+}
+
+static int __init test_sort_engines(int *a, int len)
+{
+	enum test_pattern pattern;
+	struct rnd_state rnd;
+	int n;
+
+	prandom_seed_state(&rnd, TEST_SEED);
+	for (pattern = 0; pattern < NR_PATTERNS; pattern++) {
+		for (n = 0; n <= len; n += n < 64 ? 1 : 61) {
+			fill(a, n, pattern, &rnd);
+			heapsort_r(a, n, sizeof(*a), cmpint_r, NULL, NULL);
+			if (!is_sorted(a, n))
+				goto fail;
+
+			fill(a, n, pattern, &rnd);
+			introsort_r(a, n, sizeof(*a), cmpint_r, NULL, NULL);
+			if (!is_sorted(a, n))
+				goto fail;
+		}
+	}
+	return 0;
+fail:
+	pr_err("%s input of %d elements not sorted\n",
+	       pattern_names[pattern], n);
+	return -EINVAL;
+}
+
+/* Both engines sort a copy of the same input */
+static void __init bench_sort(void)
+{
+	size_t size = bench_len * sizeof(int);
+	enum test_pattern pattern;
+	struct rnd_state rnd;
+	ktime_t heap, intro;
+	int *a, *input;
+
+	if (!bench_len)
+		return;
+
+	a = kvmalloc_array(bench_len, sizeof(*a), GFP_KERNEL);
+	input = kvmalloc_array(bench_len, sizeof(*input), GFP_KERNEL);
+	if (!a || !input)
+		goto out;
+
+	prandom_seed_state(&rnd, TEST_SEED);
+	for (pattern = 0; pattern < NR_PATTERNS; pattern++) {
+		fill(input, bench_len, pattern, &rnd);
+
+		memcpy(a, input, size);
+		heap = ktime_get();
+		heapsort_r(a, bench_len, sizeof(*a), cmpint_r, NULL, NULL);
+		heap = ktime_sub(ktime_get(), heap);
+
+		memcpy(a, input, size);
+		intro = ktime_get();
+		introsort_r(a, bench_len, sizeof(*a), cmpint_r, NULL, NULL);
+		intro = ktime_sub(ktime_get(), intro);
+
+		pr_info("%u %s elements: heapsort %lld us, introsort %lld us\n",
+			bench_len, pattern_names[pattern],
+			ktime_to_us(heap), ktime_to_us(intro));
+		cond_resched();
+	}
+
+out:
+	kvfree(input);
+	kvfree(a);
+}
+
 static int __init test_sort_init(void)
 {
 	int *a, i, r = 1, err = -ENOMEM;
@@ -33,8 +175,13 @@ static int __init test_sort_init(void)
 			pr_err("test has failed\n");
 			goto exit;
 		}
-	err = 0;
+
+	err = test_sort_engines(a, TEST_LEN);
+	if (err)
+		goto exit;
+
 	pr_info("test passed\n");
+	bench_sort();
 exit:
 	kfree(a);
 	return err;
@@ -0,0 +1,245 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Test cases for the XXH3 functions in <linux/xxhash.h>
+ *
+ * The one-shot hashes are checked against vectors produced by the
+ * reference xxHash 0.8 implementation, and the streaming interface is
+ * checked against the one-shot results with the input split at a range
+ * of offsets.  The throughput of xxh64() and xxh3_64() is then reported
+ * for a few buffer sizes.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/xxhash.h>
+
+#define TEST_BUF_LEN	8200
+#define TEST_SEED	0x9E3779B185EBCA8DULL
+
+static unsigned int bench_iters = 10000;
+module_param(bench_iters, uint, 0444);
+MODULE_PARM_DESC(bench_iters, "Number of iterations per benchmark (0 to skip)");
+
+struct xxh3_test_vector {
+	size_t len;
+	int seeded;
+	u64 hash64;
+	u64 low64, high64;
+};
+
+static const struct xxh3_test_vector xxh3_vectors[] __initconst = {
+	{     0, 0, 0x2d06800538d394c2ULL,
+	  0x6001c324468d497fULL, 0x99aa06d3014798d8ULL },
+	{     0, 1, 0xa8a6b918b2f0364aULL,
+	  0xa986dfc5d7605bfeULL, 0x00feaa732a3ce25eULL },
+	{     1, 0, 0xc44bdff4074eecdbULL,
+	  0xc44bdff4074eecdbULL, 0xa6cd5e9392000f6aULL },
+	{     1, 1, 0x032be332dd766ef8ULL,
+	  0x032be332dd766ef8ULL, 0x20e49abcc53b3842ULL },
+	{     3, 0, 0x54247382a8d6b94dULL,
+	  0x54247382a8d6b94dULL, 0x20efc49ff02422eaULL },
+	{     3, 1, 0x634b8990b4976373ULL,
+	  0x634b8990b4976373ULL, 0x1c7ecf6a308cf00eULL },
+	{     4, 0, 0xe5dc74bc51848a51ULL,
+	  0x2e7d8d6876a39fe9ULL, 0x970d585ac632bf8eULL },
+	{     4, 1, 0xaa2e7eccb0c8f747ULL,
+	  0xbfaf51f1e67e0b0fULL, 0x3d53e5dfd837d927ULL },
+	{     8, 0, 0x24ccc9acaa9f65e4ULL,
+	  0x64c69cab4bb21dc5ULL, 0x47a7f080d82bb456ULL },
+	{     8, 1, 0x8f973410999b8f6bULL,
+	  0x7b29471dc729b5ffULL, 0xf50cec145bcd5c5aULL },
+	{     9, 0, 0x14d5001c15dd3f2bULL,
+	  0xed7ccbc501eb7501ULL, 0x564ef6078950d457ULL },
+	{     9, 1, 0xb3ae7333d9013f60ULL,
+	  0xaef5dfc0ac9f9044ULL, 0x6b380b43ffa61042ULL },
+	{    16, 0, 0x981b17d36c7498c9ULL,
+	  0x562980258a998629ULL, 0xc68c368ecf8a9c05ULL },
+	{    16, 1, 0x663f29333b4db6b1ULL,
+	  0x0346d13a7a5498c7ULL, 0x6ffcb80cd33085c8ULL },
+	{    17, 0, 0x796f5acd3a60f862ULL,
+	  0xabbc12d11973d7dbULL, 0x955fa78643ed3669ULL },
+	{    17, 1, 0xf3ec5067f4306db3ULL,
+	  0x980a14119985a7dfULL, 0xd77681219e464828ULL },
+	{   128, 0, 0xfcff24126754d861ULL,
+	  0xebb15e34a7fb5ab1ULL, 0x39992220e045260aULL },
+	{   128, 1, 0x73fde75280646649ULL,
+	  0x8394f5c51f1d8246ULL, 0xa0f7ccb68ee02addULL },
+	{   129, 0, 0x98f1b0a679a2ca29ULL,
+	  0x86c9e3bc8f0a3b5cULL, 0x03815fc91f1b30b6ULL },
+	{   129, 1, 0x21fffdbca099c844ULL,
+	  0xd4aae26fcec7dc03ULL, 0xad559266067c0bf3ULL },
+	{   240, 0, 0x81c3c2b67f568ccfULL,
+	  0x5c9aae94c8ebe5a0ULL, 0xaa4202daa2769dc8ULL },
+	{   240, 1, 0xcc0f58c27ef3d8eeULL,
+	  0x604e98db085c1864ULL, 0x29d2133d6ea58c5bULL },
+	{   241, 0, 0xc5a639ecd2030e5eULL,
+	  0xc5a639ecd2030e5eULL, 0x99a80ecf0ecfc647ULL },
+	{   241, 1, 0xdda9b0a161d4829aULL,
+	  0xdda9b0a161d4829aULL, 0xec64afae6a137582ULL },
+	{  1024, 0, 0xdd85c9b5c1109c5cULL,
+	  0xdd85c9b5c1109c5cULL, 0x0d30d24071c64c57ULL },
+	{  1024, 1, 0xef368a8a2ebabaefULL,
+	  0xef368a8a2ebabaefULL, 0x17600efe2b493a18ULL },
+	{  2051, 0, 0xe62f2e2bf20aaac7ULL,
+	  0xe62f2e2bf20aaac7ULL, 0x99120b1130bb7839ULL },
+	{  2051, 1, 0x243368f8e121ee9cULL,
+	  0x243368f8e121ee9cULL, 0xb76a302fc8dec9dbULL },
+	{  4096, 0, 0xe91206429d1f48f9ULL,
+	  0xe91206429d1f48f9ULL, 0xb9cfaea2ca5626a4ULL },
+	{  4096, 1, 0x2a3bbb20a5439dcdULL,
+	  0x2a3bbb20a5439dcdULL, 0x8fbc8fd4d526d1bdULL },
+	{  8199, 0, 0xc6fd166000e6fbc2ULL,
+	  0xc6fd166000e6fbc2ULL, 0xe0dbe5a093c93660ULL },
+	{  8199, 1, 0x3cba241b34e23cf7ULL,
+	  0x3cba241b34e23cf7ULL, 0x4e801f681f33f5bdULL },
+};
+
+static void __init fill_buf(u8 *buf, size_t len)
+{
+	u64 gen = 2654435761U;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		buf[i] = gen >> 56;
+		gen *= 11400714785074694797ULL;
+	}
+}
+
+static int __init test_vectors(const u8 *buf)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(xxh3_vectors); i++) {
+		const struct xxh3_test_vector *v = &xxh3_vectors[i];
+		u64 seed = v->seeded ? TEST_SEED : 0;
+		struct xxh128_hash h128;
+		u64 h64;
+
+		h64 = xxh3_64(buf, v->len, seed);
+		if (h64 != v->hash64) {
+			pr_err("xxh3_64 len %zu seed %llx: got %016llx expected %016llx\n",
+			       v->len, seed, h64, v->hash64);
+			return -EINVAL;
+		}
+		h128 = xxh3_128(buf, v->len, seed);
+		if (h128.low64 != v->low64 || h128.high64 != v->high64) {
+			pr_err("xxh3_128 len %zu seed %llx: got %016llx%016llx expected %016llx%016llx\n",
+			       v->len, seed, h128.high64, h128.low64,
+			       v->high64, v->low64);
+			return -EINVAL;
+		}
+	}
+	return 0;
+}
+
+static int __init test_streaming(const u8 *buf)
+{
+	static const size_t chunks[] __initconst = { 1, 7, 64, 100, 256, 1000 };
+	struct xxh3_state *state;
+	int i, j, err = -ENOMEM;
+
+	state = kmalloc(sizeof(*state), GFP_KERNEL);
+	if (!state)
+		return err;
+
+	err = -EINVAL;
+	for (i = 0; i < ARRAY_SIZE(xxh3_vectors); i++) {
+		const struct xxh3_test_vector *v = &xxh3_vectors[i];
+		u64 seed = v->seeded ? TEST_SEED : 0;
+
+		for (j = 0; j < ARRAY_SIZE(chunks); j++) {
+			struct xxh128_hash h128;
+			size_t done, n;
+
+			xxh3_reset(state, seed);
+			for (done = 0; done < v->len; done += n) {
+				n = min(chunks[j], v->len - done);
+				xxh3_update(state, buf + done, n);
+			}
+
+			if (xxh3_64_digest(state) != v->hash64) {
+				pr_err("xxh3_64_digest len %zu chunk %zu mismatch\n",
+				       v->len, chunks[j]);
+				goto out;
+			}
+			h128 = xxh3_128_digest(state);
+			if (h128.low64 != v->low64 ||
+			    h128.high64 != v->high64) {
+				pr_err("xxh3_128_digest len %zu chunk %zu mismatch\n",
+				       v->len, chunks[j]);
+				goto out;
+			}
+		}
+	}
+	err = 0;
+out:
+	kfree(state);
+	return err;
+}
+
+static void __init bench_xxhash(const u8 *buf)
+{
+	static const size_t lens[] __initconst = {
+		64, 1024, 4096, TEST_BUF_LEN,
+	};
+	u64 sink = 0, t64, t3;
+	unsigned int i, j;
+	ktime_t t;
+
+	if (!bench_iters)
+		return;
+
+	for (i = 0; i < ARRAY_SIZE(lens); i++) {
+		t = ktime_get();
+		for (j = 0; j < bench_iters; j++)
+			sink += xxh64(buf, lens[i], j);
+		t64 = ktime_to_ns(ktime_sub(ktime_get(), t));
+
+		t = ktime_get();
+		for (j = 0; j < bench_iters; j++)
+			sink += xxh3_64(buf, lens[i], j);
+		t3 = ktime_to_ns(ktime_sub(ktime_get(), t));
+
+		pr_info("%zu bytes: xxh64 %llu MB/s, xxh3_64 %llu MB/s\n",
+			lens[i],
+			div64_u64((u64)lens[i] * bench_iters * 1000, t64 ?: 1),
+			div64_u64((u64)lens[i] * bench_iters * 1000, t3 ?: 1));
+		cond_resched();
+	}
+	/* Keep the loops from being optimised away */
+	pr_debug("sink %llx\n", sink);
+}
+
+static int __init test_xxhash_init(void)
+{
+	u8 *buf;
+	int err;
+
+	buf = kmalloc(TEST_BUF_LEN, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+	fill_buf(buf, TEST_BUF_LEN);
+
+	err = test_vectors(buf);
+	if (!err)
+		err = test_streaming(buf);
+	if (!err) {
+		pr_info("test passed\n");
+		bench_xxhash(buf);
+	}
+
+	kfree(buf);
+	return err;
+}
+
+static void __exit test_xxhash_exit(void)
+{
+}
+
+module_init(test_xxhash_init);
+module_exit(test_xxhash_exit);
+
+MODULE_LICENSE("GPL");
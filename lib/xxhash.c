@@ -44,7 +44,13 @@
 #include <linux/kernel.h>
 #include <linux/module.h>
 #include <linux/string.h>
+#include <linux/swab.h>
 #include <linux/xxhash.h>
+#ifdef CONFIG_X86_64
+#include <asm/cpufeature.h>
+#include <asm/fpu/api.h>
+#include <asm/simd.h>
+#endif
 
 /*-*************************************
  * Macros
@@ -496,5 +502,948 @@ uint64_t xxh64_digest(const struct xxh64_state *state)
 }
 EXPORT_SYMBOL(xxh64_digest);
 
+/*-**************************************************
+ * XXH3
+ ***************************************************/
+
+/*
+ * XXH3 is a port of the xxHash 0.8 algorithm.  Inputs of up to 240 bytes
+ * are hashed in constant time with a handful of 64x64->128 multiplies;
+ * longer inputs go through eight 64-bit accumulators fed one 64-byte
+ * stripe at a time, which is where the SIMD implementations below come in.
+ */
+
+#define XXH3_STRIPE_LEN			64
+#define XXH3_SECRET_CONSUME_RATE	8
+#define XXH3_ACC_NB			8
+#define XXH3_MIDSIZE_MAX		240
+#define XXH3_MIDSIZE_STARTOFFSET	3
+#define XXH3_MIDSIZE_LASTOFFSET		17
+#define XXH3_SECRET_SIZE_MIN		136
+#define XXH3_SECRET_LASTACC_START	7
+#define XXH3_SECRET_MERGEACCS_START	11
+#define XXH3_SECRET_LIMIT		(XXH3_SECRET_SIZE - XXH3_STRIPE_LEN)
+#define XXH3_STRIPES_PER_BLOCK	\
+	(XXH3_SECRET_LIMIT / XXH3_SECRET_CONSUME_RATE)
+#define XXH3_BLOCK_LEN		(XXH3_STRIPE_LEN * XXH3_STRIPES_PER_BLOCK)
+#define XXH3_BUFFER_STRIPES		(XXH3_BUFFER_SIZE / XXH3_STRIPE_LEN)
+
+/*
+ * Inputs shorter than this are not worth saving the FPU state for, and
+ * the FPU is released every XXH3_SIMD_BLOCKS blocks to bound the time
+ * spent with preemption disabled.
+ */
+#define XXH3_SIMD_MIN_LEN		1024
+#define XXH3_SIMD_BLOCKS		4
+
+static const uint64_t PRIME_MX1 = 0x165667919E3779F9ULL;
+static const uint64_t PRIME_MX2 = 0x9FB21C651E98DF25ULL;
+
+/* Pseudorandom secret taken directly from FARSH */
+static const uint8_t xxh3_ksecret[XXH3_SECRET_SIZE] __aligned(64) = {
+	0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe,
+	0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+	0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb,
+	0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+	0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78,
+	0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+	0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e,
+	0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+	0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb,
+	0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+	0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e,
+	0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+	0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f,
+	0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+	0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31,
+	0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+	0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3,
+	0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+	0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49,
+	0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+	0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc,
+	0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+	0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28,
+	0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+static uint64_t xxh64_avalanche(uint64_t h64)
+{
+	h64 ^= h64 >> 33;
+	h64 *= PRIME64_2;
+	h64 ^= h64 >> 29;
+	h64 *= PRIME64_3;
+	h64 ^= h64 >> 32;
+	return h64;
+}
+
+static uint64_t xxh3_avalanche(uint64_t h64)
+{
+	h64 ^= h64 >> 37;
+	h64 *= PRIME_MX1;
+	h64 ^= h64 >> 32;
+	return h64;
+}
+
+static uint64_t xxh3_rrmxmx(uint64_t h64, uint64_t len)
+{
+	h64 ^= xxh_rotl64(h64, 49) ^ xxh_rotl64(h64, 24);
+	h64 *= PRIME_MX2;
+	h64 ^= (h64 >> 35) + len;
+	h64 *= PRIME_MX2;
+	return h64 ^ (h64 >> 28);
+}
+
+static struct xxh128_hash xxh_mult64to128(uint64_t lhs, uint64_t rhs)
+{
+	struct xxh128_hash r;
+#if defined(CONFIG_ARCH_SUPPORTS_INT128) && defined(__SIZEOF_INT128__)
+	unsigned __int128 product = (unsigned __int128)lhs * rhs;
+
+	r.low64 = (uint64_t)product;
+	r.high64 = (uint64_t)(product >> 64);
+#else
+	uint64_t lo_lo = (uint64_t)(uint32_t)lhs * (uint32_t)rhs;
+	uint64_t hi_lo = (lhs >> 32) * (uint32_t)rhs;
+	uint64_t lo_hi = (uint64_t)(uint32_t)lhs * (rhs >> 32);
+	uint64_t hi_hi = (lhs >> 32) * (rhs >> 32);
+	uint64_t cross = (lo_lo >> 32) + (uint32_t)hi_lo + lo_hi;
+
+	r.high64 = (hi_lo >> 32) + (cross >> 32) + hi_hi;
+	r.low64 = (cross << 32) | (uint32_t)lo_lo;
+#endif
+	return r;
+}
+
+static uint64_t xxh3_mul128_fold64(uint64_t lhs, uint64_t rhs)
+{
+	struct xxh128_hash product = xxh_mult64to128(lhs, rhs);
+
+	return product.low64 ^ product.high64;
+}
+
+static uint64_t xxh3_mix16b(const uint8_t *input, const uint8_t *secret,
+			    uint64_t seed)
+{
+	return xxh3_mul128_fold64(
+		get_unaligned_le64(input) ^ (get_unaligned_le64(secret) + seed),
+		get_unaligned_le64(input + 8) ^
+			(get_unaligned_le64(secret + 8) - seed));
+}
+
+static uint64_t xxh3_len_0to16_64(const uint8_t *input, size_t len,
+				  const uint8_t *secret, uint64_t seed)
+{
+	if (len > 8) {
+		const uint64_t bitflip1 =
+			(get_unaligned_le64(secret + 24) ^
+			 get_unaligned_le64(secret + 32)) + seed;
+		const uint64_t bitflip2 =
+			(get_unaligned_le64(secret + 40) ^
+			 get_unaligned_le64(secret + 48)) - seed;
+		const uint64_t input_lo = get_unaligned_le64(input) ^ bitflip1;
+		const uint64_t input_hi = get_unaligned_le64(input + len - 8) ^
+					  bitflip2;
+
+		return xxh3_avalanche(len + swab64(input_lo) + input_hi +
+				      xxh3_mul128_fold64(input_lo, input_hi));
+	}
+	if (len >= 4) {
+		const uint64_t s = seed ^
+			((uint64_t)swab32((uint32_t)seed) << 32);
+		const uint64_t bitflip =
+			(get_unaligned_le64(secret + 8) ^
+			 get_unaligned_le64(secret + 16)) - s;
+		const uint64_t input64 = get_unaligned_le32(input + len - 4) +
+			((uint64_t)get_unaligned_le32(input) << 32);
+
+		return xxh3_rrmxmx(input64 ^ bitflip, len);
+	}
+	if (len) {
+		const uint32_t combined = ((uint32_t)input[0] << 16) |
+					  ((uint32_t)input[len >> 1] << 24) |
+					  input[len - 1] | ((uint32_t)len << 8);
+		const uint64_t bitflip =
+			(get_unaligned_le32(secret) ^
+			 get_unaligned_le32(secret + 4)) + seed;
+
+		return xxh64_avalanche(combined ^ bitflip);
+	}
+	return xxh64_avalanche(seed ^ get_unaligned_le64(secret + 56) ^
+			       get_unaligned_le64(secret + 64));
+}
+
+static uint64_t xxh3_len_17to128_64(const uint8_t *input, size_t len,
+				    const uint8_t *secret, uint64_t seed)
+{
+	uint64_t acc = len * PRIME64_1;
+
+	if (len > 32) {
+		if (len > 64) {
+			if (len > 96) {
+				acc += xxh3_mix16b(input + 48, secret + 96,
+						   seed);
+				acc += xxh3_mix16b(input + len - 64,
+						   secret + 112, seed);
+			}
+			acc += xxh3_mix16b(input + 32, secret + 64, seed);
+			acc += xxh3_mix16b(input + len - 48, secret + 80, seed);
+		}
+		acc += xxh3_mix16b(input + 16, secret + 32, seed);
+		acc += xxh3_mix16b(input + len - 32, secret + 48, seed);
+	}
+	acc += xxh3_mix16b(input, secret, seed);
+	acc += xxh3_mix16b(input + len - 16, secret + 16, seed);
+
+	return xxh3_avalanche(acc);
+}
+
+static uint64_t xxh3_len_129to240_64(const uint8_t *input, size_t len,
+				     const uint8_t *secret, uint64_t seed)
+{
+	const unsigned int nb_rounds = len / 16;
+	uint64_t acc = len * PRIME64_1;
+	uint64_t acc_end;
+	unsigned int i;
+
+	for (i = 0; i < 8; i++)
+		acc += xxh3_mix16b(input + 16 * i, secret + 16 * i, seed);
+	acc_end = xxh3_mix16b(input + len - 16, secret + XXH3_SECRET_SIZE_MIN -
+			      XXH3_MIDSIZE_LASTOFFSET, seed);
+	acc = xxh3_avalanche(acc);
+
+	for (i = 8; i < nb_rounds; i++)
+		acc_end += xxh3_mix16b(input + 16 * i, secret + 16 * (i - 8) +
+				       XXH3_MIDSIZE_STARTOFFSET, seed);
+
+	return xxh3_avalanche(acc + acc_end);
+}
+
+static void xxh3_accumulate_scalar(uint64_t *acc, const uint8_t *input,
+				   const uint8_t *secret, size_t nb_stripes)
+{
+	size_t n;
+	int i;
+
+	for (n = 0; n < nb_stripes; n++) {
+		for (i = 0; i < XXH3_ACC_NB; i++) {
+			const uint64_t data_val =
+				get_unaligned_le64(input + 8 * i);
+			const uint64_t data_key = data_val ^
+				get_unaligned_le64(secret + 8 * i);
+
+			acc[i ^ 1] += data_val;
+			acc[i] += (uint32_t)data_key * (data_key >> 32);
+		}
+		input += XXH3_STRIPE_LEN;
+		secret += XXH3_SECRET_CONSUME_RATE;
+	}
+}
+
+static void xxh3_scramble_scalar(uint64_t *acc, const uint8_t *secret)
+{
+	int i;
+
+	for (i = 0; i < XXH3_ACC_NB; i++) {
+		uint64_t acc64 = acc[i];
+
+		acc64 ^= acc64 >> 47;
+		acc64 ^= get_unaligned_le64(secret + 8 * i);
+		acc64 *= PRIME32_1;
+		acc[i] = acc64;
+	}
+}
+
+enum xxh3_impl {
+	XXH3_SCALAR,
+#ifdef CONFIG_X86_64
+	XXH3_SSE2,
+	XXH3_AVX2,
+#endif
+};
+
+#ifdef CONFIG_X86_64
+/*
+ * The accumulators live in xmm0-xmm3 (ymm0-ymm1 for AVX2) for the whole
+ * call, with xmm7/ymm7 holding PRIME32_1 while scrambling.  As in the
+ * raid6 code, this relies on the kernel never using vector registers
+ * itself between the asm statements.
+ */
+static const uint64_t xxh3_prime32_1_x4[4] __aligned(32) = {
+	2654435761U, 2654435761U, 2654435761U, 2654435761U,
+};
+
+/*
+ * Memory operands spanning the whole vector, so that the compiler knows
+ * which bytes each load or store touches.
+ */
+#define XXH3_XMM(p)	(*(const uint8_t (*)[16])(const void *)(p))
+#define XXH3_YMM(p)	(*(const uint8_t (*)[32])(const void *)(p))
+#define XXH3_XMM_OUT(p)	(*(uint8_t (*)[16])(void *)(p))
+#define XXH3_YMM_OUT(p)	(*(uint8_t (*)[32])(void *)(p))
+
+#define XXH3_SSE2_ACCUMULATE(k)						\
+do {									\
+	asm volatile("movdqu %0,%%xmm4"					\
+		     : : "m" (XXH3_XMM(&input[16 * (k)])));		\
+	asm volatile("movdqu %0,%%xmm5"					\
+		     : : "m" (XXH3_XMM(&secret[16 * (k)])));		\
+	asm volatile("pxor %xmm4,%xmm5");				\
+	asm volatile("pshufd $0x31,%xmm5,%xmm6");			\
+	asm volatile("pmuludq %xmm6,%xmm5");				\
+	asm volatile("pshufd $0x4e,%xmm4,%xmm4");			\
+	asm volatile("paddq %xmm4,%xmm" #k);				\
+	asm volatile("paddq %xmm5,%xmm" #k);				\
+} while (0)
+
+#define XXH3_SSE2_SCRAMBLE(k)						\
+do {									\
+	asm volatile("movdqa %xmm" #k ",%xmm4");			\
+	asm volatile("psrlq $47,%xmm4");				\
+	asm volatile("pxor %xmm4,%xmm" #k);				\
+	asm volatile("movdqu %0,%%xmm5"					\
+		     : : "m" (XXH3_XMM(&secret[16 * (k)])));		\
+	asm volatile("pxor %xmm5,%xmm" #k);				\
+	asm volatile("pshufd $0x31,%xmm" #k ",%xmm6");			\
+	asm volatile("pmuludq %xmm7,%xmm" #k);				\
+	asm volatile("pmuludq %xmm7,%xmm6");				\
+	asm volatile("psllq $32,%xmm6");				\
+	asm volatile("paddq %xmm6,%xmm" #k);				\
+} while (0)
+
+static void xxh3_accumulate_sse2(uint64_t *acc, const uint8_t *input,
+				 const uint8_t *secret, size_t nb_stripes)
+{
+	size_t n;
+
+	asm volatile("movdqu %0,%%xmm0" : : "m" (XXH3_XMM(&acc[0])));
+	asm volatile("movdqu %0,%%xmm1" : : "m" (XXH3_XMM(&acc[2])));
+	asm volatile("movdqu %0,%%xmm2" : : "m" (XXH3_XMM(&acc[4])));
+	asm volatile("movdqu %0,%%xmm3" : : "m" (XXH3_XMM(&acc[6])));
+	for (n = 0; n < nb_stripes; n++) {
+		XXH3_SSE2_ACCUMULATE(0);
+		XXH3_SSE2_ACCUMULATE(1);
+		XXH3_SSE2_ACCUMULATE(2);
+		XXH3_SSE2_ACCUMULATE(3);
+		input += XXH3_STRIPE_LEN;
+		secret += XXH3_SECRET_CONSUME_RATE;
+	}
+	asm volatile("movdqu %%xmm0,%0" : "=m" (XXH3_XMM_OUT(&acc[0])));
+	asm volatile("movdqu %%xmm1,%0" : "=m" (XXH3_XMM_OUT(&acc[2])));
+	asm volatile("movdqu %%xmm2,%0" : "=m" (XXH3_XMM_OUT(&acc[4])));
+	asm volatile("movdqu %%xmm3,%0" : "=m" (XXH3_XMM_OUT(&acc[6])));
+}
+
+static void xxh3_scramble_sse2(uint64_t *acc, const uint8_t *secret)
+{
+	asm volatile("movdqu %0,%%xmm0" : : "m" (XXH3_XMM(&acc[0])));
+	asm volatile("movdqu %0,%%xmm1" : : "m" (XXH3_XMM(&acc[2])));
+	asm volatile("movdqu %0,%%xmm2" : : "m" (XXH3_XMM(&acc[4])));
+	asm volatile("movdqu %0,%%xmm3" : : "m" (XXH3_XMM(&acc[6])));
+	asm volatile("movdqa %0,%%xmm7" : : "m" (xxh3_prime32_1_x4));
+	XXH3_SSE2_SCRAMBLE(0);
+	XXH3_SSE2_SCRAMBLE(1);
+	XXH3_SSE2_SCRAMBLE(2);
+	XXH3_SSE2_SCRAMBLE(3);
+	asm volatile("movdqu %%xmm0,%0" : "=m" (XXH3_XMM_OUT(&acc[0])));
+	asm volatile("movdqu %%xmm1,%0" : "=m" (XXH3_XMM_OUT(&acc[2])));
+	asm volatile("movdqu %%xmm2,%0" : "=m" (XXH3_XMM_OUT(&acc[4])));
+	asm volatile("movdqu %%xmm3,%0" : "=m" (XXH3_XMM_OUT(&acc[6])));
+}
+
+#define XXH3_AVX2_ACCUMULATE(k)						\
+do {									\
+	asm volatile("vmovdqu %0,%%ymm4"				\
+		     : : "m" (XXH3_YMM(&input[32 * (k)])));		\
+	asm volatile("vpxor %0,%%ymm4,%%ymm5"				\
+		     : : "m" (XXH3_YMM(&secret[32 * (k)])));		\
+	asm volatile("vpshufd $0x31,%ymm5,%ymm6");			\
+	asm volatile("vpmuludq %ymm6,%ymm5,%ymm5");			\
+	asm volatile("vpshufd $0x4e,%ymm4,%ymm4");			\
+	asm volatile("vpaddq %ymm4,%ymm" #k ",%ymm" #k);		\
+	asm volatile("vpaddq %ymm5,%ymm" #k ",%ymm" #k);		\
+} while (0)
+
+#define XXH3_AVX2_SCRAMBLE(k)						\
+do {									\
+	asm volatile("vpsrlq $47,%ymm" #k ",%ymm4");			\
+	asm volatile("vpxor %ymm4,%ymm" #k ",%ymm" #k);			\
+	asm volatile("vpxor %0,%%ymm" #k ",%%ymm" #k			\
+		     : : "m" (XXH3_YMM(&secret[32 * (k)])));		\
+	asm volatile("vpshufd $0x31,%ymm" #k ",%ymm6");			\
+	asm volatile("vpmuludq %ymm7,%ymm" #k ",%ymm" #k);		\
+	asm volatile("vpmuludq %ymm7,%ymm6,%ymm6");			\
+	asm volatile("vpsllq $32,%ymm6,%ymm6");				\
+	asm volatile("vpaddq %ymm6,%ymm" #k ",%ymm" #k);		\
+} while (0)
+
+static void xxh3_accumulate_avx2(uint64_t *acc, const uint8_t *input,
+				 const uint8_t *secret, size_t nb_stripes)
+{
+	size_t n;
+
+	asm volatile("vmovdqu %0,%%ymm0" : : "m" (XXH3_YMM(&acc[0])));
+	asm volatile("vmovdqu %0,%%ymm1" : : "m" (XXH3_YMM(&acc[4])));
+	for (n = 0; n < nb_stripes; n++) {
+		XXH3_AVX2_ACCUMULATE(0);
+		XXH3_AVX2_ACCUMULATE(1);
+		input += XXH3_STRIPE_LEN;
+		secret += XXH3_SECRET_CONSUME_RATE;
+	}
+	asm volatile("vmovdqu %%ymm0,%0" : "=m" (XXH3_YMM_OUT(&acc[0])));
+	asm volatile("vmovdqu %%ymm1,%0" : "=m" (XXH3_YMM_OUT(&acc[4])));
+}
+
+static void xxh3_scramble_avx2(uint64_t *acc, const uint8_t *secret)
+{
+	asm volatile("vmovdqu %0,%%ymm0" : : "m" (XXH3_YMM(&acc[0])));
+	asm volatile("vmovdqu %0,%%ymm1" : : "m" (XXH3_YMM(&acc[4])));
+	asm volatile("vmovdqa %0,%%ymm7" : : "m" (xxh3_prime32_1_x4));
+	XXH3_AVX2_SCRAMBLE(0);
+	XXH3_AVX2_SCRAMBLE(1);
+	asm volatile("vmovdqu %%ymm0,%0" : "=m" (XXH3_YMM_OUT(&acc[0])));
+	asm volatile("vmovdqu %%ymm1,%0" : "=m" (XXH3_YMM_OUT(&acc[4])));
+}
+
+static enum xxh3_impl xxh3_simd_begin(size_t len)
+{
+	if (len < XXH3_SIMD_MIN_LEN || !may_use_simd())
+		return XXH3_SCALAR;
+
+	kernel_fpu_begin();
+	if (boot_cpu_has(X86_FEATURE_AVX2) && boot_cpu_has(X86_FEATURE_AVX))
+		return XXH3_AVX2;
+	return XXH3_SSE2;
+}
+
+static void xxh3_simd_end(enum xxh3_impl impl)
+{
+	if (impl != XXH3_SCALAR)
+		kernel_fpu_end();
+}
+
+static void xxh3_simd_yield(enum xxh3_impl impl)
+{
+	if (impl != XXH3_SCALAR) {
+		kernel_fpu_end();
+		kernel_fpu_begin();
+	}
+}
+#else
+static enum xxh3_impl xxh3_simd_begin(size_t len)
+{
+	return XXH3_SCALAR;
+}
+
+static void xxh3_simd_end(enum xxh3_impl impl)
+{
+}
+
+static void xxh3_simd_yield(enum xxh3_impl impl)
+{
+}
+#endif
+
+static void xxh3_accumulate(uint64_t *acc, const uint8_t *input,
+			    const uint8_t *secret, size_t nb_stripes,
+			    enum xxh3_impl impl)
+{
+	switch (impl) {
+#ifdef CONFIG_X86_64
+	case XXH3_AVX2:
+		xxh3_accumulate_avx2(acc, input, secret, nb_stripes);
+		break;
+	case XXH3_SSE2:
+		xxh3_accumulate_sse2(acc, input, secret, nb_stripes);
+		break;
+#endif
+	default:
+		xxh3_accumulate_scalar(acc, input, secret, nb_stripes);
+		break;
+	}
+}
+
+static void xxh3_scramble(uint64_t *acc, const uint8_t *secret,
+			  enum xxh3_impl impl)
+{
+	switch (impl) {
+#ifdef CONFIG_X86_64
+	case XXH3_AVX2:
+		xxh3_scramble_avx2(acc, secret);
+		break;
+	case XXH3_SSE2:
+		xxh3_scramble_sse2(acc, secret);
+		break;
+#endif
+	default:
+		xxh3_scramble_scalar(acc, secret);
+		break;
+	}
+}
+
+static void xxh3_init_acc(uint64_t *acc)
+{
+	acc[0] = PRIME32_3;
+	acc[1] = PRIME64_1;
+	acc[2] = PRIME64_2;
+	acc[3] = PRIME64_3;
+	acc[4] = PRIME64_4;
+	acc[5] = PRIME32_2;
+	acc[6] = PRIME64_5;
+	acc[7] = PRIME32_1;
+}
+
+static void xxh3_init_custom_secret(uint8_t *secret, uint64_t seed)
+{
+	int i;
+
+	for (i = 0; i < XXH3_SECRET_SIZE; i += 16) {
+		put_unaligned_le64(get_unaligned_le64(xxh3_ksecret + i) + seed,
+				   secret + i);
+		put_unaligned_le64(get_unaligned_le64(xxh3_ksecret + i + 8) -
+				   seed, secret + i + 8);
+	}
+}
+
+static void xxh3_hash_long_loop(uint64_t *acc, const uint8_t *input,
+				size_t len, const uint8_t *secret)
+{
+	const size_t nb_blocks = (len - 1) / XXH3_BLOCK_LEN;
+	enum xxh3_impl impl = xxh3_simd_begin(len);
+	size_t n, nb_stripes;
+
+	for (n = 0; n < nb_blocks; n++) {
+		xxh3_accumulate(acc, input + n * XXH3_BLOCK_LEN, secret,
+				XXH3_STRIPES_PER_BLOCK, impl);
+		xxh3_scramble(acc, secret + XXH3_SECRET_LIMIT, impl);
+		if ((n + 1) % XXH3_SIMD_BLOCKS == 0)
+			xxh3_simd_yield(impl);
+	}
+
+	/* Last partial block, then the last stripe */
+	nb_stripes = ((len - 1) - XXH3_BLOCK_LEN * nb_blocks) / XXH3_STRIPE_LEN;
+	xxh3_accumulate(acc, input + nb_blocks * XXH3_BLOCK_LEN, secret,
+			nb_stripes, impl);
+	xxh3_accumulate(acc, input + len - XXH3_STRIPE_LEN,
+			secret + XXH3_SECRET_LIMIT - XXH3_SECRET_LASTACC_START,
+			1, impl);
+	xxh3_simd_end(impl);
+}
+
+static uint64_t xxh3_merge_accs(const uint64_t *acc, const uint8_t *secret,
+				uint64_t start)
+{
+	uint64_t result64 = start;
+	int i;
+
+	for (i = 0; i < XXH3_ACC_NB; i += 2)
+		result64 += xxh3_mul128_fold64(
+			acc[i] ^ get_unaligned_le64(secret + 8 * i),
+			acc[i + 1] ^ get_unaligned_le64(secret + 8 * i + 8));
+
+	return xxh3_avalanche(result64);
+}
+
+static noinline uint64_t xxh3_hash_long_64(const uint8_t *input, size_t len,
+					   uint64_t seed)
+{
+	uint8_t custom_secret[XXH3_SECRET_SIZE];
+	const uint8_t *secret = xxh3_ksecret;
+	uint64_t acc[XXH3_ACC_NB];
+
+	if (seed) {
+		xxh3_init_custom_secret(custom_secret, seed);
+		secret = custom_secret;
+	}
+
+	xxh3_init_acc(acc);
+	xxh3_hash_long_loop(acc, input, len, secret);
+
+	return xxh3_merge_accs(acc, secret + XXH3_SECRET_MERGEACCS_START,
+			       (uint64_t)len * PRIME64_1);
+}
+
+uint64_t xxh3_64(const void *input, const size_t len, const uint64_t seed)
+{
+	const uint8_t *p = (const uint8_t *)input;
+
+	if (len <= 16)
+		return xxh3_len_0to16_64(p, len, xxh3_ksecret, seed);
+	if (len <= 128)
+		return xxh3_len_17to128_64(p, len, xxh3_ksecret, seed);
+	if (len <= XXH3_MIDSIZE_MAX)
+		return xxh3_len_129to240_64(p, len, xxh3_ksecret, seed);
+	return xxh3_hash_long_64(p, len, seed);
+}
+EXPORT_SYMBOL(xxh3_64);
+
+static struct xxh128_hash xxh3_len_0to16_128(const uint8_t *input, size_t len,
+					     const uint8_t *secret,
+					     uint64_t seed)
+{
+	struct xxh128_hash h128;
+
+	if (len > 8) {
+		const uint64_t bitflipl =
+			(get_unaligned_le64(secret + 32) ^
+			 get_unaligned_le64(secret + 40)) - seed;
+		const uint64_t bitfliph =
+			(get_unaligned_le64(secret + 48) ^
+			 get_unaligned_le64(secret + 56)) + seed;
+		const uint64_t input_lo = get_unaligned_le64(input);
+		uint64_t input_hi = get_unaligned_le64(input + len - 8);
+		struct xxh128_hash m128;
+
+		m128 = xxh_mult64to128(input_lo ^ input_hi ^ bitflipl,
+				       PRIME64_1);
+		m128.low64 += (uint64_t)(len - 1) << 54;
+		input_hi ^= bitfliph;
+		/* += input_hi * PRIME32_2, without a 64x64 multiply */
+		m128.high64 += input_hi +
+			(uint64_t)(uint32_t)input_hi * (PRIME32_2 - 1);
+		m128.low64 ^= swab64(m128.high64);
+
+		h128 = xxh_mult64to128(m128.low64, PRIME64_2);
+		h128.high64 += m128.high64 * PRIME64_2;
+		h128.low64 = xxh3_avalanche(h128.low64);
+		h128.high64 = xxh3_avalanche(h128.high64);
+		return h128;
+	}
+	if (len >= 4) {
+		const uint64_t s = seed ^
+			((uint64_t)swab32((uint32_t)seed) << 32);
+		const uint64_t input_64 = get_unaligned_le32(input) +
+			((uint64_t)get_unaligned_le32(input + len - 4) << 32);
+		const uint64_t bitflip =
+			(get_unaligned_le64(secret + 16) ^
+			 get_unaligned_le64(secret + 24)) + s;
+
+		h128 = xxh_mult64to128(input_64 ^ bitflip,
+				       PRIME64_1 + (len << 2));
+		h128.high64 += h128.low64 << 1;
+		h128.low64 ^= h128.high64 >> 3;
+		h128.low64 ^= h128.low64 >> 35;
+		h128.low64 *= PRIME_MX2;
+		h128.low64 ^= h128.low64 >> 28;
+		h128.high64 = xxh3_avalanche(h128.high64);
+		return h128;
+	}
+	if (len) {
+		const uint32_t combinedl = ((uint32_t)input[0] << 16) |
+					   ((uint32_t)input[len >> 1] << 24) |
+					   input[len - 1] |
+					   ((uint32_t)len << 8);
+		const uint32_t combinedh = xxh_rotl32(swab32(combinedl), 13);
+		const uint64_t bitflipl =
+			(get_unaligned_le32(secret) ^
+			 get_unaligned_le32(secret + 4)) + seed;
+		const uint64_t bitfliph =
+			(get_unaligned_le32(secret + 8) ^
+			 get_unaligned_le32(secret + 12)) - seed;
+
+		h128.low64 = xxh64_avalanche(combinedl ^ bitflipl);
+		h128.high64 = xxh64_avalanche(combinedh ^ bitfliph);
+		return h128;
+	}
+	h128.low64 = xxh64_avalanche(seed ^ get_unaligned_le64(secret + 64) ^
+				     get_unaligned_le64(secret + 72));
+	h128.high64 = xxh64_avalanche(seed ^ get_unaligned_le64(secret + 80) ^
+				      get_unaligned_le64(secret + 88));
+	return h128;
+}
+
+static struct xxh128_hash xxh128_mix32b(struct xxh128_hash acc,
+					const uint8_t *input_1,
+					const uint8_t *input_2,
+					const uint8_t *secret, uint64_t seed)
+{
+	acc.low64 += xxh3_mix16b(input_1, secret, seed);
+	acc.low64 ^= get_unaligned_le64(input_2) +
+		     get_unaligned_le64(input_2 + 8);
+	acc.high64 += xxh3_mix16b(input_2, secret + 16, seed);
+	acc.high64 ^= get_unaligned_le64(input_1) +
+		      get_unaligned_le64(input_1 + 8);
+	return acc;
+}
+
+static struct xxh128_hash xxh128_finish(struct xxh128_hash acc, size_t len,
+					uint64_t seed)
+{
+	struct xxh128_hash h128;
+
+	h128.low64 = xxh3_avalanche(acc.low64 + acc.high64);
+	h128.high64 = (acc.low64 * PRIME64_1) + (acc.high64 * PRIME64_4) +
+		      ((len - seed) * PRIME64_2);
+	h128.high64 = 0 - xxh3_avalanche(h128.high64);
+	return h128;
+}
+
+static struct xxh128_hash xxh3_len_17to128_128(const uint8_t *input,
+					       size_t len,
+					       const uint8_t *secret,
+					       uint64_t seed)
+{
+	struct xxh128_hash acc = { .low64 = len * PRIME64_1 };
+
+	if (len > 32) {
+		if (len > 64) {
+			if (len > 96)
+				acc = xxh128_mix32b(acc, input + 48,
+						    input + len - 64,
+						    secret + 96, seed);
+			acc = xxh128_mix32b(acc, input + 32, input + len - 48,
+					    secret + 64, seed);
+		}
+		acc = xxh128_mix32b(acc, input + 16, input + len - 32,
+				    secret + 32, seed);
+	}
+	acc = xxh128_mix32b(acc, input, input + len - 16, secret, seed);
+
+	return xxh128_finish(acc, len, seed);
+}
+
+static struct xxh128_hash xxh3_len_129to240_128(const uint8_t *input,
+						size_t len,
+						const uint8_t *secret,
+						uint64_t seed)
+{
+	struct xxh128_hash acc = { .low64 = len * PRIME64_1 };
+	unsigned int i;
+
+	for (i = 32; i < 160; i += 32)
+		acc = xxh128_mix32b(acc, input + i - 32, input + i - 16,
+				    secret + i - 32, seed);
+	acc.low64 = xxh3_avalanche(acc.low64);
+	acc.high64 = xxh3_avalanche(acc.high64);
+
+	for (i = 160; i <= len; i += 32)
+		acc = xxh128_mix32b(acc, input + i - 32, input + i - 16,
+				    secret + XXH3_MIDSIZE_STARTOFFSET + i - 160,
+				    seed);
+	acc = xxh128_mix32b(acc, input + len - 16, input + len - 32,
+			    secret + XXH3_SECRET_SIZE_MIN -
+			    XXH3_MIDSIZE_LASTOFFSET - 16, 0 - seed);
+
+	return xxh128_finish(acc, len, seed);
+}
+
+static struct xxh128_hash xxh3_merge_accs_128(const uint64_t *acc,
+					      const uint8_t *secret,
+					      uint64_t len)
+{
+	struct xxh128_hash h128;
+
+	h128.low64 = xxh3_merge_accs(acc, secret + XXH3_SECRET_MERGEACCS_START,
+				     len * PRIME64_1);
+	h128.high64 = xxh3_merge_accs(acc, secret + XXH3_SECRET_SIZE -
+				      XXH3_STRIPE_LEN -
+				      XXH3_SECRET_MERGEACCS_START,
+				      ~(len * PRIME64_2));
+	return h128;
+}
+
+static noinline struct xxh128_hash xxh3_hash_long_128(const uint8_t *input,
+						      size_t len,
+						      uint64_t seed)
+{
+	uint8_t custom_secret[XXH3_SECRET_SIZE];
+	const uint8_t *secret = xxh3_ksecret;
+	uint64_t acc[XXH3_ACC_NB];
+
+	if (seed) {
+		xxh3_init_custom_secret(custom_secret, seed);
+		secret = custom_secret;
+	}
+
+	xxh3_init_acc(acc);
+	xxh3_hash_long_loop(acc, input, len, secret);
+
+	return xxh3_merge_accs_128(acc, secret, len);
+}
+
+struct xxh128_hash xxh3_128(const void *input, const size_t len,
+			    const uint64_t seed)
+{
+	const uint8_t *p = (const uint8_t *)input;
+
+	if (len <= 16)
+		return xxh3_len_0to16_128(p, len, xxh3_ksecret, seed);
+	if (len <= 128)
+		return xxh3_len_17to128_128(p, len, xxh3_ksecret, seed);
+	if (len <= XXH3_MIDSIZE_MAX)
+		return xxh3_len_129to240_128(p, len, xxh3_ksecret, seed);
+	return xxh3_hash_long_128(p, len, seed);
+}
+EXPORT_SYMBOL(xxh3_128);
+
+/*-**************************************************
+ * XXH3 Streaming
+ ***************************************************/
+static const uint8_t *xxh3_state_secret(const struct xxh3_state *state)
+{
+	return state->seed ? state->custom_secret : xxh3_ksecret;
+}
+
+void xxh3_copy_state(struct xxh3_state *dst, const struct xxh3_state *src)
+{
+	memcpy(dst, src, sizeof(*dst));
+}
+EXPORT_SYMBOL(xxh3_copy_state);
+
+void xxh3_reset(struct xxh3_state *state, const uint64_t seed)
+{
+	memset(state, 0, sizeof(*state));
+	xxh3_init_acc(state->acc);
+	state->seed = seed;
+	if (seed)
+		xxh3_init_custom_secret(state->custom_secret, seed);
+}
+EXPORT_SYMBOL(xxh3_reset);
+
+static const uint8_t *xxh3_consume_stripes(uint64_t *acc,
+					   uint32_t *nb_stripes_so_far,
+					   const uint8_t *input,
+					   size_t nb_stripes,
+					   const uint8_t *secret,
+					   enum xxh3_impl impl)
+{
+	const uint8_t *initial_secret = secret +
+		*nb_stripes_so_far * XXH3_SECRET_CONSUME_RATE;
+	size_t n = XXH3_STRIPES_PER_BLOCK - *nb_stripes_so_far;
+	unsigned int blocks = 0;
+
+	if (nb_stripes >= n) {
+		do {
+			xxh3_accumulate(acc, input, initial_secret, n, impl);
+			xxh3_scramble(acc, secret + XXH3_SECRET_LIMIT, impl);
+			if (++blocks % XXH3_SIMD_BLOCKS == 0)
+				xxh3_simd_yield(impl);
+			input += n * XXH3_STRIPE_LEN;
+			nb_stripes -= n;
+			n = XXH3_STRIPES_PER_BLOCK;
+			initial_secret = secret;
+		} while (nb_stripes >= XXH3_STRIPES_PER_BLOCK);
+		*nb_stripes_so_far = 0;
+	}
+	if (nb_stripes) {
+		xxh3_accumulate(acc, input, initial_secret, nb_stripes, impl);
+		input += nb_stripes * XXH3_STRIPE_LEN;
+		*nb_stripes_so_far += nb_stripes;
+	}
+	return input;
+}
+
+int xxh3_update(struct xxh3_state *state, const void *input, const size_t len)
+{
+	const uint8_t *p = (const uint8_t *)input;
+	const uint8_t *const b_end = p + len;
+	const uint8_t *secret = xxh3_state_secret(state);
+	enum xxh3_impl impl;
+
+	if (input == NULL)
+		return -EINVAL;
+
+	state->total_len += len;
+
+	if (len <= XXH3_BUFFER_SIZE - state->buffered_size) {
+		memcpy(state->buffer + state->buffered_size, input, len);
+		state->buffered_size += (uint32_t)len;
+		return 0;
+	}
+
+	impl = xxh3_simd_begin(len);
+
+	/* Complete and consume the buffered data first */
+	if (state->buffered_size) {
+		const size_t load_size = XXH3_BUFFER_SIZE -
+					 state->buffered_size;
+
+		memcpy(state->buffer + state->buffered_size, p, load_size);
+		p += load_size;
+		xxh3_consume_stripes(state->acc, &state->nb_stripes_so_far,
+				     state->buffer, XXH3_BUFFER_STRIPES,
+				     secret, impl);
+		state->buffered_size = 0;
+	}
+
+	/* Always keep some input back for the digest */
+	if (b_end - p > XXH3_BUFFER_SIZE) {
+		const size_t nb_stripes = (size_t)(b_end - 1 - p) /
+					  XXH3_STRIPE_LEN;
+
+		p = xxh3_consume_stripes(state->acc, &state->nb_stripes_so_far,
+					 p, nb_stripes, secret, impl);
+		memcpy(state->buffer + XXH3_BUFFER_SIZE - XXH3_STRIPE_LEN,
+		       p - XXH3_STRIPE_LEN, XXH3_STRIPE_LEN);
+	}
+	xxh3_simd_end(impl);
+
+	memcpy(state->buffer, p, (size_t)(b_end - p));
+	state->buffered_size = (uint32_t)(b_end - p);
+
+	return 0;
+}
+EXPORT_SYMBOL(xxh3_update);
+
+static void xxh3_digest_long(uint64_t *acc, const struct xxh3_state *state,
+			     const uint8_t *secret)
+{
+	uint8_t last_stripe[XXH3_STRIPE_LEN];
+	const uint8_t *last_stripe_ptr;
+
+	memcpy(acc, state->acc, sizeof(state->acc));
+	if (state->buffered_size >= XXH3_STRIPE_LEN) {
+		const size_t nb_stripes = (state->buffered_size - 1) /
+					  XXH3_STRIPE_LEN;
+		uint32_t nb_stripes_so_far = state->nb_stripes_so_far;
+
+		xxh3_consume_stripes(acc, &nb_stripes_so_far, state->buffer,
+				     nb_stripes, secret, XXH3_SCALAR);
+		last_stripe_ptr = state->buffer + state->buffered_size -
+				  XXH3_STRIPE_LEN;
+	} else {
+		/* Pull the rest of the last stripe from the previous buffer */
+		const size_t catchup = XXH3_STRIPE_LEN - state->buffered_size;
+
+		memcpy(last_stripe, state->buffer + XXH3_BUFFER_SIZE - catchup,
+		       catchup);
+		memcpy(last_stripe + catchup, state->buffer,
+		       state->buffered_size);
+		last_stripe_ptr = last_stripe;
+	}
+	xxh3_accumulate_scalar(acc, last_stripe_ptr,
+			       secret + XXH3_SECRET_LIMIT -
+			       XXH3_SECRET_LASTACC_START, 1);
+}
+
+uint64_t xxh3_64_digest(const struct xxh3_state *state)
+{
+	const uint8_t *secret = xxh3_state_secret(state);
+	uint64_t acc[XXH3_ACC_NB];
+
+	if (state->total_len <= XXH3_MIDSIZE_MAX)
+		return xxh3_64(state->buffer, (size_t)state->total_len,
+			       state->seed);
+
+	xxh3_digest_long(acc, state, secret);
+	return xxh3_merge_accs(acc, secret + XXH3_SECRET_MERGEACCS_START,
+			       state->total_len * PRIME64_1);
+}
+EXPORT_SYMBOL(xxh3_64_digest);
+
+struct xxh128_hash xxh3_128_digest(const struct xxh3_state *state)
+{
+	const uint8_t *secret = xxh3_state_secret(state);
+	uint64_t acc[XXH3_ACC_NB];
+
+	if (state->total_len <= XXH3_MIDSIZE_MAX)
+		return xxh3_128(state->buffer, (size_t)state->total_len,
+				state->seed);
+
+	xxh3_digest_long(acc, state, secret);
+	return xxh3_merge_accs_128(acc, secret, state->total_len);
+}
+EXPORT_SYMBOL(xxh3_128_digest);
+
 MODULE_LICENSE("Dual BSD/GPL");
 MODULE_DESCRIPTION("xxHash");
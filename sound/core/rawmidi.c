@@ -15,6 +15,8 @@
 #include <linux/module.h>
 #include <linux/delay.h>
 #include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/log2.h>
 #include <linux/nospec.h>
 #include <sound/rawmidi.h>
 #include <sound/info.h>
@@ -111,6 +113,39 @@ static inline int snd_rawmidi_ready_append(struct snd_rawmidi_substream *substre
 	       (!substream->append || runtime->avail >= count);
 }
 
+/*
+ * pick up the reader position and the wakeup threshold from the control
+ * area of an mmap'ed input ring; call with runtime->lock held
+ */
+static void snd_rawmidi_mmap_sync(struct snd_rawmidi_runtime *runtime)
+{
+	struct snd_rawmidi_mmap_control *ctl = runtime->mmap_control;
+	u32 hw_count, appl_count, used, avail_min;
+
+	if (!ctl)
+		return;
+	hw_count = runtime->mmap_appl_count + runtime->avail;
+	appl_count = smp_load_acquire(&ctl->appl_count);
+	used = hw_count - appl_count;
+	/* ignore positions the driver never produced */
+	if (used <= runtime->buffer_size) {
+		runtime->mmap_appl_count = appl_count;
+		runtime->appl_ptr = appl_count & (runtime->buffer_size - 1);
+		runtime->avail = used;
+	}
+	avail_min = READ_ONCE(ctl->avail_min);
+	if (avail_min >= 1 && avail_min <= runtime->buffer_size)
+		runtime->avail_min = avail_min;
+}
+
+/* publish the bytes received into an mmap'ed input ring */
+static void snd_rawmidi_mmap_commit(struct snd_rawmidi_runtime *runtime)
+{
+	if (runtime->mmap_control)
+		smp_store_release(&runtime->mmap_control->hw_count,
+				  runtime->mmap_appl_count + runtime->avail);
+}
+
 static void snd_rawmidi_input_event_work(struct work_struct *work)
 {
 	struct snd_rawmidi_runtime *runtime =
@@ -148,11 +183,19 @@ static int snd_rawmidi_runtime_create(struct snd_rawmidi_substream *substream)
 	return 0;
 }
 
+static void snd_rawmidi_free_buffer(void *buffer, void *mmap_area)
+{
+	if (mmap_area)
+		vfree(mmap_area);
+	else
+		kvfree(buffer);
+}
+
 static int snd_rawmidi_runtime_free(struct snd_rawmidi_substream *substream)
 {
 	struct snd_rawmidi_runtime *runtime = substream->runtime;
 
-	kvfree(runtime->buffer);
+	snd_rawmidi_free_buffer(runtime->buffer, runtime->mmap_area);
 	kfree(runtime);
 	substream->runtime = NULL;
 	return 0;
@@ -180,6 +223,11 @@ static void __reset_runtime_ptrs(struct snd_rawmidi_runtime *runtime,
 	runtime->drain = 0;
 	runtime->appl_ptr = runtime->hw_ptr = 0;
 	runtime->avail = is_input ? 0 : runtime->buffer_size;
+	if (runtime->mmap_control) {
+		runtime->mmap_appl_count = 0;
+		WRITE_ONCE(runtime->mmap_control->appl_count, 0);
+		WRITE_ONCE(runtime->mmap_control->hw_count, 0);
+	}
 }
 
 static void reset_runtime_ptrs(struct snd_rawmidi_runtime *runtime,
@@ -292,6 +340,8 @@ static int open_substream(struct snd_rawmidi *rmidi,
 		}
 		substream->opened = 1;
 		substream->active_sensing = 0;
+		substream->framing = SNDRV_RAWMIDI_MODE_FRAMING_NONE;
+		substream->clock_type = SNDRV_RAWMIDI_MODE_CLOCK_NONE;
 		if (mode & SNDRV_RAWMIDI_LFLG_APPEND)
 			substream->append = 1;
 		substream->pid = get_pid(task_pid(current));
@@ -654,30 +704,72 @@ static int snd_rawmidi_info_select_user(struct snd_card *card,
 	return 0;
 }
 
-static int resize_runtime_buffer(struct snd_rawmidi_runtime *runtime,
+static inline int get_align(unsigned int framing)
+{
+	if (framing == SNDRV_RAWMIDI_MODE_FRAMING_TSTAMP)
+		return sizeof(struct snd_rawmidi_framing_tstamp) - 1;
+	return 0;
+}
+
+static int resize_runtime_buffer(struct snd_rawmidi_substream *substream,
 				 struct snd_rawmidi_params *params,
-				 bool is_input)
+				 unsigned int framing, bool mmap)
 {
+	struct snd_rawmidi_runtime *runtime = substream->runtime;
+	bool is_input = substream->stream == SNDRV_RAWMIDI_STREAM_INPUT;
 	char *newbuf, *oldbuf;
+	void *newarea, *oldarea;
+	int err = 0;
 
 	if (params->buffer_size < 32 || params->buffer_size > 1024L * 1024L)
 		return -EINVAL;
 	if (params->avail_min < 1 || params->avail_min > params->buffer_size)
 		return -EINVAL;
-	if (params->buffer_size != runtime->buffer_size) {
-		newbuf = kvzalloc(params->buffer_size, GFP_KERNEL);
-		if (!newbuf)
-			return -ENOMEM;
+	if (params->buffer_size & get_align(framing))
+		return -EINVAL;
+	if (mmap && !is_power_of_2(params->buffer_size))
+		return -EINVAL;
+
+	/* serialize against snd_rawmidi_mmap() */
+	mutex_lock(&substream->rmidi->open_mutex);
+	if (params->buffer_size != runtime->buffer_size ||
+	    mmap != !!runtime->mmap_area) {
+		if (atomic_read(&runtime->mmap_count)) {
+			err = -EBUSY;
+			goto unlock;
+		}
+		if (mmap) {
+			newarea = vmalloc_user(PAGE_SIZE +
+					       PAGE_ALIGN(params->buffer_size));
+			newbuf = newarea ? newarea + PAGE_SIZE : NULL;
+		} else {
+			newarea = NULL;
+			newbuf = kvzalloc(params->buffer_size, GFP_KERNEL);
+		}
+		if (!newbuf) {
+			err = -ENOMEM;
+			goto unlock;
+		}
 		spin_lock_irq(&runtime->lock);
 		oldbuf = runtime->buffer;
+		oldarea = runtime->mmap_area;
 		runtime->buffer = newbuf;
 		runtime->buffer_size = params->buffer_size;
+		runtime->mmap_area = newarea;
+		runtime->mmap_control = newarea;
 		__reset_runtime_ptrs(runtime, is_input);
 		spin_unlock_irq(&runtime->lock);
-		kvfree(oldbuf);
+		snd_rawmidi_free_buffer(oldbuf, oldarea);
 	}
 	runtime->avail_min = params->avail_min;
-	return 0;
+	if (runtime->mmap_control) {
+		runtime->mmap_control->buffer_size = runtime->buffer_size;
+		WRITE_ONCE(runtime->mmap_control->avail_min,
+			   runtime->avail_min);
+	}
+ unlock:
+	mutex_unlock(&substream->rmidi->open_mutex);
+	return err;
 }
 
 int snd_rawmidi_output_params(struct snd_rawmidi_substream *substream,
@@ -685,17 +777,47 @@ int snd_rawmidi_output_params(struct snd_rawmidi_substream *substream,
 {
 	if (substream->append && substream->use_count > 1)
 		return -EBUSY;
+	if (params->mode)
+		return -EINVAL;
 	snd_rawmidi_drain_output(substream);
 	substream->active_sensing = !params->no_active_sensing;
-	return resize_runtime_buffer(substream->runtime, params, false);
+	return resize_runtime_buffer(substream, params,
+				     SNDRV_RAWMIDI_MODE_FRAMING_NONE, false);
 }
 EXPORT_SYMBOL(snd_rawmidi_output_params);
 
 int snd_rawmidi_input_params(struct snd_rawmidi_substream *substream,
 			     struct snd_rawmidi_params *params)
 {
+	unsigned int framing, clock_type;
+	bool mmap;
+	int err;
+
+	if (params->mode & ~(SNDRV_RAWMIDI_MODE_FRAMING_MASK |
+			     SNDRV_RAWMIDI_MODE_CLOCK_MASK |
+			     SNDRV_RAWMIDI_MODE_MMAP))
+		return -EINVAL;
+
+	framing = params->mode & SNDRV_RAWMIDI_MODE_FRAMING_MASK;
+	clock_type = params->mode & SNDRV_RAWMIDI_MODE_CLOCK_MASK;
+	mmap = params->mode & SNDRV_RAWMIDI_MODE_MMAP;
+
+	if (framing > SNDRV_RAWMIDI_MODE_FRAMING_TSTAMP)
+		return -EINVAL;
+	if (framing == SNDRV_RAWMIDI_MODE_FRAMING_NONE &&
+	    clock_type != SNDRV_RAWMIDI_MODE_CLOCK_NONE)
+		return -EINVAL;
+	if (clock_type > SNDRV_RAWMIDI_MODE_CLOCK_MONOTONIC_RAW)
+		return -EINVAL;
+
 	snd_rawmidi_drain_input(substream);
-	return resize_runtime_buffer(substream->runtime, params, true);
+	err = resize_runtime_buffer(substream, params, framing, mmap);
+	if (err < 0)
+		return err;
+
+	substream->framing = framing;
+	substream->clock_type = clock_type;
+	return 0;
 }
 EXPORT_SYMBOL(snd_rawmidi_input_params);
 
@@ -720,6 +842,7 @@ static int snd_rawmidi_input_status(struct snd_rawmidi_substream *substream,
 	memset(status, 0, sizeof(*status));
 	status->stream = SNDRV_RAWMIDI_STREAM_INPUT;
 	spin_lock_irq(&runtime->lock);
+	snd_rawmidi_mmap_sync(runtime);
 	status->avail = runtime->avail;
 	status->xruns = runtime->xruns;
 	runtime->xruns = 0;
@@ -937,6 +1060,67 @@ static int snd_rawmidi_control_ioctl(struct snd_card *card,
 	return -ENOIOCTLCMD;
 }
 
+static struct timespec64 get_framing_tstamp(struct snd_rawmidi_substream *substream)
+{
+	struct timespec64 ts64 = {0, 0};
+
+	switch (substream->clock_type) {
+	case SNDRV_RAWMIDI_MODE_CLOCK_MONOTONIC_RAW:
+		ktime_get_raw_ts64(&ts64);
+		break;
+	case SNDRV_RAWMIDI_MODE_CLOCK_MONOTONIC:
+		ktime_get_ts64(&ts64);
+		break;
+	case SNDRV_RAWMIDI_MODE_CLOCK_REALTIME:
+		ktime_get_real_ts64(&ts64);
+		break;
+	}
+	return ts64;
+}
+
+/* store the data in frames of struct snd_rawmidi_framing_tstamp */
+static int receive_with_tstamp_framing(struct snd_rawmidi_substream *substream,
+				       const unsigned char *buffer,
+				       int src_count,
+				       const struct timespec64 *tstamp)
+{
+	struct snd_rawmidi_runtime *runtime = substream->runtime;
+	struct snd_rawmidi_framing_tstamp *dest_ptr;
+	struct snd_rawmidi_framing_tstamp frame = {
+		.tv_sec = tstamp->tv_sec,
+		.tv_nsec = tstamp->tv_nsec,
+	};
+	int orig_count = src_count;
+	int frame_size = sizeof(struct snd_rawmidi_framing_tstamp);
+
+	BUILD_BUG_ON(frame_size != 0x20);
+	if (snd_BUG_ON((runtime->hw_ptr & 0x1f) != 0))
+		return -EINVAL;
+
+	while (src_count > 0) {
+		if ((int)(runtime->buffer_size - runtime->avail) < frame_size) {
+			runtime->xruns += src_count;
+			break;
+		}
+		if (src_count >= SNDRV_RAWMIDI_FRAMING_DATA_LENGTH) {
+			frame.length = SNDRV_RAWMIDI_FRAMING_DATA_LENGTH;
+		} else {
+			frame.length = src_count;
+			memset(frame.data, 0, SNDRV_RAWMIDI_FRAMING_DATA_LENGTH);
+		}
+		memcpy(frame.data, buffer, frame.length);
+		buffer += frame.length;
+		src_count -= frame.length;
+		dest_ptr = (struct snd_rawmidi_framing_tstamp *)
+			(runtime->buffer + runtime->hw_ptr);
+		*dest_ptr = frame;
+		runtime->avail += frame_size;
+		runtime->hw_ptr += frame_size;
+		runtime->hw_ptr %= runtime->buffer_size;
+	}
+	return orig_count - src_count;
+}
+
 /**
  * snd_rawmidi_receive - receive the input data from the device
  * @substream: the rawmidi substream
@@ -951,6 +1135,7 @@ int snd_rawmidi_receive(struct snd_rawmidi_substream *substream,
 			const unsigned char *buffer, int count)
 {
 	unsigned long flags;
+	struct timespec64 ts64;
 	int result = 0, count1;
 	struct snd_rawmidi_runtime *runtime = substream->runtime;
 
@@ -962,7 +1147,13 @@ int snd_rawmidi_receive(struct snd_rawmidi_substream *substream,
 		return -EINVAL;
 	}
 	spin_lock_irqsave(&runtime->lock, flags);
-	if (count == 1) {	/* special case, faster code */
+	snd_rawmidi_mmap_sync(runtime);
+	if (substream->framing == SNDRV_RAWMIDI_MODE_FRAMING_TSTAMP) {
+		ts64 = get_framing_tstamp(substream);
+		substream->bytes += count;
+		result = receive_with_tstamp_framing(substream, buffer, count,
+						     &ts64);
+	} else if (count == 1) {	/* special case, faster code */
 		substream->bytes++;
 		if (runtime->avail < runtime->buffer_size) {
 			runtime->buffer[runtime->hw_ptr++] = buffer[0];
@@ -1001,6 +1192,7 @@ int snd_rawmidi_receive(struct snd_rawmidi_substream *substream,
 		}
 	}
 	if (result > 0) {
+		snd_rawmidi_mmap_commit(runtime);
 		if (runtime->event)
 			schedule_work(&runtime->event_work);
 		else if (snd_rawmidi_ready(substream))
@@ -1073,6 +1265,9 @@ static ssize_t snd_rawmidi_read(struct file *file, char __user *buf, size_t coun
 	if (substream == NULL)
 		return -EIO;
 	runtime = substream->runtime;
+	/* the mmap'ed ring is consumed through its control area */
+	if (runtime->mmap_area)
+		return -EBADFD;
 	snd_rawmidi_input_trigger(substream, 1);
 	result = 0;
 	while (count > 0) {
@@ -1476,6 +1671,12 @@ static __poll_t snd_rawmidi_poll(struct file *file, poll_table *wait)
 	}
 	mask = 0;
 	if (rfile->input != NULL) {
+		runtime = rfile->input->runtime;
+		if (runtime->mmap_control) {
+			spin_lock_irq(&runtime->lock);
+			snd_rawmidi_mmap_sync(runtime);
+			spin_unlock_irq(&runtime->lock);
+		}
 		if (snd_rawmidi_ready(rfile->input))
 			mask |= EPOLLIN | EPOLLRDNORM;
 	}
@@ -1486,6 +1687,58 @@ static __poll_t snd_rawmidi_poll(struct file *file, poll_table *wait)
 	return mask;
 }
 
+static void snd_rawmidi_vm_open(struct vm_area_struct *vma)
+{
+	struct snd_rawmidi_runtime *runtime = vma->vm_private_data;
+
+	atomic_inc(&runtime->mmap_count);
+}
+
+static void snd_rawmidi_vm_close(struct vm_area_struct *vma)
+{
+	struct snd_rawmidi_runtime *runtime = vma->vm_private_data;
+
+	atomic_dec(&runtime->mmap_count);
+}
+
+static const struct vm_operations_struct snd_rawmidi_vm_ops = {
+	.open =		snd_rawmidi_vm_open,
+	.close =	snd_rawmidi_vm_close,
+};
+
+/*
+ * map the control area and the ring of an input stream set up with
+ * SNDRV_RAWMIDI_MODE_MMAP
+ */
+static int snd_rawmidi_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct snd_rawmidi_file *rfile = file->private_data;
+	struct snd_rawmidi_substream *substream = rfile->input;
+	struct snd_rawmidi_runtime *runtime;
+	int err;
+
+	if (!substream)
+		return -ENXIO;
+	runtime = substream->runtime;
+
+	mutex_lock(&substream->rmidi->open_mutex);
+	if (!runtime->mmap_area) {
+		err = -EBADFD;
+		goto unlock;
+	}
+	err = remap_vmalloc_range(vma, runtime->mmap_area, vma->vm_pgoff);
+	if (err < 0)
+		goto unlock;
+	vma->vm_ops = &snd_rawmidi_vm_ops;
+	vma->vm_private_data = runtime;
+	atomic_inc(&runtime->mmap_count);
+ unlock:
+	mutex_unlock(&substream->rmidi->open_mutex);
+	if (!err)
+		snd_rawmidi_input_trigger(substream, 1);
+	return err;
+}
+
 /*
  */
 #ifdef CONFIG_COMPAT
@@ -1570,6 +1823,7 @@ static const struct file_operations snd_rawmidi_f_ops = {
 	.release =	snd_rawmidi_release,
 	.llseek =	no_llseek,
 	.poll =		snd_rawmidi_poll,
+	.mmap =		snd_rawmidi_mmap,
 	.unlocked_ioctl =	snd_rawmidi_ioctl,
 	.compat_ioctl =	snd_rawmidi_ioctl_compat,
 };
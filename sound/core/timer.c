@@ -13,6 +13,7 @@
 #include <linux/module.h>
 #include <linux/string.h>
 #include <linux/sched/signal.h>
+#include <linux/percpu.h>
 #include <sound/core.h>
 #include <sound/timer.h>
 #include <sound/control.h>
@@ -568,6 +569,7 @@ static int snd_timer_start1(struct snd_timer_instance *timeri,
 	} else {
 		if (start)
 			timer->sticks = ticks;
+		timer->last_irq = ktime_get();
 		timer->hw.start(timer);
 	      __start_now:
 		timer->running++;
@@ -639,6 +641,7 @@ static int snd_timer_stop1(struct snd_timer_instance *timeri, bool stop)
 	if ((timeri->flags & SNDRV_TIMER_IFLG_RUNNING) &&
 	    !(--timer->running)) {
 		timer->hw.stop(timer);
+		timer->last_irq = 0;
 		if (timer->flags & SNDRV_TIMER_FLG_RESCHED) {
 			timer->flags &= ~SNDRV_TIMER_FLG_RESCHED;
 			snd_timer_reschedule(timer, 0);
@@ -813,22 +816,121 @@ static void snd_timer_clear_callbacks(struct snd_timer *timer,
 }
 
 /*
- * timer tasklet
+ * slow callback dispatch
  *
+ * Timers with pending slow callbacks are queued on the list of the CPU
+ * that raised the interrupt, and the tasklet of that CPU handles all of
+ * them in one batch.
  */
-static void snd_timer_tasklet(unsigned long arg)
+struct snd_timer_dispatch {
+	struct llist_head pending;
+	struct tasklet_struct tasklet;
+};
+
+static DEFINE_PER_CPU(struct snd_timer_dispatch, snd_timer_dispatch);
+
+/* woken when a timer has no queued or in-flight dispatch left */
+static DECLARE_WAIT_QUEUE_HEAD(snd_timer_dispatch_wait);
+
+static void snd_timer_dispatch_tasklet(unsigned long arg)
 {
-	struct snd_timer *timer = (struct snd_timer *) arg;
+	struct snd_timer_dispatch *d = (struct snd_timer_dispatch *)arg;
+	struct snd_timer *timer, *tmp;
+	struct llist_node *list;
 	unsigned long flags;
 
-	if (timer->card && timer->card->shutdown) {
-		snd_timer_clear_callbacks(timer, &timer->sack_list_head);
-		return;
+	list = llist_reverse_order(llist_del_all(&d->pending));
+	llist_for_each_entry_safe(timer, tmp, list, dispatch_node) {
+		spin_lock_irqsave(&timer->lock, flags);
+		if (timer->card && timer->card->shutdown) {
+			while (!list_empty(&timer->sack_list_head))
+				list_del_init(timer->sack_list_head.next);
+		} else {
+			snd_timer_process_callbacks(timer,
+						    &timer->sack_list_head);
+		}
+
+		/*
+		 * The slow list is empty and the lock held, so only instances
+		 * added after this batch queue the timer again.  A timer is
+		 * never processed on two CPUs at once.
+		 */
+		clear_bit(0, &timer->dispatch_pending);
+		spin_unlock_irqrestore(&timer->lock, flags);
+
+		/*
+		 * The timer may be freed as soon as the count drops, so wake
+		 * the global queue rather than anything inside the timer.
+		 */
+		if (atomic_dec_and_test(&timer->dispatch_active))
+			wake_up(&snd_timer_dispatch_wait);
 	}
+}
 
-	spin_lock_irqsave(&timer->lock, flags);
-	snd_timer_process_callbacks(timer, &timer->sack_list_head);
-	spin_unlock_irqrestore(&timer->lock, flags);
+static void snd_timer_dispatch_queue(struct snd_timer *timer)
+{
+	struct snd_timer_dispatch *d;
+
+	if (test_and_set_bit(0, &timer->dispatch_pending))
+		return; /* already queued, picked up by that batch */
+
+	atomic_inc(&timer->dispatch_active);
+	d = get_cpu_ptr(&snd_timer_dispatch);
+	llist_add(&timer->dispatch_node, &d->pending);
+	tasklet_schedule(&d->tasklet);
+	put_cpu_ptr(&snd_timer_dispatch);
+}
+
+/* wait until the queued slow callbacks of the timer are finished */
+static void snd_timer_dispatch_sync(struct snd_timer *timer)
+{
+	wait_event(snd_timer_dispatch_wait,
+		   !atomic_read(&timer->dispatch_active));
+}
+
+static void __init snd_timer_dispatch_init(void)
+{
+	struct snd_timer_dispatch *d;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		d = per_cpu_ptr(&snd_timer_dispatch, cpu);
+		init_llist_head(&d->pending);
+		tasklet_init(&d->tasklet, snd_timer_dispatch_tasklet,
+			     (unsigned long)d);
+	}
+}
+
+static void __exit snd_timer_dispatch_done(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		tasklet_kill(&per_cpu_ptr(&snd_timer_dispatch, cpu)->tasklet);
+}
+
+/*
+ * account the deviation of the interrupt interval from the elapsed ticks
+ * reported by the hardware
+ */
+static void snd_timer_update_jitter(struct snd_timer *timer,
+				    unsigned long ticks_left,
+				    unsigned long resolution)
+{
+	ktime_t now = ktime_get();
+	s64 jitter;
+
+	if (timer->last_irq) {
+		jitter = ktime_to_ns(ktime_sub(now, timer->last_irq)) -
+			 (s64)ticks_left * resolution;
+		if (jitter < 0)
+			jitter = -jitter;
+		timer->jitter_count++;
+		timer->jitter_sum += jitter;
+		if (jitter > timer->jitter_max)
+			timer->jitter_max = jitter;
+	}
+	timer->last_irq = now;
 }
 
 /*
@@ -857,6 +959,7 @@ void snd_timer_interrupt(struct snd_timer * timer, unsigned long ticks_left)
 
 	/* remember the current resolution */
 	resolution = snd_timer_hw_resolution(timer);
+	snd_timer_update_jitter(timer, ticks_left, resolution);
 
 	/* loop for all active instances
 	 * Here we cannot use list_for_each_entry because the active_list of a
@@ -913,6 +1016,7 @@ void snd_timer_interrupt(struct snd_timer * timer, unsigned long ticks_left)
 		}
 	} else {
 		timer->hw.stop(timer);
+		timer->last_irq = 0;
 	}
 
 	/* now process all fast callbacks */
@@ -923,7 +1027,7 @@ void snd_timer_interrupt(struct snd_timer * timer, unsigned long ticks_left)
 	spin_unlock_irqrestore(&timer->lock, flags);
 
 	if (use_tasklet)
-		tasklet_schedule(&timer->task_queue);
+		snd_timer_dispatch_queue(timer);
 }
 EXPORT_SYMBOL(snd_timer_interrupt);
 
@@ -967,8 +1071,7 @@ int snd_timer_new(struct snd_card *card, char *id, struct snd_timer_id *tid,
 	INIT_LIST_HEAD(&timer->ack_list_head);
 	INIT_LIST_HEAD(&timer->sack_list_head);
 	spin_lock_init(&timer->lock);
-	tasklet_init(&timer->task_queue, snd_timer_tasklet,
-		     (unsigned long)timer);
+	atomic_set(&timer->dispatch_active, 0);
 	timer->max_instances = 1000; /* default limit per timer */
 	if (card != NULL) {
 		timer->module = card->module;
@@ -1003,6 +1106,7 @@ static int snd_timer_free(struct snd_timer *timer)
 	list_del(&timer->device_list);
 	mutex_unlock(&register_mutex);
 
+	snd_timer_dispatch_sync(timer);
 	if (timer->private_free)
 		timer->private_free(timer);
 	kfree(timer);
@@ -1247,6 +1351,7 @@ static void snd_timer_proc_read(struct snd_info_entry *entry,
 {
 	struct snd_timer *timer;
 	struct snd_timer_instance *ti;
+	u64 count, sum, max;
 
 	mutex_lock(&register_mutex);
 	list_for_each_entry(timer, &snd_timer_list, device_list) {
@@ -1278,6 +1383,15 @@ static void snd_timer_proc_read(struct snd_info_entry *entry,
 		if (timer->hw.flags & SNDRV_TIMER_HW_SLAVE)
 			snd_iprintf(buffer, " SLAVE");
 		snd_iprintf(buffer, "\n");
+		spin_lock_irq(&timer->lock);
+		count = timer->jitter_count;
+		sum = timer->jitter_sum;
+		max = timer->jitter_max;
+		spin_unlock_irq(&timer->lock);
+		if (count)
+			snd_iprintf(buffer,
+				    "  Jitter : %llu irqs, avg %lluns, max %lluns\n",
+				    count, div64_u64(sum, count), max);
 		list_for_each_entry(ti, &timer->open_list_head, open_list)
 			snd_iprintf(buffer, "  Client %s : %s\n",
 				    ti->owner ? ti->owner : "unknown",
@@ -2311,6 +2425,8 @@ static int __init alsa_timer_init(void)
 			      "system timer");
 #endif
 
+	snd_timer_dispatch_init();
+
 	err = snd_timer_register_system();
 	if (err < 0) {
 		pr_err("ALSA: unable to register system timer (%i)\n", err);
@@ -2339,6 +2455,7 @@ static void __exit alsa_timer_exit(void)
 	snd_timer_free_all();
 	put_device(&timer_dev);
 	snd_timer_proc_done();
+	snd_timer_dispatch_done();
 #ifdef SNDRV_OSS_INFO_DEV_TIMERS
 	snd_oss_info_unregister(SNDRV_OSS_INFO_DEV_TIMERS, SNDRV_CARDS - 1);
 #endif
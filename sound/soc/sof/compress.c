@@ -32,6 +32,10 @@ int sof_probe_compr_open(struct snd_compr_stream *cstream,
 	}
 
 	sdev->extractor_stream_tag = ret;
+
+	ret = sof_probe_demux_init(sdev, cstream, dai);
+	if (ret < 0)
+		dev_warn(dai->dev, "Probe demux unavailable: %d\n", ret);
 	return 0;
 }
 EXPORT_SYMBOL(sof_probe_compr_open);
@@ -57,6 +61,8 @@ int sof_probe_compr_free(struct snd_compr_stream *cstream,
 	kfree(desc);
 
 exit:
+	sof_probe_demux_free(sdev);
+
 	ret = sof_ipc_probe_deinit(sdev);
 	if (ret < 0)
 		dev_err(dai->dev, "Failed to deinit probe: %d\n", ret);
@@ -13,6 +13,7 @@
 #include <sound/soc.h>
 #include <sound/sof.h>
 #include "sof-priv.h"
+#include "sof-audio.h"
 #include "ops.h"
 #if IS_ENABLED(CONFIG_SND_SOC_SOF_DEBUG_PROBES)
 #include "probe.h"
@@ -297,6 +298,8 @@ int snd_sof_device_probe(struct device *dev, struct snd_sof_pdata *plat_data)
 	sdev->fw_state = SOF_FW_BOOT_NOT_STARTED;
 #if IS_ENABLED(CONFIG_SND_SOC_SOF_DEBUG_PROBES)
 	sdev->extractor_stream_tag = SOF_PROBE_INVALID_NODE_ID;
+	mutex_init(&sdev->probe_demux_mutex);
+	spin_lock_init(&sdev->probe_demux_lock);
 #endif
 	dev_set_drvdata(dev, sdev);
 
@@ -377,6 +380,18 @@ int snd_sof_device_remove(struct device *dev)
 }
 EXPORT_SYMBOL(snd_sof_device_remove);
 
+static int __init snd_sof_core_init(void)
+{
+	snd_sof_init_topology_tokens();
+	return 0;
+}
+module_init(snd_sof_core_init);
+
+static void __exit snd_sof_core_exit(void)
+{
+}
+module_exit(snd_sof_core_exit);
+
 MODULE_AUTHOR("Liam Girdwood");
 MODULE_DESCRIPTION("Sound Open Firmware (SOF) Core");
 MODULE_LICENSE("Dual BSD/GPL");
@@ -142,7 +142,7 @@ static ssize_t probe_points_write(struct file *file,
 	struct sof_probe_point_desc *desc;
 	size_t num_tkns, bytes;
 	u32 *tkns;
-	int ret;
+	int i, ret;
 
 	if (sdev->extractor_stream_tag == SOF_PROBE_INVALID_NODE_ID) {
 		dev_warn(sdev->dev, "no extractor stream running\n");
@@ -159,10 +159,20 @@ static ssize_t probe_points_write(struct file *file,
 	}
 
 	desc = (struct sof_probe_point_desc *)tkns;
-	ret = sof_ipc_probe_points_add(sdev,
-			desc, bytes / sizeof(*desc));
-	if (!ret)
-		ret = count;
+	num_tkns = bytes / sizeof(*desc);
+	ret = sof_ipc_probe_points_add(sdev, desc, num_tkns);
+	if (ret)
+		goto exit;
+
+	/* give each extraction point its own ring */
+	for (i = 0; i < num_tkns; i++) {
+		if (desc[i].purpose != SOF_CONNECTION_PURPOSE_EXTRACT)
+			continue;
+		if (sof_probe_demux_add_point(sdev, desc[i].buffer_id))
+			dev_warn(sdev->dev, "no ring for probe point %#010x\n",
+				 desc[i].buffer_id);
+	}
+	ret = count;
 exit:
 	kfree(tkns);
 	return ret;
@@ -182,7 +192,7 @@ static ssize_t probe_points_remove_write(struct file *file,
 	struct snd_sof_dev *sdev = dfse->sdev;
 	size_t num_tkns;
 	u32 *tkns;
-	int ret;
+	int i, ret;
 
 	if (sdev->extractor_stream_tag == SOF_PROBE_INVALID_NODE_ID) {
 		dev_warn(sdev->dev, "no extractor stream running\n");
@@ -198,8 +208,12 @@ static ssize_t probe_points_remove_write(struct file *file,
 	}
 
 	ret = sof_ipc_probe_points_remove(sdev, tkns, num_tkns);
-	if (!ret)
-		ret = count;
+	if (ret)
+		goto exit;
+
+	for (i = 0; i < num_tkns; i++)
+		sof_probe_demux_remove_point(sdev, tkns[i]);
+	ret = count;
 exit:
 	kfree(tkns);
 	return ret;
@@ -211,6 +225,32 @@ static const struct file_operations probe_points_remove_fops = {
 	.llseek = default_llseek,
 };
 
+static ssize_t probe_demux_read(struct file *file,
+		char __user *to, size_t count, loff_t *ppos)
+{
+	struct snd_sof_dfsentry *dfse = file->private_data;
+	struct snd_sof_dev *sdev = dfse->sdev;
+	size_t len;
+	char *buf;
+	int ret;
+
+	buf = kzalloc(PAGE_SIZE, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	len = sof_probe_demux_info(sdev, buf, PAGE_SIZE);
+	ret = simple_read_from_buffer(to, count, ppos, buf, len);
+
+	kfree(buf);
+	return ret;
+}
+
+static const struct file_operations probe_demux_fops = {
+	.open = simple_open,
+	.read = probe_demux_read,
+	.llseek = default_llseek,
+};
+
 static int snd_sof_debugfs_probe_item(struct snd_sof_dev *sdev,
 				 const char *name, mode_t mode,
 				 const struct file_operations *fops)
@@ -660,6 +700,10 @@ int snd_sof_dbg_init(struct snd_sof_dev *sdev)
 			0200, &probe_points_remove_fops);
 	if (err < 0)
 		return err;
+	err = snd_sof_debugfs_probe_item(sdev, "probe_demux",
+			0444, &probe_demux_fops);
+	if (err < 0)
+		return err;
 #endif
 
 #if IS_ENABLED(CONFIG_SND_SOC_SOF_DEBUG_IPC_FLOOD_TEST)
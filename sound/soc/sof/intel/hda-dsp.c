@@ -15,7 +15,12 @@
  * Hardware interface for generic Intel audio DSP HDA IP
  */
 
+#include <linux/debugfs.h>
+#include <linux/hrtimer.h>
 #include <linux/module.h>
+#include <linux/pm_runtime.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
 #include <sound/hdaudio_ext.h>
 #include <sound/hda_register.h>
 #include "../sof-audio.h"
@@ -30,6 +35,11 @@ MODULE_PARM_DESC(enable_trace_D0I3_S0,
 		 "SOF HDA enable trace when the DSP is in D0I3 in S0");
 #endif
 
+static unsigned int hda_d0i3_coalesce_ms = SOF_HDA_D0I3_COALESCE_MS;
+module_param_named(d0i3_coalesce_ms, hda_d0i3_coalesce_ms, uint, 0644);
+MODULE_PARM_DESC(d0i3_coalesce_ms,
+		 "SOF HDA time control IPCs are held to share one D0I3 exit");
+
 /*
  * DSP Core control.
  */
@@ -376,9 +386,62 @@ static int hda_dsp_update_d0i3c_register(struct snd_sof_dev *sdev, u8 value)
 	return 0;
 }
 
+/* running average with a 1/8 weight for the new sample */
+static u64 hda_dsp_d0i3_avg(u64 avg, u64 sample)
+{
+	if (!avg)
+		return sample;
+
+	return avg - (avg >> 3) + (sample >> 3);
+}
+
+static void hda_dsp_d0i3_exit_latency(struct snd_sof_dev *sdev, ktime_t start)
+{
+	struct sof_intel_hda_dev *hda = sdev->pdata->hw_pdata;
+	struct sof_hda_d0i3_policy *policy = &hda->d0i3_policy;
+	u64 delta = ktime_to_ns(ktime_sub(ktime_get(), start));
+	unsigned long flags;
+
+	spin_lock_irqsave(&policy->lock, flags);
+	policy->exit_latency = hda_dsp_d0i3_avg(policy->exit_latency, delta);
+	spin_unlock_irqrestore(&policy->lock, flags);
+}
+
+/* account the time spent in the previous state and count D0 transitions */
+static void hda_dsp_d0i3_account(struct snd_sof_dev *sdev,
+				 const struct sof_dsp_power_state *old_state,
+				 const struct sof_dsp_power_state *new_state)
+{
+	struct sof_intel_hda_dev *hda = sdev->pdata->hw_pdata;
+	struct sof_hda_d0i3_policy *policy = &hda->d0i3_policy;
+	ktime_t now = ktime_get();
+	unsigned long flags;
+
+	spin_lock_irqsave(&policy->lock, flags);
+
+	if (old_state->state == SOF_DSP_PM_D0 &&
+	    old_state->substate < SOF_HDA_DSP_PM_D0_SUBSTATES)
+		policy->residency[old_state->substate] +=
+			ktime_to_ns(ktime_sub(now, policy->state_since));
+	policy->state_since = now;
+
+	/* a D0I3 -> D0I3 re-entry for S0IX is not a transition */
+	if (old_state->state == SOF_DSP_PM_D0 &&
+	    new_state->state == SOF_DSP_PM_D0 &&
+	    old_state->substate != new_state->substate) {
+		if (new_state->substate == SOF_HDA_DSP_PM_D0I3)
+			policy->entries++;
+		else
+			policy->exits++;
+	}
+
+	spin_unlock_irqrestore(&policy->lock, flags);
+}
+
 static int hda_dsp_set_D0_state(struct snd_sof_dev *sdev,
 				const struct sof_dsp_power_state *target_state)
 {
+	ktime_t start = ktime_get();
 	u32 flags = 0;
 	int ret;
 	u8 value = 0;
@@ -437,6 +500,10 @@ static int hda_dsp_set_D0_state(struct snd_sof_dev *sdev,
 		goto revert;
 	}
 
+	if (sdev->dsp_power_state.substate == SOF_HDA_DSP_PM_D0I3 &&
+	    target_state->substate == SOF_HDA_DSP_PM_D0I0)
+		hda_dsp_d0i3_exit_latency(sdev, start);
+
 	return ret;
 
 revert:
@@ -452,6 +519,32 @@ static int hda_dsp_set_D0_state(struct snd_sof_dev *sdev,
 	return ret;
 }
 
+/*
+ * While only D0I3-compatible streams are active in S0, a D0I3 exit is
+ * requested by runtime control traffic. Returns how long the first such
+ * request holds the exit so that the IPCs sent close together share it,
+ * or 0 if the exit must not be delayed.
+ */
+static unsigned int hda_dsp_d0i3_coalesce(struct snd_sof_dev *sdev,
+				const struct sof_dsp_power_state *target_state)
+{
+	if (target_state->state != SOF_DSP_PM_D0 ||
+	    target_state->substate != SOF_HDA_DSP_PM_D0I0 ||
+	    sdev->dsp_power_state.state != SOF_DSP_PM_D0 ||
+	    sdev->dsp_power_state.substate != SOF_HDA_DSP_PM_D0I3)
+		return 0;
+
+	/* never hold the suspend and resume paths */
+	if (sdev->system_suspend_target != SOF_SUSPEND_NONE ||
+	    !pm_runtime_active(sdev->dev))
+		return 0;
+
+	if (!snd_sof_dsp_only_d0i3_compatible_stream_active(sdev))
+		return 0;
+
+	return READ_ONCE(hda_d0i3_coalesce_ms);
+}
+
 /*
  * All DSP power state transitions are initiated by the driver.
  * If the requested state change fails, the error is simply returned.
@@ -459,9 +552,10 @@ static int hda_dsp_set_D0_state(struct snd_sof_dev *sdev,
  * is called again either because of a new IPC sent to the DSP or
  * during system suspend/resume.
  */
-int hda_dsp_set_power_state(struct snd_sof_dev *sdev,
-			    const struct sof_dsp_power_state *target_state)
+static int __hda_dsp_set_power_state(struct snd_sof_dev *sdev,
+				const struct sof_dsp_power_state *target_state)
 {
+	struct sof_dsp_power_state old_state = sdev->dsp_power_state;
 	int ret = 0;
 
 	/*
@@ -511,11 +605,51 @@ int hda_dsp_set_power_state(struct snd_sof_dev *sdev,
 	}
 
 	sdev->dsp_power_state = *target_state;
+	hda_dsp_d0i3_account(sdev, &old_state, target_state);
 	dev_dbg(sdev->dev, "New DSP state %d substate %d\n",
 		target_state->state, target_state->substate);
 	return ret;
 }
 
+int hda_dsp_set_power_state(struct snd_sof_dev *sdev,
+			    const struct sof_dsp_power_state *target_state)
+{
+	struct sof_intel_hda_dev *hda = sdev->pdata->hw_pdata;
+	struct sof_hda_d0i3_policy *policy = &hda->d0i3_policy;
+	unsigned int slot_ms = hda_dsp_d0i3_coalesce(sdev, target_state);
+	unsigned long flags;
+	ktime_t slot;
+	int ret;
+
+	if (!slot_ms)
+		return __hda_dsp_set_power_state(sdev, target_state);
+
+	/*
+	 * The first IPC holds the exit for the coalescing slot, the others
+	 * wait for it here and find the DSP already in D0I0.
+	 */
+	mutex_lock(&policy->exit_mutex);
+	if (sdev->dsp_power_state.state == target_state->state &&
+	    sdev->dsp_power_state.substate == target_state->substate) {
+		spin_lock_irqsave(&policy->lock, flags);
+		policy->coalesced++;
+		spin_unlock_irqrestore(&policy->lock, flags);
+		mutex_unlock(&policy->exit_mutex);
+		return 0;
+	}
+
+	if (sdev->dsp_power_state.substate == SOF_HDA_DSP_PM_D0I3) {
+		slot = ms_to_ktime(slot_ms);
+		set_current_state(TASK_UNINTERRUPTIBLE);
+		schedule_hrtimeout(&slot, HRTIMER_MODE_REL);
+	}
+
+	ret = __hda_dsp_set_power_state(sdev, target_state);
+	mutex_unlock(&policy->exit_mutex);
+
+	return ret;
+}
+
 /*
  * Audio DSP states may transform as below:-
  *
@@ -827,6 +961,107 @@ int hda_dsp_set_hw_params_upon_resume(struct snd_sof_dev *sdev)
 	return 0;
 }
 
+void hda_dsp_d0i3_init(struct snd_sof_dev *sdev)
+{
+	struct sof_intel_hda_dev *hda = sdev->pdata->hw_pdata;
+
+	INIT_DELAYED_WORK(&hda->d0i3_work, hda_dsp_d0i3_work);
+	spin_lock_init(&hda->d0i3_policy.lock);
+	mutex_init(&hda->d0i3_policy.exit_mutex);
+	hda->d0i3_policy.state_since = ktime_get();
+}
+
+/*
+ * Called for each IPC sent to the DSP. The IPC rate is tracked to pick
+ * the D0I3 entry delay, which never exceeds the default delay. When IPCs
+ * come further apart than that, the next one is not expected within the
+ * delay, so the DSP goes back to D0I3 as soon as the break-even point of
+ * the measured exit latency is reached. The exits themselves are shared
+ * by the IPCs coalesced in hda_dsp_d0i3_coalesce().
+ */
+void hda_dsp_d0i3_schedule(struct snd_sof_dev *sdev)
+{
+	struct sof_intel_hda_dev *hda = sdev->pdata->hw_pdata;
+	struct sof_hda_d0i3_policy *policy = &hda->d0i3_policy;
+	const u64 window_max = SOF_HDA_D0I3_WORK_DELAY_MS * NSEC_PER_MSEC;
+	u64 window = window_max;
+	ktime_t now = ktime_get();
+	unsigned long flags;
+	u64 gap;
+
+	spin_lock_irqsave(&policy->lock, flags);
+
+	if (policy->last_ipc) {
+		gap = ktime_to_ns(ktime_sub(now, policy->last_ipc));
+		gap = min(gap, 2 * window_max);
+		policy->ipc_interval = hda_dsp_d0i3_avg(policy->ipc_interval,
+							gap);
+	}
+	policy->last_ipc = now;
+	policy->ipcs++;
+
+	if (policy->ipc_interval > window_max)
+		window = max_t(u64, SOF_HDA_D0I3_WINDOW_MIN_MS * NSEC_PER_MSEC,
+			       policy->exit_latency * SOF_HDA_D0I3_BREAK_EVEN);
+	window = min(window, window_max);
+	policy->window = window;
+
+	spin_unlock_irqrestore(&policy->lock, flags);
+
+	/*
+	 * Use mod_delayed_work() to avoid scheduling multiple workqueue
+	 * items when IPCs are sent at a high rate. mod_delayed_work()
+	 * modifies the timer if the work is pending.
+	 */
+	mod_delayed_work(system_wq, &hda->d0i3_work, nsecs_to_jiffies(window));
+}
+
+static int hda_dsp_d0i3_stats_show(struct seq_file *s, void *unused)
+{
+	struct snd_sof_dev *sdev = s->private;
+	struct sof_intel_hda_dev *hda = sdev->pdata->hw_pdata;
+	struct sof_hda_d0i3_policy *policy = &hda->d0i3_policy;
+	struct sof_hda_d0i3_policy snap;
+	struct sof_dsp_power_state state;
+	unsigned long flags;
+	u64 now;
+
+	spin_lock_irqsave(&policy->lock, flags);
+	snap = *policy;
+	state = sdev->dsp_power_state;
+	now = ktime_to_ns(ktime_sub(ktime_get(), policy->state_since));
+	spin_unlock_irqrestore(&policy->lock, flags);
+
+	/* include the time spent in the current state */
+	if (state.state == SOF_DSP_PM_D0 &&
+	    state.substate < SOF_HDA_DSP_PM_D0_SUBSTATES)
+		snap.residency[state.substate] += now;
+
+	seq_printf(s, "D0I0 residency: %llu ms\n",
+		   div_u64(snap.residency[SOF_HDA_DSP_PM_D0I0], NSEC_PER_MSEC));
+	seq_printf(s, "D0I3 residency: %llu ms\n",
+		   div_u64(snap.residency[SOF_HDA_DSP_PM_D0I3], NSEC_PER_MSEC));
+	seq_printf(s, "D0I3 entries: %llu\n", snap.entries);
+	seq_printf(s, "D0I3 exits: %llu\n", snap.exits);
+	seq_printf(s, "IPCs: %llu\n", snap.ipcs);
+	seq_printf(s, "Coalesced IPCs: %llu\n", snap.coalesced);
+	seq_printf(s, "IPC interval: %llu us\n",
+		   div_u64(snap.ipc_interval, NSEC_PER_USEC));
+	seq_printf(s, "Exit latency: %llu us\n",
+		   div_u64(snap.exit_latency, NSEC_PER_USEC));
+	seq_printf(s, "Wake window: %llu ms\n",
+		   div_u64(snap.window, NSEC_PER_MSEC));
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(hda_dsp_d0i3_stats);
+
+void hda_dsp_d0i3_debugfs_init(struct snd_sof_dev *sdev)
+{
+	debugfs_create_file("d0i3_stats", 0444, sdev->debugfs_root, sdev,
+			    &hda_dsp_d0i3_stats_fops);
+}
+
 void hda_dsp_d0i3_work(struct work_struct *work)
 {
 	struct sof_intel_hda_dev *hdev = container_of(work,
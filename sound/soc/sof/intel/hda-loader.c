@@ -429,6 +429,8 @@ int hda_dsp_post_fw_run(struct snd_sof_dev *sdev)
 				"error: could not startup SoundWire links\n");
 			return ret;
 		}
+
+		hda_dsp_d0i3_debugfs_init(sdev);
 	}
 
 	hda_sdw_int_enable(sdev, true);
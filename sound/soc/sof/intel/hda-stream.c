@@ -20,6 +20,7 @@
 #include <sound/hda_register.h>
 #include <sound/sof.h>
 #include "../ops.h"
+#include "../probe.h"
 #include "../sof-audio.h"
 #include "hda.h"
 
@@ -590,6 +591,7 @@ hda_dsp_set_bytes_transferred(struct hdac_stream *hstream, u64 buffer_size)
 static bool hda_dsp_stream_check(struct hdac_bus *bus, u32 status)
 {
 	struct sof_intel_hda_dev *sof_hda = bus_to_sof_hda(bus);
+	struct snd_sof_dev *sdev = dev_get_drvdata(bus->dev);
 	struct hdac_stream *s;
 	bool active = false;
 	u32 sd_status;
@@ -616,6 +618,7 @@ static bool hda_dsp_stream_check(struct hdac_bus *bus, u32 status)
 				hda_dsp_set_bytes_transferred(s,
 					s->cstream->runtime->buffer_size);
 				snd_compr_fragment_elapsed(s->cstream);
+				sof_probe_demux_elapsed(sdev, s->cstream);
 			}
 		}
 	}
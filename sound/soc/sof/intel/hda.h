@@ -411,10 +411,40 @@ struct sof_intel_dsp_bdl {
  */
 #define SOF_HDA_D0I3_WORK_DELAY_MS	5000
 
+/*
+ * Shortest D0I3 entry delay, used when IPCs come further apart than
+ * SOF_HDA_D0I3_WORK_DELAY_MS.
+ */
+#define SOF_HDA_D0I3_WINDOW_MIN_MS	100
+
+/* default time control IPCs are held so they share one D0I3 exit */
+#define SOF_HDA_D0I3_COALESCE_MS	20
+
+/* the wake window is never shorter than this many D0I3 exit latencies */
+#define SOF_HDA_D0I3_BREAK_EVEN		8
+
 /* HDA DSP D0 substate */
 enum sof_hda_D0_substate {
 	SOF_HDA_DSP_PM_D0I0,	/* default D0 substate */
 	SOF_HDA_DSP_PM_D0I3,	/* low power D0 substate */
+	SOF_HDA_DSP_PM_D0_SUBSTATES,
+};
+
+/* adaptive D0I3 entry policy and its statistics */
+struct sof_hda_d0i3_policy {
+	struct mutex exit_mutex; /* serialises coalesced D0I3 exits */
+	spinlock_t lock;	/* protects all fields below */
+	ktime_t last_ipc;
+	u64 ipc_interval;	/* average gap between IPCs (ns) */
+	u64 exit_latency;	/* average D0I3 -> D0I0 transition (ns) */
+
+	ktime_t state_since;
+	u64 residency[SOF_HDA_DSP_PM_D0_SUBSTATES]; /* ns per substate */
+	u64 entries;		/* D0I0 -> D0I3 transitions */
+	u64 exits;		/* D0I3 -> D0I0 transitions */
+	u64 ipcs;		/* IPCs sent */
+	u64 coalesced;		/* D0I3 exits saved by coalescing */
+	u64 window;		/* current D0I3 entry delay (ns) */
 };
 
 /* represents DSP HDA controller frontend - i.e. host facing control */
@@ -442,6 +472,7 @@ struct sof_intel_hda_dev {
 
 	/* delayed work to enter D0I3 opportunistically */
 	struct delayed_work d0i3_work;
+	struct sof_hda_d0i3_policy d0i3_policy;
 
 	/* ACPI information stored between scan and probe steps */
 	struct sdw_intel_acpi_info info;
@@ -516,6 +547,9 @@ void hda_dsp_dump(struct snd_sof_dev *sdev, u32 flags);
 void hda_ipc_dump(struct snd_sof_dev *sdev);
 void hda_ipc_irq_dump(struct snd_sof_dev *sdev);
 void hda_dsp_d0i3_work(struct work_struct *work);
+void hda_dsp_d0i3_init(struct snd_sof_dev *sdev);
+void hda_dsp_d0i3_schedule(struct snd_sof_dev *sdev);
+void hda_dsp_d0i3_debugfs_init(struct snd_sof_dev *sdev);
 
 /*
  * DSP PCM Operations.
@@ -0,0 +1,601 @@
+// SPDX-License-Identifier: (GPL-2.0 OR BSD-3-Clause)
+//
+// This file is provided under a dual BSD/GPLv2 license.  When using or
+// redistributing this file, you may do so under either license.
+//
+// Copyright(c) 2020 Intel Corporation. All rights reserved.
+//
+
+/*
+ * Extraction probes share a single compress stream: the DSP interleaves
+ * packets from every connected probe point. The demultiplexer below walks
+ * the extraction DMA buffer after each fragment and copies the packets of
+ * each point into its own ring, exposed through debugfs as
+ * probe_data_<buffer_id>. Readers mmap the file, poll it and consume
+ * records by advancing the tail in the control page.
+ */
+
+#include <linux/debugfs.h>
+#include <linux/kref.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/poll.h>
+#include <linux/sizes.h>
+#include <linux/vmalloc.h>
+#include <sound/compress_driver.h>
+#include "ops.h"
+#include "probe.h"
+
+#define SOF_PROBE_SYNC_WORD		0xBABEBEBA
+#define SOF_PROBE_CHECKSUM_SIZE		sizeof(u64)
+#define SOF_PROBE_RECORD_ALIGN		8
+
+static unsigned int probe_ring_size = SZ_256K;
+module_param(probe_ring_size, uint, 0644);
+MODULE_PARM_DESC(probe_ring_size, "SOF per probe point ring size in bytes");
+
+/* header of each packet in the extraction stream */
+struct sof_probe_packet_hdr {
+	u32 sync_word;
+	u32 buffer_id;
+	u32 format;
+	u32 timestamp_low;
+	u32 timestamp_high;
+	u32 data_size_bytes;
+} __packed;
+
+enum sof_probe_parse_state {
+	SOF_PROBE_PARSE_SYNC,
+	SOF_PROBE_PARSE_HEADER,
+	SOF_PROBE_PARSE_DATA,
+	SOF_PROBE_PARSE_CHECKSUM,
+};
+
+struct sof_probe_point_ring {
+	struct kref kref;
+	struct list_head list;
+	u32 buffer_id;
+	bool removed;
+
+	void *area;			/* control page followed by the ring */
+	struct sof_probe_ring_control *ctl;
+	u8 *ring;
+	u32 size;
+
+	u64 bytes;
+	wait_queue_head_t wait;
+	struct dentry *dfs;
+};
+
+struct sof_probe_demux {
+	struct snd_sof_dev *sdev;
+	struct snd_compr_stream *cstream;
+	struct snd_soc_dai *dai;
+	struct work_struct work;
+
+	struct mutex lock;		/* protects everything below */
+	struct list_head points;
+
+	u32 pos;			/* extraction bytes consumed */
+	u32 offset;			/* offset of @pos in the DMA buffer */
+	enum sof_probe_parse_state state;
+	struct sof_probe_packet_hdr hdr;
+	u32 fill;			/* header bytes collected */
+	u32 left;			/* data or checksum bytes to skip */
+	struct sof_probe_point_ring *cur; /* ring of the current packet */
+	u32 cur_head;			/* write position in @cur */
+
+	u64 resyncs;
+	u64 overruns;
+};
+
+static void sof_probe_ring_release(struct kref *kref)
+{
+	struct sof_probe_point_ring *pr =
+		container_of(kref, struct sof_probe_point_ring, kref);
+
+	vfree(pr->area);
+	kfree(pr);
+}
+
+static void sof_probe_ring_put(struct sof_probe_point_ring *pr)
+{
+	kref_put(&pr->kref, sof_probe_ring_release);
+}
+
+static void sof_probe_ring_vm_open(struct vm_area_struct *vma)
+{
+	struct sof_probe_point_ring *pr = vma->vm_private_data;
+
+	kref_get(&pr->kref);
+}
+
+static void sof_probe_ring_vm_close(struct vm_area_struct *vma)
+{
+	sof_probe_ring_put(vma->vm_private_data);
+}
+
+static const struct vm_operations_struct sof_probe_ring_vm_ops = {
+	.open = sof_probe_ring_vm_open,
+	.close = sof_probe_ring_vm_close,
+};
+
+/*
+ * The file is created with debugfs_create_file_unsafe() as the debugfs
+ * proxy does not forward mmap. The ring is pinned by a reference held for
+ * the lifetime of the open file and of every mapping instead.
+ */
+static int sof_probe_ring_open(struct inode *inode, struct file *file)
+{
+	struct dentry *dentry = file->f_path.dentry;
+	struct sof_probe_point_ring *pr;
+	int ret;
+
+	ret = debugfs_file_get(dentry);
+	if (ret)
+		return ret;
+
+	pr = inode->i_private;
+	kref_get(&pr->kref);
+	file->private_data = pr;
+
+	debugfs_file_put(dentry);
+	return nonseekable_open(inode, file);
+}
+
+static int sof_probe_ring_release_file(struct inode *inode, struct file *file)
+{
+	sof_probe_ring_put(file->private_data);
+	return 0;
+}
+
+static int sof_probe_ring_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct sof_probe_point_ring *pr = file->private_data;
+	int ret;
+
+	ret = remap_vmalloc_range(vma, pr->area, vma->vm_pgoff);
+	if (ret < 0)
+		return ret;
+
+	vma->vm_ops = &sof_probe_ring_vm_ops;
+	vma->vm_private_data = pr;
+	kref_get(&pr->kref);
+
+	return 0;
+}
+
+static __poll_t sof_probe_ring_poll(struct file *file, poll_table *wait)
+{
+	struct sof_probe_point_ring *pr = file->private_data;
+	__poll_t mask = 0;
+
+	poll_wait(file, &pr->wait, wait);
+
+	if (smp_load_acquire(&pr->ctl->head) != READ_ONCE(pr->ctl->tail))
+		mask |= EPOLLIN | EPOLLRDNORM;
+	if (READ_ONCE(pr->removed))
+		mask |= EPOLLHUP;
+
+	return mask;
+}
+
+static const struct file_operations sof_probe_ring_fops = {
+	.owner = THIS_MODULE,
+	.open = sof_probe_ring_open,
+	.release = sof_probe_ring_release_file,
+	.mmap = sof_probe_ring_mmap,
+	.poll = sof_probe_ring_poll,
+	.llseek = no_llseek,
+};
+
+static struct sof_probe_point_ring *
+sof_probe_demux_find(struct sof_probe_demux *demux, u32 buffer_id)
+{
+	struct sof_probe_point_ring *pr;
+
+	list_for_each_entry(pr, &demux->points, list)
+		if (pr->buffer_id == buffer_id)
+			return pr;
+
+	return NULL;
+}
+
+/* drop whatever packet is in flight and hunt for the next sync word */
+static void sof_probe_demux_resync(struct sof_probe_demux *demux)
+{
+	if (demux->cur)
+		demux->cur->ctl->drops++;
+	demux->cur = NULL;
+	demux->state = SOF_PROBE_PARSE_SYNC;
+	demux->fill = 0;
+	demux->left = 0;
+}
+
+static void sof_probe_ring_copy(struct sof_probe_point_ring *pr, u32 pos,
+				const void *src, u32 len)
+{
+	u32 off = pos & (pr->size - 1);
+	u32 n = min(len, pr->size - off);
+
+	memcpy(pr->ring + off, src, n);
+	memcpy(pr->ring, src + n, len - n);
+}
+
+static void sof_probe_demux_packet_start(struct sof_probe_demux *demux)
+{
+	struct sof_probe_packet_hdr *hdr = &demux->hdr;
+	struct sof_probe_ring_record rec;
+	struct sof_probe_point_ring *pr;
+	u32 head, tail, need;
+
+	/* a packet can never be larger than the buffer carrying it */
+	if (hdr->data_size_bytes > demux->cstream->runtime->buffer_size) {
+		demux->resyncs++;
+		sof_probe_demux_resync(demux);
+		return;
+	}
+
+	demux->state = SOF_PROBE_PARSE_DATA;
+	demux->left = hdr->data_size_bytes;
+	demux->cur = NULL;
+
+	pr = sof_probe_demux_find(demux, hdr->buffer_id);
+	if (!pr)
+		return;
+
+	need = sizeof(rec) + ALIGN(hdr->data_size_bytes, SOF_PROBE_RECORD_ALIGN);
+	head = pr->ctl->head;
+	tail = READ_ONCE(pr->ctl->tail);
+	if (head - tail > pr->size || pr->size - (head - tail) < need) {
+		pr->ctl->drops++;
+		return;
+	}
+
+	rec.timestamp = ((u64)hdr->timestamp_high << 32) | hdr->timestamp_low;
+	rec.format = hdr->format;
+	rec.size = hdr->data_size_bytes;
+	sof_probe_ring_copy(pr, head, &rec, sizeof(rec));
+
+	demux->cur = pr;
+	demux->cur_head = head + sizeof(rec);
+}
+
+static void sof_probe_demux_packet_end(struct sof_probe_demux *demux)
+{
+	struct sof_probe_point_ring *pr = demux->cur;
+
+	demux->state = SOF_PROBE_PARSE_CHECKSUM;
+	demux->left = SOF_PROBE_CHECKSUM_SIZE;
+	if (!pr)
+		return;
+
+	demux->cur = NULL;
+	pr->bytes += demux->hdr.data_size_bytes;
+	pr->ctl->packets++;
+	/* publish the record only once its data is in place */
+	smp_store_release(&pr->ctl->head,
+			  ALIGN(demux->cur_head, SOF_PROBE_RECORD_ALIGN));
+	wake_up_interruptible(&pr->wait);
+}
+
+static void sof_probe_demux_parse(struct sof_probe_demux *demux,
+				  const u8 *buf, u32 len)
+{
+	u8 *hdr = (u8 *)&demux->hdr;
+	u32 n;
+
+	while (len) {
+		switch (demux->state) {
+		case SOF_PROBE_PARSE_SYNC:
+			n = min_t(u32, len, sizeof(u32) - demux->fill);
+			memcpy(hdr + demux->fill, buf, n);
+			demux->fill += n;
+			if (demux->fill < sizeof(u32))
+				break;
+			if (demux->hdr.sync_word == SOF_PROBE_SYNC_WORD) {
+				demux->state = SOF_PROBE_PARSE_HEADER;
+				break;
+			}
+			/* slide by one byte until the stream lines up again */
+			memmove(hdr, hdr + 1, sizeof(u32) - 1);
+			demux->fill--;
+			break;
+
+		case SOF_PROBE_PARSE_HEADER:
+			n = min_t(u32, len, sizeof(demux->hdr) - demux->fill);
+			memcpy(hdr + demux->fill, buf, n);
+			demux->fill += n;
+			if (demux->fill < sizeof(demux->hdr))
+				break;
+			demux->fill = 0;
+			sof_probe_demux_packet_start(demux);
+			if (demux->state == SOF_PROBE_PARSE_DATA && !demux->left)
+				sof_probe_demux_packet_end(demux);
+			break;
+
+		case SOF_PROBE_PARSE_DATA:
+			n = min(len, demux->left);
+			if (demux->cur) {
+				sof_probe_ring_copy(demux->cur, demux->cur_head,
+						    buf, n);
+				demux->cur_head += n;
+			}
+			demux->left -= n;
+			if (!demux->left)
+				sof_probe_demux_packet_end(demux);
+			break;
+
+		case SOF_PROBE_PARSE_CHECKSUM:
+			n = min(len, demux->left);
+			demux->left -= n;
+			if (!demux->left)
+				demux->state = SOF_PROBE_PARSE_SYNC;
+			break;
+		}
+
+		buf += n;
+		len -= n;
+	}
+}
+
+static void sof_probe_demux_work(struct work_struct *work)
+{
+	struct sof_probe_demux *demux =
+		container_of(work, struct sof_probe_demux, work);
+	struct snd_compr_runtime *rtd = demux->cstream->runtime;
+	struct snd_compr_tstamp tstamp = {0};
+	u32 avail, skip, n;
+	int ret;
+
+	/*
+	 * Query the position straight from the platform rather than through
+	 * the compress core, which would take the pcm mutex that free holds
+	 * while cancelling this work.
+	 */
+	ret = snd_sof_probe_compr_pointer(demux->sdev, demux->cstream,
+					  &tstamp, demux->dai);
+	if (ret < 0 || !rtd->buffer_size)
+		return;
+
+	mutex_lock(&demux->lock);
+
+	avail = tstamp.copied_total - demux->pos;
+	if (avail > rtd->buffer_size) {
+		/* the DMA lapped us, restart from the oldest valid byte */
+		skip = avail - rtd->buffer_size;
+		demux->pos += skip;
+		demux->offset = ((u64)demux->offset + skip) % rtd->buffer_size;
+		demux->overruns++;
+		sof_probe_demux_resync(demux);
+		avail = rtd->buffer_size;
+	}
+
+	while (avail) {
+		n = min(avail, rtd->buffer_size - demux->offset);
+		sof_probe_demux_parse(demux, rtd->dma_area + demux->offset, n);
+
+		demux->offset += n;
+		if (demux->offset == rtd->buffer_size)
+			demux->offset = 0;
+		demux->pos += n;
+		avail -= n;
+	}
+
+	mutex_unlock(&demux->lock);
+}
+
+/**
+ * sof_probe_demux_elapsed - schedule demultiplexing of new probe data
+ * @sdev:	SOF sound device
+ * @cstream:	Compress stream which just completed a fragment
+ *
+ * Called from the platform stream interrupt handling. The DMA buffer is
+ * walked later from a work item so nothing is parsed in atomic context.
+ * The work is scheduled under probe_demux_lock, so once free has cleared
+ * the pointer under that lock it cannot be scheduled again.
+ */
+void sof_probe_demux_elapsed(struct snd_sof_dev *sdev,
+			     struct snd_compr_stream *cstream)
+{
+	struct sof_probe_demux *demux;
+	unsigned long flags;
+
+	spin_lock_irqsave(&sdev->probe_demux_lock, flags);
+	demux = sdev->probe_demux;
+	if (demux && demux->cstream == cstream)
+		schedule_work(&demux->work);
+	spin_unlock_irqrestore(&sdev->probe_demux_lock, flags);
+}
+EXPORT_SYMBOL(sof_probe_demux_elapsed);
+
+int sof_probe_demux_init(struct snd_sof_dev *sdev,
+			 struct snd_compr_stream *cstream,
+			 struct snd_soc_dai *dai)
+{
+	struct sof_probe_demux *demux;
+
+	demux = kzalloc(sizeof(*demux), GFP_KERNEL);
+	if (!demux)
+		return -ENOMEM;
+
+	demux->sdev = sdev;
+	demux->cstream = cstream;
+	demux->dai = dai;
+	demux->state = SOF_PROBE_PARSE_SYNC;
+	INIT_WORK(&demux->work, sof_probe_demux_work);
+	mutex_init(&demux->lock);
+	INIT_LIST_HEAD(&demux->points);
+
+	mutex_lock(&sdev->probe_demux_mutex);
+	spin_lock_irq(&sdev->probe_demux_lock);
+	sdev->probe_demux = demux;
+	spin_unlock_irq(&sdev->probe_demux_lock);
+	mutex_unlock(&sdev->probe_demux_mutex);
+	return 0;
+}
+
+static void sof_probe_demux_unlink(struct sof_probe_point_ring *pr)
+{
+	list_del(&pr->list);
+	debugfs_remove(pr->dfs);
+
+	WRITE_ONCE(pr->removed, true);
+	wake_up_interruptible(&pr->wait);
+	sof_probe_ring_put(pr);
+}
+
+/*
+ * The compress core has stopped the stream by now. Clearing the pointer
+ * under probe_demux_lock stops the elapsed callback from scheduling more
+ * work, and probe_demux_mutex waits out the debugfs users.
+ */
+void sof_probe_demux_free(struct snd_sof_dev *sdev)
+{
+	struct sof_probe_demux *demux;
+	struct sof_probe_point_ring *pr, *tmp;
+
+	mutex_lock(&sdev->probe_demux_mutex);
+	spin_lock_irq(&sdev->probe_demux_lock);
+	demux = sdev->probe_demux;
+	sdev->probe_demux = NULL;
+	spin_unlock_irq(&sdev->probe_demux_lock);
+	mutex_unlock(&sdev->probe_demux_mutex);
+
+	if (!demux)
+		return;
+
+	cancel_work_sync(&demux->work);
+
+	mutex_lock(&demux->lock);
+	list_for_each_entry_safe(pr, tmp, &demux->points, list)
+		sof_probe_demux_unlink(pr);
+	mutex_unlock(&demux->lock);
+
+	mutex_destroy(&demux->lock);
+	kfree(demux);
+}
+
+/**
+ * sof_probe_demux_add_point - create the capture ring of a probe point
+ * @sdev:	SOF sound device
+ * @buffer_id:	Extraction probe point
+ */
+int sof_probe_demux_add_point(struct snd_sof_dev *sdev, u32 buffer_id)
+{
+	struct sof_probe_demux *demux;
+	struct sof_probe_point_ring *pr;
+	char name[32];
+	u32 size;
+	int ret = 0;
+
+	size = clamp_t(u32, probe_ring_size, PAGE_SIZE, SZ_16M);
+	size = roundup_pow_of_two(size);
+
+	mutex_lock(&sdev->probe_demux_mutex);
+	demux = sdev->probe_demux;
+	if (!demux) {
+		mutex_unlock(&sdev->probe_demux_mutex);
+		return -ENOENT;
+	}
+
+	mutex_lock(&demux->lock);
+
+	if (sof_probe_demux_find(demux, buffer_id))
+		goto exit;
+
+	pr = kzalloc(sizeof(*pr), GFP_KERNEL);
+	if (!pr) {
+		ret = -ENOMEM;
+		goto exit;
+	}
+
+	pr->area = vmalloc_user(PAGE_SIZE + size);
+	if (!pr->area) {
+		kfree(pr);
+		ret = -ENOMEM;
+		goto exit;
+	}
+
+	kref_init(&pr->kref);
+	init_waitqueue_head(&pr->wait);
+	pr->buffer_id = buffer_id;
+	pr->size = size;
+	pr->ctl = pr->area;
+	pr->ring = pr->area + PAGE_SIZE;
+	pr->ctl->size = size;
+	pr->ctl->buffer_id = buffer_id;
+
+	snprintf(name, sizeof(name), "probe_data_%08x", buffer_id);
+	/* readers advance the tail through the writable control page */
+	pr->dfs = debugfs_create_file_unsafe(name, 0600, sdev->debugfs_root,
+					     pr, &sof_probe_ring_fops);
+	list_add_tail(&pr->list, &demux->points);
+
+exit:
+	mutex_unlock(&demux->lock);
+	mutex_unlock(&sdev->probe_demux_mutex);
+	return ret;
+}
+
+void sof_probe_demux_remove_point(struct snd_sof_dev *sdev, u32 buffer_id)
+{
+	struct sof_probe_demux *demux;
+	struct sof_probe_point_ring *pr;
+
+	mutex_lock(&sdev->probe_demux_mutex);
+	demux = sdev->probe_demux;
+	if (!demux)
+		goto out;
+
+	mutex_lock(&demux->lock);
+
+	pr = sof_probe_demux_find(demux, buffer_id);
+	if (pr) {
+		if (demux->cur == pr)
+			demux->cur = NULL;
+		sof_probe_demux_unlink(pr);
+	}
+
+	mutex_unlock(&demux->lock);
+out:
+	mutex_unlock(&sdev->probe_demux_mutex);
+}
+
+/**
+ * sof_probe_demux_info - dump demultiplexer statistics
+ * @sdev:	SOF sound device
+ * @buf:	Destination buffer
+ * @size:	Size of @buf
+ *
+ * Returns the number of bytes written.
+ */
+size_t sof_probe_demux_info(struct snd_sof_dev *sdev, char *buf, size_t size)
+{
+	struct sof_probe_demux *demux;
+	struct sof_probe_point_ring *pr;
+	size_t len = 0;
+
+	mutex_lock(&sdev->probe_demux_mutex);
+	demux = sdev->probe_demux;
+	if (!demux)
+		goto out;
+
+	mutex_lock(&demux->lock);
+
+	len += scnprintf(buf + len, size - len,
+			 "Resyncs: %llu  Overruns: %llu\n",
+			 demux->resyncs, demux->overruns);
+
+	list_for_each_entry(pr, &demux->points, list)
+		len += scnprintf(buf + len, size - len,
+			"Id: %#010x  Packets: %llu  Bytes: %llu  Drops: %llu  Ring: %u\n",
+			pr->buffer_id, pr->ctl->packets, pr->bytes,
+			pr->ctl->drops, pr->size);
+
+	mutex_unlock(&demux->lock);
+out:
+	mutex_unlock(&sdev->probe_demux_mutex);
+	return len;
+}
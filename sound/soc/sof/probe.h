@@ -13,6 +13,8 @@
 
 #include <sound/sof/header.h>
 
+struct snd_compr_stream;
+struct snd_soc_dai;
 struct snd_sof_dev;
 
 #define SOF_PROBE_INVALID_NODE_ID UINT_MAX
@@ -66,6 +68,28 @@ struct sof_ipc_probe_point_remove_params {
 	unsigned int buffer_id[0];
 } __packed;
 
+/*
+ * Layout of debugfs probe_data_<buffer_id>: a control page followed by
+ * a ring of @size bytes. Each packet extracted for the probe point is
+ * stored as a struct sof_probe_ring_record followed by its data, padded
+ * to 8 bytes. Records may wrap around the end of the ring. The reader
+ * consumes records by advancing @tail once it is done with them.
+ */
+struct sof_probe_ring_control {
+	u32 head;		/* bytes produced, free running */
+	u32 tail;		/* bytes consumed, free running */
+	u32 size;		/* ring size, power of two */
+	u32 buffer_id;
+	u64 packets;		/* packets stored */
+	u64 drops;		/* packets lost to a full ring */
+} __packed;
+
+struct sof_probe_ring_record {
+	u64 timestamp;		/* DSP timestamp of the packet */
+	u32 format;		/* encoded sample format */
+	u32 size;		/* data bytes following the record */
+} __packed;
+
 int sof_ipc_probe_init(struct snd_sof_dev *sdev,
 		u32 stream_tag, size_t buffer_size);
 int sof_ipc_probe_deinit(struct snd_sof_dev *sdev);
@@ -82,4 +106,21 @@ int sof_ipc_probe_points_add(struct snd_sof_dev *sdev,
 int sof_ipc_probe_points_remove(struct snd_sof_dev *sdev,
 		unsigned int *buffer_id, size_t num_buffer_id);
 
+int sof_probe_demux_init(struct snd_sof_dev *sdev,
+		struct snd_compr_stream *cstream, struct snd_soc_dai *dai);
+void sof_probe_demux_free(struct snd_sof_dev *sdev);
+int sof_probe_demux_add_point(struct snd_sof_dev *sdev, u32 buffer_id);
+void sof_probe_demux_remove_point(struct snd_sof_dev *sdev, u32 buffer_id);
+size_t sof_probe_demux_info(struct snd_sof_dev *sdev, char *buf, size_t size);
+
+#if IS_ENABLED(CONFIG_SND_SOC_SOF_DEBUG_PROBES)
+void sof_probe_demux_elapsed(struct snd_sof_dev *sdev,
+		struct snd_compr_stream *cstream);
+#else
+static inline void sof_probe_demux_elapsed(struct snd_sof_dev *sdev,
+		struct snd_compr_stream *cstream)
+{
+}
+#endif
+
 #endif
@@ -143,6 +143,7 @@ int snd_sof_bytes_ext_get(struct snd_kcontrol *kcontrol,
  * be freed by snd_soc_unregister_component,
  */
 int snd_sof_load_topology(struct snd_soc_component *scomp, const char *file);
+void snd_sof_init_topology_tokens(void);
 int snd_sof_complete_pipeline(struct device *dev,
 			      struct snd_sof_widget *swidget);
 
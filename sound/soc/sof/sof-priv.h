@@ -83,6 +83,7 @@ struct snd_sof_debugfs_map;
 struct snd_soc_tplg_ops;
 struct snd_soc_component;
 struct snd_sof_pdata;
+struct sof_probe_demux;
 
 /*
  * SOF DSP HW abstraction operations.
@@ -428,6 +429,10 @@ struct snd_sof_dev {
 
 #if IS_ENABLED(CONFIG_SND_SOC_SOF_DEBUG_PROBES)
 	unsigned int extractor_stream_tag;
+	struct sof_probe_demux *probe_demux;
+	/* debugfs users hold the mutex, the elapsed callback the spinlock */
+	struct mutex probe_demux_mutex;
+	spinlock_t probe_demux_lock;
 #endif
 
 	/* DMA for Trace */
@@ -751,146 +751,243 @@ static const struct sof_topology_token led_tokens[] = {
 	 get_token_u32, offsetof(struct snd_sof_led_control, direction), 0},
 };
 
-static void sof_parse_uuid_tokens(struct snd_soc_component *scomp,
-				  void *object,
-				  const struct sof_topology_token *tokens,
-				  int count,
-				  struct snd_soc_tplg_vendor_array *array)
-{
-	struct snd_soc_tplg_vendor_uuid_elem *elem;
-	int i, j;
-
-	/* parse element by element */
-	for (i = 0; i < le32_to_cpu(array->num_elems); i++) {
-		elem = &array->uuid[i];
-
-		/* search for token */
-		for (j = 0; j < count; j++) {
-			/* match token type */
-			if (tokens[j].type != SND_SOC_TPLG_TUPLE_TYPE_UUID)
-				continue;
-
-			/* match token id */
-			if (tokens[j].token != le32_to_cpu(elem->token))
-				continue;
-
-			/* matched - now load token */
-			tokens[j].get_token(elem, object, tokens[j].offset,
-					    tokens[j].size);
+/*
+ * Token lookup.
+ *
+ * Every token table only uses tokens from a single SOF_TKN_* group, so each
+ * table gets a direct-indexed slot map (token - group base -> table entry)
+ * built once at module init. Tables that do not fit a single group fall back
+ * to a linear scan.
+ */
+#define SOF_TKN_GROUP_SIZE	100
+
+enum sof_tokens {
+	SOF_BUFFER_TOKENS,
+	SOF_DAI_TOKENS,
+	SOF_DAI_LINK_TOKENS,
+	SOF_SCHED_TOKENS,
+	SOF_VOLUME_TOKENS,
+	SOF_SRC_TOKENS,
+	SOF_ASRC_TOKENS,
+	SOF_TONE_TOKENS,
+	SOF_PROCESS_TOKENS,
+	SOF_PCM_TOKENS,
+	SOF_STREAM_TOKENS,
+	SOF_COMP_TOKENS,
+	SOF_SSP_TOKENS,
+	SOF_DMIC_TOKENS,
+	SOF_ESAI_TOKENS,
+	SOF_SAI_TOKENS,
+	SOF_DMIC_PDM_TOKENS,
+	SOF_HDA_TOKENS,
+	SOF_LED_TOKENS,
+	SOF_TOKEN_COUNT,
+};
+
+struct sof_token_info {
+	const char *name;
+	const struct sof_topology_token *tokens;
+	int count;
+	bool indexed;
+	u32 base;
+	u8 slot[SOF_TKN_GROUP_SIZE];	/* entry index + 1, 0 if unused */
+};
+
+#define SOF_TOKEN_INFO(_name, _tokens)		\
+	{					\
+		.name = _name,			\
+		.tokens = _tokens,		\
+		.count = ARRAY_SIZE(_tokens),	\
+	}
+
+static struct sof_token_info sof_token_info[SOF_TOKEN_COUNT] __ro_after_init = {
+	[SOF_BUFFER_TOKENS] = SOF_TOKEN_INFO("buffer", buffer_tokens),
+	[SOF_DAI_TOKENS] = SOF_TOKEN_INFO("dai", dai_tokens),
+	[SOF_DAI_LINK_TOKENS] = SOF_TOKEN_INFO("dai link", dai_link_tokens),
+	[SOF_SCHED_TOKENS] = SOF_TOKEN_INFO("sched", sched_tokens),
+	[SOF_VOLUME_TOKENS] = SOF_TOKEN_INFO("volume", volume_tokens),
+	[SOF_SRC_TOKENS] = SOF_TOKEN_INFO("src", src_tokens),
+	[SOF_ASRC_TOKENS] = SOF_TOKEN_INFO("asrc", asrc_tokens),
+	[SOF_TONE_TOKENS] = SOF_TOKEN_INFO("tone", tone_tokens),
+	[SOF_PROCESS_TOKENS] = SOF_TOKEN_INFO("process", process_tokens),
+	[SOF_PCM_TOKENS] = SOF_TOKEN_INFO("pcm", pcm_tokens),
+	[SOF_STREAM_TOKENS] = SOF_TOKEN_INFO("stream", stream_tokens),
+	[SOF_COMP_TOKENS] = SOF_TOKEN_INFO("comp", comp_tokens),
+	[SOF_SSP_TOKENS] = SOF_TOKEN_INFO("ssp", ssp_tokens),
+	[SOF_DMIC_TOKENS] = SOF_TOKEN_INFO("dmic", dmic_tokens),
+	[SOF_ESAI_TOKENS] = SOF_TOKEN_INFO("esai", esai_tokens),
+	[SOF_SAI_TOKENS] = SOF_TOKEN_INFO("sai", sai_tokens),
+	[SOF_DMIC_PDM_TOKENS] = SOF_TOKEN_INFO("dmic pdm", dmic_pdm_tokens),
+	[SOF_HDA_TOKENS] = SOF_TOKEN_INFO("hda", hda_tokens),
+	[SOF_LED_TOKENS] = SOF_TOKEN_INFO("led", led_tokens),
+};
+
+static bool sof_token_info_index(struct sof_token_info *info)
+{
+	u32 slot;
+	int i;
+
+	if (!info->count || info->count >= U8_MAX)
+		return false;
+
+	info->base = rounddown(info->tokens[0].token, SOF_TKN_GROUP_SIZE);
+
+	for (i = 0; i < info->count; i++) {
+		slot = info->tokens[i].token - info->base;
+
+		/* token outside the group or listed twice */
+		if (slot >= SOF_TKN_GROUP_SIZE || info->slot[slot])
+			return false;
+
+		info->slot[slot] = i + 1;
+	}
+
+	return true;
+}
+
+/* build the per table lookup maps, called once at module init */
+void __init snd_sof_init_topology_tokens(void)
+{
+	struct sof_token_info *info;
+	int i;
+
+	for (i = 0; i < SOF_TOKEN_COUNT; i++) {
+		info = &sof_token_info[i];
+
+		info->indexed = sof_token_info_index(info);
+		if (!info->indexed) {
+			memset(info->slot, 0, sizeof(info->slot));
+			if (info->count)
+				pr_debug("sof: %s tokens use linear lookup\n",
+					 info->name);
 		}
 	}
 }
 
-static void sof_parse_string_tokens(struct snd_soc_component *scomp,
-				    void *object,
-				    const struct sof_topology_token *tokens,
-				    int count,
-				    struct snd_soc_tplg_vendor_array *array)
+static const struct sof_topology_token *
+sof_token_find(const struct sof_token_info *info, u32 token)
 {
-	struct snd_soc_tplg_vendor_string_elem *elem;
-	int i, j;
+	u32 slot;
+	int i;
 
-	/* parse element by element */
-	for (i = 0; i < le32_to_cpu(array->num_elems); i++) {
-		elem = &array->string[i];
+	if (info->indexed) {
+		slot = token - info->base;
+		if (slot >= SOF_TKN_GROUP_SIZE || !info->slot[slot])
+			return NULL;
 
-		/* search for token */
-		for (j = 0; j < count; j++) {
-			/* match token type */
-			if (tokens[j].type != SND_SOC_TPLG_TUPLE_TYPE_STRING)
-				continue;
+		return &info->tokens[info->slot[slot] - 1];
+	}
 
-			/* match token id */
-			if (tokens[j].token != le32_to_cpu(elem->token))
-				continue;
+	for (i = 0; i < info->count; i++)
+		if (info->tokens[i].token == token)
+			return &info->tokens[i];
 
-			/* matched - now load token */
-			tokens[j].get_token(elem, object, tokens[j].offset,
-					    tokens[j].size);
-		}
+	return NULL;
+}
+
+static bool sof_token_type_match(u32 token_type, u32 array_type)
+{
+	switch (array_type) {
+	case SND_SOC_TPLG_TUPLE_TYPE_UUID:
+	case SND_SOC_TPLG_TUPLE_TYPE_STRING:
+		return token_type == array_type;
+	default:
+		return token_type == SND_SOC_TPLG_TUPLE_TYPE_WORD ||
+		       token_type == SND_SOC_TPLG_TUPLE_TYPE_SHORT ||
+		       token_type == SND_SOC_TPLG_TUPLE_TYPE_BYTE ||
+		       token_type == SND_SOC_TPLG_TUPLE_TYPE_BOOL;
 	}
 }
 
-static void sof_parse_word_tokens(struct snd_soc_component *scomp,
-				  void *object,
-				  const struct sof_topology_token *tokens,
-				  int count,
-				  struct snd_soc_tplg_vendor_array *array)
+/* determine the extra object offset of a word token */
+static int sof_word_token_offset(struct snd_soc_component *scomp, u32 token,
+				 u32 *offset)
 {
 	struct snd_sof_dev *sdev = snd_soc_component_get_drvdata(scomp);
-	struct snd_soc_tplg_vendor_value_elem *elem;
 	size_t size = sizeof(struct sof_ipc_dai_dmic_pdm_ctrl);
-	int i, j;
-	u32 offset;
 	u32 *index = NULL;
 
-	/* parse element by element */
-	for (i = 0; i < le32_to_cpu(array->num_elems); i++) {
-		elem = &array->value[i];
-
-		/* search for token */
-		for (j = 0; j < count; j++) {
-			/* match token type */
-			if (!(tokens[j].type == SND_SOC_TPLG_TUPLE_TYPE_WORD ||
-			      tokens[j].type == SND_SOC_TPLG_TUPLE_TYPE_SHORT ||
-			      tokens[j].type == SND_SOC_TPLG_TUPLE_TYPE_BYTE ||
-			      tokens[j].type == SND_SOC_TPLG_TUPLE_TYPE_BOOL))
-				continue;
-
-			/* match token id */
-			if (tokens[j].token != le32_to_cpu(elem->token))
-				continue;
-
-			/* pdm config array index */
-			if (sdev->private)
-				index = sdev->private;
-
-			/* matched - determine offset */
-			switch (tokens[j].token) {
-			case SOF_TKN_INTEL_DMIC_PDM_CTRL_ID:
-
-				/* inc number of pdm array index */
-				if (index)
-					(*index)++;
-				/* fallthrough */
-			case SOF_TKN_INTEL_DMIC_PDM_MIC_A_Enable:
-			case SOF_TKN_INTEL_DMIC_PDM_MIC_B_Enable:
-			case SOF_TKN_INTEL_DMIC_PDM_POLARITY_A:
-			case SOF_TKN_INTEL_DMIC_PDM_POLARITY_B:
-			case SOF_TKN_INTEL_DMIC_PDM_CLK_EDGE:
-			case SOF_TKN_INTEL_DMIC_PDM_SKEW:
-
-				/* check if array index is valid */
-				if (!index || *index == 0) {
-					dev_err(scomp->dev,
-						"error: invalid array offset\n");
-					continue;
-				} else {
-					/* offset within the pdm config array */
-					offset = size * (*index - 1);
-				}
-				break;
-			default:
-				offset = 0;
-				break;
-			}
-
-			/* load token */
-			tokens[j].get_token(elem, object,
-					    offset + tokens[j].offset,
-					    tokens[j].size);
+	/* pdm config array index */
+	if (sdev->private)
+		index = sdev->private;
+
+	switch (token) {
+	case SOF_TKN_INTEL_DMIC_PDM_CTRL_ID:
+
+		/* inc number of pdm array index */
+		if (index)
+			(*index)++;
+		/* fallthrough */
+	case SOF_TKN_INTEL_DMIC_PDM_MIC_A_Enable:
+	case SOF_TKN_INTEL_DMIC_PDM_MIC_B_Enable:
+	case SOF_TKN_INTEL_DMIC_PDM_POLARITY_A:
+	case SOF_TKN_INTEL_DMIC_PDM_POLARITY_B:
+	case SOF_TKN_INTEL_DMIC_PDM_CLK_EDGE:
+	case SOF_TKN_INTEL_DMIC_PDM_SKEW:
+
+		/* check if array index is valid */
+		if (!index || *index == 0) {
+			dev_err(scomp->dev, "error: invalid array offset\n");
+			return -EINVAL;
 		}
+
+		/* offset within the pdm config array */
+		*offset = size * (*index - 1);
+		break;
+	default:
+		*offset = 0;
+		break;
 	}
+
+	return 0;
 }
 
-static int sof_parse_tokens(struct snd_soc_component *scomp,
-			    void *object,
-			    const struct sof_topology_token *tokens,
-			    int count,
-			    struct snd_soc_tplg_vendor_array *array,
-			    int priv_size)
+/* one object and the token table used to fill it in */
+struct sof_token_set {
+	enum sof_tokens id;
+	void *object;
+};
+
+static void sof_parse_token_elem(struct snd_soc_component *scomp,
+				 const struct sof_token_set *sets,
+				 int num_sets, u32 array_type, void *elem)
+{
+	const struct sof_topology_token *tkn;
+	u32 token = le32_to_cpu(*(__le32 *)elem);
+	u32 offset;
+	int i;
+
+	for (i = 0; i < num_sets; i++) {
+		tkn = sof_token_find(&sof_token_info[sets[i].id], token);
+		if (!tkn || !sof_token_type_match(tkn->type, array_type))
+			continue;
+
+		offset = 0;
+		if (array_type != SND_SOC_TPLG_TUPLE_TYPE_UUID &&
+		    array_type != SND_SOC_TPLG_TUPLE_TYPE_STRING &&
+		    sof_word_token_offset(scomp, token, &offset) < 0)
+			continue;
+
+		/* matched - now load token */
+		tkn->get_token(elem, sets[i].object, offset + tkn->offset,
+			       tkn->size);
+	}
+}
+
+/*
+ * Parse the vendor arrays of a topology object in a single pass, loading
+ * every tuple into each object of @sets whose token table contains it.
+ */
+static int sof_parse_token_sets(struct snd_soc_component *scomp,
+				const struct sof_token_set *sets,
+				int num_sets,
+				struct snd_soc_tplg_vendor_array *array,
+				int priv_size)
 {
+	u32 type;
+	void *elem;
 	int asize;
+	int i;
 
 	while (priv_size > 0) {
 		asize = le32_to_cpu(array->size);
@@ -910,22 +1007,14 @@ static int sof_parse_tokens(struct snd_soc_component *scomp,
 			return -EINVAL;
 		}
 
-		/* call correct parser depending on type */
-		switch (le32_to_cpu(array->type)) {
+		type = le32_to_cpu(array->type);
+		switch (type) {
 		case SND_SOC_TPLG_TUPLE_TYPE_UUID:
-			sof_parse_uuid_tokens(scomp, object, tokens, count,
-					      array);
-			break;
 		case SND_SOC_TPLG_TUPLE_TYPE_STRING:
-			sof_parse_string_tokens(scomp, object, tokens, count,
-						array);
-			break;
 		case SND_SOC_TPLG_TUPLE_TYPE_BOOL:
 		case SND_SOC_TPLG_TUPLE_TYPE_BYTE:
 		case SND_SOC_TPLG_TUPLE_TYPE_WORD:
 		case SND_SOC_TPLG_TUPLE_TYPE_SHORT:
-			sof_parse_word_tokens(scomp, object, tokens, count,
-					      array);
 			break;
 		default:
 			dev_err(scomp->dev, "error: unknown token type %d\n",
@@ -933,6 +1022,18 @@ static int sof_parse_tokens(struct snd_soc_component *scomp,
 			return -EINVAL;
 		}
 
+		/* parse element by element */
+		for (i = 0; i < le32_to_cpu(array->num_elems); i++) {
+			if (type == SND_SOC_TPLG_TUPLE_TYPE_UUID)
+				elem = &array->uuid[i];
+			else if (type == SND_SOC_TPLG_TUPLE_TYPE_STRING)
+				elem = &array->string[i];
+			else
+				elem = &array->value[i];
+
+			sof_parse_token_elem(scomp, sets, num_sets, type, elem);
+		}
+
 		/* next array */
 		array = (struct snd_soc_tplg_vendor_array *)((u8 *)array
 			+ asize);
@@ -940,6 +1041,36 @@ static int sof_parse_tokens(struct snd_soc_component *scomp,
 	return 0;
 }
 
+static int sof_parse_tokens(struct snd_soc_component *scomp,
+			    void *object,
+			    enum sof_tokens id,
+			    struct snd_soc_tplg_vendor_array *array,
+			    int priv_size)
+{
+	struct sof_token_set set = {
+		.id = id,
+		.object = object,
+	};
+
+	return sof_parse_token_sets(scomp, &set, 1, array, priv_size);
+}
+
+/* parse a component's own tokens and its generic config tokens in one pass */
+static int sof_parse_comp_tokens(struct snd_soc_component *scomp,
+				 void *object, enum sof_tokens id,
+				 struct sof_ipc_comp_config *config,
+				 struct snd_soc_tplg_private *private)
+{
+	struct sof_token_set sets[] = {
+		{ .id = id, .object = object },
+		{ .id = SOF_COMP_TOKENS, .object = config },
+	};
+
+	return sof_parse_token_sets(scomp, sets, ARRAY_SIZE(sets),
+				    private->array,
+				    le32_to_cpu(private->size));
+}
+
 static void sof_dbg_comp_config(struct snd_soc_component *scomp,
 				struct sof_ipc_comp_config *config)
 {
@@ -1016,9 +1147,8 @@ static int sof_control_load_volume(struct snd_soc_component *scomp,
 
 skip:
 	/* set up possible led control from mixer private data */
-	ret = sof_parse_tokens(scomp, &scontrol->led_ctl, led_tokens,
-			       ARRAY_SIZE(led_tokens), mc->priv.array,
-			       le32_to_cpu(mc->priv.size));
+	ret = sof_parse_tokens(scomp, &scontrol->led_ctl, SOF_LED_TOKENS,
+			       mc->priv.array, le32_to_cpu(mc->priv.size));
 	if (ret != 0) {
 		dev_err(scomp->dev, "error: parse led tokens failed %d\n",
 			le32_to_cpu(mc->priv.size));
@@ -1304,24 +1434,14 @@ static int sof_widget_load_dai(struct snd_soc_component *scomp, int index,
 	comp_dai.comp.pipeline_id = index;
 	comp_dai.config.hdr.size = sizeof(comp_dai.config);
 
-	ret = sof_parse_tokens(scomp, &comp_dai, dai_tokens,
-			       ARRAY_SIZE(dai_tokens), private->array,
-			       le32_to_cpu(private->size));
+	ret = sof_parse_comp_tokens(scomp, &comp_dai, SOF_DAI_TOKENS,
+				    &comp_dai.config, private);
 	if (ret != 0) {
 		dev_err(scomp->dev, "error: parse dai tokens failed %d\n",
 			le32_to_cpu(private->size));
 		return ret;
 	}
 
-	ret = sof_parse_tokens(scomp, &comp_dai.config, comp_tokens,
-			       ARRAY_SIZE(comp_tokens), private->array,
-			       le32_to_cpu(private->size));
-	if (ret != 0) {
-		dev_err(scomp->dev, "error: parse dai.cfg tokens failed %d\n",
-			private->size);
-		return ret;
-	}
-
 	dev_dbg(scomp->dev, "dai %s: type %d index %d\n",
 		swidget->widget->name, comp_dai.type, comp_dai.dai_index);
 	sof_dbg_comp_config(scomp, &comp_dai.config);
@@ -1362,9 +1482,8 @@ static int sof_widget_load_buffer(struct snd_soc_component *scomp, int index,
 	buffer->comp.type = SOF_COMP_BUFFER;
 	buffer->comp.pipeline_id = index;
 
-	ret = sof_parse_tokens(scomp, buffer, buffer_tokens,
-			       ARRAY_SIZE(buffer_tokens), private->array,
-			       le32_to_cpu(private->size));
+	ret = sof_parse_tokens(scomp, buffer, SOF_BUFFER_TOKENS,
+			       private->array, le32_to_cpu(private->size));
 	if (ret != 0) {
 		dev_err(scomp->dev, "error: parse buffer tokens failed %d\n",
 			private->size);
@@ -1435,20 +1554,10 @@ static int sof_widget_load_pcm(struct snd_soc_component *scomp, int index,
 	host->direction = dir;
 	host->config.hdr.size = sizeof(host->config);
 
-	ret = sof_parse_tokens(scomp, host, pcm_tokens,
-			       ARRAY_SIZE(pcm_tokens), private->array,
-			       le32_to_cpu(private->size));
+	ret = sof_parse_comp_tokens(scomp, host, SOF_PCM_TOKENS,
+				    &host->config, private);
 	if (ret != 0) {
 		dev_err(scomp->dev, "error: parse host tokens failed %d\n",
-			private->size);
-		goto err;
-	}
-
-	ret = sof_parse_tokens(scomp, &host->config, comp_tokens,
-			       ARRAY_SIZE(comp_tokens), private->array,
-			       le32_to_cpu(private->size));
-	if (ret != 0) {
-		dev_err(scomp->dev, "error: parse host.cfg tokens failed %d\n",
 			le32_to_cpu(private->size));
 		goto err;
 	}
@@ -1551,9 +1660,8 @@ static int sof_widget_load_pipeline(struct snd_soc_component *scomp,
 	dev_dbg(scomp->dev, "tplg: pipeline id %d comp %d scheduling comp id %d\n",
 		pipeline->pipeline_id, pipeline->comp_id, pipeline->sched_id);
 
-	ret = sof_parse_tokens(scomp, pipeline, sched_tokens,
-			       ARRAY_SIZE(sched_tokens), private->array,
-			       le32_to_cpu(private->size));
+	ret = sof_parse_tokens(scomp, pipeline, SOF_SCHED_TOKENS,
+			       private->array, le32_to_cpu(private->size));
 	if (ret != 0) {
 		dev_err(scomp->dev, "error: parse pipeline tokens failed %d\n",
 			private->size);
@@ -1601,9 +1709,8 @@ static int sof_widget_load_mixer(struct snd_soc_component *scomp, int index,
 	mixer->comp.pipeline_id = index;
 	mixer->config.hdr.size = sizeof(mixer->config);
 
-	ret = sof_parse_tokens(scomp, &mixer->config, comp_tokens,
-			       ARRAY_SIZE(comp_tokens), private->array,
-			       le32_to_cpu(private->size));
+	ret = sof_parse_tokens(scomp, &mixer->config, SOF_COMP_TOKENS,
+			       private->array, le32_to_cpu(private->size));
 	if (ret != 0) {
 		dev_err(scomp->dev, "error: parse mixer.cfg tokens failed %d\n",
 			private->size);
@@ -1648,9 +1755,8 @@ static int sof_widget_load_mux(struct snd_soc_component *scomp, int index,
 	mux->comp.pipeline_id = index;
 	mux->config.hdr.size = sizeof(mux->config);
 
-	ret = sof_parse_tokens(scomp, &mux->config, comp_tokens,
-			       ARRAY_SIZE(comp_tokens), private->array,
-			       le32_to_cpu(private->size));
+	ret = sof_parse_tokens(scomp, &mux->config, SOF_COMP_TOKENS,
+			       private->array, le32_to_cpu(private->size));
 	if (ret != 0) {
 		dev_err(scomp->dev, "error: parse mux.cfg tokens failed %d\n",
 			private->size);
@@ -1706,19 +1812,10 @@ static int sof_widget_load_pga(struct snd_soc_component *scomp, int index,
 	volume->comp.pipeline_id = index;
 	volume->config.hdr.size = sizeof(volume->config);
 
-	ret = sof_parse_tokens(scomp, volume, volume_tokens,
-			       ARRAY_SIZE(volume_tokens), private->array,
-			       le32_to_cpu(private->size));
+	ret = sof_parse_comp_tokens(scomp, volume, SOF_VOLUME_TOKENS,
+				    &volume->config, private);
 	if (ret != 0) {
 		dev_err(scomp->dev, "error: parse volume tokens failed %d\n",
-			private->size);
-		goto err;
-	}
-	ret = sof_parse_tokens(scomp, &volume->config, comp_tokens,
-			       ARRAY_SIZE(comp_tokens), private->array,
-			       le32_to_cpu(private->size));
-	if (ret != 0) {
-		dev_err(scomp->dev, "error: parse volume.cfg tokens failed %d\n",
 			le32_to_cpu(private->size));
 		goto err;
 	}
@@ -1774,20 +1871,10 @@ static int sof_widget_load_src(struct snd_soc_component *scomp, int index,
 	src->comp.pipeline_id = index;
 	src->config.hdr.size = sizeof(src->config);
 
-	ret = sof_parse_tokens(scomp, src, src_tokens,
-			       ARRAY_SIZE(src_tokens), private->array,
-			       le32_to_cpu(private->size));
+	ret = sof_parse_comp_tokens(scomp, src, SOF_SRC_TOKENS,
+				    &src->config, private);
 	if (ret != 0) {
 		dev_err(scomp->dev, "error: parse src tokens failed %d\n",
-			private->size);
-		goto err;
-	}
-
-	ret = sof_parse_tokens(scomp, &src->config, comp_tokens,
-			       ARRAY_SIZE(comp_tokens), private->array,
-			       le32_to_cpu(private->size));
-	if (ret != 0) {
-		dev_err(scomp->dev, "error: parse src.cfg tokens failed %d\n",
 			le32_to_cpu(private->size));
 		goto err;
 	}
@@ -1833,20 +1920,10 @@ static int sof_widget_load_asrc(struct snd_soc_component *scomp, int index,
 	asrc->comp.pipeline_id = index;
 	asrc->config.hdr.size = sizeof(asrc->config);
 
-	ret = sof_parse_tokens(scomp, asrc, asrc_tokens,
-			       ARRAY_SIZE(asrc_tokens), private->array,
-			       le32_to_cpu(private->size));
+	ret = sof_parse_comp_tokens(scomp, asrc, SOF_ASRC_TOKENS,
+				    &asrc->config, private);
 	if (ret != 0) {
 		dev_err(scomp->dev, "error: parse asrc tokens failed %d\n",
-			private->size);
-		goto err;
-	}
-
-	ret = sof_parse_tokens(scomp, &asrc->config, comp_tokens,
-			       ARRAY_SIZE(comp_tokens), private->array,
-			       le32_to_cpu(private->size));
-	if (ret != 0) {
-		dev_err(scomp->dev, "error: parse asrc.cfg tokens failed %d\n",
 			le32_to_cpu(private->size));
 		goto err;
 	}
@@ -1894,24 +1971,14 @@ static int sof_widget_load_siggen(struct snd_soc_component *scomp, int index,
 	tone->comp.pipeline_id = index;
 	tone->config.hdr.size = sizeof(tone->config);
 
-	ret = sof_parse_tokens(scomp, tone, tone_tokens,
-			       ARRAY_SIZE(tone_tokens), private->array,
-			       le32_to_cpu(private->size));
+	ret = sof_parse_comp_tokens(scomp, tone, SOF_TONE_TOKENS,
+				    &tone->config, private);
 	if (ret != 0) {
 		dev_err(scomp->dev, "error: parse tone tokens failed %d\n",
 			le32_to_cpu(private->size));
 		goto err;
 	}
 
-	ret = sof_parse_tokens(scomp, &tone->config, comp_tokens,
-			       ARRAY_SIZE(comp_tokens), private->array,
-			       le32_to_cpu(private->size));
-	if (ret != 0) {
-		dev_err(scomp->dev, "error: parse tone.cfg tokens failed %d\n",
-			le32_to_cpu(private->size));
-		goto err;
-	}
-
 	dev_dbg(scomp->dev, "tone %s: frequency %d amplitude %d\n",
 		swidget->widget->name, tone->frequency, tone->amplitude);
 	sof_dbg_comp_config(scomp, &tone->config);
@@ -2063,9 +2130,8 @@ static int sof_process_load(struct snd_soc_component *scomp, int index,
 	process->comp.pipeline_id = index;
 	process->config.hdr.size = sizeof(process->config);
 
-	ret = sof_parse_tokens(scomp, &process->config, comp_tokens,
-			       ARRAY_SIZE(comp_tokens), private->array,
-			       le32_to_cpu(private->size));
+	ret = sof_parse_tokens(scomp, &process->config, SOF_COMP_TOKENS,
+			       private->array, le32_to_cpu(private->size));
 	if (ret != 0) {
 		dev_err(scomp->dev, "error: parse process.cfg tokens failed %d\n",
 			le32_to_cpu(private->size));
@@ -2148,9 +2214,8 @@ static int sof_widget_load_process(struct snd_soc_component *scomp, int index,
 	memset(&config, 0, sizeof(config));
 
 	/* get the process token */
-	ret = sof_parse_tokens(scomp, &config, process_tokens,
-			       ARRAY_SIZE(process_tokens), private->array,
-			       le32_to_cpu(private->size));
+	ret = sof_parse_tokens(scomp, &config, SOF_PROCESS_TOKENS,
+			       private->array, le32_to_cpu(private->size));
 	if (ret != 0) {
 		dev_err(scomp->dev, "error: parse process tokens failed %d\n",
 			le32_to_cpu(private->size));
@@ -2469,9 +2534,8 @@ static int sof_dai_load(struct snd_soc_component *scomp, int index,
 	dai_drv->dobj.private = spcm;
 	list_add(&spcm->list, &sdev->pcm_list);
 
-	ret = sof_parse_tokens(scomp, spcm, stream_tokens,
-			       ARRAY_SIZE(stream_tokens), private->array,
-			       le32_to_cpu(private->size));
+	ret = sof_parse_tokens(scomp, spcm, SOF_STREAM_TOKENS,
+			       private->array, le32_to_cpu(private->size));
 	if (ret) {
 		dev_err(scomp->dev, "error: parse stream tokens failed %d\n",
 			le32_to_cpu(private->size));
@@ -2651,9 +2715,8 @@ static int sof_link_ssp_load(struct snd_soc_component *scomp, int index,
 	memset(&config->ssp, 0, sizeof(struct sof_ipc_dai_ssp_params));
 	config->hdr.size = size;
 
-	ret = sof_parse_tokens(scomp, &config->ssp, ssp_tokens,
-			       ARRAY_SIZE(ssp_tokens), private->array,
-			       le32_to_cpu(private->size));
+	ret = sof_parse_tokens(scomp, &config->ssp, SOF_SSP_TOKENS,
+			       private->array, le32_to_cpu(private->size));
 	if (ret != 0) {
 		dev_err(scomp->dev, "error: parse ssp tokens failed %d\n",
 			le32_to_cpu(private->size));
@@ -2728,9 +2791,8 @@ static int sof_link_sai_load(struct snd_soc_component *scomp, int index,
 	memset(&config->sai, 0, sizeof(struct sof_ipc_dai_sai_params));
 	config->hdr.size = size;
 
-	ret = sof_parse_tokens(scomp, &config->sai, sai_tokens,
-			       ARRAY_SIZE(sai_tokens), private->array,
-			       le32_to_cpu(private->size));
+	ret = sof_parse_tokens(scomp, &config->sai, SOF_SAI_TOKENS,
+			       private->array, le32_to_cpu(private->size));
 	if (ret != 0) {
 		dev_err(scomp->dev, "error: parse sai tokens failed %d\n",
 			le32_to_cpu(private->size));
@@ -2796,9 +2858,8 @@ static int sof_link_esai_load(struct snd_soc_component *scomp, int index,
 	memset(&config->esai, 0, sizeof(struct sof_ipc_dai_esai_params));
 	config->hdr.size = size;
 
-	ret = sof_parse_tokens(scomp, &config->esai, esai_tokens,
-			       ARRAY_SIZE(esai_tokens), private->array,
-			       le32_to_cpu(private->size));
+	ret = sof_parse_tokens(scomp, &config->esai, SOF_ESAI_TOKENS,
+			       private->array, le32_to_cpu(private->size));
 	if (ret != 0) {
 		dev_err(scomp->dev, "error: parse esai tokens failed %d\n",
 			le32_to_cpu(private->size));
@@ -2868,9 +2929,8 @@ static int sof_link_dmic_load(struct snd_soc_component *scomp, int index,
 	memset(&config->dmic, 0, sizeof(struct sof_ipc_dai_dmic_params));
 
 	/* get DMIC tokens */
-	ret = sof_parse_tokens(scomp, &config->dmic, dmic_tokens,
-			       ARRAY_SIZE(dmic_tokens), private->array,
-			       le32_to_cpu(private->size));
+	ret = sof_parse_tokens(scomp, &config->dmic, SOF_DMIC_TOKENS,
+			       private->array, le32_to_cpu(private->size));
 	if (ret != 0) {
 		dev_err(scomp->dev, "error: parse dmic tokens failed %d\n",
 			le32_to_cpu(private->size));
@@ -2903,8 +2963,8 @@ static int sof_link_dmic_load(struct snd_soc_component *scomp, int index,
 	}
 
 	/* get DMIC PDM tokens */
-	ret = sof_parse_tokens(scomp, &ipc_config->dmic.pdm[0], dmic_pdm_tokens,
-			       ARRAY_SIZE(dmic_pdm_tokens), private->array,
+	ret = sof_parse_tokens(scomp, &ipc_config->dmic.pdm[0],
+			       SOF_DMIC_PDM_TOKENS, private->array,
 			       le32_to_cpu(private->size));
 	if (ret != 0) {
 		dev_err(scomp->dev, "error: parse dmic pdm tokens failed %d\n",
@@ -3049,9 +3109,8 @@ static int sof_link_hda_load(struct snd_soc_component *scomp, int index,
 	config->hdr.size = size;
 
 	/* get any bespoke DAI tokens */
-	ret = sof_parse_tokens(scomp, config, hda_tokens,
-			       ARRAY_SIZE(hda_tokens), private->array,
-			       le32_to_cpu(private->size));
+	ret = sof_parse_tokens(scomp, config, SOF_HDA_TOKENS,
+			       private->array, le32_to_cpu(private->size));
 	if (ret != 0) {
 		dev_err(scomp->dev, "error: parse hda tokens failed %d\n",
 			le32_to_cpu(private->size));
@@ -3150,9 +3209,8 @@ static int sof_link_load(struct snd_soc_component *scomp, int index,
 	memset(&config, 0, sizeof(config));
 
 	/* get any common DAI tokens */
-	ret = sof_parse_tokens(scomp, &config, dai_link_tokens,
-			       ARRAY_SIZE(dai_link_tokens), private->array,
-			       le32_to_cpu(private->size));
+	ret = sof_parse_tokens(scomp, &config, SOF_DAI_LINK_TOKENS,
+			       private->array, le32_to_cpu(private->size));
 	if (ret != 0) {
 		dev_err(scomp->dev, "error: parse link tokens failed %d\n",
 			le32_to_cpu(private->size));
@@ -0,0 +1,223 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include "../../kselftest_harness.h"
+
+#ifndef __NR_epoll_ctl_batch
+#define __NR_epoll_ctl_batch 439
+#endif
+
+#define NR_PIPES	256
+#define BENCH_LOOPS	200
+
+struct epoll_ctl_batch_cmd {
+	int32_t op;
+	int32_t fd;
+	uint32_t events;
+	int32_t result;
+	uint64_t data;
+};
+
+static int sys_epoll_ctl_batch(int epfd, unsigned int flags,
+			       unsigned int ncmds,
+			       struct epoll_ctl_batch_cmd *cmds)
+{
+	return syscall(__NR_epoll_ctl_batch, epfd, flags, ncmds, cmds);
+}
+
+static void fill_cmds(struct epoll_ctl_batch_cmd *cmds, int (*fds)[2],
+		      int n, int op, uint32_t events)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		cmds[i].op = op;
+		cmds[i].fd = fds[i][0];
+		cmds[i].events = events;
+		cmds[i].result = 1;
+		cmds[i].data = i;
+	}
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+FIXTURE(batch) {
+	int efd;
+	int fds[NR_PIPES][2];
+	struct epoll_ctl_batch_cmd cmds[NR_PIPES];
+	struct epoll_event events[NR_PIPES];
+	int supported;
+};
+
+FIXTURE_SETUP(batch)
+{
+	int i;
+
+	self->efd = epoll_create1(0);
+	ASSERT_GE(self->efd, 0);
+	for (i = 0; i < NR_PIPES; i++) {
+		ASSERT_EQ(pipe(self->fds[i]), 0);
+		ASSERT_EQ(write(self->fds[i][1], "w", 1), 1);
+	}
+
+	self->supported = !sys_epoll_ctl_batch(self->efd, 0, 0, NULL) ||
+			  errno != ENOSYS;
+}
+
+FIXTURE_TEARDOWN(batch)
+{
+	int i;
+
+	for (i = 0; i < NR_PIPES; i++) {
+		close(self->fds[i][0]);
+		close(self->fds[i][1]);
+	}
+	close(self->efd);
+}
+
+/* Add oneshot fds, collect their events and re-arm them in one call */
+TEST_F(batch, oneshot_rearm)
+{
+	int i, n;
+
+	if (!self->supported)
+		XFAIL(return, "epoll_ctl_batch() not supported");
+
+	fill_cmds(self->cmds, self->fds, NR_PIPES, EPOLL_CTL_ADD,
+		  EPOLLIN | EPOLLONESHOT);
+	ASSERT_EQ(sys_epoll_ctl_batch(self->efd, 0, NR_PIPES, self->cmds),
+		  NR_PIPES);
+	for (i = 0; i < NR_PIPES; i++)
+		ASSERT_EQ(self->cmds[i].result, 0);
+
+	n = epoll_wait(self->efd, self->events, NR_PIPES, 0);
+	ASSERT_EQ(n, NR_PIPES);
+	for (i = 0; i < n; i++)
+		EXPECT_EQ(self->events[i].events, EPOLLIN);
+
+	/* All disarmed now */
+	EXPECT_EQ(epoll_wait(self->efd, self->events, NR_PIPES, 0), 0);
+
+	fill_cmds(self->cmds, self->fds, NR_PIPES, EPOLL_CTL_MOD,
+		  EPOLLIN | EPOLLONESHOT);
+	ASSERT_EQ(sys_epoll_ctl_batch(self->efd, 0, NR_PIPES, self->cmds),
+		  NR_PIPES);
+	EXPECT_EQ(epoll_wait(self->efd, self->events, NR_PIPES, 0), NR_PIPES);
+
+	fill_cmds(self->cmds, self->fds, NR_PIPES, EPOLL_CTL_DEL, 0);
+	ASSERT_EQ(sys_epoll_ctl_batch(self->efd, 0, NR_PIPES, self->cmds),
+		  NR_PIPES);
+	EXPECT_EQ(epoll_wait(self->efd, self->events, NR_PIPES, 0), 0);
+}
+
+/* Processing stops at the first failure, which is reported in ->result */
+TEST_F(batch, partial)
+{
+	if (!self->supported)
+		XFAIL(return, "epoll_ctl_batch() not supported");
+
+	fill_cmds(self->cmds, self->fds, 4, EPOLL_CTL_ADD, EPOLLIN);
+	self->cmds[2].fd = self->fds[0][0];
+
+	EXPECT_EQ(sys_epoll_ctl_batch(self->efd, 0, 4, self->cmds), 2);
+	EXPECT_EQ(self->cmds[0].result, 0);
+	EXPECT_EQ(self->cmds[1].result, 0);
+	EXPECT_EQ(self->cmds[2].result, -EEXIST);
+	EXPECT_EQ(self->cmds[3].result, 1);
+
+	/* Nothing succeeded: the error is returned */
+	EXPECT_EQ(sys_epoll_ctl_batch(self->efd, 0, 1, &self->cmds[2]), -1);
+	EXPECT_EQ(errno, EEXIST);
+
+	self->cmds[0].fd = -1;
+	EXPECT_EQ(sys_epoll_ctl_batch(self->efd, 0, 1, self->cmds), -1);
+	EXPECT_EQ(errno, EBADF);
+
+	EXPECT_EQ(sys_epoll_ctl_batch(self->efd, 1, 1, self->cmds), -1);
+	EXPECT_EQ(errno, EINVAL);
+	EXPECT_EQ(sys_epoll_ctl_batch(self->fds[0][0], 0, 1, self->cmds), -1);
+	EXPECT_EQ(errno, EINVAL);
+}
+
+/* Adding an epoll fd needs the loop checks and takes the slow path */
+TEST_F(batch, nested)
+{
+	int inner;
+
+	if (!self->supported)
+		XFAIL(return, "epoll_ctl_batch() not supported");
+
+	inner = epoll_create1(0);
+	ASSERT_GE(inner, 0);
+
+	fill_cmds(self->cmds, self->fds, 3, EPOLL_CTL_ADD, EPOLLIN);
+	self->cmds[1].fd = inner;
+	ASSERT_EQ(sys_epoll_ctl_batch(self->efd, 0, 3, self->cmds), 3);
+
+	/* And closing a loop is refused */
+	self->cmds[0].op = EPOLL_CTL_ADD;
+	self->cmds[0].fd = self->efd;
+	EXPECT_EQ(sys_epoll_ctl_batch(inner, 0, 1, self->cmds), -1);
+	EXPECT_EQ(errno, ELOOP);
+
+	close(inner);
+}
+
+/* Re-arming oneshot fds: one epoll_ctl() per fd vs one batch */
+TEST_F(batch, bench)
+{
+	uint64_t t, single = 0, batched = 0;
+	struct epoll_event ev;
+	int i, loop;
+
+	if (!self->supported)
+		XFAIL(return, "epoll_ctl_batch() not supported");
+
+	fill_cmds(self->cmds, self->fds, NR_PIPES, EPOLL_CTL_ADD,
+		  EPOLLIN | EPOLLONESHOT);
+	ASSERT_EQ(sys_epoll_ctl_batch(self->efd, 0, NR_PIPES, self->cmds),
+		  NR_PIPES);
+
+	for (loop = 0; loop < BENCH_LOOPS; loop++) {
+		ASSERT_EQ(epoll_wait(self->efd, self->events, NR_PIPES, 0),
+			  NR_PIPES);
+		t = now_ns();
+		for (i = 0; i < NR_PIPES; i++) {
+			ev.events = EPOLLIN | EPOLLONESHOT;
+			ev.data.u64 = i;
+			ASSERT_EQ(epoll_ctl(self->efd, EPOLL_CTL_MOD,
+					    self->fds[i][0], &ev), 0);
+		}
+		single += now_ns() - t;
+
+		ASSERT_EQ(epoll_wait(self->efd, self->events, NR_PIPES, 0),
+			  NR_PIPES);
+		fill_cmds(self->cmds, self->fds, NR_PIPES, EPOLL_CTL_MOD,
+			  EPOLLIN | EPOLLONESHOT);
+		t = now_ns();
+		ASSERT_EQ(sys_epoll_ctl_batch(self->efd, 0, NR_PIPES,
+					      self->cmds), NR_PIPES);
+		batched += now_ns() - t;
+	}
+
+	TH_LOG("re-arming %d fds: epoll_ctl %llu ns/fd, epoll_ctl_batch %llu ns/fd",
+	       NR_PIPES,
+	       (unsigned long long)single / (BENCH_LOOPS * NR_PIPES),
+	       (unsigned long long)batched / (BENCH_LOOPS * NR_PIPES));
+}
+
+TEST_HARNESS_MAIN
@@ -0,0 +1,281 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Pipe throughput for write()/read() and for a vmsplice()/splice()
+ * pipeline, at the default pipe size and at a size set with F_SETPIPE_SZ.
+ * Raise /proc/sys/fs/pipe-max-buf-order to let the large pipes use
+ * higher-order buffers.  Whatever the buffer order, a pipe filled with
+ * vmsplice() must hold as many bytes as F_GETPIPE_SZ reports.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+
+#include "../kselftest.h"
+
+#define TOTAL_BYTES	(1UL << 30)
+#define CHUNK		(256UL << 10)
+#define NR_SIZES	2
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int make_pipe(int fds[2], int size)
+{
+	if (pipe(fds))
+		return -1;
+	if (size && fcntl(fds[1], F_SETPIPE_SZ, size) < 0) {
+		close(fds[0]);
+		close(fds[1]);
+		return -1;
+	}
+	return 0;
+}
+
+/* Drain @fd until EOF, checking the byte count */
+static int consume(int fd, unsigned long expected)
+{
+	unsigned long total = 0;
+	char *buf = malloc(CHUNK);
+	ssize_t n;
+
+	if (!buf)
+		return -1;
+	while ((n = read(fd, buf, CHUNK)) > 0)
+		total += n;
+	free(buf);
+
+	return n < 0 || total != expected ? -1 : 0;
+}
+
+static void produce_write(int fd)
+{
+	char *buf = malloc(CHUNK);
+	unsigned long left = TOTAL_BYTES;
+	ssize_t n;
+
+	if (!buf)
+		_exit(1);
+	memset(buf, 0x5a, CHUNK);
+	while (left) {
+		n = write(fd, buf, left < CHUNK ? left : CHUNK);
+		if (n <= 0)
+			_exit(1);
+		left -= n;
+	}
+	_exit(0);
+}
+
+/* Gift freshly filled pages to the pipe, so nothing has to copy them */
+static void produce_vmsplice(int fd)
+{
+	unsigned long left = TOTAL_BYTES;
+	struct iovec iov;
+	ssize_t n;
+	char *buf;
+
+	while (left) {
+		buf = mmap(NULL, CHUNK, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (buf == MAP_FAILED)
+			_exit(1);
+		memset(buf, 0x5a, CHUNK);
+		iov.iov_base = buf;
+		iov.iov_len = CHUNK;
+		while (iov.iov_len) {
+			n = vmsplice(fd, &iov, 1, SPLICE_F_GIFT);
+			if (n <= 0)
+				_exit(1);
+			iov.iov_base = (char *)iov.iov_base + n;
+			iov.iov_len -= n;
+		}
+		/* The pages belong to the pipe now */
+		munmap(buf, CHUNK);
+		left -= CHUNK;
+	}
+	_exit(0);
+}
+
+/* Move buffers from one pipe to the next without touching the data */
+static void relay_splice(int in, int out)
+{
+	ssize_t n;
+
+	while ((n = splice(in, NULL, out, NULL, CHUNK, SPLICE_F_MOVE)) > 0)
+		;
+	_exit(n < 0);
+}
+
+static int reap(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) != pid)
+		return -1;
+	return WIFEXITED(status) && !WEXITSTATUS(status) ? 0 : -1;
+}
+
+/* Fill a pipe with vmsplice() and count the bytes it takes */
+static int run_fill(int size, long *held, long *capacity)
+{
+	long cap, total = 0;
+	struct iovec iov;
+	int fds[2], ret;
+	ssize_t n;
+	char *buf;
+
+	if (make_pipe(fds, size))
+		return -1;
+
+	ret = -1;
+	cap = fcntl(fds[1], F_GETPIPE_SZ);
+	if (cap <= 0)
+		goto out;
+	buf = mmap(NULL, cap, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buf == MAP_FAILED)
+		goto out;
+	memset(buf, 0x5a, cap);
+
+	while (total < cap) {
+		iov.iov_base = buf + total;
+		iov.iov_len = cap - total;
+		n = vmsplice(fds[1], &iov, 1, SPLICE_F_NONBLOCK);
+		if (n <= 0)
+			break;
+		total += n;
+	}
+	munmap(buf, cap);
+
+	*held = total;
+	*capacity = cap;
+	ret = total == cap ? 0 : -1;
+out:
+	close(fds[0]);
+	close(fds[1]);
+	return ret;
+}
+
+static int run_write_read(int size, double *gbps)
+{
+	int fds[2], ret;
+	double t;
+	pid_t pid;
+
+	if (make_pipe(fds, size))
+		return -1;
+
+	t = now();
+	pid = fork();
+	if (pid < 0)
+		return -1;
+	if (!pid) {
+		close(fds[0]);
+		produce_write(fds[1]);
+	}
+	close(fds[1]);
+	ret = consume(fds[0], TOTAL_BYTES);
+	close(fds[0]);
+	if (reap(pid))
+		ret = -1;
+	*gbps = TOTAL_BYTES / (now() - t) / 1e9;
+
+	return ret;
+}
+
+static int run_splice(int size, double *gbps)
+{
+	int a[2], b[2], ret;
+	pid_t producer, relay;
+	double t;
+
+	if (make_pipe(a, size))
+		return -1;
+	if (make_pipe(b, size))
+		return -1;
+
+	t = now();
+	producer = fork();
+	if (producer < 0)
+		return -1;
+	if (!producer) {
+		close(a[0]);
+		close(b[0]);
+		close(b[1]);
+		produce_vmsplice(a[1]);
+	}
+	relay = fork();
+	if (relay < 0)
+		return -1;
+	if (!relay) {
+		close(a[1]);
+		close(b[0]);
+		relay_splice(a[0], b[1]);
+	}
+	close(a[0]);
+	close(a[1]);
+	close(b[1]);
+	ret = consume(b[0], TOTAL_BYTES);
+	close(b[0]);
+	if (reap(producer) || reap(relay))
+		ret = -1;
+	*gbps = TOTAL_BYTES / (now() - t) / 1e9;
+
+	return ret;
+}
+
+int main(void)
+{
+	static const int sizes[NR_SIZES] = { 0, 1 << 20 };
+	long held = 0, capacity = 0;
+	unsigned int i;
+	double gbps;
+	int fail = 0;
+
+	ksft_print_header();
+	ksft_set_plan(3 * NR_SIZES);
+
+	for (i = 0; i < NR_SIZES; i++) {
+		if (run_fill(sizes[i], &held, &capacity)) {
+			ksft_test_result_fail("vmsplice fill, pipe size %d: %ld of %ld bytes\n",
+					      sizes[i], held, capacity);
+			fail++;
+		} else {
+			ksft_test_result_pass("vmsplice fill, pipe size %d: %ld bytes\n",
+					      sizes[i], held);
+		}
+
+		if (run_write_read(sizes[i], &gbps)) {
+			ksft_test_result_fail("write/read, pipe size %d\n",
+					      sizes[i]);
+			fail++;
+		} else {
+			ksft_test_result_pass("write/read, pipe size %d: %.2f GB/s\n",
+					      sizes[i], gbps);
+		}
+
+		if (run_splice(sizes[i], &gbps)) {
+			ksft_test_result_fail("vmsplice/splice, pipe size %d\n",
+					      sizes[i]);
+			fail++;
+		} else {
+			ksft_test_result_pass("vmsplice/splice, pipe size %d: %.2f GB/s\n",
+					      sizes[i], gbps);
+		}
+	}
+
+	return fail ? ksft_exit_fail() : ksft_exit_pass();
+}